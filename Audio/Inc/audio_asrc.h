@@ -0,0 +1,45 @@
+/**
+ ******************************************************************************
+ * @file    audio_asrc.h
+ * @brief   Block fractional resampler between the receive ring and the I2S buffer.
+ ******************************************************************************
+ */
+
+#ifndef __AUDIO_ASRC_H
+#define __AUDIO_ASRC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Input frames kept from one block to the next for the 4-tap interpolator */
+#define AUDIO_ASRC_HISTORY                            4U
+
+/* Step limits: +-1/2^shift around 1 input frame per output frame */
+#ifndef AUDIO_ASRC_LIMIT_SHIFT
+#define AUDIO_ASRC_LIMIT_SHIFT                        8U
+#endif /* AUDIO_ASRC_LIMIT_SHIFT */
+
+#define AUDIO_ASRC_STEP_UNITY                         (1ULL << 32)
+
+/* Work buffer frames for blocks of n output frames: history plus the most input one block can take */
+#define AUDIO_ASRC_WORK_FRAMES(n)                     (AUDIO_ASRC_HISTORY + (n) + ((n) >> AUDIO_ASRC_LIMIT_SHIFT) + 2U)
+
+typedef struct {
+  int32_t hist[AUDIO_ASRC_HISTORY * 2U]; /* last input frames of the previous block */
+  uint64_t pos;                          /* next output position from the first history frame, Q32 */
+  uint64_t step;                         /* input frames per output frame, Q32 */
+} AUDIO_AsrcTypeDef;
+
+void AUDIO_AsrcReset(AUDIO_AsrcTypeDef *asrc);
+void AUDIO_AsrcSetStep(AUDIO_AsrcTypeDef *asrc, uint64_t step);
+uint32_t AUDIO_AsrcInputFrames(const AUDIO_AsrcTypeDef *asrc, uint32_t frames);
+void AUDIO_AsrcProcess_q31(AUDIO_AsrcTypeDef *asrc, int32_t *work, int32_t *dst, uint32_t frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_ASRC_H */
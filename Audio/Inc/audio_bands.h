@@ -0,0 +1,69 @@
+/**
+ ******************************************************************************
+ * @file    audio_bands.h
+ * @brief   Grouping of the analyzer spectrum into display bands.
+ ******************************************************************************
+ */
+
+#ifndef __AUDIO_BANDS_H
+#define __AUDIO_BANDS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "arm_math.h"
+#include "audio_spectrum.h"
+
+#include <stdint.h>
+
+/* Bands of the widest layout, the linear one */
+#ifndef AUDIO_BANDS_MAX
+#define AUDIO_BANDS_MAX                               240U
+#endif /* AUDIO_BANDS_MAX */
+
+/* Bands of the mel layout */
+#ifndef AUDIO_BANDS_MEL
+#define AUDIO_BANDS_MEL                               96U
+#endif /* AUDIO_BANDS_MEL */
+
+#if AUDIO_BANDS_MEL > AUDIO_BANDS_MAX
+#error "AUDIO_BANDS_MEL must not exceed AUDIO_BANDS_MAX"
+#endif
+
+/* Span of the octave and mel layouts, Hz, cut at Nyquist */
+#define AUDIO_BANDS_FREQ_LOW                          20.0f
+#define AUDIO_BANDS_FREQ_HIGH                         20000.0f
+
+typedef enum {
+  AUDIO_BANDS_LINEAR = 0U,                     /* one bin per band from DC, as many as fit */
+  AUDIO_BANDS_OCTAVE_3,                        /* 1/3 octave */
+  AUDIO_BANDS_OCTAVE_6,                        /* 1/6 octave */
+  AUDIO_BANDS_OCTAVE_12,                       /* 1/12 octave */
+  AUDIO_BANDS_MEL_SCALE,                       /* AUDIO_BANDS_MEL bands even on the mel scale */
+  AUDIO_BANDS_LAYOUTS
+} AUDIO_BandsLayoutTypeDef;
+
+typedef struct {
+  uint16_t bin;                                /* first bin */
+  uint16_t count;                              /* bins */
+  uint16_t weight;                             /* first weight in AUDIO_BandsTypeDef.weight */
+} AUDIO_BandTypeDef;
+
+typedef struct {
+  AUDIO_BandsLayoutTypeDef layout;
+  uint32_t freq;                               /* sampling frequency the index was built for */
+  uint32_t count;                              /* bands of the layout */
+  AUDIO_BandTypeDef band[AUDIO_BANDS_MAX];
+  /* Share of each bin in its band, a bin on a band edge is split in two */
+  float32_t weight[AUDIO_SPECTRUM_BINS + AUDIO_BANDS_MAX];
+} AUDIO_BandsTypeDef;
+
+void AUDIO_BandsConfig(AUDIO_BandsTypeDef *bands, AUDIO_BandsLayoutTypeDef layout, uint32_t freq);
+void AUDIO_BandsProcess(const AUDIO_BandsTypeDef *bands, const float32_t *power, float32_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_BANDS_H */
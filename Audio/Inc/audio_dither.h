@@ -0,0 +1,44 @@
+/**
+ ******************************************************************************
+ * @file    audio_dither.h
+ * @brief   Dithered requantization of the float pipeline to the 16-bit I2S word.
+ ******************************************************************************
+ */
+
+#ifndef __AUDIO_DITHER_H
+#define __AUDIO_DITHER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "arm_math.h"
+
+#include <stdint.h>
+
+typedef enum {
+  AUDIO_DITHER_OFF = 0,                  /* plain rounding */
+  AUDIO_DITHER_TPDF,                     /* +-1 LSB triangular dither, flat noise floor */
+  AUDIO_DITHER_SHAPED,                   /* TPDF dither, error feedback pushes the noise up in frequency */
+} AUDIO_DitherModeTypeDef;
+
+#ifndef AUDIO_DITHER_DEFAULT
+#define AUDIO_DITHER_DEFAULT                          AUDIO_DITHER_TPDF
+#endif /* AUDIO_DITHER_DEFAULT */
+
+typedef struct {
+  uint8_t mode;
+  uint32_t seed;                         /* xorshift32 state, never 0 */
+  float32_t err[2][2];                   /* last two requantization errors per channel, LSB */
+} AUDIO_DitherTypeDef;
+
+void AUDIO_DitherInit(AUDIO_DitherTypeDef *dither, AUDIO_DitherModeTypeDef mode);
+void AUDIO_DitherReset(AUDIO_DitherTypeDef *dither);
+void AUDIO_DitherRound_q15(const float32_t *src, int16_t *dst, uint32_t frames);
+void AUDIO_DitherQuantize_q15(AUDIO_DitherTypeDef *dither, const float32_t *src, int16_t *dst, uint32_t frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_DITHER_H */
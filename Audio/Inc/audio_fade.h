@@ -0,0 +1,33 @@
+/**
+ ******************************************************************************
+ * @file    audio_fade.h
+ * @brief   Short ramps that hide a starved stream: fade to silence and back.
+ ******************************************************************************
+ */
+
+#ifndef __AUDIO_FADE_H
+#define __AUDIO_FADE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Ramp length: 2^shift frames, 16 frames is a third of a millisecond at 48 kHz */
+#ifndef AUDIO_FADE_SHIFT
+#define AUDIO_FADE_SHIFT                              4U
+#endif /* AUDIO_FADE_SHIFT */
+
+#define AUDIO_FADE_FRAMES                             (1UL << AUDIO_FADE_SHIFT)
+
+void AUDIO_FadeIn_q15(int16_t *frames, uint32_t n);
+void AUDIO_FadeIn_q31(int32_t *frames, uint32_t n);
+void AUDIO_FadeHold_q15(const int16_t *last, int16_t *dst, uint32_t n);
+void AUDIO_FadeHold_q31(const int32_t *last, int32_t *dst, uint32_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_FADE_H */
@@ -0,0 +1,61 @@
+/**
+ ******************************************************************************
+ * @file    audio_fifo.h
+ * @brief   Single-producer single-consumer sample FIFO from the I2S path to the analyzer.
+ ******************************************************************************
+ */
+
+#ifndef __AUDIO_FIFO_H
+#define __AUDIO_FIFO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "arm_math.h"
+
+#include <stdint.h>
+
+/* Samples: a 1024 sample frame plus 60 ms of slack for the consumer at 48 kHz */
+#ifndef AUDIO_FIFO_SIZE
+#define AUDIO_FIFO_SIZE                               4096U
+#endif /* AUDIO_FIFO_SIZE */
+
+#if (AUDIO_FIFO_SIZE & (AUDIO_FIFO_SIZE - 1U)) != 0U
+#error "AUDIO_FIFO_SIZE must be a power of two"
+#endif
+
+#define AUDIO_FIFO_MASK                               (AUDIO_FIFO_SIZE - 1U)
+
+typedef struct {
+  int16_t buf[AUDIO_FIFO_SIZE];
+  volatile uint32_t wr;       /* samples written by the producer (free-running) */
+  volatile uint32_t rd;       /* samples released by the consumer (free-running) */
+  uint32_t drops;             /* samples the producer found no room for */
+  volatile uint32_t overruns; /* pushes dropped for want of room (free-running) */
+  volatile uint32_t gap;      /* wr at the last dropped push */
+  uint32_t resynced;          /* overruns the consumer has restarted its frames after */
+} AUDIO_FifoTypeDef;
+
+uint32_t AUDIO_FifoReserve(AUDIO_FifoTypeDef *fifo, uint32_t n);
+void AUDIO_FifoCommit(AUDIO_FifoTypeDef *fifo, uint32_t n);
+void AUDIO_FifoPush_q15(AUDIO_FifoTypeDef *fifo, const int16_t *frames, uint32_t n);
+void AUDIO_FifoPush_q31(AUDIO_FifoTypeDef *fifo, const int32_t *frames, uint32_t n);
+void AUDIO_FifoPush_f32(AUDIO_FifoTypeDef *fifo, const float32_t *frames, uint32_t n);
+uint8_t AUDIO_FifoRead_q15(AUDIO_FifoTypeDef *fifo, int16_t *dst, uint32_t size, uint32_t hop);
+
+/**
+ * @brief  AUDIO_FifoFill
+ *         Number of samples written and not yet released
+ * @param  fifo: FIFO instance
+ * @retval samples
+ */
+static inline uint32_t AUDIO_FifoFill(const AUDIO_FifoTypeDef *fifo) {
+  return fifo->wr - fifo->rd;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_FIFO_H */
@@ -0,0 +1,25 @@
+/**
+ ******************************************************************************
+ * @file    audio_format.h
+ * @brief   PCM sample format conversion kernels.
+ ******************************************************************************
+ */
+
+#ifndef __AUDIO_FORMAT_H
+#define __AUDIO_FORMAT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+void AUDIO_Unpack24_q31(const uint8_t *src, int32_t *dst, uint32_t samples);
+void AUDIO_Pack24_q31(const int32_t *src, uint8_t *dst, uint32_t samples);
+void AUDIO_Pack24_q15(const int16_t *src, uint8_t *dst, uint32_t samples);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_FORMAT_H */
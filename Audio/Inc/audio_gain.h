@@ -0,0 +1,65 @@
+/**
+ ******************************************************************************
+ * @file    audio_gain.h
+ * @brief   Stereo Q15 gain stage driven by the UAC volume control.
+ ******************************************************************************
+ */
+
+#ifndef __AUDIO_GAIN_H
+#define __AUDIO_GAIN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* UAC volume is a signed 8.8 dB value, the table covers 0dB..-96dB */
+#define AUDIO_GAIN_DB_MIN                             ((int16_t)0xA000)
+#define AUDIO_GAIN_DB_MAX                             ((int16_t)0x0000)
+#define AUDIO_GAIN_DB_STEP                            0x0080U    /* 0.5dB */
+
+/* Gain = mant / 32768 / 2^shift, mant is kept in [0.5, 1) for precision */
+typedef struct {
+  int16_t mant;
+  uint8_t shift;
+} AUDIO_GainTypeDef;
+
+#define AUDIO_GAIN_UNITY                              ((AUDIO_GainTypeDef){0x7FFF, 0U})
+#define AUDIO_GAIN_MUTE                               ((AUDIO_GainTypeDef){0x0000, 0U})
+
+AUDIO_GainTypeDef AUDIO_GainFromVolume(int16_t volume);
+void AUDIO_GainApply_q15(const int16_t *src, int16_t *dst, uint32_t frames, AUDIO_GainTypeDef gain);
+void AUDIO_GainApply_q31(const int32_t *src, int32_t *dst, uint32_t samples, AUDIO_GainTypeDef gain);
+void AUDIO_GainRamp_q31(const int32_t *src, int32_t *dst, uint32_t frames, AUDIO_GainTypeDef from,
+                        AUDIO_GainTypeDef to, uint32_t span);
+void AUDIO_GainRamp_q15(const int16_t *src, float *dst, uint32_t frames, AUDIO_GainTypeDef from,
+                        AUDIO_GainTypeDef to, uint32_t span);
+void AUDIO_GainRamp_f32(const float *src, float *dst, uint32_t frames, AUDIO_GainTypeDef from,
+                        AUDIO_GainTypeDef to, uint32_t span);
+
+/**
+ * @brief  AUDIO_GainEqual
+ *         Compare two gains
+ * @param  a, b: gains from AUDIO_GainFromVolume or the constants above
+ * @retval 1 if they scale identically
+ */
+static inline uint8_t AUDIO_GainEqual(AUDIO_GainTypeDef a, AUDIO_GainTypeDef b) {
+  return (uint8_t)(a.mant == b.mant && a.shift == b.shift);
+}
+
+/**
+ * @brief  AUDIO_GainToFloat
+ *         Linear value of a gain, for the float stages
+ * @param  gain: gain from AUDIO_GainFromVolume
+ * @retval gain, 1.0f at 0dB
+ */
+static inline float AUDIO_GainToFloat(AUDIO_GainTypeDef gain) {
+  return (float)gain.mant / 32768.0f / (float)(1UL << gain.shift);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_GAIN_H */
@@ -0,0 +1,67 @@
+/**
+ ******************************************************************************
+ * @file    audio_graph.h
+ * @brief   Static chain of in-place float stages for the playback path.
+ ******************************************************************************
+ */
+
+#ifndef __AUDIO_GRAPH_H
+#define __AUDIO_GRAPH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "arm_math.h"
+
+#include <stdint.h>
+
+#ifndef AUDIO_GRAPH_STAGES_MAX
+#define AUDIO_GRAPH_STAGES_MAX                        8U
+#endif /* AUDIO_GRAPH_STAGES_MAX */
+
+/* Process a block of interleaved stereo frames in place */
+typedef void (*AUDIO_StageProcessTypeDef)(void *ctx, float32_t *frames, uint32_t n);
+
+/* Whether the stage would change the block at all */
+typedef uint8_t (*AUDIO_StageActiveTypeDef)(const void *ctx);
+
+typedef struct {
+  uint8_t id;
+  uint8_t bypass;
+  AUDIO_StageProcessTypeDef process;
+  AUDIO_StageActiveTypeDef active;       /* NULL when always active */
+  uint8_t edge;                          /* runs with the graph, never makes it run */
+  void *ctx;
+  uint32_t cycles;                       /* worst case of one block */
+} AUDIO_StageTypeDef;
+
+typedef struct {
+  AUDIO_StageTypeDef stage[AUDIO_GRAPH_STAGES_MAX];
+  uint8_t count;
+} AUDIO_GraphTypeDef;
+
+void AUDIO_GraphInit(AUDIO_GraphTypeDef *graph);
+AUDIO_StageTypeDef *AUDIO_GraphAdd(AUDIO_GraphTypeDef *graph, uint8_t id, AUDIO_StageProcessTypeDef process,
+                                   AUDIO_StageActiveTypeDef active, void *ctx);
+AUDIO_StageTypeDef *AUDIO_GraphAddEdge(AUDIO_GraphTypeDef *graph, uint8_t id, AUDIO_StageProcessTypeDef process,
+                                       void *ctx);
+AUDIO_StageTypeDef *AUDIO_GraphFind(AUDIO_GraphTypeDef *graph, uint8_t id);
+uint8_t AUDIO_GraphActive(const AUDIO_GraphTypeDef *graph);
+void AUDIO_GraphProcess_f32(AUDIO_GraphTypeDef *graph, float32_t *frames, uint32_t n);
+
+/**
+ * @brief  AUDIO_StageRuns
+ *         Whether a stage takes part in the next block
+ * @param  stage: stage of a graph
+ * @retval 0 when bypassed or inactive
+ */
+static inline uint8_t AUDIO_StageRuns(const AUDIO_StageTypeDef *stage) {
+  return (uint8_t)(stage->bypass == 0U && (stage->active == NULL || stage->active(stage->ctx) != 0U));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_GRAPH_H */
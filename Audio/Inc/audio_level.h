@@ -0,0 +1,62 @@
+/**
+ ******************************************************************************
+ * @file    audio_level.h
+ * @brief   Peak, RMS and clip metering of the playback output.
+ ******************************************************************************
+ */
+
+#ifndef __AUDIO_LEVEL_H
+#define __AUDIO_LEVEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "audio_fifo.h"
+
+#include <stdint.h>
+
+#define AUDIO_LEVEL_CHANNELS                          2U
+
+/* Sliding window of the peak and RMS, in blocks: 128 ms at 48 kHz with 48 frame blocks */
+#ifndef AUDIO_LEVEL_WINDOW
+#define AUDIO_LEVEL_WINDOW                            128U
+#endif /* AUDIO_LEVEL_WINDOW */
+
+#if (AUDIO_LEVEL_WINDOW & (AUDIO_LEVEL_WINDOW - 1U)) != 0U
+#error "AUDIO_LEVEL_WINDOW must be a power of two"
+#endif
+
+#define AUDIO_LEVEL_WINDOW_MASK                       (AUDIO_LEVEL_WINDOW - 1U)
+
+/* Published once per block, read through AUDIO_LevelRead */
+typedef struct {
+  uint16_t peak[AUDIO_LEVEL_CHANNELS];  /* largest magnitude over the window, q15 */
+  uint16_t rms[AUDIO_LEVEL_CHANNELS];   /* over the window, q15 */
+  uint32_t clips[AUDIO_LEVEL_CHANNELS]; /* blocks that reached full scale (free-running) */
+  uint32_t blocks;                      /* blocks metered (free-running) */
+} AUDIO_LevelSnapshotTypeDef;
+
+typedef struct {
+  uint64_t sum[AUDIO_LEVEL_WINDOW][AUDIO_LEVEL_CHANNELS];  /* sum of squares of each block, q30 */
+  uint16_t peak[AUDIO_LEVEL_WINDOW][AUDIO_LEVEL_CHANNELS]; /* peak of each block, q15 */
+  uint16_t frames[AUDIO_LEVEL_WINDOW];                     /* length of each block */
+  uint64_t total[AUDIO_LEVEL_CHANNELS];                    /* sum over the window */
+  uint32_t total_frames;
+  uint16_t max[AUDIO_LEVEL_CHANNELS];                      /* peak over the window */
+  uint32_t pos;                                            /* oldest block, replaced next */
+  volatile uint32_t seq;                                   /* odd while the snapshot is written */
+  AUDIO_LevelSnapshotTypeDef snap;
+} AUDIO_LevelTypeDef;
+
+void AUDIO_LevelInit(AUDIO_LevelTypeDef *level);
+void AUDIO_LevelReset(AUDIO_LevelTypeDef *level);
+void AUDIO_LevelBlock_q15(AUDIO_LevelTypeDef *level, const int16_t *frames, uint32_t n, AUDIO_FifoTypeDef *tap);
+void AUDIO_LevelBlock_q31(AUDIO_LevelTypeDef *level, const int32_t *frames, uint32_t n, AUDIO_FifoTypeDef *tap);
+void AUDIO_LevelRead(const AUDIO_LevelTypeDef *level, AUDIO_LevelSnapshotTypeDef *snap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_LEVEL_H */
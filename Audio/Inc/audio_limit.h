@@ -0,0 +1,86 @@
+/**
+ ******************************************************************************
+ * @file    audio_limit.h
+ * @brief   Lookahead brickwall limiter at the end of the playback DSP stage.
+ ******************************************************************************
+ */
+
+#ifndef __AUDIO_LIMIT_H
+#define __AUDIO_LIMIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "arm_math.h"
+
+#include <stdint.h>
+
+/* Longest lookahead window, frames: 2 ms at 96 kHz plus the current frame */
+#define AUDIO_LIMIT_WINDOW_MAX                        256U
+#define AUDIO_LIMIT_WINDOW_MASK                       (AUDIO_LIMIT_WINDOW_MAX - 1U)
+
+/* Settings limits: ceiling in 8.8 dBFS like the UAC volume, lookahead (attack), release */
+#define AUDIO_LIMIT_CEILING_MIN                       ((int16_t)0xE800)  /* -24dB */
+#define AUDIO_LIMIT_CEILING_MAX                       ((int16_t)0x0000)
+#define AUDIO_LIMIT_ATTACK_US_MAX                     2000U
+#define AUDIO_LIMIT_RELEASE_MS_MIN                    1U
+#define AUDIO_LIMIT_RELEASE_MS_MAX                    1000U
+
+/* Off until the host enables it: at unity volume with no stage boosting
+   it only adds the lookahead delay and a block of float work */
+#ifndef AUDIO_LIMIT_ON_DEFAULT
+#define AUDIO_LIMIT_ON_DEFAULT                        0U
+#endif /* AUDIO_LIMIT_ON_DEFAULT */
+#ifndef AUDIO_LIMIT_CEILING_DEFAULT
+#define AUDIO_LIMIT_CEILING_DEFAULT                   ((int16_t)0xFF00)  /* -1dB */
+#endif /* AUDIO_LIMIT_CEILING_DEFAULT */
+#ifndef AUDIO_LIMIT_ATTACK_US_DEFAULT
+#define AUDIO_LIMIT_ATTACK_US_DEFAULT                 1000U
+#endif /* AUDIO_LIMIT_ATTACK_US_DEFAULT */
+#ifndef AUDIO_LIMIT_RELEASE_MS_DEFAULT
+#define AUDIO_LIMIT_RELEASE_MS_DEFAULT                50U
+#endif /* AUDIO_LIMIT_RELEASE_MS_DEFAULT */
+
+typedef struct {
+  uint8_t on;
+  int16_t ceiling_db;                    /* 8.8 dBFS */
+  uint16_t attack_us;
+  uint16_t release_ms;
+  float32_t ceiling;                     /* linear */
+  float32_t release;                     /* gain recovery per frame, one-pole */
+  float32_t inv_window;
+  uint32_t window;                       /* lookahead + 1, frames */
+  uint32_t pos;                          /* frames processed (free-running) */
+  uint32_t head;                         /* deque cursors (free-running) */
+  uint32_t tail;
+  uint32_t box_idx;                      /* next slot of box and delay, 0..window - 1 */
+  float32_t gain;                        /* window minimum of the required gain, released */
+  float32_t sum;                         /* of box */
+  float32_t dq_peak[AUDIO_LIMIT_WINDOW_MAX]; /* decreasing peaks of the window */
+  uint32_t dq_pos[AUDIO_LIMIT_WINDOW_MAX];
+  float32_t box[AUDIO_LIMIT_WINDOW_MAX]; /* last window released gains, averaged */
+  float32_t delay[AUDIO_LIMIT_WINDOW_MAX * 2U];
+} AUDIO_LimitTypeDef;
+
+void AUDIO_LimitInit(AUDIO_LimitTypeDef *lim, uint32_t freq);
+void AUDIO_LimitReset(AUDIO_LimitTypeDef *lim);
+uint8_t AUDIO_LimitConfig(AUDIO_LimitTypeDef *lim, uint32_t freq, int16_t ceiling_db, uint16_t attack_us,
+                          uint16_t release_ms);
+void AUDIO_LimitProcess_f32(AUDIO_LimitTypeDef *lim, float32_t *frames, uint32_t n);
+
+/**
+ * @brief  AUDIO_LimitLatency
+ *         Delay the lookahead adds to the output
+ * @param  lim: limiter instance
+ * @retval frames
+ */
+static inline uint32_t AUDIO_LimitLatency(const AUDIO_LimitTypeDef *lim) {
+  return lim->window - 1U;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_LIMIT_H */
@@ -0,0 +1,38 @@
+/**
+ ******************************************************************************
+ * @file    audio_mix.h
+ * @brief   Multichannel to stereo downmix matrix over interleaved Q15 frames.
+ ******************************************************************************
+ */
+
+#ifndef __AUDIO_MIX_H
+#define __AUDIO_MIX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Widest input the matrix takes, an even number of channels */
+#define AUDIO_MIX_CHANNELS_MAX                        6U
+
+/* UAC mixer control value for no contribution at all (-inf dB) */
+#define AUDIO_MIX_DB_SILENCE                          ((int16_t)0x8000)
+
+typedef struct {
+  /* Q15 coefficients per output channel, packed by pairs of input channels:
+     the low half weights the even channel, the high half the odd one */
+  uint32_t coef[2][AUDIO_MIX_CHANNELS_MAX / 2U];
+  uint8_t channels; /* input channels, 4 or 6 */
+} AUDIO_MixTypeDef;
+
+void AUDIO_MixInit(AUDIO_MixTypeDef *mix, uint8_t channels);
+void AUDIO_MixSetGain(AUDIO_MixTypeDef *mix, uint32_t in, uint32_t out, int16_t volume);
+void AUDIO_MixDown_q15(const int16_t *src, int16_t *dst, uint32_t frames, const AUDIO_MixTypeDef *mix);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_MIX_H */
@@ -0,0 +1,62 @@
+/**
+ ******************************************************************************
+ * @file    audio_peq.h
+ * @brief   Per-channel parametric EQ with host-uploaded biquad coefficients.
+ ******************************************************************************
+ */
+
+#ifndef __AUDIO_PEQ_H
+#define __AUDIO_PEQ_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "arm_math.h"
+
+#include <stdint.h>
+
+#define AUDIO_PEQ_CHANNELS                            2U
+
+#ifndef AUDIO_PEQ_BANDS_MAX
+#define AUDIO_PEQ_BANDS_MAX                           10U
+#endif /* AUDIO_PEQ_BANDS_MAX */
+
+/* Frames deinterleaved at a time */
+#ifndef AUDIO_PEQ_CHUNK_FRAMES
+#define AUDIO_PEQ_CHUNK_FRAMES                        48U
+#endif /* AUDIO_PEQ_CHUNK_FRAMES */
+
+typedef struct {
+  /* Two banks: the audio path runs one, uploads go to the other */
+  float32_t coef[2][AUDIO_PEQ_CHANNELS][5U * AUDIO_PEQ_BANDS_MAX];
+  uint8_t bands[2][AUDIO_PEQ_CHANNELS];
+  float32_t state[AUDIO_PEQ_CHANNELS][2U * AUDIO_PEQ_BANDS_MAX];
+  arm_biquad_cascade_df2T_instance_f32 eq[AUDIO_PEQ_CHANNELS];
+  float32_t work[AUDIO_PEQ_CHUNK_FRAMES];
+  uint8_t active;                        /* bank the audio path runs */
+  volatile uint8_t pending;              /* the other bank is committed, swap at the next block */
+} AUDIO_PeqTypeDef;
+
+void AUDIO_PeqInit(AUDIO_PeqTypeDef *peq);
+void AUDIO_PeqReset(AUDIO_PeqTypeDef *peq);
+uint8_t AUDIO_PeqSetBand(AUDIO_PeqTypeDef *peq, uint8_t channel, uint8_t band, const float32_t *coef);
+void AUDIO_PeqGetBand(const AUDIO_PeqTypeDef *peq, uint8_t channel, uint8_t band, float32_t *coef);
+uint8_t AUDIO_PeqCommit(AUDIO_PeqTypeDef *peq, uint8_t left, uint8_t right);
+void AUDIO_PeqProcess_f32(AUDIO_PeqTypeDef *peq, float32_t *frames, uint32_t n);
+
+/**
+ * @brief  AUDIO_PeqActive
+ *         Whether the block needs to go through AUDIO_PeqProcess_f32 at all
+ * @param  peq: EQ instance
+ * @retval 0 when bypassed
+ */
+static inline uint8_t AUDIO_PeqActive(const AUDIO_PeqTypeDef *peq) {
+  return (uint8_t)(peq->pending != 0U || peq->bands[peq->active][0] != 0U || peq->bands[peq->active][1] != 0U);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_PEQ_H */
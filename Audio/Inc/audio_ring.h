@@ -0,0 +1,83 @@
+/**
+ ******************************************************************************
+ * @file    audio_ring.h
+ * @brief   Packet slot ring shared by the USB OUT endpoint and the I2S path.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  Every isochronous OUT packet is received straight into its own slot, so a
+ *  packet never straddles the end of the buffer and the USB ISR never copies.
+ *  The consumer walks the slots in order through AUDIO_RingPeek/Consume and
+ *  may stop anywhere inside a slot, which makes 47/48/49 frame packets and a
+ *  fixed-size I2S block line up without any realignment.
+ *
+ *  Both cursors are free-running byte counters, so the fill level is simply
+ *  wr_count - rd_count and never ambiguous between empty and full.
+ *
+ *  The producer (USB) and the consumer (I2S DMA callbacks) run at the same
+ *  NVIC priority, the barriers only matter for readers in thread mode.
+ *  They go through AUDIO_RING_BARRIER, __DMB on target; a host build can
+ *  define its own before compiling audio_ring.c.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#ifndef __AUDIO_RING_H
+#define __AUDIO_RING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* One packet per millisecond: room for the longest playback latency target plus margin */
+#ifndef AUDIO_RING_SLOT_NUM
+#define AUDIO_RING_SLOT_NUM                           32U
+#endif /* AUDIO_RING_SLOT_NUM */
+
+/* Room for the largest packet: 97 frames (96 kHz) of 2 x 32-bit samples */
+#ifndef AUDIO_RING_SLOT_SIZE
+#define AUDIO_RING_SLOT_SIZE                          776U
+#endif /* AUDIO_RING_SLOT_SIZE */
+
+#if (AUDIO_RING_SLOT_NUM & (AUDIO_RING_SLOT_NUM - 1U)) != 0U
+#error "AUDIO_RING_SLOT_NUM must be a power of two"
+#endif
+
+#define AUDIO_RING_SLOT_MASK                          (AUDIO_RING_SLOT_NUM - 1U)
+
+typedef struct {
+  uint8_t slot[AUDIO_RING_SLOT_NUM][AUDIO_RING_SLOT_SIZE] __attribute__((aligned(4)));
+  uint16_t slot_len[AUDIO_RING_SLOT_NUM];
+  volatile uint32_t wr_slot;  /* slots committed by the producer (free-running) */
+  volatile uint32_t rd_slot;  /* slot being read by the consumer (free-running) */
+  uint16_t rd_off;            /* read offset inside the current slot */
+  volatile uint32_t wr_count; /* bytes committed (free-running) */
+  volatile uint32_t rd_count; /* bytes consumed (free-running) */
+  uint32_t overruns;          /* packets dropped because the ring was full */
+} AUDIO_RingTypeDef;
+
+void AUDIO_RingReset(AUDIO_RingTypeDef *ring);
+uint8_t *AUDIO_RingWriteSlot(AUDIO_RingTypeDef *ring);
+uint8_t AUDIO_RingCommit(AUDIO_RingTypeDef *ring, uint16_t len);
+uint16_t AUDIO_RingPeek(AUDIO_RingTypeDef *ring, uint8_t **data);
+void AUDIO_RingConsume(AUDIO_RingTypeDef *ring, uint16_t len);
+uint32_t AUDIO_RingRead(AUDIO_RingTypeDef *ring, uint8_t *dst, uint32_t len);
+
+/**
+ * @brief  AUDIO_RingFill
+ *         Number of committed bytes not yet consumed
+ * @param  ring: ring instance
+ * @retval bytes
+ */
+static inline uint32_t AUDIO_RingFill(const AUDIO_RingTypeDef *ring) {
+  return ring->wr_count - ring->rd_count;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_RING_H */
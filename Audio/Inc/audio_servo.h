@@ -0,0 +1,53 @@
+/**
+ ******************************************************************************
+ * @file    audio_servo.h
+ * @brief   PI rate servo behind the asynchronous feedback endpoint.
+ ******************************************************************************
+ */
+
+#ifndef __AUDIO_SERVO_H
+#define __AUDIO_SERVO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Loop natural frequency, in mHz */
+#ifndef AUDIO_SERVO_BW_MHZ
+#define AUDIO_SERVO_BW_MHZ                            100U
+#endif /* AUDIO_SERVO_BW_MHZ */
+
+/* Loop damping ratio, in percent */
+#ifndef AUDIO_SERVO_DAMPING_PCT
+#define AUDIO_SERVO_DAMPING_PCT                       100U
+#endif /* AUDIO_SERVO_DAMPING_PCT */
+
+/* Largest rate correction the servo may ask for, in ppm of the nominal rate */
+#ifndef AUDIO_SERVO_LIMIT_PPM
+#define AUDIO_SERVO_LIMIT_PPM                         2000U
+#endif /* AUDIO_SERVO_LIMIT_PPM */
+
+/* Fill measurement low-pass, time constant of 2^shift updates */
+#ifndef AUDIO_SERVO_FILTER_SHIFT
+#define AUDIO_SERVO_FILTER_SHIFT                      2U
+#endif /* AUDIO_SERVO_FILTER_SHIFT */
+
+typedef struct {
+  int64_t nominal; /* samples per frame, Q32 */
+  int64_t limit;   /* correction limit, Q32 */
+  int64_t integ;   /* integral term, Q32: the clock drift estimate */
+  int32_t error;   /* filtered fill error, frames Q16 */
+} AUDIO_ServoTypeDef;
+
+void AUDIO_ServoInit(AUDIO_ServoTypeDef *servo, uint32_t freq);
+void AUDIO_ServoReset(AUDIO_ServoTypeDef *servo);
+void AUDIO_ServoSetNominal(AUDIO_ServoTypeDef *servo, int64_t nominal);
+uint32_t AUDIO_ServoUpdate(AUDIO_ServoTypeDef *servo, int32_t error, uint32_t frames, uint32_t frac_bits);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_SERVO_H */
@@ -0,0 +1,52 @@
+/**
+ ******************************************************************************
+ * @file    audio_sofmeter.h
+ * @brief   USB frame period measurement against the I2S sample clock.
+ ******************************************************************************
+ */
+
+#ifndef __AUDIO_SOFMETER_H
+#define __AUDIO_SOFMETER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Frames accumulated per measurement, as a power of two */
+#ifndef AUDIO_SOFMETER_WINDOW_SHIFT
+#define AUDIO_SOFMETER_WINDOW_SHIFT                   6U
+#endif /* AUDIO_SOFMETER_WINDOW_SHIFT */
+
+/* Rate low-pass, time constant of 2^shift measurements */
+#ifndef AUDIO_SOFMETER_FILTER_SHIFT
+#define AUDIO_SOFMETER_FILTER_SHIFT                   3U
+#endif /* AUDIO_SOFMETER_FILTER_SHIFT */
+
+/* Captures further than this from the expected frame period are dropped, in ppm */
+#ifndef AUDIO_SOFMETER_TOLERANCE_PPM
+#define AUDIO_SOFMETER_TOLERANCE_PPM                  1000U
+#endif /* AUDIO_SOFMETER_TOLERANCE_PPM */
+
+typedef struct {
+  uint64_t scale;        /* samples per timer tick, Q48 */
+  uint32_t frame_ticks;  /* expected timer ticks per USB frame */
+  uint32_t capture;      /* previous SOF timestamp */
+  uint16_t fnsof;        /* previous SOF frame number */
+  uint8_t primed;        /* capture/fnsof hold a reference */
+  uint32_t ticks;        /* ticks accumulated in the current window */
+  uint32_t frames;       /* frames accumulated in the current window */
+  int64_t rate;          /* filtered samples per frame, Q32 */
+  uint32_t windows;      /* measurements folded into rate, 0 while rate is unknown */
+  uint32_t rejects;      /* captures dropped as implausible */
+} AUDIO_SofMeterTypeDef;
+
+void AUDIO_SofMeterInit(AUDIO_SofMeterTypeDef *meter, uint32_t i2s_clk, uint32_t i2s_div, uint32_t tim_clk);
+uint8_t AUDIO_SofMeterUpdate(AUDIO_SofMeterTypeDef *meter, uint32_t capture, uint16_t fnsof);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_SOFMETER_H */
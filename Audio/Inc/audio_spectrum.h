@@ -0,0 +1,132 @@
+/**
+ ******************************************************************************
+ * @file    audio_spectrum.h
+ * @brief   Power spectrum of the analyzer frames, float or fixed-point FFT.
+ ******************************************************************************
+ */
+
+#ifndef __AUDIO_SPECTRUM_H
+#define __AUDIO_SPECTRUM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "arm_math.h"
+
+#include <stdint.h>
+
+/* Real samples per frame, a power of two the three CMSIS real FFTs support */
+#ifndef AUDIO_SPECTRUM_SIZE
+#define AUDIO_SPECTRUM_SIZE                           1024U
+#endif /* AUDIO_SPECTRUM_SIZE */
+
+#if (AUDIO_SPECTRUM_SIZE & (AUDIO_SPECTRUM_SIZE - 1U)) != 0U || AUDIO_SPECTRUM_SIZE < 32U || \
+    AUDIO_SPECTRUM_SIZE > 4096U
+#error "AUDIO_SPECTRUM_SIZE must be a power of two in 32..4096"
+#endif
+
+#define AUDIO_SPECTRUM_BINS                           (AUDIO_SPECTRUM_SIZE / 2U)
+
+/* AUDIO_SpectrumDb of an empty bin, below the floor of a 16-bit frame */
+#define AUDIO_SPECTRUM_DB_FLOOR                       (-160.0f)
+
+/* Engines built in, leaving one out drops its instance, buffers and tables.
+   Only the float engine by default: the twiddle tables the fixed-point
+   FFTs link in would not fit the 128 KB of flash next to it. An
+   ANALYZER_BENCH build, which compares the engines, builds all three */
+#ifndef AUDIO_SPECTRUM_USE_F32
+#define AUDIO_SPECTRUM_USE_F32                        1U
+#endif /* AUDIO_SPECTRUM_USE_F32 */
+#ifndef AUDIO_SPECTRUM_USE_Q31
+#ifdef ANALYZER_BENCH
+#define AUDIO_SPECTRUM_USE_Q31                        1U
+#else
+#define AUDIO_SPECTRUM_USE_Q31                        0U
+#endif /* ANALYZER_BENCH */
+#endif /* AUDIO_SPECTRUM_USE_Q31 */
+#ifndef AUDIO_SPECTRUM_USE_Q15
+#ifdef ANALYZER_BENCH
+#define AUDIO_SPECTRUM_USE_Q15                        1U
+#else
+#define AUDIO_SPECTRUM_USE_Q15                        0U
+#endif /* ANALYZER_BENCH */
+#endif /* AUDIO_SPECTRUM_USE_Q15 */
+
+#if (AUDIO_SPECTRUM_USE_F32 == 0U) && (AUDIO_SPECTRUM_USE_Q31 == 0U) && (AUDIO_SPECTRUM_USE_Q15 == 0U)
+#error "At least one AUDIO_SPECTRUM_USE_ engine is needed"
+#endif
+
+typedef enum {
+  AUDIO_SPECTRUM_ENGINE_F32 = 0U,  /* arm_rfft_fast_f32 */
+  AUDIO_SPECTRUM_ENGINE_Q31,       /* arm_rfft_q31 on a block-scaled frame */
+  AUDIO_SPECTRUM_ENGINE_Q15,       /* arm_rfft_q15 on a block-scaled frame */
+  AUDIO_SPECTRUM_ENGINES
+} AUDIO_SpectrumEngineTypeDef;
+
+typedef enum {
+  AUDIO_SPECTRUM_WINDOW_NONE = 0U,  /* rectangular */
+  AUDIO_SPECTRUM_WINDOW_HANN,       /* -31 dB sidelobes, 4 bin main lobe */
+  AUDIO_SPECTRUM_WINDOW_BLACKMAN,   /* 4-term Blackman-Harris, -92 dB sidelobes, 8 bins */
+  AUDIO_SPECTRUM_WINDOW_FLAT_TOP,   /* 5-term flat-top, 0.01 dB amplitude error between bins */
+  AUDIO_SPECTRUM_WINDOWS
+} AUDIO_SpectrumWindowTypeDef;
+
+typedef struct {
+  AUDIO_SpectrumEngineTypeDef engine;
+  AUDIO_SpectrumWindowTypeDef window;
+  float32_t gain;                              /* power correction of the window coherent gain */
+#if (AUDIO_SPECTRUM_USE_F32 == 1U)
+  float32_t window_f32[AUDIO_SPECTRUM_SIZE];
+#endif /* AUDIO_SPECTRUM_USE_F32 */
+#if (AUDIO_SPECTRUM_USE_Q31 == 1U)
+  q31_t window_q31[AUDIO_SPECTRUM_SIZE];
+#endif /* AUDIO_SPECTRUM_USE_Q31 */
+#if (AUDIO_SPECTRUM_USE_Q15 == 1U)
+  q15_t window_q15[AUDIO_SPECTRUM_SIZE];
+#endif /* AUDIO_SPECTRUM_USE_Q15 */
+#if (AUDIO_SPECTRUM_USE_F32 == 1U)
+  arm_rfft_fast_instance_f32 rfft_f32;
+#endif /* AUDIO_SPECTRUM_USE_F32 */
+#if (AUDIO_SPECTRUM_USE_Q31 == 1U)
+  arm_rfft_instance_q31 rfft_q31;
+#endif /* AUDIO_SPECTRUM_USE_Q31 */
+#if (AUDIO_SPECTRUM_USE_Q15 == 1U)
+  arm_rfft_instance_q15 rfft_q15;
+#endif /* AUDIO_SPECTRUM_USE_Q15 */
+  union {
+    float32_t f32[AUDIO_SPECTRUM_SIZE];
+    q31_t q31[AUDIO_SPECTRUM_SIZE];
+    q15_t q15[AUDIO_SPECTRUM_SIZE];
+  } in;                                        /* FFT input, then the spectrum as float */
+  union {
+    float32_t f32[AUDIO_SPECTRUM_SIZE];
+    q31_t q31[2U * AUDIO_SPECTRUM_SIZE];
+    q15_t q15[2U * AUDIO_SPECTRUM_SIZE];
+  } out;                                       /* FFT output, the fixed-point ones are two-sided */
+  float32_t power[AUDIO_SPECTRUM_BINS];        /* per bin, 1.0 for a full-scale sine on the bin */
+  uint8_t shift;                               /* block exponent of the last fixed-point frame */
+  uint32_t cycles;                             /* last AUDIO_SpectrumProcess */
+} AUDIO_SpectrumTypeDef;
+
+/* AUDIO_SpectrumBench result for the selected engine */
+typedef struct {
+  uint32_t cycles;                             /* one frame, frame copy to power spectrum */
+  uint32_t ram;                                /* bytes of instance, window and buffers the engine works in */
+  float32_t range_db;                          /* -1 dBFS tone on a bin over the mean of the bins off its main lobe,
+                                                  0 without noise */
+} AUDIO_SpectrumBenchTypeDef;
+
+void AUDIO_SpectrumInit(AUDIO_SpectrumTypeDef *spec, AUDIO_SpectrumEngineTypeDef engine,
+                        AUDIO_SpectrumWindowTypeDef window);
+uint8_t AUDIO_SpectrumSetEngine(AUDIO_SpectrumTypeDef *spec, AUDIO_SpectrumEngineTypeDef engine);
+void AUDIO_SpectrumSetWindow(AUDIO_SpectrumTypeDef *spec, AUDIO_SpectrumWindowTypeDef window);
+void AUDIO_SpectrumProcess(AUDIO_SpectrumTypeDef *spec, const q15_t *frame);
+void AUDIO_SpectrumDb(const float32_t *power, float32_t *db, uint32_t n, float32_t *min, float32_t *max);
+void AUDIO_SpectrumBench(AUDIO_SpectrumTypeDef *spec, q15_t *frame, AUDIO_SpectrumBenchTypeDef *bench);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_SPECTRUM_H */
@@ -0,0 +1,85 @@
+/**
+ ******************************************************************************
+ * @file    audio_tone.h
+ * @brief   Bass/mid/treble filter bank and AGC behind the Feature Unit controls.
+ ******************************************************************************
+ */
+
+#ifndef __AUDIO_TONE_H
+#define __AUDIO_TONE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "arm_math.h"
+
+#include <stdint.h>
+
+/* One biquad per band: low shelf, peaking, high shelf */
+#define AUDIO_TONE_STAGES                             3U
+
+/* Band centers, Hz, and the peaking filter quality */
+#ifndef AUDIO_TONE_BASS_HZ
+#define AUDIO_TONE_BASS_HZ                            120.0f
+#endif /* AUDIO_TONE_BASS_HZ */
+#ifndef AUDIO_TONE_MID_HZ
+#define AUDIO_TONE_MID_HZ                             1000.0f
+#endif /* AUDIO_TONE_MID_HZ */
+#ifndef AUDIO_TONE_MID_Q
+#define AUDIO_TONE_MID_Q                              0.7f
+#endif /* AUDIO_TONE_MID_Q */
+#ifndef AUDIO_TONE_TREBLE_HZ
+#define AUDIO_TONE_TREBLE_HZ                          8000.0f
+#endif /* AUDIO_TONE_TREBLE_HZ */
+
+/* Band gain as in the UAC tone controls: 0.25 dB steps, limited to +-12 dB */
+#define AUDIO_TONE_DB_MIN                             (-48)
+#define AUDIO_TONE_DB_MAX                             48
+#define AUDIO_TONE_DB_RES                             1
+
+/* AGC: level it steers to, most it boosts, below which it stops boosting */
+#define AUDIO_TONE_AGC_TARGET                         0.25f   /* -12 dBFS */
+#define AUDIO_TONE_AGC_GAIN_MAX                       4.0f    /* +12 dB */
+#define AUDIO_TONE_AGC_FLOOR                          0.001f  /* -60 dBFS */
+
+typedef enum {
+  AUDIO_TONE_BASS = 0,
+  AUDIO_TONE_MID,
+  AUDIO_TONE_TREBLE,
+} AUDIO_ToneBandTypeDef;
+
+typedef struct {
+  arm_biquad_cascade_stereo_df2T_instance_f32 eq;
+  float32_t coef[5U * AUDIO_TONE_STAGES];
+  float32_t state[4U * AUDIO_TONE_STAGES];
+  float32_t fs;                          /* sampling frequency the coefficients are designed for */
+  int8_t level[AUDIO_TONE_STAGES];       /* band gain, 0.25 dB */
+  uint8_t flat;                          /* every band at 0 dB: the filter bank is skipped */
+  uint8_t agc;
+  float32_t agc_env;                     /* peak follower */
+  float32_t agc_gain;
+} AUDIO_ToneTypeDef;
+
+void AUDIO_ToneInit(AUDIO_ToneTypeDef *tone, uint32_t freq);
+void AUDIO_ToneReset(AUDIO_ToneTypeDef *tone);
+void AUDIO_ToneSetFreq(AUDIO_ToneTypeDef *tone, uint32_t freq);
+void AUDIO_ToneSetLevel(AUDIO_ToneTypeDef *tone, AUDIO_ToneBandTypeDef band, int8_t level);
+void AUDIO_ToneSetAgc(AUDIO_ToneTypeDef *tone, uint8_t on);
+void AUDIO_ToneProcess_f32(AUDIO_ToneTypeDef *tone, float32_t *frames, uint32_t n);
+
+/**
+ * @brief  AUDIO_ToneActive
+ *         Whether the block needs to go through AUDIO_ToneProcess_f32 at all
+ * @param  tone: tone instance
+ * @retval 0 when bypassed
+ */
+static inline uint8_t AUDIO_ToneActive(const AUDIO_ToneTypeDef *tone) {
+  return (uint8_t)(tone->flat == 0U || tone->agc != 0U);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_TONE_H */
@@ -0,0 +1,153 @@
+/**
+ ******************************************************************************
+ * @file    audio_asrc.c
+ * @brief   Block fractional resampler between the receive ring and the I2S buffer.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  Hosts that ignore the feedback endpoint keep sending the nominal rate,
+ *  so the fill drifts by the crystal offset until the ring under or
+ *  overruns. The resampler consumes input at step input frames per
+ *  output frame instead of exactly one, which closes the loop on the
+ *  device side without dropping or repeating samples.
+ *
+ *  Each output frame is a cubic Hermite (Catmull-Rom) interpolation of
+ *  the four input frames around its position, evaluated in Farrow form:
+ *  the polynomial coefficients depend on the input only, the fractional
+ *  position enters through three multiplies in Horner order, a handful of
+ *  cycles per sample.
+ *
+ *  A block is produced in two steps so the caller can unpack straight
+ *  from the ring: AUDIO_AsrcInputFrames tells how many new frames the
+ *  next block needs, the caller writes them after the history slot of
+ *  the work buffer, and AUDIO_AsrcProcess_q31 runs the interpolator and
+ *  keeps the last AUDIO_ASRC_HISTORY frames for the next block.
+ *
+ *  Samples are halved on the way in and the position is taken in Q28, so
+ *  the coefficients and their products fit 64 bits even for full-scale
+ *  input. The result is saturated on the way out. At a step of exactly
+ *  one every position is whole and the input comes out bit-exact, two
+ *  frames late.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_asrc.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/* The first output frame sits on the third history frame */
+#define AUDIO_ASRC_POS_START                          (2ULL << 32)
+
+/**
+ * @brief  AUDIO_AsrcInterp
+ *         Catmull-Rom interpolation between x1 and x2
+ * @param  x0, x1, x2, x3: consecutive input samples, q31
+ * @param  mu: position between x1 and x2, Q28
+ * @retval interpolated sample, q31
+ */
+static inline int32_t AUDIO_AsrcInterp(int32_t x0, int32_t x1, int32_t x2, int32_t x3, int64_t mu) {
+  int64_t h0 = x0 >> 1;
+  int64_t h1 = x1 >> 1;
+  int64_t h2 = x2 >> 1;
+  int64_t h3 = x3 >> 1;
+  int64_t c1 = (h2 - h0) >> 1;
+  int64_t c2 = h0 - 2 * h1 - (h1 >> 1) + 2 * h2 - (h3 >> 1);
+  int64_t c3 = ((h3 - h0) >> 1) + h1 + (h1 >> 1) - h2 - (h2 >> 1);
+  int64_t y;
+
+  y = ((c3 * mu) >> 28) + c2;
+  y = ((y * mu) >> 28) + c1;
+  /* The bit halving dropped comes back, so that mu = 0 returns x1 exactly */
+  y = (((y * mu) >> 28) + h1) * 2 + (x1 & 1);
+
+  /* Cubic interpolation overshoots by up to a quarter of full scale */
+  if (y > INT32_MAX) {
+    return INT32_MAX;
+  }
+  if (y < INT32_MIN) {
+    return INT32_MIN;
+  }
+  return (int32_t)y;
+}
+
+/**
+ * @brief  AUDIO_AsrcReset
+ *         Clear the history and restart at a step of exactly one
+ * @param  asrc: resampler instance
+ * @retval None
+ */
+void AUDIO_AsrcReset(AUDIO_AsrcTypeDef *asrc) {
+  (void)memset(asrc->hist, 0, sizeof(asrc->hist));
+  asrc->pos = AUDIO_ASRC_POS_START;
+  asrc->step = AUDIO_ASRC_STEP_UNITY;
+}
+
+/**
+ * @brief  AUDIO_AsrcSetStep
+ *         Set the conversion ratio for the following blocks
+ * @param  asrc: resampler instance
+ * @param  step: input frames per output frame, Q32, clamped to
+ *         1 +- 1/2^AUDIO_ASRC_LIMIT_SHIFT
+ * @retval None
+ */
+void AUDIO_AsrcSetStep(AUDIO_AsrcTypeDef *asrc, uint64_t step) {
+  const uint64_t limit = AUDIO_ASRC_STEP_UNITY >> AUDIO_ASRC_LIMIT_SHIFT;
+
+  if (step > AUDIO_ASRC_STEP_UNITY + limit) {
+    step = AUDIO_ASRC_STEP_UNITY + limit;
+  } else if (step < AUDIO_ASRC_STEP_UNITY - limit) {
+    step = AUDIO_ASRC_STEP_UNITY - limit;
+  }
+  asrc->step = step;
+}
+
+/**
+ * @brief  AUDIO_AsrcInputFrames
+ *         New input frames the next block needs
+ * @param  asrc: resampler instance
+ * @param  frames: output frames of the block
+ * @retval input frames, at most AUDIO_ASRC_WORK_FRAMES(frames) - AUDIO_ASRC_HISTORY
+ */
+uint32_t AUDIO_AsrcInputFrames(const AUDIO_AsrcTypeDef *asrc, uint32_t frames) {
+  uint64_t last = asrc->pos + (uint64_t)(frames - 1U) * asrc->step;
+
+  /* The last output frame reads up to two frames past its integer position */
+  return (uint32_t)(last >> 32) + 3U - AUDIO_ASRC_HISTORY;
+}
+
+/**
+ * @brief  AUDIO_AsrcProcess_q31
+ *         Resample one block of stereo frames
+ * @param  asrc: resampler instance
+ * @param  work: AUDIO_ASRC_HISTORY free frames followed by the
+ *         AUDIO_AsrcInputFrames new input frames, overwritten
+ * @param  dst: output frames
+ * @param  frames: output frames of the block
+ * @retval None
+ */
+void AUDIO_AsrcProcess_q31(AUDIO_AsrcTypeDef *asrc, int32_t *work, int32_t *dst, uint32_t frames) {
+  uint32_t input = AUDIO_AsrcInputFrames(asrc, frames);
+  uint64_t pos = asrc->pos;
+  uint64_t step = asrc->step;
+
+  (void)memcpy(work, asrc->hist, sizeof(asrc->hist));
+
+  while (frames > 0U) {
+    const int32_t *x = &work[((uint32_t)(pos >> 32) - 1U) * 2U];
+    int64_t mu = (int64_t)((uint32_t)pos >> 4);
+
+    dst[0] = AUDIO_AsrcInterp(x[0], x[2], x[4], x[6], mu);
+    dst[1] = AUDIO_AsrcInterp(x[1], x[3], x[5], x[7], mu);
+
+    dst += 2;
+    pos += step;
+    frames--;
+  }
+
+  /* Drop the consumed frames, the newest ones become the history */
+  (void)memcpy(asrc->hist, &work[input * 2U], sizeof(asrc->hist));
+  asrc->pos = pos - ((uint64_t)input << 32);
+}
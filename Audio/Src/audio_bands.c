@@ -0,0 +1,160 @@
+/**
+ ******************************************************************************
+ * @file    audio_bands.c
+ * @brief   Grouping of the analyzer spectrum into display bands.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  Bars are bands of the power spectrum: one bin each on the linear
+ *  layout, 1/3, 1/6 or 1/12 octave from AUDIO_BANDS_FREQ_LOW, or even
+ *  steps of the mel scale. The band edges only move with the layout and
+ *  the sampling frequency, so they are turned into an index once, when
+ *  either changes: per band its first bin, its number of bins and where
+ *  its weights start. Bin k covers k - 1/2 to k + 1/2 bins; a bin inside a
+ *  band weighs its share of the band width, a bin across an edge is split
+ *  between the two bands by how much of it lies on each side.
+ *
+ *  Bands follow each other, so the index walks the spectrum once from the
+ *  bottom and holds at most one weight per bin plus one per band. A frame
+ *  is one pass over it, a multiply-accumulate per weight, and each band
+ *  comes out as the mean power of its bins: a wide treble band reads the
+ *  same for a tone as a narrow bass band. Below a few hundred Hz the
+ *  finer octave layouts get narrower than a bin, neighbouring bands there
+ *  share a bin and read the same.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_bands.h"
+
+#include <math.h>
+
+/**
+ * @brief  AUDIO_BandsAdd
+ *         Append a band to the index
+ * @param  bands: bands instance
+ * @param  lo: lower edge, in bins
+ * @param  hi: upper edge, in bins
+ * @param  used: weights taken so far, updated
+ * @retval None
+ */
+static void AUDIO_BandsAdd(AUDIO_BandsTypeDef *bands, float32_t lo, float32_t hi, uint32_t *used) {
+  AUDIO_BandTypeDef *band = &bands->band[bands->count];
+  uint32_t first;
+  uint32_t last;
+
+  /* DC stays out, the top bin ends half a bin below Nyquist */
+  lo = lo > 0.5f ? lo : 0.5f;
+  hi = hi < (float32_t)AUDIO_SPECTRUM_BINS - 0.5f ? hi : (float32_t)AUDIO_SPECTRUM_BINS - 0.5f;
+  if (hi <= lo || bands->count == AUDIO_BANDS_MAX) {
+    return;
+  }
+
+  first = (uint32_t)(lo + 0.5f);
+  last = (uint32_t)ceilf(hi + 0.5f) - 1U;
+  if (*used + last - first + 1U > AUDIO_SPECTRUM_BINS + AUDIO_BANDS_MAX) {
+    return;
+  }
+
+  band->bin = (uint16_t)first;
+  band->count = (uint16_t)(last - first + 1U);
+  band->weight = (uint16_t)*used;
+  for (uint32_t k = first; k <= last; k++) {
+    float32_t from = (float32_t)k - 0.5f > lo ? (float32_t)k - 0.5f : lo;
+    float32_t to = (float32_t)k + 0.5f < hi ? (float32_t)k + 0.5f : hi;
+
+    bands->weight[(*used)++] = (to - from) / (hi - lo);
+  }
+  bands->count++;
+}
+
+/**
+ * @brief  AUDIO_BandsConfig
+ *         Build the index of a layout, only when the layout or the
+ *         sampling frequency changed since the last call
+ * @param  bands: bands instance, zeroed before the first call
+ * @param  layout: band layout
+ * @param  freq: sampling frequency of the spectrum, Hz
+ * @retval None
+ */
+void AUDIO_BandsConfig(AUDIO_BandsTypeDef *bands, AUDIO_BandsLayoutTypeDef layout, uint32_t freq) {
+  float32_t bin = (float32_t)freq / (float32_t)AUDIO_SPECTRUM_SIZE;
+  float32_t high = 0.5f * (float32_t)freq < AUDIO_BANDS_FREQ_HIGH ? 0.5f * (float32_t)freq : AUDIO_BANDS_FREQ_HIGH;
+  uint32_t used = 0U;
+  uint32_t n;
+
+  if (bands->count != 0U && bands->layout == layout && bands->freq == freq) {
+    return;
+  }
+  bands->layout = layout;
+  bands->freq = freq;
+  bands->count = 0U;
+  if (freq == 0U) {
+    return;
+  }
+
+  switch (layout) {
+    case AUDIO_BANDS_OCTAVE_3:
+    case AUDIO_BANDS_OCTAVE_6:
+    case AUDIO_BANDS_OCTAVE_12: {
+      float32_t per = layout == AUDIO_BANDS_OCTAVE_3 ? 3.0f : layout == AUDIO_BANDS_OCTAVE_6 ? 6.0f : 12.0f;
+
+      n = (uint32_t)ceilf(per * log2f(high / AUDIO_BANDS_FREQ_LOW));
+      for (uint32_t j = 0U; j < n; j++) {
+        float32_t lo = AUDIO_BANDS_FREQ_LOW * exp2f((float32_t)j / per);
+        float32_t hi = AUDIO_BANDS_FREQ_LOW * exp2f((float32_t)(j + 1U) / per);
+
+        AUDIO_BandsAdd(bands, lo / bin, (hi < high ? hi : high) / bin, &used);
+      }
+      break;
+    }
+
+    case AUDIO_BANDS_MEL_SCALE: {
+      float32_t mel_lo = 2595.0f * log10f(1.0f + AUDIO_BANDS_FREQ_LOW / 700.0f);
+      float32_t mel_step = (2595.0f * log10f(1.0f + high / 700.0f) - mel_lo) / (float32_t)AUDIO_BANDS_MEL;
+
+      for (uint32_t j = 0U; j < AUDIO_BANDS_MEL; j++) {
+        float32_t lo = 700.0f * (powf(10.0f, (mel_lo + (float32_t)j * mel_step) / 2595.0f) - 1.0f);
+        float32_t hi = 700.0f * (powf(10.0f, (mel_lo + (float32_t)(j + 1U) * mel_step) / 2595.0f) - 1.0f);
+
+        AUDIO_BandsAdd(bands, lo / bin, hi / bin, &used);
+      }
+      break;
+    }
+
+    case AUDIO_BANDS_LINEAR:
+    default:
+      n = AUDIO_SPECTRUM_BINS < AUDIO_BANDS_MAX ? AUDIO_SPECTRUM_BINS : AUDIO_BANDS_MAX;
+      for (uint32_t j = 0U; j < n; j++) {
+        bands->band[j].bin = (uint16_t)j;
+        bands->band[j].count = 1U;
+        bands->band[j].weight = (uint16_t)j;
+        bands->weight[j] = 1.0f;
+      }
+      bands->count = n;
+      break;
+  }
+}
+
+/**
+ * @brief  AUDIO_BandsProcess
+ *         Mean power of every band of a spectrum
+ * @param  bands: configured bands instance
+ * @param  power: AUDIO_SPECTRUM_BINS power values
+ * @param  out: bands->count band powers
+ * @retval None
+ */
+void AUDIO_BandsProcess(const AUDIO_BandsTypeDef *bands, const float32_t *power, float32_t *out) {
+  for (uint32_t b = 0U; b < bands->count; b++) {
+    const AUDIO_BandTypeDef *band = &bands->band[b];
+    const float32_t *w = &bands->weight[band->weight];
+    const float32_t *p = &power[band->bin];
+    float32_t sum = 0.0f;
+
+    for (uint32_t k = 0U; k < band->count; k++) {
+      sum += w[k] * p[k];
+    }
+    out[b] = sum;
+  }
+}
@@ -0,0 +1,154 @@
+/**
+ ******************************************************************************
+ * @file    audio_dither.c
+ * @brief   Dithered requantization of the float pipeline to the 16-bit I2S word.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  The playback path keeps the volume and every DSP stage in float and
+ *  narrows to 16 bits once, here. Plain rounding at that point turns the
+ *  low-level detail of a quiet passage into distortion correlated with
+ *  the signal; adding triangular (TPDF) noise of +-1 LSB first makes the
+ *  error independent of the signal, a steady hiss 4.8 dB above the
+ *  rounding floor instead.
+ *
+ *  One xorshift32 draw gives both uniform halves of the triangular value,
+ *  so the generator costs a few integer operations per sample.
+ *
+ *  AUDIO_DITHER_SHAPED feeds the total error back through
+ *  2 z^-1 - z^-2, which gives the noise a (1 - z^-1)^2 spectrum: deep
+ *  below a few kHz, where the ear is most sensitive, and concentrated
+ *  towards Nyquist. The fed-back error is bounded so that a clipped
+ *  sample cannot make the loop run away.
+ *
+ *  Dither on digital silence is a hiss of its own, so muted output goes
+ *  through AUDIO_DitherRound_q15, the rounding alone: what is left of
+ *  the filter tails settles to exact zeros.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_dither.h"
+
+/* Bound of the error fed back, LSB: the largest it gets without clipping is 1.5 */
+#define AUDIO_DITHER_ERR_MAX                          2.0f
+
+/**
+ * @brief  AUDIO_DitherInit
+ *         Start with a given mode
+ * @param  dither: dither instance
+ * @param  mode: requantization mode
+ * @retval None
+ */
+void AUDIO_DitherInit(AUDIO_DitherTypeDef *dither, AUDIO_DitherModeTypeDef mode) {
+  dither->mode = (uint8_t)mode;
+  dither->seed = 0x2545F491UL;
+  AUDIO_DitherReset(dither);
+}
+
+/**
+ * @brief  AUDIO_DitherReset
+ *         Clear the noise shaping history, between streams
+ * @param  dither: dither instance
+ * @retval None
+ */
+void AUDIO_DitherReset(AUDIO_DitherTypeDef *dither) {
+  dither->err[0][0] = 0.0f;
+  dither->err[0][1] = 0.0f;
+  dither->err[1][0] = 0.0f;
+  dither->err[1][1] = 0.0f;
+}
+
+/**
+ * @brief  AUDIO_DitherRound
+ *         Round to the nearest integer and saturate to 16 bits
+ * @param  x: sample, LSB
+ * @retval sample
+ */
+static inline int32_t AUDIO_DitherRound(float32_t x) {
+  /* Offset so the conversion, which truncates towards zero, floors */
+  return __SSAT((int32_t)(x + 32768.5f) - 32768, 16);
+}
+
+/**
+ * @brief  AUDIO_DitherRound_q15
+ *         Requantize interleaved stereo floats to int16 by plain rounding,
+ *         without dither: silence stays digital silence
+ * @param  src: full scale +-1
+ * @param  dst: output frames
+ * @param  frames: number of stereo frames
+ * @retval None
+ */
+void AUDIO_DitherRound_q15(const float32_t *src, int16_t *dst, uint32_t frames) {
+  const float32_t scale = 32768.0f;
+  uint32_t n = frames * 2U;
+
+  for (uint32_t i = 0U; i < n; i++) {
+    dst[i] = (int16_t)AUDIO_DitherRound(src[i] * scale);
+  }
+}
+
+/**
+ * @brief  AUDIO_DitherQuantize_q15
+ *         Requantize interleaved stereo floats to int16
+ * @param  dither: dither instance
+ * @param  src: full scale +-1
+ * @param  dst: output frames
+ * @param  frames: number of stereo frames
+ * @retval None
+ */
+void AUDIO_DitherQuantize_q15(AUDIO_DitherTypeDef *dither, const float32_t *src, int16_t *dst, uint32_t frames) {
+  const float32_t scale = 32768.0f;
+  const float32_t lsb = 1.0f / 65536.0f;
+  uint32_t seed = dither->seed;
+  uint32_t n = frames * 2U;
+
+  switch (dither->mode) {
+    case AUDIO_DITHER_OFF:
+      AUDIO_DitherRound_q15(src, dst, frames);
+      break;
+
+    case AUDIO_DITHER_TPDF:
+      for (uint32_t i = 0U; i < n; i++) {
+        float32_t tpdf;
+
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        /* Sum of two uniform 16-bit halves, centered: -1..+1 LSB */
+        tpdf = (float32_t)((int32_t)(seed & 0xFFFFU) + (int32_t)(seed >> 16) - 0xFFFF) * lsb;
+        dst[i] = (int16_t)AUDIO_DitherRound(src[i] * scale + tpdf);
+      }
+      break;
+
+    default:
+      for (uint32_t i = 0U; i < n; i++) {
+        float32_t *err = dither->err[i & 1U];
+        float32_t tpdf;
+        float32_t want;
+        float32_t e;
+        int32_t q;
+
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        tpdf = (float32_t)((int32_t)(seed & 0xFFFFU) + (int32_t)(seed >> 16) - 0xFFFF) * lsb;
+
+        want = src[i] * scale - 2.0f * err[0] + err[1];
+        q = AUDIO_DitherRound(want + tpdf);
+        e = (float32_t)q - want;
+        if (e > AUDIO_DITHER_ERR_MAX) {
+          e = AUDIO_DITHER_ERR_MAX;
+        } else if (e < -AUDIO_DITHER_ERR_MAX) {
+          e = -AUDIO_DITHER_ERR_MAX;
+        }
+        err[1] = err[0];
+        err[0] = e;
+        dst[i] = (int16_t)q;
+      }
+      break;
+  }
+
+  dither->seed = seed;
+}
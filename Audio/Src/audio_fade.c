@@ -0,0 +1,98 @@
+/**
+ ******************************************************************************
+ * @file    audio_fade.c
+ * @brief   Short ramps that hide a starved stream: fade to silence and back.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  When the receive ring runs dry in the middle of a block, dropping to
+ *  zero leaves a step the size of the last sample, heard as a click, and
+ *  the same happens when the data comes back. The gap is concealed
+ *  instead: the last good frame is held and ramped down to silence over
+ *  AUDIO_FADE_FRAMES, and the first frames after the gap are ramped up
+ *  from silence over the same length.
+ *
+ *  Holding the last frame needs nothing from the data before it, so the
+ *  gap may start on a block boundary, after the previous block was handed
+ *  to the DMA. The ramps only run on the blocks around a gap, a healthy
+ *  stream never calls them.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_fade.h"
+
+#include <string.h>
+
+/**
+ * @brief  AUDIO_FadeIn_q15
+ *         Ramp the first frames from silence, in place
+ * @param  frames: interleaved stereo frames
+ * @param  n: frames to ramp, at most AUDIO_FADE_FRAMES
+ * @retval None
+ */
+void AUDIO_FadeIn_q15(int16_t *frames, uint32_t n) {
+  for (uint32_t i = 0U; i < n; i++) {
+    frames[i * 2U] = (int16_t)(((int32_t)frames[i * 2U] * (int32_t)i) >> AUDIO_FADE_SHIFT);
+    frames[i * 2U + 1U] = (int16_t)(((int32_t)frames[i * 2U + 1U] * (int32_t)i) >> AUDIO_FADE_SHIFT);
+  }
+}
+
+/**
+ * @brief  AUDIO_FadeIn_q31
+ *         Ramp the first frames from silence, in place
+ * @param  frames: interleaved stereo frames
+ * @param  n: frames to ramp, at most AUDIO_FADE_FRAMES
+ * @retval None
+ */
+void AUDIO_FadeIn_q31(int32_t *frames, uint32_t n) {
+  for (uint32_t i = 0U; i < n; i++) {
+    frames[i * 2U] = (int32_t)(((int64_t)frames[i * 2U] * (int64_t)i) >> AUDIO_FADE_SHIFT);
+    frames[i * 2U + 1U] = (int32_t)(((int64_t)frames[i * 2U + 1U] * (int64_t)i) >> AUDIO_FADE_SHIFT);
+  }
+}
+
+/**
+ * @brief  AUDIO_FadeHold_q15
+ *         Fill a gap: the last good frame ramped down to silence, then zeros
+ * @param  last: last frame played before the gap
+ * @param  dst: frames of the gap
+ * @param  n: frames of the gap
+ * @retval None
+ */
+void AUDIO_FadeHold_q15(const int16_t *last, int16_t *dst, uint32_t n) {
+  int32_t l = last[0];
+  int32_t r = last[1];
+  uint32_t i;
+
+  for (i = 0U; i < n && i < AUDIO_FADE_FRAMES; i++) {
+    dst[i * 2U] = (int16_t)((l * (int32_t)(AUDIO_FADE_FRAMES - i)) >> AUDIO_FADE_SHIFT);
+    dst[i * 2U + 1U] = (int16_t)((r * (int32_t)(AUDIO_FADE_FRAMES - i)) >> AUDIO_FADE_SHIFT);
+  }
+  if (i < n) {
+    (void)memset(&dst[i * 2U], 0, (n - i) * 2U * sizeof(int16_t));
+  }
+}
+
+/**
+ * @brief  AUDIO_FadeHold_q31
+ *         Fill a gap: the last good frame ramped down to silence, then zeros
+ * @param  last: last frame played before the gap
+ * @param  dst: frames of the gap
+ * @param  n: frames of the gap
+ * @retval None
+ */
+void AUDIO_FadeHold_q31(const int32_t *last, int32_t *dst, uint32_t n) {
+  int64_t l = last[0];
+  int64_t r = last[1];
+  uint32_t i;
+
+  for (i = 0U; i < n && i < AUDIO_FADE_FRAMES; i++) {
+    dst[i * 2U] = (int32_t)((l * (int64_t)(AUDIO_FADE_FRAMES - i)) >> AUDIO_FADE_SHIFT);
+    dst[i * 2U + 1U] = (int32_t)((r * (int64_t)(AUDIO_FADE_FRAMES - i)) >> AUDIO_FADE_SHIFT);
+  }
+  if (i < n) {
+    (void)memset(&dst[i * 2U], 0, (n - i) * 2U * sizeof(int32_t));
+  }
+}
@@ -0,0 +1,192 @@
+/**
+ ******************************************************************************
+ * @file    audio_fifo.c
+ * @brief   Single-producer single-consumer sample FIFO from the I2S path to the analyzer.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  The I2S callbacks push the first channel of every output block, from
+ *  the integer samples or from a float stage of the playback graph, the
+ *  main loop pulls analysis frames; neither side ever waits for the
+ *  other. Each index is written by one side only and both are
+ *  free-running, so the fill is wr - rd and the buffer position is the
+ *  index masked by the power-of-two size.
+ *
+ *  The producer fills the free space first and publishes wr after a
+ *  barrier. When the consumer is too slow to leave room for a whole
+ *  push, the push is dropped and counted rather than overwriting what
+ *  it may be reading, and where it should have gone is recorded: the
+ *  samples on either side of that point are not contiguous. Before its
+ *  next frame the consumer releases everything up to the gap, so no
+ *  frame is ever assembled across it. AUDIO_FifoReserve and
+ *  AUDIO_FifoCommit are the two halves of a push, for a producer that
+ *  writes the samples in a loop of its own: the level meter feeds the
+ *  integer blocks in the loop that meters them.
+ *
+ *  The consumer copies a frame out without releasing it, then releases
+ *  only the hop, so the next frame overlaps the previous one by
+ *  size - hop samples straight from the buffer. A consumer that fell
+ *  more than a hop behind skips to the newest full frame instead of
+ *  working through stale ones. The frame stays int16, one or two memcpy
+ *  per frame; each analyzer engine converts it to its own format in bulk.
+ *
+ *  The barriers are AUDIO_FIFO_BARRIER, a DMB on target; a host build
+ *  can define its own before compiling this file.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_fifo.h"
+
+#include <string.h>
+
+#ifndef AUDIO_FIFO_BARRIER
+#include "stm32h7xx.h"
+#define AUDIO_FIFO_BARRIER()                          __DMB()
+#endif /* AUDIO_FIFO_BARRIER */
+
+/**
+ * @brief  AUDIO_FifoReserve
+ *         Whether a push fits; if not, drop it and mark the gap it leaves.
+ *         A producer that writes the samples in its own loop, from fifo->wr
+ *         on, publishes them with AUDIO_FifoCommit.
+ * @param  fifo: FIFO instance
+ * @param  n: samples to push
+ * @retval n when it fits, 0 when dropped
+ */
+uint32_t AUDIO_FifoReserve(AUDIO_FifoTypeDef *fifo, uint32_t n) {
+  if (n <= AUDIO_FIFO_SIZE - (fifo->wr - fifo->rd)) {
+    return n;
+  }
+
+  fifo->drops += n;
+  fifo->gap = fifo->wr;
+  AUDIO_FIFO_BARRIER();
+  fifo->overruns++;
+  return 0U;
+}
+
+/**
+ * @brief  AUDIO_FifoCommit
+ *         Publish samples written after AUDIO_FifoReserve
+ * @param  fifo: FIFO instance
+ * @param  n: samples written, as reserved
+ * @retval None
+ */
+void AUDIO_FifoCommit(AUDIO_FifoTypeDef *fifo, uint32_t n) {
+  AUDIO_FIFO_BARRIER();
+  fifo->wr += n;
+}
+
+/**
+ * @brief  AUDIO_FifoPush_q15
+ *         Write the first channel of interleaved stereo int16 frames
+ * @param  fifo: FIFO instance
+ * @param  frames: stereo frames
+ * @param  n: number of frames
+ * @retval None
+ */
+void AUDIO_FifoPush_q15(AUDIO_FifoTypeDef *fifo, const int16_t *frames, uint32_t n) {
+  uint32_t wr = fifo->wr;
+
+  n = AUDIO_FifoReserve(fifo, n);
+  for (uint32_t i = 0U; i < n; i++) {
+    fifo->buf[(wr + i) & AUDIO_FIFO_MASK] = frames[i * 2U];
+  }
+
+  AUDIO_FifoCommit(fifo, n);
+}
+
+/**
+ * @brief  AUDIO_FifoPush_q31
+ *         Write the first channel of interleaved stereo q31 frames, on
+ *         their top 16 bits
+ * @param  fifo: FIFO instance
+ * @param  frames: stereo frames
+ * @param  n: number of frames
+ * @retval None
+ */
+void AUDIO_FifoPush_q31(AUDIO_FifoTypeDef *fifo, const int32_t *frames, uint32_t n) {
+  uint32_t wr = fifo->wr;
+
+  n = AUDIO_FifoReserve(fifo, n);
+  for (uint32_t i = 0U; i < n; i++) {
+    fifo->buf[(wr + i) & AUDIO_FIFO_MASK] = (int16_t)(frames[i * 2U] >> 16);
+  }
+
+  AUDIO_FifoCommit(fifo, n);
+}
+
+/**
+ * @brief  AUDIO_FifoPush_f32
+ *         Write the first channel of interleaved stereo float frames,
+ *         truncated and saturated to 16 bits
+ * @param  fifo: FIFO instance
+ * @param  frames: stereo frames, full scale +-1
+ * @param  n: number of frames
+ * @retval None
+ */
+void AUDIO_FifoPush_f32(AUDIO_FifoTypeDef *fifo, const float32_t *frames, uint32_t n) {
+  uint32_t wr = fifo->wr;
+
+  n = AUDIO_FifoReserve(fifo, n);
+  for (uint32_t i = 0U; i < n; i++) {
+    fifo->buf[(wr + i) & AUDIO_FIFO_MASK] = (int16_t)__SSAT((int32_t)(frames[i * 2U] * 32768.0f), 16);
+  }
+
+  AUDIO_FifoCommit(fifo, n);
+}
+
+/**
+ * @brief  AUDIO_FifoRead_q15
+ *         Copy out the next frame and release its first hop samples,
+ *         never waits
+ * @param  fifo: FIFO instance
+ * @param  dst: frame
+ * @param  size: frame length, at most AUDIO_FIFO_SIZE
+ * @param  hop: samples between the starts of two frames, 1..size
+ * @retval 1 when a frame was copied, 0 when fewer than size samples are queued
+ *         since the last gap
+ */
+uint8_t AUDIO_FifoRead_q15(AUDIO_FifoTypeDef *fifo, int16_t *dst, uint32_t size, uint32_t hop) {
+  uint32_t overruns = fifo->overruns;
+  uint32_t wr;
+  uint32_t rd;
+  uint32_t pos;
+  uint32_t run;
+
+  if (overruns != fifo->resynced) {
+    /* Pushes were dropped: restart the frame after the last gap */
+    AUDIO_FIFO_BARRIER();
+    fifo->resynced = overruns;
+    if ((int32_t)(fifo->gap - fifo->rd) > 0) {
+      fifo->rd = fifo->gap;
+    }
+  }
+
+  wr = fifo->wr;
+  rd = fifo->rd;
+  if (wr - rd < size) {
+    return 0U;
+  }
+  AUDIO_FIFO_BARRIER();
+
+  /* More than a hop behind: the newest frame only */
+  if (wr - rd - size >= hop) {
+    rd = wr - size;
+  }
+
+  pos = rd & AUDIO_FIFO_MASK;
+  run = AUDIO_FIFO_SIZE - pos;
+  if (run >= size) {
+    (void)memcpy(dst, &fifo->buf[pos], size * sizeof(int16_t));
+  } else {
+    (void)memcpy(dst, &fifo->buf[pos], run * sizeof(int16_t));
+    (void)memcpy(&dst[run], fifo->buf, (size - run) * sizeof(int16_t));
+  }
+
+  AUDIO_FIFO_BARRIER();
+  fifo->rd = rd + hop;
+  return 1U;
+}
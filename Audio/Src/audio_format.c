@@ -0,0 +1,101 @@
+/**
+ ******************************************************************************
+ * @file    audio_format.c
+ * @brief   PCM sample format conversion kernels.
+ ******************************************************************************
+ */
+
+#include "audio_format.h"
+
+#include "arm_math.h"
+
+/**
+ * @brief  AUDIO_Unpack24_q31
+ *         Expand packed little-endian 24-bit samples to left-justified q31.
+ *         Four samples are rebuilt from three word loads per iteration
+ *         instead of assembling every sample byte by byte.
+ * @param  src: packed samples, any alignment
+ * @param  dst: output samples, 32-bit aligned
+ * @param  samples: number of samples (not frames)
+ * @retval None
+ */
+void AUDIO_Unpack24_q31(const uint8_t *src, int32_t *dst, uint32_t samples) {
+  while (samples >= 4U) {
+    uint32_t w0 = __UNALIGNED_UINT32_READ(&src[0]);
+    uint32_t w1 = __UNALIGNED_UINT32_READ(&src[4]);
+    uint32_t w2 = __UNALIGNED_UINT32_READ(&src[8]);
+
+    /* w0 = b3 b2 b1 b0, w1 = b7 b6 b5 b4, w2 = b11 b10 b9 b8 */
+    dst[0] = (int32_t)(w0 << 8);
+    dst[1] = (int32_t)((w1 << 16) | ((w0 >> 16) & 0x0000FF00U));
+    dst[2] = (int32_t)((w2 << 24) | ((w1 >> 8) & 0x00FFFF00U));
+    dst[3] = (int32_t)(w2 & 0xFFFFFF00U);
+
+    src += 12;
+    dst += 4;
+    samples -= 4U;
+  }
+
+  while (samples > 0U) {
+    *dst++ = (int32_t)(((uint32_t)src[0] << 8) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 24));
+    src += 3;
+    samples--;
+  }
+}
+
+/**
+ * @brief  AUDIO_Pack24_q31
+ *         Pack left-justified q31 samples to little-endian 24-bit, the
+ *         reverse of AUDIO_Unpack24_q31: four samples become three word
+ *         stores per iteration.
+ * @param  src: input samples, 32-bit aligned
+ * @param  dst: packed samples, any alignment
+ * @param  samples: number of samples (not frames)
+ * @retval None
+ */
+void AUDIO_Pack24_q31(const int32_t *src, uint8_t *dst, uint32_t samples) {
+  while (samples >= 4U) {
+    uint32_t s0 = (uint32_t)src[0] >> 8;
+    uint32_t s1 = (uint32_t)src[1] >> 8;
+    uint32_t s2 = (uint32_t)src[2] >> 8;
+    uint32_t s3 = (uint32_t)src[3] >> 8;
+
+    __UNALIGNED_UINT32_WRITE(&dst[0], s0 | (s1 << 24));
+    __UNALIGNED_UINT32_WRITE(&dst[4], (s1 >> 8) | (s2 << 16));
+    __UNALIGNED_UINT32_WRITE(&dst[8], (s2 >> 16) | (s3 << 8));
+
+    src += 4;
+    dst += 12;
+    samples -= 4U;
+  }
+
+  while (samples > 0U) {
+    uint32_t s = (uint32_t)*src++;
+
+    dst[0] = (uint8_t)(s >> 8);
+    dst[1] = (uint8_t)(s >> 16);
+    dst[2] = (uint8_t)(s >> 24);
+    dst += 3;
+    samples--;
+  }
+}
+
+/**
+ * @brief  AUDIO_Pack24_q15
+ *         Widen q15 samples to little-endian 24-bit, the low byte is zero
+ * @param  src: input samples
+ * @param  dst: packed samples, any alignment
+ * @param  samples: number of samples (not frames)
+ * @retval None
+ */
+void AUDIO_Pack24_q15(const int16_t *src, uint8_t *dst, uint32_t samples) {
+  while (samples > 0U) {
+    uint16_t s = (uint16_t)*src++;
+
+    dst[0] = 0U;
+    dst[1] = (uint8_t)s;
+    dst[2] = (uint8_t)(s >> 8);
+    dst += 3;
+    samples--;
+  }
+}
@@ -0,0 +1,341 @@
+/**
+ ******************************************************************************
+ * @file    audio_gain.c
+ * @brief   Stereo Q15 gain stage driven by the UAC volume control.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  The host volume (1/256 dB) is turned into a gain once, when it changes,
+ *  by interpolating a 0.5 dB table. The gain is stored as a Q15 mantissa
+ *  plus a right shift so that -96 dB keeps as many significant bits as
+ *  0 dB. The kernel works on packed L/R pairs with the dual 16-bit MAC.
+ *
+ *  A volume or mute change is not applied as a step, which is heard as
+ *  zipper noise, but ramped linearly across one block. The ramp runs on
+ *  the Q30 value of the gain: mant << 15 >> shift is exact for every
+ *  shift the table produces and 0 dB is exactly 1 << 30, so the last
+ *  ramped frame rounds like the constant kernel the following blocks go
+ *  back to, bit-transparent at 0 dB included.
+ *
+ *  16-bit frames headed for the float stage are ramped on the way there:
+ *  SMULWB and SMULWT multiply the Q30 gain by both halves of a packed
+ *  L/R word, keeping the top 32 bits of each 46-bit product, more than a
+ *  float holds, so the conversion and the ramp take one pass instead of
+ *  two.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_gain.h"
+
+#include <string.h>
+
+#include "arm_math.h"
+
+#define AUDIO_GAIN_TABLE_SIZE                         193U
+
+#if defined(ARM_MATH_DSP)
+#ifndef __SMULWB
+/* Not among the CMSIS intrinsics: op1 times the bottom halfword of op2, top 32 bits of the product */
+__STATIC_FORCEINLINE int32_t __SMULWB(int32_t op1, uint32_t op2) {
+  int32_t result;
+
+  __ASM("smulwb %0, %1, %2" : "=r"(result) : "r"(op1), "r"(op2));
+  return result;
+}
+
+/* op1 times the top halfword of op2, top 32 bits of the product */
+__STATIC_FORCEINLINE int32_t __SMULWT(int32_t op1, uint32_t op2) {
+  int32_t result;
+
+  __ASM("smulwt %0, %1, %2" : "=r"(result) : "r"(op1), "r"(op2));
+  return result;
+}
+#endif /* __SMULWB */
+#endif /* ARM_MATH_DSP */
+
+/* round(2^31 * 10^(-0.5 * i / 20)), i = 0..192 */
+static const uint32_t AUDIO_GainTable[AUDIO_GAIN_TABLE_SIZE] = {
+    0x7FFFFFFFU, 0x78D6FC9FU, 0x721482C0U, 0x6BB2D604U, 0x65AC8C2FU, 0x5FFC8890U,
+    0x5A9DF7ACU, 0x558C4B22U, 0x50C335D4U, 0x4C3EA839U, 0x47FACCF0U, 0x43F4057FU,
+    0x4026E73DU, 0x3C903870U, 0x392CED8EU, 0x35FA26AAU, 0x32F52CFFU, 0x301B70A8U,
+    0x2D6A866FU, 0x2AE025C3U, 0x287A26C5U, 0x26368074U, 0x241346F6U, 0x220EA9F4U,
+    0x2026F310U, 0x1E5A8472U, 0x1CA7D768U, 0x1B0D7B1BU, 0x198A1357U, 0x181C5762U,
+    0x16C310E3U, 0x157D1AE2U, 0x144960C5U, 0x1326DD71U, 0x12149A60U, 0x1111AEDBU,
+    0x101D3F2EU, 0x0F367BEEU, 0x0E5CA14CU, 0x0D8EF66DU, 0x0CCCCCCDU, 0x0C157FA9U,
+    0x0B68737AU, 0x0AC51567U, 0x0A2ADAD2U, 0x099940DBU, 0x090FCBF8U, 0x088E0783U,
+    0x08138562U, 0x079FDD9FU, 0x0732AE18U, 0x06CB9A26U, 0x066A4A53U, 0x060E6C0BU,
+    0x05B7B15BU, 0x0565D0ABU, 0x05188480U, 0x04CF8B44U, 0x048AA70BU, 0x04499D60U,
+    0x040C3714U, 0x03D2400CU, 0x039B8719U, 0x0367DDCCU, 0x0337184EU, 0x03090D3FU,
+    0x02DD958AU, 0x02B48C50U, 0x028DCEBCU, 0x02693BF0U, 0x0246B4E4U, 0x02261C4AU,
+    0x0207567AU, 0x01EA4958U, 0x01CEDC3DU, 0x01B4F7E3U, 0x019C8651U, 0x018572CBU,
+    0x016FA9BBU, 0x015B18A5U, 0x0147AE14U, 0x01355991U, 0x01240B8CU, 0x0113B557U,
+    0x01044915U, 0x00F5B9B0U, 0x00E7FACCU, 0x00DB00C0U, 0x00CEC08AU, 0x00C32FC3U,
+    0x00B8449CU, 0x00ADF5D1U, 0x00A43AA2U, 0x009B0ACEU, 0x00925E89U, 0x008A2E77U,
+    0x008273A6U, 0x007B2787U, 0x007443E8U, 0x006DC2F0U, 0x00679F1CU, 0x0061D334U,
+    0x005C5A4FU, 0x00572FC8U, 0x00524F3BU, 0x004DB486U, 0x00495BC1U, 0x0045413BU,
+    0x00416179U, 0x003DB932U, 0x003A454AU, 0x003702D4U, 0x0033EF0CU, 0x00310756U,
+    0x002E4939U, 0x002BB263U, 0x002940A2U, 0x0026F1E1U, 0x0024C42CU, 0x0022B5AAU,
+    0x0020C49CU, 0x001EEF5BU, 0x001D345BU, 0x001B9222U, 0x001A074FU, 0x00189292U,
+    0x001732AEU, 0x0015E67AU, 0x0014ACDBU, 0x001384C7U, 0x00126D43U, 0x00116562U,
+    0x00106C43U, 0x000F8115U, 0x000EA30EU, 0x000DD172U, 0x000D0B91U, 0x000C50C1U,
+    0x000BA064U, 0x000AF9E5U, 0x000A5CB6U, 0x0009C852U, 0x00093C3BU, 0x0008B7FAU,
+    0x00083B20U, 0x0007C541U, 0x000755FAU, 0x0006ECECU, 0x000689BFU, 0x00062C1FU,
+    0x0005D3BBU, 0x00058048U, 0x00053181U, 0x0004E722U, 0x0004A0ECU, 0x00045EA4U,
+    0x00042010U, 0x0003E4FDU, 0x0003AD38U, 0x00037891U, 0x000346DCU, 0x000317F0U,
+    0x0002EBA3U, 0x0002C1D0U, 0x00029A55U, 0x0002750FU, 0x000251DEU, 0x000230A6U,
+    0x00021149U, 0x0001F3ADU, 0x0001D7BAU, 0x0001BD57U, 0x0001A46DU, 0x00018CE8U,
+    0x000176B5U, 0x000161BFU, 0x00014DF5U, 0x00013B46U, 0x000129A4U, 0x000118FDU,
+    0x00010945U, 0x0000FA6FU, 0x0000EC6CU, 0x0000DF33U, 0x0000D2B6U, 0x0000C6EDU,
+    0x0000BBCCU, 0x0000B14BU, 0x0000A760U, 0x00009E03U, 0x0000952CU, 0x00008CD4U,
+    0x000084F3U,
+};
+
+/**
+ * @brief  AUDIO_GainFromVolume
+ *         Convert a UAC volume value to a gain
+ * @param  volume: 8.8 dB, clamped to AUDIO_GAIN_DB_MIN..AUDIO_GAIN_DB_MAX
+ * @retval gain
+ */
+AUDIO_GainTypeDef AUDIO_GainFromVolume(int16_t volume) {
+  AUDIO_GainTypeDef gain;
+  uint32_t atten;
+  uint32_t idx;
+  uint32_t frac;
+  uint32_t g;
+
+  if (volume >= AUDIO_GAIN_DB_MAX) {
+    return AUDIO_GAIN_UNITY;
+  }
+  if (volume < AUDIO_GAIN_DB_MIN) {
+    volume = AUDIO_GAIN_DB_MIN;
+  }
+
+  atten = (uint32_t)(-(int32_t)volume);
+  idx = atten / AUDIO_GAIN_DB_STEP;
+  frac = atten % AUDIO_GAIN_DB_STEP;
+
+  g = AUDIO_GainTable[idx];
+  if (frac != 0U) {
+    g -= (uint32_t)(((uint64_t)(g - AUDIO_GainTable[idx + 1U]) * frac) / AUDIO_GAIN_DB_STEP);
+  }
+
+  /* Normalize to a Q15 mantissa in [0.5, 1), the shift is capped so the
+     rounding constant of the kernel can not overflow */
+  gain.shift = 0U;
+  while (g < 0x40000000U && gain.shift < 15U) {
+    g <<= 1;
+    gain.shift++;
+  }
+  gain.mant = (int16_t)__USAT((int32_t)((g + 0x8000U) >> 16), 15);
+
+  return gain;
+}
+
+/**
+ * @brief  AUDIO_GainApply_q15
+ *         Scale interleaved stereo int16 frames, src and dst may alias
+ * @param  src: input frames, 32-bit aligned
+ * @param  dst: output frames, 32-bit aligned
+ * @param  frames: number of stereo frames
+ * @param  gain: gain from AUDIO_GainFromVolume
+ * @retval None
+ */
+void AUDIO_GainApply_q15(const int16_t *src, int16_t *dst, uint32_t frames, AUDIO_GainTypeDef gain) {
+  const uint32_t *in = (const uint32_t *)src;
+  uint32_t *out = (uint32_t *)dst;
+  int32_t sh = 15 + (int32_t)gain.shift;
+  int32_t rnd = 1L << (sh - 1);
+  int32_t l;
+  int32_t r;
+
+  if (gain.mant == 0x7FFF && gain.shift == 0U) {
+    /* 0dB is bit-transparent */
+    if (src != dst) {
+      (void)memcpy(dst, src, frames * 2U * sizeof(int16_t));
+    }
+    return;
+  }
+  if (gain.mant == 0) {
+    /* Mute is digital silence */
+    (void)memset(dst, 0, frames * 2U * sizeof(int16_t));
+    return;
+  }
+
+#if defined(ARM_MATH_DSP)
+  uint32_t g = (uint16_t)gain.mant;
+
+  /* L * g in the bottom product, R * g via the exchanged top product */
+  while (frames >= 2U) {
+    uint32_t x0 = in[0];
+    uint32_t x1 = in[1];
+    l = (int32_t)__SMLAD(x0, g, (uint32_t)rnd) >> sh;
+    r = (int32_t)__SMLADX(x0, g, (uint32_t)rnd) >> sh;
+    out[0] = __PKHBT(l, r, 16);
+    l = (int32_t)__SMLAD(x1, g, (uint32_t)rnd) >> sh;
+    r = (int32_t)__SMLADX(x1, g, (uint32_t)rnd) >> sh;
+    out[1] = __PKHBT(l, r, 16);
+    in += 2;
+    out += 2;
+    frames -= 2U;
+  }
+  if (frames != 0U) {
+    l = (int32_t)__SMLAD(in[0], g, (uint32_t)rnd) >> sh;
+    r = (int32_t)__SMLADX(in[0], g, (uint32_t)rnd) >> sh;
+    out[0] = __PKHBT(l, r, 16);
+  }
+#else
+  while (frames > 0U) {
+    uint32_t x = *in++;
+    l = ((int32_t)(int16_t)x * gain.mant + rnd) >> sh;
+    r = ((int32_t)(int16_t)(x >> 16) * gain.mant + rnd) >> sh;
+    *out++ = ((uint32_t)l & 0xFFFFU) | ((uint32_t)r << 16);
+    frames--;
+  }
+#endif /* ARM_MATH_DSP */
+}
+
+/**
+ * @brief  AUDIO_GainApply_q31
+ *         Scale q31 samples, src and dst may alias
+ * @param  src: input samples
+ * @param  dst: output samples
+ * @param  samples: number of samples (not frames)
+ * @param  gain: gain from AUDIO_GainFromVolume
+ * @retval None
+ */
+void AUDIO_GainApply_q31(const int32_t *src, int32_t *dst, uint32_t samples, AUDIO_GainTypeDef gain) {
+  int32_t sh = 15 + (int32_t)gain.shift;
+  int64_t rnd = 1LL << (sh - 1);
+
+  if (gain.mant == 0x7FFF && gain.shift == 0U) {
+    if (src != dst) {
+      (void)memcpy(dst, src, samples * sizeof(int32_t));
+    }
+    return;
+  }
+  if (gain.mant == 0) {
+    (void)memset(dst, 0, samples * sizeof(int32_t));
+    return;
+  }
+
+  while (samples >= 2U) {
+    dst[0] = (int32_t)(((int64_t)src[0] * gain.mant + rnd) >> sh);
+    dst[1] = (int32_t)(((int64_t)src[1] * gain.mant + rnd) >> sh);
+    src += 2;
+    dst += 2;
+    samples -= 2U;
+  }
+  if (samples != 0U) {
+    dst[0] = (int32_t)(((int64_t)src[0] * gain.mant + rnd) >> sh);
+  }
+}
+
+/**
+ * @brief  AUDIO_GainLinear
+ *         Gain as a Q30 factor, the ramps interpolate in it
+ * @param  gain: gain from AUDIO_GainFromVolume
+ * @retval gain, Q30
+ */
+static inline int32_t AUDIO_GainLinear(AUDIO_GainTypeDef gain) {
+  if (gain.mant == 0x7FFF && gain.shift == 0U) {
+    return 1L << 30;
+  }
+  return (int32_t)(((uint32_t)(uint16_t)gain.mant << 15) >> gain.shift);
+}
+
+/**
+ * @brief  AUDIO_GainRamp_q31
+ *         Scale interleaved stereo q31 frames by a gain moving linearly
+ *         from one value to another, src and dst may alias
+ * @param  src: input frames
+ * @param  dst: output frames
+ * @param  frames: number of stereo frames, at most span
+ * @param  from: gain before the first frame
+ * @param  to: gain reached on frame span - 1
+ * @param  span: length of the ramp, frames
+ * @retval None
+ */
+void AUDIO_GainRamp_q31(const int32_t *src, int32_t *dst, uint32_t frames, AUDIO_GainTypeDef from,
+                        AUDIO_GainTypeDef to, uint32_t span) {
+  int32_t g = AUDIO_GainLinear(from);
+  int32_t last = AUDIO_GainLinear(to);
+  int32_t step = (last - g) / (int32_t)span;
+  const int64_t rnd = 1LL << 29;
+
+  for (uint32_t i = 1U; i <= frames; i++) {
+    /* The step is truncated, the last frame is set to the target instead */
+    g = i == span ? last : g + step;
+    dst[0] = (int32_t)(((int64_t)src[0] * g + rnd) >> 30);
+    dst[1] = (int32_t)(((int64_t)src[1] * g + rnd) >> 30);
+    src += 2;
+    dst += 2;
+  }
+}
+
+/**
+ * @brief  AUDIO_GainRamp_q15
+ *         Convert interleaved stereo int16 frames to float, scaled by a
+ *         gain moving linearly from one value to another, or by a constant
+ *         gain when both are equal
+ * @param  src: input frames, 32-bit aligned
+ * @param  dst: output frames, full scale 1.0f
+ * @param  frames: number of stereo frames, at most span
+ * @param  from: gain before the first frame
+ * @param  to: gain reached on frame span - 1
+ * @param  span: length of the ramp, frames
+ * @retval None
+ */
+void AUDIO_GainRamp_q15(const int16_t *src, float *dst, uint32_t frames, AUDIO_GainTypeDef from,
+                        AUDIO_GainTypeDef to, uint32_t span) {
+  const uint32_t *in = (const uint32_t *)src;
+  int32_t g = AUDIO_GainLinear(from);
+  int32_t last = AUDIO_GainLinear(to);
+  int32_t step = (last - g) / (int32_t)span;
+  /* Q15 sample times Q30 gain, less the 16 bits SMULWB drops */
+  const float scale = 1.0f / 536870912.0f;
+
+  for (uint32_t i = 1U; i <= frames; i++) {
+    uint32_t x = *in++;
+
+    /* The step is truncated, the last frame is set to the target instead */
+    g = i == span ? last : g + step;
+#if defined(ARM_MATH_DSP)
+    dst[0] = (float)__SMULWB(g, x) * scale;
+    dst[1] = (float)__SMULWT(g, x) * scale;
+#else
+    dst[0] = (float)(int32_t)(((int64_t)g * (int16_t)x) >> 16) * scale;
+    dst[1] = (float)(int32_t)(((int64_t)g * (int16_t)(x >> 16)) >> 16) * scale;
+#endif /* ARM_MATH_DSP */
+    dst += 2;
+  }
+}
+
+/**
+ * @brief  AUDIO_GainRamp_f32
+ *         Scale interleaved stereo float frames by a gain moving linearly
+ *         from one value to another, src and dst may alias
+ * @param  src: input frames
+ * @param  dst: output frames
+ * @param  frames: number of stereo frames, at most span
+ * @param  from: gain before the first frame
+ * @param  to: gain reached on frame span - 1
+ * @param  span: length of the ramp, frames
+ * @retval None
+ */
+void AUDIO_GainRamp_f32(const float *src, float *dst, uint32_t frames, AUDIO_GainTypeDef from,
+                        AUDIO_GainTypeDef to, uint32_t span) {
+  float g = AUDIO_GainToFloat(from);
+  float last = AUDIO_GainToFloat(to);
+  float step = (last - g) / (float)span;
+
+  for (uint32_t i = 1U; i <= frames; i++) {
+    /* Recomputed from the start, the last frame lands on the target exactly */
+    float gi = i == span ? last : g + step * (float)i;
+    dst[0] = src[0] * gi;
+    dst[1] = src[1] * gi;
+    src += 2;
+    dst += 2;
+  }
+}
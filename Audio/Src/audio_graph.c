@@ -0,0 +1,154 @@
+/**
+ ******************************************************************************
+ * @file    audio_graph.c
+ * @brief   Static chain of in-place float stages for the playback path.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  The stages are assembled once, in processing order, from callbacks
+ *  and the state they work on; nothing is allocated. Every stage works
+ *  in place on the same block of interleaved stereo floats, so adding,
+ *  moving or bypassing one is a change to the assembly only.
+ *
+ *  A stage runs when it is neither bypassed nor idle, as told by its
+ *  optional active callback, and the worst case cost of each is kept
+ *  per stage. The caller converts to float on the way in and can skip
+ *  the graph while AUDIO_GraphActive says no stage would touch the
+ *  block, keeping its integer samples as they are.
+ *
+ *  Edge stages are the ones that only matter when the block is in float
+ *  at all: an analyzer tap, the requantization back to the output word.
+ *  They run whenever the graph runs but never make it run, so the
+ *  integer fast path stays open while every other stage is idle.
+ *
+ *  Cycles are counted with AUDIO_GRAPH_CYCLES, the DWT cycle counter on
+ *  target; a host build can define its own before compiling this file.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_graph.h"
+
+#include <string.h>
+
+#ifndef AUDIO_GRAPH_CYCLES
+#include "stm32h7xx.h"
+#define AUDIO_GRAPH_CYCLES()                          (DWT->CYCCNT)
+#endif /* AUDIO_GRAPH_CYCLES */
+
+/**
+ * @brief  AUDIO_GraphInit
+ *         Start with no stage
+ * @param  graph: graph instance
+ * @retval None
+ */
+void AUDIO_GraphInit(AUDIO_GraphTypeDef *graph) {
+  (void)memset(graph, 0, sizeof(*graph));
+}
+
+/**
+ * @brief  AUDIO_GraphAdd
+ *         Append a stage, not bypassed
+ * @param  graph: graph instance
+ * @param  id: identifier for AUDIO_GraphFind
+ * @param  process: block callback
+ * @param  active: NULL, or tells whether the stage would change the block
+ * @param  ctx: state handed to both callbacks
+ * @retval the stage, NULL when the graph is full
+ */
+AUDIO_StageTypeDef *AUDIO_GraphAdd(AUDIO_GraphTypeDef *graph, uint8_t id, AUDIO_StageProcessTypeDef process,
+                                   AUDIO_StageActiveTypeDef active, void *ctx) {
+  AUDIO_StageTypeDef *stage;
+
+  if (graph->count >= AUDIO_GRAPH_STAGES_MAX) {
+    return NULL;
+  }
+
+  stage = &graph->stage[graph->count++];
+  stage->id = id;
+  stage->bypass = 0U;
+  stage->process = process;
+  stage->active = active;
+  stage->edge = 0U;
+  stage->ctx = ctx;
+  stage->cycles = 0U;
+  return stage;
+}
+
+/**
+ * @brief  AUDIO_GraphAddEdge
+ *         Append an edge stage: runs on every block that goes through the
+ *         graph, unless bypassed, but is left out of AUDIO_GraphActive
+ * @param  graph: graph instance
+ * @param  id: identifier for AUDIO_GraphFind
+ * @param  process: block callback
+ * @param  ctx: state handed to the callback
+ * @retval the stage, NULL when the graph is full
+ */
+AUDIO_StageTypeDef *AUDIO_GraphAddEdge(AUDIO_GraphTypeDef *graph, uint8_t id, AUDIO_StageProcessTypeDef process,
+                                       void *ctx) {
+  AUDIO_StageTypeDef *stage = AUDIO_GraphAdd(graph, id, process, NULL, ctx);
+
+  if (stage != NULL) {
+    stage->edge = 1U;
+  }
+  return stage;
+}
+
+/**
+ * @brief  AUDIO_GraphFind
+ *         Look a stage up by identifier
+ * @param  graph: graph instance
+ * @param  id: identifier given to AUDIO_GraphAdd
+ * @retval the stage, NULL when there is none
+ */
+AUDIO_StageTypeDef *AUDIO_GraphFind(AUDIO_GraphTypeDef *graph, uint8_t id) {
+  for (uint32_t i = 0U; i < graph->count; i++) {
+    if (graph->stage[i].id == id) {
+      return &graph->stage[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief  AUDIO_GraphActive
+ *         Whether any stage other than an edge would run on the next block
+ * @param  graph: graph instance
+ * @retval 0 when the block can bypass the graph
+ */
+uint8_t AUDIO_GraphActive(const AUDIO_GraphTypeDef *graph) {
+  for (uint32_t i = 0U; i < graph->count; i++) {
+    if (graph->stage[i].edge == 0U && AUDIO_StageRuns(&graph->stage[i]) != 0U) {
+      return 1U;
+    }
+  }
+  return 0U;
+}
+
+/**
+ * @brief  AUDIO_GraphProcess_f32
+ *         Run the stages in order over a block, in place
+ * @param  graph: graph instance
+ * @param  frames: interleaved stereo samples, full scale +-1
+ * @param  n: number of frames
+ * @retval None
+ */
+void AUDIO_GraphProcess_f32(AUDIO_GraphTypeDef *graph, float32_t *frames, uint32_t n) {
+  for (uint32_t i = 0U; i < graph->count; i++) {
+    AUDIO_StageTypeDef *stage = &graph->stage[i];
+    uint32_t cycles;
+
+    if (AUDIO_StageRuns(stage) == 0U) {
+      continue;
+    }
+
+    cycles = AUDIO_GRAPH_CYCLES();
+    stage->process(stage->ctx, frames, n);
+    cycles = AUDIO_GRAPH_CYCLES() - cycles;
+    if (cycles > stage->cycles) {
+      stage->cycles = cycles;
+    }
+  }
+}
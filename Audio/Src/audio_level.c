@@ -0,0 +1,362 @@
+/**
+ ******************************************************************************
+ * @file    audio_level.c
+ * @brief   Peak, RMS and clip metering of the playback output.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  Every finished I2S block is metered once, in the same loop for all
+ *  three measures, while it is still in the cache: per channel the sum of
+ *  squares, the largest and the smallest sample. The sums and peaks of
+ *  the last AUDIO_LEVEL_WINDOW blocks are kept, so the window slides by
+ *  adding the new block and dropping the oldest one instead of summing it
+ *  again; the window peak is only searched again when the block that held
+ *  it leaves.
+ *
+ *  The kernel works on packed L/R pairs: two frames are regrouped into an
+ *  L pair and an R pair, each squared and accumulated by one dual 16-bit
+ *  MAC into a 64-bit sum, and the lanes track their maximum and minimum
+ *  with a dual subtract and select. 24/32-bit samples are metered on
+ *  their top 16 bits, packed by one halfword move per frame.
+ *
+ *  The same loop writes the first channel to the analyzer FIFO, whose
+ *  integer edge reads the same block: the bottom lane of each packed
+ *  frame is the 16-bit sample it takes. With the FIFO reserved up front
+ *  and committed after the loop, the finished block is read once for
+ *  both, whichever of the four output paths (16 or 24/32-bit, straight
+ *  or through the float graph) produced it.
+ *
+ *  A block that reaches full scale on a channel counts as one clip.
+ *
+ *  The result is published as a snapshot under a sequence counter: the
+ *  writer makes it odd while it updates the snapshot, a reader in thread
+ *  mode copies the snapshot and retries if the counter was odd or moved.
+ *  Readers at the interrupt priority of the writer never see it odd.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_level.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "arm_math.h"
+
+#ifndef AUDIO_LEVEL_BARRIER
+#include "stm32h7xx.h"
+#define AUDIO_LEVEL_BARRIER()                         __DMB()
+#endif /* AUDIO_LEVEL_BARRIER */
+
+/**
+ * @brief  AUDIO_LevelPush
+ *         Slide the window over one metered block and publish the result
+ * @param  level: level meter instance
+ * @param  hi: largest sample of each channel, q15
+ * @param  lo: smallest sample of each channel, q15
+ * @param  sum: sum of squares of each channel, q30
+ * @param  n: frames of the block
+ * @retval None
+ */
+static void AUDIO_LevelPush(AUDIO_LevelTypeDef *level, const int32_t *hi, const int32_t *lo, const uint64_t *sum,
+                            uint32_t n) {
+  uint32_t pos = level->pos;
+  uint8_t clip[AUDIO_LEVEL_CHANNELS];
+  float32_t rms;
+
+  level->total_frames += n - level->frames[pos];
+  level->frames[pos] = (uint16_t)n;
+
+  for (uint32_t ch = 0U; ch < AUDIO_LEVEL_CHANNELS; ch++) {
+    uint16_t peak = (uint16_t)(hi[ch] > -lo[ch] ? hi[ch] : -lo[ch]);
+    uint16_t old = level->peak[pos][ch];
+
+    level->total[ch] += sum[ch] - level->sum[pos][ch];
+    level->sum[pos][ch] = sum[ch];
+    level->peak[pos][ch] = peak;
+
+    if (peak >= level->max[ch]) {
+      level->max[ch] = peak;
+    } else if (old == level->max[ch]) {
+      /* The block that held the window peak has left */
+      level->max[ch] = peak;
+      for (uint32_t i = 0U; i < AUDIO_LEVEL_WINDOW; i++) {
+        if (level->peak[i][ch] > level->max[ch]) {
+          level->max[ch] = level->peak[i][ch];
+        }
+      }
+    }
+
+    clip[ch] = (uint8_t)(hi[ch] >= INT16_MAX || lo[ch] <= -INT16_MAX);
+  }
+  level->pos = (pos + 1U) & AUDIO_LEVEL_WINDOW_MASK;
+
+  level->seq++;
+  AUDIO_LEVEL_BARRIER();
+  for (uint32_t ch = 0U; ch < AUDIO_LEVEL_CHANNELS; ch++) {
+    level->snap.peak[ch] = level->max[ch];
+    (void)arm_sqrt_f32((float32_t)level->total[ch] / (float32_t)level->total_frames, &rms);
+    level->snap.rms[ch] = (uint16_t)(rms < 32768.0f ? rms : 32768.0f);
+    level->snap.clips[ch] += clip[ch];
+  }
+  level->snap.blocks++;
+  AUDIO_LEVEL_BARRIER();
+  level->seq++;
+}
+
+#if defined(ARM_MATH_DSP)
+/**
+ * @brief  AUDIO_LevelPair
+ *         Meter two packed L/R frames
+ * @param  x0, x1: consecutive frames, L in the bottom halfword
+ * @param  hi, lo: per-lane running maximum and minimum, packed
+ * @param  sl, sr: running sums of squares
+ * @retval None
+ */
+static inline void AUDIO_LevelPair(uint32_t x0, uint32_t x1, uint32_t *hi, uint32_t *lo, uint64_t *sl,
+                                   uint64_t *sr) {
+  uint32_t l = __PKHBT(x0, x1, 16);
+  uint32_t r = __PKHTB(x1, x0, 16);
+
+  *sl = __SMLALD(l, l, *sl);
+  *sr = __SMLALD(r, r, *sr);
+
+  /* GE flags from the dual subtract pick the lanes for the select */
+  (void)__SSUB16(x0, *hi);
+  *hi = __SEL(x0, *hi);
+  (void)__SSUB16(x1, *hi);
+  *hi = __SEL(x1, *hi);
+  (void)__SSUB16(*lo, x0);
+  *lo = __SEL(x0, *lo);
+  (void)__SSUB16(*lo, x1);
+  *lo = __SEL(x1, *lo);
+}
+
+/**
+ * @brief  AUDIO_LevelFinish
+ *         Unpack the lanes of a metered block and push it
+ * @param  level: level meter instance
+ * @param  hi, lo: per-lane maximum and minimum, packed
+ * @param  sl, sr: sums of squares
+ * @param  n: frames of the block
+ * @retval None
+ */
+static void AUDIO_LevelFinish(AUDIO_LevelTypeDef *level, uint32_t hi, uint32_t lo, uint64_t sl, uint64_t sr,
+                              uint32_t n) {
+  int32_t max[AUDIO_LEVEL_CHANNELS] = {(int16_t)hi, (int16_t)(hi >> 16)};
+  int32_t min[AUDIO_LEVEL_CHANNELS] = {(int16_t)lo, (int16_t)(lo >> 16)};
+  uint64_t sum[AUDIO_LEVEL_CHANNELS] = {sl, sr};
+
+  AUDIO_LevelPush(level, max, min, sum, n);
+}
+#endif /* ARM_MATH_DSP */
+
+/**
+ * @brief  AUDIO_LevelInit
+ *         Clear the window and the clip counters
+ * @param  level: level meter instance
+ * @retval None
+ */
+void AUDIO_LevelInit(AUDIO_LevelTypeDef *level) {
+  (void)memset(level, 0, sizeof(*level));
+}
+
+/**
+ * @brief  AUDIO_LevelReset
+ *         Clear the window when the stream stops, the clip and block
+ *         counters keep running
+ * @param  level: level meter instance
+ * @retval None
+ */
+void AUDIO_LevelReset(AUDIO_LevelTypeDef *level) {
+  (void)memset(level->sum, 0, sizeof(level->sum));
+  (void)memset(level->peak, 0, sizeof(level->peak));
+  (void)memset(level->frames, 0, sizeof(level->frames));
+  (void)memset(level->total, 0, sizeof(level->total));
+  (void)memset(level->max, 0, sizeof(level->max));
+  level->total_frames = 0U;
+  level->pos = 0U;
+
+  level->seq++;
+  AUDIO_LEVEL_BARRIER();
+  (void)memset(level->snap.peak, 0, sizeof(level->snap.peak));
+  (void)memset(level->snap.rms, 0, sizeof(level->snap.rms));
+  AUDIO_LEVEL_BARRIER();
+  level->seq++;
+}
+
+/**
+ * @brief  AUDIO_LevelTapStart
+ *         Reserve room in the tap for the first channel of a block
+ * @param  tap: analyzer FIFO, NULL when not fed
+ * @param  n: number of frames
+ * @param  wr: where the block goes in the tap
+ * @retval n when the block is written to the tap, 0 otherwise
+ */
+static uint32_t AUDIO_LevelTapStart(AUDIO_FifoTypeDef *tap, uint32_t n, uint32_t *wr) {
+  if (tap == NULL) {
+    *wr = 0U;
+    return 0U;
+  }
+  *wr = tap->wr;
+  return AUDIO_FifoReserve(tap, n);
+}
+
+/**
+ * @brief  AUDIO_LevelBlock_q15
+ *         Meter a block of interleaved stereo int16 frames, and write its
+ *         first channel to the analyzer tap in the same loop
+ * @param  level: level meter instance
+ * @param  frames: block, 32-bit aligned
+ * @param  n: number of stereo frames, at most UINT16_MAX
+ * @param  tap: analyzer FIFO, NULL to meter only
+ * @retval None
+ */
+void AUDIO_LevelBlock_q15(AUDIO_LevelTypeDef *level, const int16_t *frames, uint32_t n, AUDIO_FifoTypeDef *tap) {
+  const uint32_t *in = (const uint32_t *)frames;
+  uint64_t sl = 0U;
+  uint64_t sr = 0U;
+  uint32_t wr;
+  uint32_t room = AUDIO_LevelTapStart(tap, n, &wr);
+
+#if defined(ARM_MATH_DSP)
+  uint32_t hi = 0x80008000U;
+  uint32_t lo = 0x7FFF7FFFU;
+  uint32_t i;
+
+  for (i = 0U; i + 2U <= n; i += 2U) {
+    uint32_t x0 = in[i];
+    uint32_t x1 = in[i + 1U];
+
+    AUDIO_LevelPair(x0, x1, &hi, &lo, &sl, &sr);
+    if (room != 0U) {
+      tap->buf[(wr + i) & AUDIO_FIFO_MASK] = (int16_t)x0;
+      tap->buf[(wr + i + 1U) & AUDIO_FIFO_MASK] = (int16_t)x1;
+    }
+  }
+  if (i < n) {
+    /* Paired with silence, which moves neither the sums nor the peak */
+    AUDIO_LevelPair(in[i], 0U, &hi, &lo, &sl, &sr);
+    if (room != 0U) {
+      tap->buf[(wr + i) & AUDIO_FIFO_MASK] = (int16_t)in[i];
+    }
+  }
+  AUDIO_LevelFinish(level, hi, lo, sl, sr, n);
+#else
+  int32_t max[AUDIO_LEVEL_CHANNELS] = {INT16_MIN, INT16_MIN};
+  int32_t min[AUDIO_LEVEL_CHANNELS] = {INT16_MAX, INT16_MAX};
+  uint64_t sum[AUDIO_LEVEL_CHANNELS];
+
+  for (uint32_t i = 0U; i < n; i++) {
+    int32_t l = (int16_t)in[i];
+    int32_t r = (int16_t)(in[i] >> 16);
+
+    sl += (uint64_t)(l * l);
+    sr += (uint64_t)(r * r);
+    max[0] = l > max[0] ? l : max[0];
+    min[0] = l < min[0] ? l : min[0];
+    max[1] = r > max[1] ? r : max[1];
+    min[1] = r < min[1] ? r : min[1];
+    if (room != 0U) {
+      tap->buf[(wr + i) & AUDIO_FIFO_MASK] = (int16_t)l;
+    }
+  }
+  sum[0] = sl;
+  sum[1] = sr;
+  AUDIO_LevelPush(level, max, min, sum, n);
+#endif /* ARM_MATH_DSP */
+
+  if (room != 0U) {
+    AUDIO_FifoCommit(tap, room);
+  }
+}
+
+/**
+ * @brief  AUDIO_LevelBlock_q31
+ *         Meter a block of interleaved stereo q31 frames on their top
+ *         16 bits, and write those of its first channel to the analyzer
+ *         tap in the same loop
+ * @param  level: level meter instance
+ * @param  frames: block
+ * @param  n: number of stereo frames, at most UINT16_MAX
+ * @param  tap: analyzer FIFO, NULL to meter only
+ * @retval None
+ */
+void AUDIO_LevelBlock_q31(AUDIO_LevelTypeDef *level, const int32_t *frames, uint32_t n, AUDIO_FifoTypeDef *tap) {
+  uint64_t sl = 0U;
+  uint64_t sr = 0U;
+  uint32_t wr;
+  uint32_t room = AUDIO_LevelTapStart(tap, n, &wr);
+
+#if defined(ARM_MATH_DSP)
+  uint32_t hi = 0x80008000U;
+  uint32_t lo = 0x7FFF7FFFU;
+  uint32_t i;
+
+  /* The top halfword of L moves under the top halfword of R */
+  for (i = 0U; i + 2U <= n; i += 2U) {
+    uint32_t x0 = __PKHTB((uint32_t)frames[i * 2U + 1U], (uint32_t)frames[i * 2U], 16);
+    uint32_t x1 = __PKHTB((uint32_t)frames[i * 2U + 3U], (uint32_t)frames[i * 2U + 2U], 16);
+
+    AUDIO_LevelPair(x0, x1, &hi, &lo, &sl, &sr);
+    if (room != 0U) {
+      tap->buf[(wr + i) & AUDIO_FIFO_MASK] = (int16_t)x0;
+      tap->buf[(wr + i + 1U) & AUDIO_FIFO_MASK] = (int16_t)x1;
+    }
+  }
+  if (i < n) {
+    uint32_t x0 = __PKHTB((uint32_t)frames[i * 2U + 1U], (uint32_t)frames[i * 2U], 16);
+
+    AUDIO_LevelPair(x0, 0U, &hi, &lo, &sl, &sr);
+    if (room != 0U) {
+      tap->buf[(wr + i) & AUDIO_FIFO_MASK] = (int16_t)x0;
+    }
+  }
+  AUDIO_LevelFinish(level, hi, lo, sl, sr, n);
+#else
+  int32_t max[AUDIO_LEVEL_CHANNELS] = {INT16_MIN, INT16_MIN};
+  int32_t min[AUDIO_LEVEL_CHANNELS] = {INT16_MAX, INT16_MAX};
+  uint64_t sum[AUDIO_LEVEL_CHANNELS];
+
+  for (uint32_t i = 0U; i < n; i++) {
+    int32_t l = frames[i * 2U] >> 16;
+    int32_t r = frames[i * 2U + 1U] >> 16;
+
+    sl += (uint64_t)(l * l);
+    sr += (uint64_t)(r * r);
+    max[0] = l > max[0] ? l : max[0];
+    min[0] = l < min[0] ? l : min[0];
+    max[1] = r > max[1] ? r : max[1];
+    min[1] = r < min[1] ? r : min[1];
+    if (room != 0U) {
+      tap->buf[(wr + i) & AUDIO_FIFO_MASK] = (int16_t)l;
+    }
+  }
+  sum[0] = sl;
+  sum[1] = sr;
+  AUDIO_LevelPush(level, max, min, sum, n);
+#endif /* ARM_MATH_DSP */
+
+  if (room != 0U) {
+    AUDIO_FifoCommit(tap, room);
+  }
+}
+
+/**
+ * @brief  AUDIO_LevelRead
+ *         Copy the last published snapshot, from any context
+ * @param  level: level meter instance
+ * @param  snap: copy of the snapshot
+ * @retval None
+ */
+void AUDIO_LevelRead(const AUDIO_LevelTypeDef *level, AUDIO_LevelSnapshotTypeDef *snap) {
+  uint32_t seq;
+
+  do {
+    seq = level->seq;
+    AUDIO_LEVEL_BARRIER();
+    *snap = level->snap;
+    AUDIO_LEVEL_BARRIER();
+  } while ((seq & 1U) != 0U || seq != level->seq);
+}
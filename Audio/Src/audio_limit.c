@@ -0,0 +1,169 @@
+/**
+ ******************************************************************************
+ * @file    audio_limit.c
+ * @brief   Lookahead brickwall limiter at the end of the playback DSP stage.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  The audio is delayed by the lookahead, window - 1 frames, while the
+ *  gain is computed from the undelayed input:
+ *
+ *   - the gain each frame needs to stay under the ceiling is taken from
+ *     the largest stereo-linked peak of the last window frames. A monotonic
+ *     deque holds the decreasing peaks of the window, so the maximum is
+ *     its front and each frame is pushed and popped at most once: O(1) per
+ *     frame whatever the window;
+ *   - the gain drops at once and recovers through a one-pole release;
+ *   - a moving average over the same window turns the drop into a ramp
+ *     that is complete when the peak leaves the delay line.
+ *
+ *  Every gain averaged for a delayed frame is at most the one that frame
+ *  needs, so the output never exceeds the ceiling. A final clamp only
+ *  catches the rounding of the running sum, which is recomputed once per
+ *  window.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_limit.h"
+#include "audio_gain.h"
+
+#include <string.h>
+
+/**
+ * @brief  AUDIO_LimitInit
+ *         Start with the default settings, off unless AUDIO_LIMIT_ON_DEFAULT
+ * @param  lim: limiter instance
+ * @param  freq: sampling frequency, Hz
+ * @retval None
+ */
+void AUDIO_LimitInit(AUDIO_LimitTypeDef *lim, uint32_t freq) {
+  lim->on = AUDIO_LIMIT_ON_DEFAULT;
+  (void)AUDIO_LimitConfig(lim, freq, AUDIO_LIMIT_CEILING_DEFAULT, AUDIO_LIMIT_ATTACK_US_DEFAULT,
+                          AUDIO_LIMIT_RELEASE_MS_DEFAULT);
+}
+
+/**
+ * @brief  AUDIO_LimitReset
+ *         Empty the delay line and restart at unity gain, between streams
+ * @param  lim: limiter instance
+ * @retval None
+ */
+void AUDIO_LimitReset(AUDIO_LimitTypeDef *lim) {
+  (void)memset(lim->delay, 0, sizeof(lim->delay));
+  for (uint32_t i = 0U; i < lim->window; i++) {
+    lim->box[i] = 1.0f;
+  }
+  lim->sum = (float32_t)lim->window;
+  lim->gain = 1.0f;
+  lim->pos = 0U;
+  lim->head = 0U;
+  lim->tail = 0U;
+  lim->box_idx = 0U;
+}
+
+/**
+ * @brief  AUDIO_LimitConfig
+ *         Apply new settings, or the current ones at a new sampling
+ *         frequency. Restarts the limiter.
+ * @param  lim: limiter instance
+ * @param  freq: sampling frequency, Hz
+ * @param  ceiling_db: output ceiling, 8.8 dBFS, AUDIO_LIMIT_CEILING_MIN..AUDIO_LIMIT_CEILING_MAX
+ * @param  attack_us: lookahead, up to AUDIO_LIMIT_ATTACK_US_MAX
+ * @param  release_ms: recovery time constant, AUDIO_LIMIT_RELEASE_MS_MIN..AUDIO_LIMIT_RELEASE_MS_MAX
+ * @retval 0 if refused: out of range
+ */
+uint8_t AUDIO_LimitConfig(AUDIO_LimitTypeDef *lim, uint32_t freq, int16_t ceiling_db, uint16_t attack_us,
+                          uint16_t release_ms) {
+  if (ceiling_db < AUDIO_LIMIT_CEILING_MIN || ceiling_db > AUDIO_LIMIT_CEILING_MAX ||
+      attack_us > AUDIO_LIMIT_ATTACK_US_MAX || release_ms < AUDIO_LIMIT_RELEASE_MS_MIN ||
+      release_ms > AUDIO_LIMIT_RELEASE_MS_MAX) {
+    return 0U;
+  }
+
+  lim->ceiling_db = ceiling_db;
+  lim->attack_us = attack_us;
+  lim->release_ms = release_ms;
+
+  lim->ceiling = AUDIO_GainToFloat(AUDIO_GainFromVolume(ceiling_db));
+  lim->release = 1000.0f / ((float32_t)release_ms * (float32_t)freq);
+  lim->window = (uint32_t)(((uint64_t)attack_us * freq) / 1000000U) + 1U;
+  lim->inv_window = 1.0f / (float32_t)lim->window;
+
+  AUDIO_LimitReset(lim);
+  return 1U;
+}
+
+/**
+ * @brief  AUDIO_LimitProcess_f32
+ *         Limit a block in place, delayed by AUDIO_LimitLatency
+ * @param  lim: limiter instance
+ * @param  frames: interleaved stereo samples, full scale +-1
+ * @param  n: number of frames
+ * @retval None
+ */
+void AUDIO_LimitProcess_f32(AUDIO_LimitTypeDef *lim, float32_t *frames, uint32_t n) {
+  const float32_t ceiling = lim->ceiling;
+  uint32_t pos = lim->pos;
+  uint32_t head = lim->head;
+  uint32_t tail = lim->tail;
+  uint32_t bi = lim->box_idx;
+  float32_t gain = lim->gain;
+  float32_t sum = lim->sum;
+
+  for (uint32_t i = 0U; i < n; i++) {
+    float32_t l = frames[2U * i];
+    float32_t r = frames[2U * i + 1U];
+    float32_t peak = fabsf(l) > fabsf(r) ? fabsf(l) : fabsf(r);
+    float32_t need;
+    float32_t g;
+    uint32_t rd;
+
+    /* Sliding maximum: drop the peaks the new one hides, then the one that left the window */
+    while (tail != head && lim->dq_peak[(tail - 1U) & AUDIO_LIMIT_WINDOW_MASK] <= peak) {
+      tail--;
+    }
+    lim->dq_peak[tail & AUDIO_LIMIT_WINDOW_MASK] = peak;
+    lim->dq_pos[tail & AUDIO_LIMIT_WINDOW_MASK] = pos;
+    tail++;
+    if (pos - lim->dq_pos[head & AUDIO_LIMIT_WINDOW_MASK] >= lim->window) {
+      head++;
+    }
+    peak = lim->dq_peak[head & AUDIO_LIMIT_WINDOW_MASK];
+
+    need = peak > ceiling ? ceiling / peak : 1.0f;
+    gain = need < gain ? need : gain + (need - gain) * lim->release;
+
+    sum += gain - lim->box[bi];
+    lim->box[bi] = gain;
+    g = sum * lim->inv_window;
+
+    /* Delay line of window - 1 frames: the oldest frame sits right after the newest */
+    lim->delay[2U * bi] = l;
+    lim->delay[2U * bi + 1U] = r;
+    rd = bi + 1U == lim->window ? 0U : bi + 1U;
+    l = lim->delay[2U * rd] * g;
+    r = lim->delay[2U * rd + 1U] * g;
+
+    frames[2U * i] = l > ceiling ? ceiling : (l < -ceiling ? -ceiling : l);
+    frames[2U * i + 1U] = r > ceiling ? ceiling : (r < -ceiling ? -ceiling : r);
+
+    bi = rd;
+    pos++;
+    if (bi == 0U) {
+      /* Bound the rounding of the running sum */
+      sum = 0.0f;
+      for (uint32_t k = 0U; k < lim->window; k++) {
+        sum += lim->box[k];
+      }
+    }
+  }
+
+  lim->pos = pos;
+  lim->head = head;
+  lim->tail = tail;
+  lim->box_idx = bi;
+  lim->gain = gain;
+  lim->sum = sum;
+}
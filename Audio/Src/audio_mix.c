@@ -0,0 +1,117 @@
+/**
+ ******************************************************************************
+ * @file    audio_mix.c
+ * @brief   Multichannel to stereo downmix matrix over interleaved Q15 frames.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  Each output sample is the dot product of one input frame with a row of
+ *  the matrix. With the coefficients stored by pairs in the order of the
+ *  samples, one word load fetches two input channels and one dual 16-bit
+ *  multiply-accumulate (SMLALD) weights both: a 6-channel frame costs
+ *  three loads and six SMLALD for the two outputs.
+ *
+ *  The accumulator is 64 bits wide: six full-scale products at unity gain
+ *  overflow 32 bits. The sum is saturated once, on the way out.
+ *
+ *  Coefficients come from the UAC mixer controls, in 1/256 dB, through the
+ *  volume table of audio_gain.c.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_mix.h"
+#include "audio_gain.h"
+
+#include <string.h>
+
+#include "arm_math.h"
+
+/**
+ * @brief  AUDIO_MixInit
+ *         Clear the matrix for an input width, every crosspoint silent
+ * @param  mix: matrix instance
+ * @param  channels: input channels, even, at most AUDIO_MIX_CHANNELS_MAX
+ * @retval None
+ */
+void AUDIO_MixInit(AUDIO_MixTypeDef *mix, uint8_t channels) {
+  (void)memset(mix->coef, 0, sizeof(mix->coef));
+  mix->channels = channels;
+}
+
+/**
+ * @brief  AUDIO_MixSetGain
+ *         Set one crosspoint of the matrix
+ * @param  mix: matrix instance
+ * @param  in: input channel, from 0
+ * @param  out: output channel, 0 for left, 1 for right
+ * @param  volume: 8.8 dB as in the UAC mixer control, AUDIO_MIX_DB_SILENCE for none
+ * @retval None
+ */
+void AUDIO_MixSetGain(AUDIO_MixTypeDef *mix, uint32_t in, uint32_t out, int16_t volume) {
+  AUDIO_GainTypeDef gain = AUDIO_GainFromVolume(volume);
+  uint32_t *pair = &mix->coef[out][in / 2U];
+  uint32_t coef = 0U;
+  uint32_t sh = (in & 1U) * 16U;
+
+  if (volume != AUDIO_MIX_DB_SILENCE) {
+    coef = gain.shift != 0U ? ((uint32_t)gain.mant + (1UL << (gain.shift - 1U))) >> gain.shift
+                            : (uint32_t)gain.mant;
+  }
+  *pair = (*pair & ~(0xFFFFUL << sh)) | (coef << sh);
+}
+
+/**
+ * @brief  AUDIO_MixDown_q15
+ *         Downmix interleaved frames to stereo
+ * @param  src: frames of mix->channels samples, 32-bit aligned
+ * @param  dst: stereo frames, 32-bit aligned, must not alias src
+ * @param  frames: number of frames
+ * @param  mix: matrix
+ * @retval None
+ */
+void AUDIO_MixDown_q15(const int16_t *src, int16_t *dst, uint32_t frames, const AUDIO_MixTypeDef *mix) {
+  const uint32_t *in = (const uint32_t *)src;
+  uint32_t *out = (uint32_t *)dst;
+  const uint32_t *cl = mix->coef[0];
+  const uint32_t *cr = mix->coef[1];
+  uint32_t pairs = mix->channels / 2U;
+  int64_t l;
+  int64_t r;
+
+  while (frames > 0U) {
+#if defined(ARM_MATH_DSP)
+    uint32_t x0 = in[0];
+    uint32_t x1 = in[1];
+
+    l = (int64_t)__SMLALD(x0, cl[0], 0x4000);
+    r = (int64_t)__SMLALD(x0, cr[0], 0x4000);
+    l = (int64_t)__SMLALD(x1, cl[1], (uint64_t)l);
+    r = (int64_t)__SMLALD(x1, cr[1], (uint64_t)r);
+    if (pairs == 3U) {
+      uint32_t x2 = in[2];
+      l = (int64_t)__SMLALD(x2, cl[2], (uint64_t)l);
+      r = (int64_t)__SMLALD(x2, cr[2], (uint64_t)r);
+    }
+#else
+    l = 0x4000;
+    r = 0x4000;
+    for (uint32_t p = 0U; p < pairs; p++) {
+      int32_t lo = (int16_t)in[p];
+      int32_t hi = (int16_t)(in[p] >> 16);
+      l += (int64_t)lo * (int16_t)cl[p] + (int64_t)hi * (int16_t)(cl[p] >> 16);
+      r += (int64_t)lo * (int16_t)cr[p] + (int64_t)hi * (int16_t)(cr[p] >> 16);
+    }
+#endif /* ARM_MATH_DSP */
+
+    l >>= 15;
+    r >>= 15;
+    l = l > INT16_MAX ? INT16_MAX : (l < INT16_MIN ? INT16_MIN : l);
+    r = r > INT16_MAX ? INT16_MAX : (r < INT16_MIN ? INT16_MIN : r);
+    *out++ = ((uint32_t)l & 0xFFFFU) | ((uint32_t)r << 16);
+
+    in += pairs;
+    frames--;
+  }
+}
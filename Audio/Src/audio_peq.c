@@ -0,0 +1,196 @@
+/**
+ ******************************************************************************
+ * @file    audio_peq.c
+ * @brief   Per-channel parametric EQ with host-uploaded biquad coefficients.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  Each channel runs its own cascade of up to AUDIO_PEQ_BANDS_MAX biquads
+ *  through the CMSIS transposed direct form II kernel. The coefficients
+ *  are designed on the host and uploaded band by band in CMSIS order,
+ *  {b0, b1, b2, a1, a2} with the feedback terms negated.
+ *
+ *  Uploads never touch the coefficients in use: they land in a staging
+ *  bank, and AUDIO_PeqCommit only marks it pending. The audio path swaps
+ *  banks at the start of its next block, so a block always runs one
+ *  complete set, then copies the new set back into staging so the next
+ *  upload edits it rather than the one it replaced.
+ *
+ *  Filter state carries over the swap for the bands that were already
+ *  running, bands that start running begin from silence.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_peq.h"
+
+#include <string.h>
+
+/**
+ * @brief  AUDIO_PeqFinite
+ *         Whether a coefficient is a finite number
+ * @param  x: coefficient
+ * @retval 0 for infinities and NaNs
+ */
+static inline uint8_t AUDIO_PeqFinite(float32_t x) {
+  return (uint8_t)(x - x == 0.0f);
+}
+
+/**
+ * @brief  AUDIO_PeqInstall
+ *         Point the filter instances at the active bank
+ * @param  peq: EQ instance
+ * @retval None
+ */
+static void AUDIO_PeqInstall(AUDIO_PeqTypeDef *peq) {
+  for (uint32_t ch = 0U; ch < AUDIO_PEQ_CHANNELS; ch++) {
+    arm_biquad_cascade_df2T_init_f32(&peq->eq[ch], peq->bands[peq->active][ch], peq->coef[peq->active][ch],
+                                     peq->state[ch]);
+  }
+}
+
+/**
+ * @brief  AUDIO_PeqInit
+ *         Start with no band on either channel
+ * @param  peq: EQ instance
+ * @retval None
+ */
+void AUDIO_PeqInit(AUDIO_PeqTypeDef *peq) {
+  (void)memset(peq->coef, 0, sizeof(peq->coef));
+  (void)memset(peq->bands, 0, sizeof(peq->bands));
+  peq->active = 0U;
+  peq->pending = 0U;
+  AUDIO_PeqInstall(peq);
+  AUDIO_PeqReset(peq);
+}
+
+/**
+ * @brief  AUDIO_PeqReset
+ *         Clear the filter history, between streams
+ * @param  peq: EQ instance
+ * @retval None
+ */
+void AUDIO_PeqReset(AUDIO_PeqTypeDef *peq) {
+  (void)memset(peq->state, 0, sizeof(peq->state));
+}
+
+/**
+ * @brief  AUDIO_PeqSetBand
+ *         Write one band into the staging bank
+ * @param  peq: EQ instance
+ * @param  channel: 0 left, 1 right
+ * @param  band: 0..AUDIO_PEQ_BANDS_MAX - 1
+ * @param  coef: b0, b1, b2, a1, a2, feedback terms negated
+ * @retval 0 if refused: out of range, not finite or unstable
+ */
+uint8_t AUDIO_PeqSetBand(AUDIO_PeqTypeDef *peq, uint8_t channel, uint8_t band, const float32_t *coef) {
+  float32_t a1 = -coef[3];
+  float32_t a2 = -coef[4];
+
+  if (channel >= AUDIO_PEQ_CHANNELS || band >= AUDIO_PEQ_BANDS_MAX) {
+    return 0U;
+  }
+  if (AUDIO_PeqFinite(coef[0]) == 0U || AUDIO_PeqFinite(coef[1]) == 0U || AUDIO_PeqFinite(coef[2]) == 0U) {
+    return 0U;
+  }
+
+  /* Poles inside the unit circle; written so that NaNs fail too */
+  if (!(a2 < 1.0f && a2 > -1.0f && a1 < 1.0f + a2 && a1 > -(1.0f + a2))) {
+    return 0U;
+  }
+
+  (void)memcpy(&peq->coef[peq->active ^ 1U][channel][5U * band], coef, 5U * sizeof(float32_t));
+  return 1U;
+}
+
+/**
+ * @brief  AUDIO_PeqGetBand
+ *         Read one band of the bank in use
+ * @param  peq: EQ instance
+ * @param  channel: 0 left, 1 right
+ * @param  band: 0..AUDIO_PEQ_BANDS_MAX - 1
+ * @param  coef: b0, b1, b2, a1, a2, feedback terms negated
+ * @retval None
+ */
+void AUDIO_PeqGetBand(const AUDIO_PeqTypeDef *peq, uint8_t channel, uint8_t band, float32_t *coef) {
+  (void)memcpy(coef, &peq->coef[peq->active][channel][5U * band], 5U * sizeof(float32_t));
+}
+
+/**
+ * @brief  AUDIO_PeqCommit
+ *         Hand the staging bank to the audio path, from its next block on
+ * @param  peq: EQ instance
+ * @param  left: bands to run on the left channel, 0 to bypass it
+ * @param  right: bands to run on the right channel, 0 to bypass it
+ * @retval 0 if refused: too many bands
+ */
+uint8_t AUDIO_PeqCommit(AUDIO_PeqTypeDef *peq, uint8_t left, uint8_t right) {
+  uint8_t staging = peq->active ^ 1U;
+
+  if (left > AUDIO_PEQ_BANDS_MAX || right > AUDIO_PEQ_BANDS_MAX) {
+    return 0U;
+  }
+
+  peq->bands[staging][0] = left;
+  peq->bands[staging][1] = right;
+  peq->pending = 1U;
+  return 1U;
+}
+
+/**
+ * @brief  AUDIO_PeqSwap
+ *         Switch to the committed bank
+ * @param  peq: EQ instance
+ * @retval None
+ */
+static void AUDIO_PeqSwap(AUDIO_PeqTypeDef *peq) {
+  uint8_t old = peq->active;
+
+  peq->active = old ^ 1U;
+  for (uint32_t ch = 0U; ch < AUDIO_PEQ_CHANNELS; ch++) {
+    uint8_t was = peq->bands[old][ch];
+
+    if (peq->bands[peq->active][ch] > was) {
+      (void)memset(&peq->state[ch][2U * was], 0, 2U * (peq->bands[peq->active][ch] - was) * sizeof(float32_t));
+    }
+  }
+  AUDIO_PeqInstall(peq);
+
+  (void)memcpy(peq->coef[old], peq->coef[peq->active], sizeof(peq->coef[old]));
+  (void)memcpy(peq->bands[old], peq->bands[peq->active], sizeof(peq->bands[old]));
+  peq->pending = 0U;
+}
+
+/**
+ * @brief  AUDIO_PeqProcess_f32
+ *         Filter a block in place, after taking a pending bank
+ * @param  peq: EQ instance
+ * @param  frames: interleaved stereo samples
+ * @param  n: number of frames
+ * @retval None
+ */
+void AUDIO_PeqProcess_f32(AUDIO_PeqTypeDef *peq, float32_t *frames, uint32_t n) {
+  if (peq->pending != 0U) {
+    AUDIO_PeqSwap(peq);
+  }
+
+  for (uint32_t ch = 0U; ch < AUDIO_PEQ_CHANNELS; ch++) {
+    if (peq->eq[ch].numStages == 0U) {
+      continue;
+    }
+
+    for (uint32_t done = 0U; done < n; done += AUDIO_PEQ_CHUNK_FRAMES) {
+      uint32_t run = n - done < AUDIO_PEQ_CHUNK_FRAMES ? n - done : AUDIO_PEQ_CHUNK_FRAMES;
+      float32_t *x = &frames[done * 2U + ch];
+
+      for (uint32_t i = 0U; i < run; i++) {
+        peq->work[i] = x[i * 2U];
+      }
+      arm_biquad_cascade_df2T_f32(&peq->eq[ch], peq->work, peq->work, run);
+      for (uint32_t i = 0U; i < run; i++) {
+        x[i * 2U] = peq->work[i];
+      }
+    }
+  }
+}
@@ -0,0 +1,135 @@
+/**
+ ******************************************************************************
+ * @file    audio_ring.c
+ * @brief   Packet slot ring shared by the USB OUT endpoint and the I2S path.
+ ******************************************************************************
+ */
+
+#include "audio_ring.h"
+
+#include <string.h>
+
+#ifndef AUDIO_RING_BARRIER
+#include "stm32h7xx.h"
+#define AUDIO_RING_BARRIER()                          __DMB()
+#endif /* AUDIO_RING_BARRIER */
+
+/**
+ * @brief  AUDIO_RingReset
+ *         Drop all queued packets and rewind both cursors
+ * @param  ring: ring instance
+ * @retval None
+ */
+void AUDIO_RingReset(AUDIO_RingTypeDef *ring) {
+  ring->wr_slot = 0U;
+  ring->rd_slot = 0U;
+  ring->rd_off = 0U;
+  ring->wr_count = 0U;
+  ring->rd_count = 0U;
+  ring->overruns = 0U;
+}
+
+/**
+ * @brief  AUDIO_RingWriteSlot
+ *         Slot the next packet must be received into
+ * @param  ring: ring instance
+ * @retval pointer to AUDIO_RING_SLOT_SIZE bytes
+ */
+uint8_t *AUDIO_RingWriteSlot(AUDIO_RingTypeDef *ring) {
+  return ring->slot[ring->wr_slot & AUDIO_RING_SLOT_MASK];
+}
+
+/**
+ * @brief  AUDIO_RingCommit
+ *         Publish the packet received into the write slot.
+ *         The write slot must never be one the consumer can still reach,
+ *         so at most AUDIO_RING_SLOT_NUM - 1 slots are ever readable. When
+ *         the ring is full the packet is dropped and the slot reused.
+ * @param  ring: ring instance
+ * @param  len: packet length in bytes
+ * @retval 1 if the packet was queued, 0 if it was dropped
+ */
+uint8_t AUDIO_RingCommit(AUDIO_RingTypeDef *ring, uint16_t len) {
+  uint32_t wr_slot = ring->wr_slot;
+
+  if (len == 0U) {
+    return 1U;
+  }
+  if (wr_slot + 1U - ring->rd_slot > AUDIO_RING_SLOT_NUM - 1U) {
+    ring->overruns++;
+    return 0U;
+  }
+
+  ring->slot_len[wr_slot & AUDIO_RING_SLOT_MASK] = len;
+  AUDIO_RING_BARRIER();
+  ring->wr_count += len;
+  ring->wr_slot = wr_slot + 1U;
+
+  return 1U;
+}
+
+/**
+ * @brief  AUDIO_RingPeek
+ *         Contiguous readable run inside the current read slot
+ * @param  ring: ring instance
+ * @param  data: set to the first readable byte
+ * @retval number of contiguous bytes, 0 when the ring is empty
+ */
+uint16_t AUDIO_RingPeek(AUDIO_RingTypeDef *ring, uint8_t **data) {
+  uint32_t rd_slot = ring->rd_slot;
+
+  if (rd_slot == ring->wr_slot) {
+    return 0U;
+  }
+  AUDIO_RING_BARRIER();
+
+  *data = &ring->slot[rd_slot & AUDIO_RING_SLOT_MASK][ring->rd_off];
+  return ring->slot_len[rd_slot & AUDIO_RING_SLOT_MASK] - ring->rd_off;
+}
+
+/**
+ * @brief  AUDIO_RingConsume
+ *         Release bytes returned by AUDIO_RingPeek
+ * @param  ring: ring instance
+ * @param  len: bytes to release, at most the value AUDIO_RingPeek returned
+ * @retval None
+ */
+void AUDIO_RingConsume(AUDIO_RingTypeDef *ring, uint16_t len) {
+  uint32_t rd_slot = ring->rd_slot;
+
+  ring->rd_off += len;
+  ring->rd_count += len;
+  if (ring->rd_off >= ring->slot_len[rd_slot & AUDIO_RING_SLOT_MASK]) {
+    ring->rd_off = 0U;
+    AUDIO_RING_BARRIER();
+    ring->rd_slot = rd_slot + 1U;
+  }
+}
+
+/**
+ * @brief  AUDIO_RingRead
+ *         Copy out up to len bytes, crossing slot boundaries as needed
+ * @param  ring: ring instance
+ * @param  dst: destination buffer
+ * @param  len: bytes wanted
+ * @retval bytes copied
+ */
+uint32_t AUDIO_RingRead(AUDIO_RingTypeDef *ring, uint8_t *dst, uint32_t len) {
+  uint32_t done = 0U;
+  uint8_t *src;
+
+  while (done < len) {
+    uint16_t run = AUDIO_RingPeek(ring, &src);
+    if (run == 0U) {
+      break;
+    }
+    if (run > len - done) {
+      run = (uint16_t)(len - done);
+    }
+    memcpy(&dst[done], src, run);
+    AUDIO_RingConsume(ring, run);
+    done += run;
+  }
+
+  return done;
+}
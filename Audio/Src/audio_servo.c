@@ -0,0 +1,110 @@
+/**
+ ******************************************************************************
+ * @file    audio_servo.c
+ * @brief   PI rate servo behind the asynchronous feedback endpoint.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  The buffer fill integrates the difference between the host rate and
+ *  the I2S rate, so a proportional-only feedback leaves a standing fill
+ *  error proportional to the crystal offset and rings with the host's
+ *  reaction delay. Here the fill error goes through a short low-pass,
+ *  then a PI controller: the proportional term pulls the fill back to
+ *  the target, the integral term converges on the clock drift itself.
+ *
+ *  With the fill as a pure integrator the closed loop is second order,
+ *  so Kp = 2 * zeta * wn and Ki = wn^2 give the requested natural
+ *  frequency and damping. Everything runs in Q32 samples per frame.
+ *
+ *  Anti-windup: the integral only moves when the output is not saturated
+ *  or when the error would pull it back, and is clamped to the limit.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_servo.h"
+
+/* Natural frequency in rad per USB frame (1 ms) */
+#define AUDIO_SERVO_WN            (2.0 * 3.14159265358979 * AUDIO_SERVO_BW_MHZ / 1.0e6)
+/* Q32 correction per frame of fill error, and per frame of error per frame elapsed */
+#define AUDIO_SERVO_KP            ((int64_t)(2.0 * AUDIO_SERVO_DAMPING_PCT / 100.0 * AUDIO_SERVO_WN * 4294967296.0))
+#define AUDIO_SERVO_KI            ((int64_t)(AUDIO_SERVO_WN * AUDIO_SERVO_WN * 4294967296.0))
+
+/**
+ * @brief  AUDIO_ServoInit
+ *         Set the nominal rate and start from a zero drift estimate
+ * @param  servo: servo instance
+ * @param  freq: sampling frequency in Hz
+ * @retval None
+ */
+void AUDIO_ServoInit(AUDIO_ServoTypeDef *servo, uint32_t freq) {
+  servo->nominal = (int64_t)(((uint64_t)freq << 32) / 1000U);
+  servo->limit = servo->nominal / 1000000 * AUDIO_SERVO_LIMIT_PPM;
+  servo->integ = 0;
+  servo->error = 0;
+}
+
+/**
+ * @brief  AUDIO_ServoReset
+ *         Forget the fill history when the stream restarts. The drift
+ *         estimate is kept, the clocks have not changed.
+ * @param  servo: servo instance
+ * @retval None
+ */
+void AUDIO_ServoReset(AUDIO_ServoTypeDef *servo) {
+  servo->error = 0;
+}
+
+/**
+ * @brief  AUDIO_ServoSetNominal
+ *         Replace the nominal rate by a measured one, the loop then only
+ *         trims the fill around it
+ * @param  servo: servo instance
+ * @param  nominal: samples per frame, Q32
+ * @retval None
+ */
+void AUDIO_ServoSetNominal(AUDIO_ServoTypeDef *servo, int64_t nominal) {
+  servo->nominal = nominal;
+}
+
+/**
+ * @brief  AUDIO_ServoUpdate
+ *         Run one step of the loop
+ * @param  servo: servo instance
+ * @param  error: fill minus target, in frames
+ * @param  frames: USB frames elapsed since the previous update
+ * @param  frac_bits: fractional bits of the result, 14 for 10.14, 16 for 16.16
+ * @retval samples per frame to request from the host
+ */
+uint32_t AUDIO_ServoUpdate(AUDIO_ServoTypeDef *servo, int32_t error, uint32_t frames, uint32_t frac_bits) {
+  int64_t e;
+  int64_t p;
+  int64_t corr;
+
+  servo->error += (error * 65536 - servo->error) >> AUDIO_SERVO_FILTER_SHIFT;
+  e = servo->error;
+
+  p = (AUDIO_SERVO_KP * e) >> 16;
+  corr = p + servo->integ;
+
+  /* Integrate unless saturated in the direction the error pushes */
+  if (!((corr >= servo->limit && e > 0) || (corr <= -servo->limit && e < 0))) {
+    servo->integ += (AUDIO_SERVO_KI * (int64_t)frames * e) >> 16;
+    if (servo->integ > servo->limit) {
+      servo->integ = servo->limit;
+    } else if (servo->integ < -servo->limit) {
+      servo->integ = -servo->limit;
+    }
+    corr = p + servo->integ;
+  }
+
+  if (corr > servo->limit) {
+    corr = servo->limit;
+  } else if (corr < -servo->limit) {
+    corr = -servo->limit;
+  }
+
+  /* A fuller buffer asks the host for fewer samples */
+  return (uint32_t)((servo->nominal - corr + (1LL << (31U - frac_bits))) >> (32U - frac_bits));
+}
@@ -0,0 +1,112 @@
+/**
+ ******************************************************************************
+ * @file    audio_sofmeter.c
+ * @brief   USB frame period measurement against the I2S sample clock.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  A free-running timer latches its counter on every USB SOF through its
+ *  internal trigger input, so the timestamps do not depend on when the
+ *  SOF interrupt gets to run. The timer and the I2S kernel clock both come
+ *  from the HSE crystal, so the number of samples the I2S plays per timer
+ *  tick is an exact constant of the clock tree:
+ *
+ *      samples per frame = ticks per frame * i2s_clk / (i2s_div * tim_clk)
+ *
+ *  Ticks are summed over 2^AUDIO_SOFMETER_WINDOW_SHIFT frames, which puts
+ *  the +-1 tick capture quantization well under 0.1 ppm, then the result
+ *  goes through a first order low-pass to smooth the host SOF jitter.
+ *
+ *  Nothing here touches the hardware, captures can be replayed as is.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_sofmeter.h"
+
+#define AUDIO_SOFMETER_WINDOW                         (1UL << AUDIO_SOFMETER_WINDOW_SHIFT)
+#define AUDIO_SOFMETER_FNSOF_MASK                     0x3FFFU
+
+/**
+ * @brief  AUDIO_SofMeterInit
+ *         Set the clock ratio and forget any previous measurement
+ * @param  meter: meter instance
+ * @param  i2s_clk: I2S kernel clock, Hz
+ * @param  i2s_div: I2S kernel clock cycles per sample frame
+ * @param  tim_clk: capture timer clock, Hz
+ * @retval None
+ */
+void AUDIO_SofMeterInit(AUDIO_SofMeterTypeDef *meter, uint32_t i2s_clk, uint32_t i2s_div, uint32_t tim_clk) {
+  uint64_t den = (uint64_t)i2s_div * tim_clk;
+  uint64_t rem = i2s_clk;
+
+  /* i2s_clk * 2^48 / den, 16 bits at a time so nothing overflows */
+  meter->scale = 0U;
+  for (uint32_t i = 0; i < 3U; i++) {
+    rem <<= 16;
+    meter->scale = (meter->scale << 16) + rem / den;
+    rem %= den;
+  }
+  meter->frame_ticks = tim_clk / 1000U;
+  meter->primed = 0U;
+  meter->ticks = 0U;
+  meter->frames = 0U;
+  meter->rate = 0;
+  meter->windows = 0U;
+  meter->rejects = 0U;
+}
+
+/**
+ * @brief  AUDIO_SofMeterUpdate
+ *         Fold in the timestamp of the latest SOF
+ * @param  meter: meter instance
+ * @param  capture: timer value latched on that SOF
+ * @param  fnsof: its frame number
+ * @retval 1 when rate was updated, 0 otherwise
+ */
+uint8_t AUDIO_SofMeterUpdate(AUDIO_SofMeterTypeDef *meter, uint32_t capture, uint16_t fnsof) {
+  uint32_t frames = (uint32_t)(fnsof - meter->fnsof) & AUDIO_SOFMETER_FNSOF_MASK;
+  uint32_t ticks = capture - meter->capture;
+  uint32_t expected;
+  uint32_t margin;
+  int64_t rate;
+
+  if (meter->primed == 0U || frames == 0U) {
+    meter->capture = capture;
+    meter->fnsof = fnsof;
+    meter->primed = 1U;
+    return 0U;
+  }
+  meter->capture = capture;
+  meter->fnsof = fnsof;
+
+  /* A capture overwritten by a later SOF, or a timer that does not count */
+  expected = frames * meter->frame_ticks;
+  margin = (uint32_t)((uint64_t)expected * AUDIO_SOFMETER_TOLERANCE_PPM / 1000000U);
+  if (ticks > expected + margin || ticks < expected - margin) {
+    meter->ticks = 0U;
+    meter->frames = 0U;
+    meter->rejects++;
+    return 0U;
+  }
+
+  meter->ticks += ticks;
+  meter->frames += frames;
+  if (meter->frames < AUDIO_SOFMETER_WINDOW) {
+    return 0U;
+  }
+
+  rate = (int64_t)(((uint64_t)meter->ticks * meter->scale / meter->frames) >> 16);
+  meter->ticks = 0U;
+  meter->frames = 0U;
+
+  if (meter->windows == 0U) {
+    meter->rate = rate;
+  } else {
+    meter->rate += (rate - meter->rate) >> AUDIO_SOFMETER_FILTER_SHIFT;
+  }
+  meter->windows++;
+
+  return 1U;
+}
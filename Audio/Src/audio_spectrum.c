@@ -0,0 +1,394 @@
+/**
+ ******************************************************************************
+ * @file    audio_spectrum.c
+ * @brief   Power spectrum of the analyzer frames, float or fixed-point FFT.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  One frame of int16 samples in, one power value per bin out, whatever
+ *  the engine: 1.0 is a full-scale sine centered on the bin, so the bar
+ *  pipeline neither knows nor cares which FFT ran.
+ *
+ *  The float engine converts the frame with arm_q15_to_float and runs
+ *  arm_rfft_fast_f32. The fixed-point engines run arm_rfft_q31 or
+ *  arm_rfft_q15, which scale down by log2(N) bits on the way to keep the
+ *  butterflies from overflowing; on a quiet frame that throws away most of
+ *  the signal. The frame is therefore block scaled first: shifted up by
+ *  the largest amount its peak allows, and the power scaled back by the
+ *  same exponent once it is float. The q15 engine keeps a quiet passage
+ *  about as clean as a loud one this way, its floor follows the signal.
+ *
+ *  Before the FFT the frame is multiplied by a window, a table computed
+ *  once by AUDIO_SpectrumSetWindow in the format of each engine and
+ *  applied with arm_mult_f32, arm_mult_q31 or arm_mult_q15: a tone
+ *  between two bins then stays within the main lobe of the window instead
+ *  of leaking over the whole spectrum. Windows are cosine sums, their
+ *  coherent gain is the constant term, and the power is divided by its
+ *  square so a full-scale sine still reads 1.0 in its bin. For the
+ *  fixed-point engines the window comes after block scaling, it can only
+ *  lower the peak.
+ *
+ *  Only the one-sided half of the spectrum is converted to float and
+ *  squared, with arm_cmplx_mag_squared_f32; the q15 and q31 outputs are
+ *  two-sided and need 2N words.
+ *
+ *  AUDIO_SpectrumDb takes the spectrum to decibels for the display in one
+ *  pass that also finds the range. The log2 of a power is its float
+ *  exponent plus a degree 4 minimax polynomial of its mantissa in [1, 2):
+ *  no libm call, no double, within 0.0003 dB of 10 * log10.
+ *
+ *  AUDIO_SpectrumBench runs a -1 dBFS tone centered on a bin through the
+ *  selected engine and reports the cycles of the frame, the RAM the engine
+ *  works in and the distance from the tone to the mean of the other bins.
+ *  Cycles are counted with AUDIO_SPECTRUM_CYCLES, the DWT cycle counter on
+ *  target; a host build can define its own before compiling this file.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_spectrum.h"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#ifndef AUDIO_SPECTRUM_CYCLES
+#include "stm32h7xx.h"
+#define AUDIO_SPECTRUM_CYCLES()                       (DWT->CYCCNT)
+#endif /* AUDIO_SPECTRUM_CYCLES */
+
+/* Bins on either side of the benchmark tone left out of the noise floor,
+   the widest main lobe, flat-top */
+#define AUDIO_SPECTRUM_BENCH_LOBE                     5U
+
+/* Bin of the benchmark tone, coprime with the frame length so the
+   quantization error of the tone spreads over the whole spectrum */
+#define AUDIO_SPECTRUM_BENCH_BIN                      (AUDIO_SPECTRUM_BINS / 5U + 1U)
+
+/* Power of AUDIO_SPECTRUM_DB_FLOOR */
+#define AUDIO_SPECTRUM_POWER_FLOOR                    1e-16f
+
+/* 10 * log10(2), dB per octave of power */
+#define AUDIO_SPECTRUM_DB_LOG2                        3.01029996f
+
+/* log2(m) on [1, 2), minimax, |error| < 8.8e-5 */
+#define AUDIO_SPECTRUM_LOG2_C0                        (-2.51285462f)
+#define AUDIO_SPECTRUM_LOG2_C1                        4.07009079f
+#define AUDIO_SPECTRUM_LOG2_C2                        (-2.12067513f)
+#define AUDIO_SPECTRUM_LOG2_C3                        0.645142365f
+#define AUDIO_SPECTRUM_LOG2_C4                        (-0.0816158087f)
+
+#if (AUDIO_SPECTRUM_USE_Q31 == 1U) || (AUDIO_SPECTRUM_USE_Q15 == 1U)
+/**
+ * @brief  AUDIO_SpectrumExponent
+ *         Block exponent of a frame: the left shift that brings its peak
+ *         just below full scale
+ * @param  frame: samples
+ * @retval shift, 0..15, or 16 for a silent frame
+ */
+static uint8_t AUDIO_SpectrumExponent(const q15_t *frame) {
+  q15_t max;
+  q15_t min;
+  uint32_t index;
+  uint32_t peak;
+
+  arm_max_q15((q15_t *)frame, AUDIO_SPECTRUM_SIZE, &max, &index);
+  arm_min_q15((q15_t *)frame, AUDIO_SPECTRUM_SIZE, &min, &index);
+  peak = (uint32_t)(max > -min ? max : -min);
+  if (peak == 0U) {
+    return 16U;
+  }
+
+  /* Magnitude below 2^14 leaves a free bit, 2^15 (-32768) none */
+  return __CLZ(peak) > 17U ? (uint8_t)(__CLZ(peak) - 17U) : 0U;
+}
+
+/**
+ * @brief  AUDIO_SpectrumPower
+ *         Square the one-sided spectrum, left as float in spec->in, and
+ *         undo the FFT and block scaling
+ * @param  spec: spectrum instance
+ * @retval None
+ */
+static void AUDIO_SpectrumPower(AUDIO_SpectrumTypeDef *spec) {
+  /* |X|^2 * 2^(2 * log2(N)) / 4^shift, then 4 / N^2 for a sine at 1.0 */
+  float32_t scale = 4.0f * spec->gain / (float32_t)(1UL << (2U * spec->shift));
+
+  arm_cmplx_mag_squared_f32(spec->in.f32, spec->power, AUDIO_SPECTRUM_BINS);
+  arm_scale_f32(spec->power, scale, spec->power, AUDIO_SPECTRUM_BINS);
+}
+#endif /* AUDIO_SPECTRUM_USE_Q31 || AUDIO_SPECTRUM_USE_Q15 */
+
+/**
+ * @brief  AUDIO_SpectrumInit
+ *         Initialize the FFTs built in and select an engine and a window
+ * @param  spec: spectrum instance
+ * @param  engine: engine to run, the first one built in if it is not
+ * @param  window: window of the frames
+ * @retval None
+ */
+void AUDIO_SpectrumInit(AUDIO_SpectrumTypeDef *spec, AUDIO_SpectrumEngineTypeDef engine,
+                        AUDIO_SpectrumWindowTypeDef window) {
+  (void)memset(spec, 0, sizeof(*spec));
+
+#if (AUDIO_SPECTRUM_USE_F32 == 1U)
+  (void)arm_rfft_fast_init_f32(&spec->rfft_f32, AUDIO_SPECTRUM_SIZE);
+  spec->engine = AUDIO_SPECTRUM_ENGINE_F32;
+#endif /* AUDIO_SPECTRUM_USE_F32 */
+#if (AUDIO_SPECTRUM_USE_Q15 == 1U)
+  (void)arm_rfft_init_q15(&spec->rfft_q15, AUDIO_SPECTRUM_SIZE, 0U, 1U);
+#if (AUDIO_SPECTRUM_USE_F32 == 0U)
+  spec->engine = AUDIO_SPECTRUM_ENGINE_Q15;
+#endif /* AUDIO_SPECTRUM_USE_F32 */
+#endif /* AUDIO_SPECTRUM_USE_Q15 */
+#if (AUDIO_SPECTRUM_USE_Q31 == 1U)
+  (void)arm_rfft_init_q31(&spec->rfft_q31, AUDIO_SPECTRUM_SIZE, 0U, 1U);
+#if (AUDIO_SPECTRUM_USE_F32 == 0U)
+  spec->engine = AUDIO_SPECTRUM_ENGINE_Q31;
+#endif /* AUDIO_SPECTRUM_USE_F32 */
+#endif /* AUDIO_SPECTRUM_USE_Q31 */
+
+  (void)AUDIO_SpectrumSetEngine(spec, engine);
+  AUDIO_SpectrumSetWindow(spec, window);
+}
+
+/**
+ * @brief  AUDIO_SpectrumSetEngine
+ *         Switch the engine of the next frames
+ * @param  spec: spectrum instance
+ * @param  engine: engine to run
+ * @retval 1 when switched, 0 when the engine is not built in
+ */
+uint8_t AUDIO_SpectrumSetEngine(AUDIO_SpectrumTypeDef *spec, AUDIO_SpectrumEngineTypeDef engine) {
+  switch (engine) {
+#if (AUDIO_SPECTRUM_USE_F32 == 1U)
+    case AUDIO_SPECTRUM_ENGINE_F32:
+#endif /* AUDIO_SPECTRUM_USE_F32 */
+#if (AUDIO_SPECTRUM_USE_Q31 == 1U)
+    case AUDIO_SPECTRUM_ENGINE_Q31:
+#endif /* AUDIO_SPECTRUM_USE_Q31 */
+#if (AUDIO_SPECTRUM_USE_Q15 == 1U)
+    case AUDIO_SPECTRUM_ENGINE_Q15:
+#endif /* AUDIO_SPECTRUM_USE_Q15 */
+      spec->engine = engine;
+      return 1U;
+
+    default:
+      return 0U;
+  }
+}
+
+/**
+ * @brief  AUDIO_SpectrumSetWindow
+ *         Compute the window tables of the engines built in
+ * @param  spec: spectrum instance
+ * @param  window: window of the next frames, rectangular if unknown
+ * @retval None
+ */
+void AUDIO_SpectrumSetWindow(AUDIO_SpectrumTypeDef *spec, AUDIO_SpectrumWindowTypeDef window) {
+  /* Periodic cosine sums, w(n) = a0 - a1 cos(2 pi n / N) + a2 cos(4 pi n / N) - ... */
+  static const float64_t coeffs[AUDIO_SPECTRUM_WINDOWS][5] = {
+      {1.0, 0.0, 0.0, 0.0, 0.0},
+      {0.5, 0.5, 0.0, 0.0, 0.0},
+      {0.35875, 0.48829, 0.14128, 0.01168, 0.0},
+      {0.21557895, 0.41663158, 0.277263158, 0.083578947, 0.006947368},
+  };
+  const float64_t *a;
+
+  if (window >= AUDIO_SPECTRUM_WINDOWS) {
+    window = AUDIO_SPECTRUM_WINDOW_NONE;
+  }
+  a = coeffs[window];
+  spec->window = window;
+  spec->gain = (float32_t)(1.0 / (a[0] * a[0]));
+
+  for (uint32_t i = 0U; i < AUDIO_SPECTRUM_SIZE; i++) {
+    float64_t w = a[0];
+
+    for (uint32_t k = 1U; k < 5U; k++) {
+      float64_t c = a[k] * cos(6.283185307179586 * (float64_t)((k * i) % AUDIO_SPECTRUM_SIZE) /
+                               (float64_t)AUDIO_SPECTRUM_SIZE);
+      w += (k & 1U) != 0U ? -c : c;
+    }
+
+#if (AUDIO_SPECTRUM_USE_F32 == 1U)
+    spec->window_f32[i] = (float32_t)w;
+#endif /* AUDIO_SPECTRUM_USE_F32 */
+    /* Just below 1.0 rounds up to full scale, which would wrap to -1 */
+#if (AUDIO_SPECTRUM_USE_Q31 == 1U)
+    spec->window_q31[i] = w * 2147483648.0 < 2147483647.0 ? (q31_t)llrint(w * 2147483648.0) : INT32_MAX;
+#endif /* AUDIO_SPECTRUM_USE_Q31 */
+#if (AUDIO_SPECTRUM_USE_Q15 == 1U)
+    spec->window_q15[i] = w * 32768.0 < 32767.0 ? (q15_t)lrint(w * 32768.0) : INT16_MAX;
+#endif /* AUDIO_SPECTRUM_USE_Q15 */
+  }
+}
+
+/**
+ * @brief  AUDIO_SpectrumProcess
+ *         Power spectrum of one frame with the selected engine
+ * @param  spec: spectrum instance
+ * @param  frame: AUDIO_SPECTRUM_SIZE samples, left untouched
+ * @retval None
+ */
+void AUDIO_SpectrumProcess(AUDIO_SpectrumTypeDef *spec, const q15_t *frame) {
+  uint32_t cycles = AUDIO_SPECTRUM_CYCLES();
+
+  switch (spec->engine) {
+#if (AUDIO_SPECTRUM_USE_Q31 == 1U)
+    case AUDIO_SPECTRUM_ENGINE_Q31:
+      spec->shift = AUDIO_SpectrumExponent(frame);
+      if (spec->shift == 16U) {
+        (void)memset(spec->power, 0, sizeof(spec->power));
+        break;
+      }
+      arm_q15_to_q31((q15_t *)frame, spec->in.q31, AUDIO_SPECTRUM_SIZE);
+      arm_shift_q31(spec->in.q31, (int8_t)spec->shift, spec->in.q31, AUDIO_SPECTRUM_SIZE);
+      if (spec->window != AUDIO_SPECTRUM_WINDOW_NONE) {
+        arm_mult_q31(spec->in.q31, spec->window_q31, spec->in.q31, AUDIO_SPECTRUM_SIZE);
+      }
+      arm_rfft_q31(&spec->rfft_q31, spec->in.q31, spec->out.q31);
+      arm_q31_to_float(spec->out.q31, spec->in.f32, 2U * AUDIO_SPECTRUM_BINS);
+      AUDIO_SpectrumPower(spec);
+      break;
+#endif /* AUDIO_SPECTRUM_USE_Q31 */
+
+#if (AUDIO_SPECTRUM_USE_Q15 == 1U)
+    case AUDIO_SPECTRUM_ENGINE_Q15:
+      spec->shift = AUDIO_SpectrumExponent(frame);
+      if (spec->shift == 16U) {
+        (void)memset(spec->power, 0, sizeof(spec->power));
+        break;
+      }
+      arm_shift_q15((q15_t *)frame, (int8_t)spec->shift, spec->in.q15, AUDIO_SPECTRUM_SIZE);
+      if (spec->window != AUDIO_SPECTRUM_WINDOW_NONE) {
+        arm_mult_q15(spec->in.q15, spec->window_q15, spec->in.q15, AUDIO_SPECTRUM_SIZE);
+      }
+      arm_rfft_q15(&spec->rfft_q15, spec->in.q15, spec->out.q15);
+      arm_q15_to_float(spec->out.q15, spec->in.f32, 2U * AUDIO_SPECTRUM_BINS);
+      AUDIO_SpectrumPower(spec);
+      break;
+#endif /* AUDIO_SPECTRUM_USE_Q15 */
+
+#if (AUDIO_SPECTRUM_USE_F32 == 1U)
+    case AUDIO_SPECTRUM_ENGINE_F32:
+      spec->shift = 0U;
+      arm_q15_to_float((q15_t *)frame, spec->in.f32, AUDIO_SPECTRUM_SIZE);
+      if (spec->window != AUDIO_SPECTRUM_WINDOW_NONE) {
+        arm_mult_f32(spec->in.f32, spec->window_f32, spec->in.f32, AUDIO_SPECTRUM_SIZE);
+      }
+      arm_rfft_fast_f32(&spec->rfft_f32, spec->in.f32, spec->out.f32, 0U);
+      arm_cmplx_mag_squared_f32(spec->out.f32, spec->power, AUDIO_SPECTRUM_BINS);
+      /* The real Nyquist term is packed in the imaginary part of DC */
+      spec->power[0] = spec->out.f32[0] * spec->out.f32[0];
+      arm_scale_f32(spec->power, 4.0f * spec->gain / ((float32_t)AUDIO_SPECTRUM_SIZE * (float32_t)AUDIO_SPECTRUM_SIZE),
+                    spec->power, AUDIO_SPECTRUM_BINS);
+      break;
+#endif /* AUDIO_SPECTRUM_USE_F32 */
+
+    default:
+      break;
+  }
+
+  spec->cycles = AUDIO_SPECTRUM_CYCLES() - cycles;
+}
+
+/**
+ * @brief  AUDIO_SpectrumDb
+ *         Power to decibels, with the smallest and largest result
+ * @param  power: power per bin
+ * @param  db: decibels per bin, AUDIO_SPECTRUM_DB_FLOOR at most down
+ * @param  n: number of bins, at least 1
+ * @param  min: smallest of db
+ * @param  max: largest of db
+ * @retval None
+ */
+void AUDIO_SpectrumDb(const float32_t *power, float32_t *db, uint32_t n, float32_t *min, float32_t *max) {
+  float32_t lo = FLT_MAX;
+  float32_t hi = AUDIO_SPECTRUM_DB_FLOOR;
+
+  for (uint32_t i = 0U; i < n; i++) {
+    union {
+      float32_t f;
+      uint32_t u;
+    } x;
+    float32_t m;
+    float32_t d;
+
+    /* Also catches zero, denormals and NaN */
+    x.f = power[i] > AUDIO_SPECTRUM_POWER_FLOOR ? power[i] : AUDIO_SPECTRUM_POWER_FLOOR;
+    d = (float32_t)((int32_t)(x.u >> 23) - 127);
+    x.u = (x.u & 0x007FFFFFU) | 0x3F800000U;
+    m = x.f;
+
+    d += (((AUDIO_SPECTRUM_LOG2_C4 * m + AUDIO_SPECTRUM_LOG2_C3) * m + AUDIO_SPECTRUM_LOG2_C2) * m +
+          AUDIO_SPECTRUM_LOG2_C1) * m + AUDIO_SPECTRUM_LOG2_C0;
+    d *= AUDIO_SPECTRUM_DB_LOG2;
+
+    db[i] = d;
+    lo = d < lo ? d : lo;
+    hi = d > hi ? d : hi;
+  }
+
+  *min = lo;
+  *max = hi;
+}
+
+/**
+ * @brief  AUDIO_SpectrumBench
+ *         Measure the selected engine on a -1 dBFS tone centered on a bin
+ * @param  spec: spectrum instance
+ * @param  frame: AUDIO_SPECTRUM_SIZE samples of scratch for the tone
+ * @param  bench: result
+ * @retval None
+ */
+void AUDIO_SpectrumBench(AUDIO_SpectrumTypeDef *spec, q15_t *frame, AUDIO_SpectrumBenchTypeDef *bench) {
+  const float64_t amplitude = 0.891250938 * 32767.0;
+  float64_t noise = 0.0;
+
+  for (uint32_t i = 0U; i < AUDIO_SPECTRUM_SIZE; i++) {
+    float64_t phase = 6.283185307179586 * (float64_t)((i * AUDIO_SPECTRUM_BENCH_BIN) % AUDIO_SPECTRUM_SIZE) /
+                      (float64_t)AUDIO_SPECTRUM_SIZE;
+    frame[i] = (q15_t)lrint(amplitude * sin(phase));
+  }
+
+  AUDIO_SpectrumProcess(spec, frame);
+  bench->cycles = spec->cycles;
+
+  /* Every bin but DC and the main lobe of the tone is noise: quantization,
+     FFT rounding and the sidelobes of the window */
+  for (uint32_t k = 1U; k < AUDIO_SPECTRUM_BINS; k++) {
+    if (k + AUDIO_SPECTRUM_BENCH_LOBE < AUDIO_SPECTRUM_BENCH_BIN ||
+        k > AUDIO_SPECTRUM_BENCH_BIN + AUDIO_SPECTRUM_BENCH_LOBE) {
+      noise += spec->power[k];
+    }
+  }
+  noise /= (float64_t)(AUDIO_SPECTRUM_BINS - 2U - 2U * AUDIO_SPECTRUM_BENCH_LOBE);
+  bench->range_db = noise > 0.0 ? (float32_t)(10.0 * log10(spec->power[AUDIO_SPECTRUM_BENCH_BIN] / noise)) : 0.0f;
+
+  switch (spec->engine) {
+#if (AUDIO_SPECTRUM_USE_Q31 == 1U)
+    case AUDIO_SPECTRUM_ENGINE_Q31:
+      bench->ram = sizeof(spec->rfft_q31) + sizeof(spec->window_q31) + sizeof(spec->in.q31) + sizeof(spec->out.q31) +
+                   sizeof(spec->power);
+      break;
+#endif /* AUDIO_SPECTRUM_USE_Q31 */
+#if (AUDIO_SPECTRUM_USE_Q15 == 1U)
+    case AUDIO_SPECTRUM_ENGINE_Q15:
+      /* The float copy of the spectrum needs all of spec->in */
+      bench->ram = sizeof(spec->rfft_q15) + sizeof(spec->window_q15) + sizeof(spec->in.f32) + sizeof(spec->out.q15) +
+                   sizeof(spec->power);
+      break;
+#endif /* AUDIO_SPECTRUM_USE_Q15 */
+#if (AUDIO_SPECTRUM_USE_F32 == 1U)
+    case AUDIO_SPECTRUM_ENGINE_F32:
+      bench->ram = sizeof(spec->rfft_f32) + sizeof(spec->window_f32) + sizeof(spec->in.f32) + sizeof(spec->out.f32) +
+                   sizeof(spec->power);
+      break;
+#endif /* AUDIO_SPECTRUM_USE_F32 */
+    default:
+      bench->ram = 0U;
+      break;
+  }
+}
@@ -0,0 +1,227 @@
+/**
+ ******************************************************************************
+ * @file    audio_tone.c
+ * @brief   Bass/mid/treble filter bank and AGC behind the Feature Unit controls.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  The three bands are a cascade of biquads (RBJ cookbook): a low shelf, a
+ *  peaking filter and a high shelf, run over interleaved stereo floats by
+ *  the CMSIS transposed direct form II kernel. A band is redesigned only
+ *  when its control or the sampling frequency changes, never per block,
+ *  and the whole bank is skipped while every band is at 0 dB.
+ *
+ *  The AGC follows the block peak after the filters, attacking within a
+ *  few blocks and releasing over a few hundred milliseconds, and steers it
+ *  to AUDIO_TONE_AGC_TARGET. The gain moves linearly across each block so
+ *  it never steps, boosts at most AUDIO_TONE_AGC_GAIN_MAX and holds still
+ *  below AUDIO_TONE_AGC_FLOOR rather than pumping up the noise.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_tone.h"
+
+#include <string.h>
+
+/* Per-block smoothing of the AGC peak follower and gain */
+#define AUDIO_TONE_AGC_ATTACK                         0.5f
+#define AUDIO_TONE_AGC_RELEASE                        0.005f
+
+/**
+ * @brief  AUDIO_ToneDesign
+ *         Compute the coefficients of one band
+ * @param  tone: tone instance
+ * @param  band: band to design
+ * @retval None
+ */
+static void AUDIO_ToneDesign(AUDIO_ToneTypeDef *tone, AUDIO_ToneBandTypeDef band) {
+  static const float32_t hz[AUDIO_TONE_STAGES] = {AUDIO_TONE_BASS_HZ, AUDIO_TONE_MID_HZ, AUDIO_TONE_TREBLE_HZ};
+  float32_t *c = &tone->coef[5U * (uint32_t)band];
+  float32_t w0 = 2.0f * PI * hz[band] / tone->fs;
+  float32_t cw = arm_cos_f32(w0);
+  float32_t sw = arm_sin_f32(w0);
+  float32_t x = (float32_t)tone->level[band] * 0.25f * 0.057564627f; /* dB * ln(10) / 40 */
+  float32_t a;
+  float32_t sa;
+  float32_t alpha;
+  float32_t b0, b1, b2, a0, a1, a2;
+
+  /* A = 10^(dB / 40) */
+  arm_vexp_f32(&x, &a, 1U);
+
+  if (band == AUDIO_TONE_MID) {
+    alpha = sw / (2.0f * AUDIO_TONE_MID_Q);
+    b0 = 1.0f + alpha * a;
+    b1 = -2.0f * cw;
+    b2 = 1.0f - alpha * a;
+    a0 = 1.0f + alpha / a;
+    a1 = -2.0f * cw;
+    a2 = 1.0f - alpha / a;
+  } else {
+    /* Shelf slope 1 */
+    (void)arm_sqrt_f32(a, &sa);
+    alpha = sw * 0.70710678f;
+    if (band == AUDIO_TONE_BASS) {
+      b0 = a * ((a + 1.0f) - (a - 1.0f) * cw + 2.0f * sa * alpha);
+      b1 = 2.0f * a * ((a - 1.0f) - (a + 1.0f) * cw);
+      b2 = a * ((a + 1.0f) - (a - 1.0f) * cw - 2.0f * sa * alpha);
+      a0 = (a + 1.0f) + (a - 1.0f) * cw + 2.0f * sa * alpha;
+      a1 = -2.0f * ((a - 1.0f) + (a + 1.0f) * cw);
+      a2 = (a + 1.0f) + (a - 1.0f) * cw - 2.0f * sa * alpha;
+    } else {
+      b0 = a * ((a + 1.0f) + (a - 1.0f) * cw + 2.0f * sa * alpha);
+      b1 = -2.0f * a * ((a - 1.0f) + (a + 1.0f) * cw);
+      b2 = a * ((a + 1.0f) + (a - 1.0f) * cw - 2.0f * sa * alpha);
+      a0 = (a + 1.0f) - (a - 1.0f) * cw + 2.0f * sa * alpha;
+      a1 = 2.0f * ((a - 1.0f) - (a + 1.0f) * cw);
+      a2 = (a + 1.0f) - (a - 1.0f) * cw - 2.0f * sa * alpha;
+    }
+  }
+
+  /* CMSIS order, feedback terms negated */
+  c[0] = b0 / a0;
+  c[1] = b1 / a0;
+  c[2] = b2 / a0;
+  c[3] = -a1 / a0;
+  c[4] = -a2 / a0;
+}
+
+/**
+ * @brief  AUDIO_ToneInit
+ *         Start flat, AGC off
+ * @param  tone: tone instance
+ * @param  freq: sampling frequency, Hz
+ * @retval None
+ */
+void AUDIO_ToneInit(AUDIO_ToneTypeDef *tone, uint32_t freq) {
+  (void)memset(tone->level, 0, sizeof(tone->level));
+  tone->flat = 1U;
+  tone->agc = 0U;
+  arm_biquad_cascade_stereo_df2T_init_f32(&tone->eq, (uint8_t)AUDIO_TONE_STAGES, tone->coef, tone->state);
+  AUDIO_ToneSetFreq(tone, freq);
+}
+
+/**
+ * @brief  AUDIO_ToneReset
+ *         Clear the filter and AGC history, between streams
+ * @param  tone: tone instance
+ * @retval None
+ */
+void AUDIO_ToneReset(AUDIO_ToneTypeDef *tone) {
+  (void)memset(tone->state, 0, sizeof(tone->state));
+  tone->agc_env = 0.0f;
+  tone->agc_gain = 1.0f;
+}
+
+/**
+ * @brief  AUDIO_ToneSetFreq
+ *         Redesign every band for a new sampling frequency
+ * @param  tone: tone instance
+ * @param  freq: sampling frequency, Hz
+ * @retval None
+ */
+void AUDIO_ToneSetFreq(AUDIO_ToneTypeDef *tone, uint32_t freq) {
+  tone->fs = (float32_t)freq;
+  AUDIO_ToneDesign(tone, AUDIO_TONE_BASS);
+  AUDIO_ToneDesign(tone, AUDIO_TONE_MID);
+  AUDIO_ToneDesign(tone, AUDIO_TONE_TREBLE);
+  AUDIO_ToneReset(tone);
+}
+
+/**
+ * @brief  AUDIO_ToneSetLevel
+ *         Set the gain of one band and redesign it
+ * @param  tone: tone instance
+ * @param  band: band
+ * @param  level: 0.25 dB, clamped to AUDIO_TONE_DB_MIN..AUDIO_TONE_DB_MAX
+ * @retval None
+ */
+void AUDIO_ToneSetLevel(AUDIO_ToneTypeDef *tone, AUDIO_ToneBandTypeDef band, int8_t level) {
+  uint8_t was = AUDIO_ToneActive(tone);
+
+  if (level < AUDIO_TONE_DB_MIN) {
+    level = AUDIO_TONE_DB_MIN;
+  } else if (level > AUDIO_TONE_DB_MAX) {
+    level = AUDIO_TONE_DB_MAX;
+  }
+  if (level == tone->level[band]) {
+    return;
+  }
+
+  tone->level[band] = level;
+  AUDIO_ToneDesign(tone, band);
+  tone->flat = (uint8_t)(tone->level[AUDIO_TONE_BASS] == 0 && tone->level[AUDIO_TONE_MID] == 0 &&
+                         tone->level[AUDIO_TONE_TREBLE] == 0);
+
+  /* The history of a bypassed bank is stale */
+  if (was == 0U) {
+    AUDIO_ToneReset(tone);
+  }
+}
+
+/**
+ * @brief  AUDIO_ToneSetAgc
+ *         Switch the AGC on or off
+ * @param  tone: tone instance
+ * @param  on: 0 for off
+ * @retval None
+ */
+void AUDIO_ToneSetAgc(AUDIO_ToneTypeDef *tone, uint8_t on) {
+  if (on != 0U && tone->agc == 0U) {
+    tone->agc_env = 0.0f;
+    tone->agc_gain = 1.0f;
+  }
+  tone->agc = (uint8_t)(on != 0U);
+}
+
+/**
+ * @brief  AUDIO_ToneProcess_f32
+ *         Run the filter bank and the AGC over a block, in place
+ * @param  tone: tone instance
+ * @param  frames: interleaved stereo samples, full scale +-1
+ * @param  n: number of frames
+ * @retval None
+ */
+void AUDIO_ToneProcess_f32(AUDIO_ToneTypeDef *tone, float32_t *frames, uint32_t n) {
+  float32_t peak = 0.0f;
+  float32_t target;
+  float32_t step;
+  float32_t g;
+
+  if (tone->flat == 0U) {
+    arm_biquad_cascade_stereo_df2T_f32(&tone->eq, frames, frames, n);
+  }
+  if (tone->agc == 0U || n == 0U) {
+    return;
+  }
+
+  for (uint32_t i = 0U; i < 2U * n; i++) {
+    float32_t x = frames[i] < 0.0f ? -frames[i] : frames[i];
+    if (x > peak) {
+      peak = x;
+    }
+  }
+  tone->agc_env += (peak - tone->agc_env) * (peak > tone->agc_env ? AUDIO_TONE_AGC_ATTACK : AUDIO_TONE_AGC_RELEASE);
+
+  target = tone->agc_gain;
+  if (tone->agc_env > AUDIO_TONE_AGC_FLOOR) {
+    target = AUDIO_TONE_AGC_TARGET / tone->agc_env;
+    if (target > AUDIO_TONE_AGC_GAIN_MAX) {
+      target = AUDIO_TONE_AGC_GAIN_MAX;
+    }
+  }
+  target = tone->agc_gain + (target - tone->agc_gain) *
+                                (target < tone->agc_gain ? AUDIO_TONE_AGC_ATTACK : AUDIO_TONE_AGC_RELEASE);
+
+  /* Ramp from the previous gain so the block edges never step */
+  g = tone->agc_gain;
+  step = (target - g) / (float32_t)n;
+  for (uint32_t i = 0U; i < n; i++) {
+    g += step;
+    frames[2U * i] *= g;
+    frames[2U * i + 1U] *= g;
+  }
+  tone->agc_gain = target;
+}
@@ -53,6 +53,9 @@ extern "C" {
 void Error_Handler(void);
 
 /* USER CODE BEGIN EFP */
+HAL_StatusTypeDef AUDIO_ClockConfig(uint32_t freq);
+void AUDIO_SofTimerInit(void);
+uint32_t AUDIO_SofTimerGetClock(void);
 
 /* USER CODE END EFP */
 
@@ -69,6 +72,10 @@ void Error_Handler(void);
 #define LCD_RST_GPIO_Port GPIOD
 
 /* USER CODE BEGIN Private defines */
+/* Free-running 32-bit timer latching every USB SOF on CCR1 */
+#define AUDIO_SOF_TIM TIM2
+/* TIM2 internal trigger ITR6: USB2 OTG_FS SOF */
+#define AUDIO_SOF_TIM_ITR (TIM_SMCR_TS_1 | TIM_SMCR_TS_3)
 
 /* USER CODE END Private defines */
 
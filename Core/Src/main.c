@@ -24,9 +24,14 @@
 #include "usbd_core.h"
 #include "usbd_desc.h"
 #include "usbd_audio.h"
+#include "usbd_audio2.h"
 
 #include "lcd.h"
 #include "arm_math.h"
+#include "audio_spectrum.h"
+#include "audio_bands.h"
+
+#include <stdio.h>
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -36,10 +41,29 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
-#define N_SAMPLES 1024
-#define BAR_COUNT 240
+#define N_SAMPLES AUDIO_SPECTRUM_SIZE
+/* FFT of the analyzer: AUDIO_SPECTRUM_ENGINE_F32, _Q31 or _Q15, the fixed-point
+   ones built in with AUDIO_SPECTRUM_USE_Q31 or _Q15 = 1U, else F32 runs */
+#ifndef ANALYZER_ENGINE
+#define ANALYZER_ENGINE AUDIO_SPECTRUM_ENGINE_F32
+#endif
+/* Window of the analyzer frames: AUDIO_SPECTRUM_WINDOW_NONE, _HANN, _BLACKMAN or _FLAT_TOP */
+#ifndef ANALYZER_WINDOW
+#define ANALYZER_WINDOW AUDIO_SPECTRUM_WINDOW_HANN
+#endif
+/* Overlap of consecutive frames, 0, 50 or 75 %: a frame every N_SAMPLES, N_SAMPLES / 2 or N_SAMPLES / 4 samples */
+#ifndef ANALYZER_OVERLAP
+#define ANALYZER_OVERLAP 50
+#endif
+#define N_HOP (N_SAMPLES * (100 - ANALYZER_OVERLAP) / 100)
+/* Bars: AUDIO_BANDS_LINEAR, _OCTAVE_3, _OCTAVE_6, _OCTAVE_12 or _MEL_SCALE */
+#ifndef ANALYZER_BANDS
+#define ANALYZER_BANDS AUDIO_BANDS_OCTAVE_12
+#endif
+#define BAR_COUNT AUDIO_BANDS_MAX
 #define SMOOTH_DOWN  0.08
 #define SMOOTH_UP    0.8
+#define LEVEL_DB_MIN -60.0f
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -74,12 +98,30 @@ static void MX_SPI1_Init(void);
 static void MX_USART1_UART_Init(void);
 static void MX_USB_OTG_FS_PCD_Init(void);
 /* USER CODE BEGIN PFP */
-void AUDIO_WaitForSamples(float32_t *samples, uint32_t size);
+
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
-
+/**
+  * @brief  Length of a level bar, LEVEL_DB_MIN..0 dBFS across the screen
+  * @param  level: q15 magnitude, 0x8000 is full scale
+  * @retval pixels
+  */
+static uint8_t LevelToWidth(uint16_t level) {
+  float32_t power = (float32_t) level * (float32_t) level / (32768.0f * 32768.0f);
+  float32_t db;
+  float32_t min;
+  float32_t max;
+
+  /* 20 * log10 of the magnitude is 10 * log10 of its square, the analyzer's
+     fast log2 instead of libm; silence comes out at AUDIO_SPECTRUM_DB_FLOOR */
+  AUDIO_SpectrumDb(&power, &db, 1, &min, &max);
+  if (db <= LEVEL_DB_MIN) {
+    return 0;
+  }
+  return (uint8_t) (240.0f * (1.0f - db / LEVEL_DB_MIN));
+}
 /* USER CODE END 0 */
 
 /**
@@ -112,6 +154,10 @@ int main(void)
   PeriphCommonClock_Config();
 
   /* USER CODE BEGIN SysInit */
+  /* Cycle counter used to profile the audio interrupts */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 
   /* USER CODE END SysInit */
 
@@ -128,10 +174,36 @@ int main(void)
   LCD_DrawRect(0, 0, 240, 240, 0xFFFF);
   LCD_Sync();
 
-  static arm_rfft_fast_instance_f32 S;
-  static float32_t inBuf[N_SAMPLES] = { 0.0 };
-  static float32_t outBuf[N_SAMPLES] = { 0.0 };
-  arm_rfft_fast_init_f32(&S, N_SAMPLES);
+  static AUDIO_SpectrumTypeDef spectrum;
+  static q15_t frame[N_SAMPLES];
+  AUDIO_SpectrumInit(&spectrum, ANALYZER_ENGINE, ANALYZER_WINDOW);
+  static AUDIO_BandsTypeDef bands;
+  AUDIO_BandsLayoutTypeDef layout = ANALYZER_BANDS;
+
+#ifdef ANALYZER_BENCH
+  /* Every engine on a test tone, reported over USART1; ANALYZER_BENCH must be
+     defined for the whole build (cmake -DANALYZER_BENCH=ON) so that
+     audio_spectrum.c builds them all */
+  for (int e = 0; e < AUDIO_SPECTRUM_ENGINES; e++) {
+    static const char *const name[AUDIO_SPECTRUM_ENGINES] = { "f32", "q31", "q15" };
+    AUDIO_SpectrumBenchTypeDef bench;
+    if (AUDIO_SpectrumSetEngine(&spectrum, (AUDIO_SpectrumEngineTypeDef) e) == 0) {
+      continue;
+    }
+    AUDIO_SpectrumBench(&spectrum, frame, &bench);
+    printf("%s: %lu cycles/frame, %lu bytes, %d dB\r\n", name[e], (unsigned long) bench.cycles,
+           (unsigned long) bench.ram, (int) bench.range_db);
+    /* One frame per refresh, a refresh every hop samples at 48 kHz */
+    static const uint32_t overlap[3] = { 0, 50, 75 };
+    for (int o = 0; o < 3; o++) {
+      uint32_t hop = N_SAMPLES * (100 - overlap[o]) / 100;
+      uint32_t load = (uint32_t) ((uint64_t) bench.cycles * 48000U * 1000U / hop / SystemCoreClock);
+      printf("  %lu%% overlap: %lu.%lu%% CPU\r\n", (unsigned long) overlap[o], (unsigned long) (load / 10),
+             (unsigned long) (load % 10));
+    }
+  }
+  (void) AUDIO_SpectrumSetEngine(&spectrum, ANALYZER_ENGINE);
+#endif
 
   /* USER CODE END 2 */
 
@@ -139,8 +211,14 @@ int main(void)
   /* USER CODE BEGIN WHILE */
   while (1)
   {
-    AUDIO_WaitForSamples(inBuf, N_SAMPLES);
-    arm_rfft_fast_f32(&S, inBuf, outBuf, 0);
+    /* Sampling frequency changes requested over USB retune the clocks here */
+    USBD_AUDIO_Poll(&hUsbDeviceFS);
+    if (USBD_AUDIO_ReadTap(frame, N_SAMPLES, N_HOP) == 0) {
+      /* No full frame yet: sleep until the next interrupt instead of spinning */
+      __WFI();
+      continue;
+    }
+    AUDIO_SpectrumProcess(&spectrum, frame);
 //    arm_cmplx_mag_f32(outBuf, inBuf, N_SAMPLES);
 
     float32_t bucketVals[BAR_COUNT] = { 0.0 };
@@ -170,33 +248,13 @@ int main(void)
 //        }
 //      }
 //    }
-    uint8_t minMaxInit = 0;
     float32_t bucketValMax;
     float32_t bucketValMin;
-    for (int i = 0; i < BAR_COUNT; i++) {
-      float32_t real = outBuf[i * 2];
-      float32_t imag = outBuf[i * 2 + 1];
-      float32_t db;
-      if (real != 0 || imag != 0) {
-        db = 10.0 * log10(pow(real, 2) + pow(imag, 2));
-      } else {
-        db = 0;
-      }
-      if (minMaxInit) {
-        if (db > bucketValMax) {
-          bucketValMax = db;
-        }
-        if (db < bucketValMin) {
-          bucketValMin = db;
-        }
-      } else {
-        bucketValMax = db;
-        bucketValMin = db;
-        minMaxInit = 1;
-      }
-      bucketVals[i] = db;
-    }
-    for (int i = 0; i < BAR_COUNT; i++) {
+    /* Only rebuilds the band index when the layout or the I2S rate changed */
+    AUDIO_BandsConfig(&bands, layout, hi2s2.Init.AudioFreq);
+    AUDIO_BandsProcess(&bands, spectrum.power, bucketVals);
+    AUDIO_SpectrumDb(bucketVals, bucketVals, bands.count, &bucketValMin, &bucketValMax);
+    for (int i = 0; i < bands.count; i++) {
       if (bucketValMax != bucketValMin) {
         bucketVals[i] = (bucketVals[i] - bucketValMin) / (bucketValMax - bucketValMin);
       } else {
@@ -206,7 +264,7 @@ int main(void)
 
     static uint8_t lastInit = 0;
     static float32_t lastBucketVals[BAR_COUNT] = { 0.0 };
-    for (int i = 0; i < BAR_COUNT; i++) {
+    for (int i = 0; i < bands.count; i++) {
       if (lastInit) {
         if (bucketVals[i] < lastBucketVals[i]) {
           lastBucketVals[i] = bucketVals[i] * SMOOTH_DOWN + lastBucketVals[i] * (1 - SMOOTH_DOWN);
@@ -221,13 +279,24 @@ int main(void)
 
 
     LCD_DrawRect(0, 0, 240, 240, 0xFFFF);
-    for (int i = 0; i < BAR_COUNT; i++) {
+    for (int i = 0; i < bands.count; i++) {
       uint16_t h = (uint16_t) (240.0 * lastBucketVals[i]);
-      uint16_t w = 240 / BAR_COUNT;
-      uint16_t x = i * w;
+      uint16_t x = i * 240 / bands.count;
+      uint16_t w = (i + 1) * 240 / bands.count - x;
       uint16_t y = 0;
       LCD_DrawRect(x, y, w, h, 0x0FF0);
     }
+    /* Output level per channel: RMS bar and window peak tick, red while it is at full scale */
+    AUDIO_LevelSnapshotTypeDef level;
+    if (USBD_AUDIO_ReadLevel(&hUsbDeviceFS, &level) == USBD_OK) {
+      for (int ch = 0; ch < 2; ch++) {
+        uint8_t rms = LevelToWidth(level.rms[ch]);
+        uint8_t peak = LevelToWidth(level.peak[ch]);
+        uint8_t y = 232 + ch * 4;
+        LCD_DrawRect(0, y, rms, 3, 0x001F);
+        LCD_DrawRect(peak > 2 ? peak - 2 : 0, y, 2, 3, level.peak[ch] >= 0x7FFF ? 0xF800 : 0x0000);
+      }
+    }
 
     LCD_DrawRect(0, 0, 10, 20, 0xF00F);
 
@@ -490,15 +559,23 @@ static void MX_USB_OTG_FS_PCD_Init(void)
   hpcd_USB_OTG_FS.pData = &hUsbDeviceFS;
   hUsbDeviceFS.pData = &hpcd_USB_OTG_FS;
 
-  HAL_PCDEx_SetRxFiFo(&hpcd_USB_OTG_FS, 0x120);
+  AUDIO_SofTimerInit();
+
+  HAL_PCDEx_SetRxFiFo(&hpcd_USB_OTG_FS, 0x1A0);
   HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 0, 0x40);
   HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 1, 0x80);
+  /* Loopback capture: one 96 kHz 32-bit packet, 776 bytes */
+  HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 2, 0xC2);
 
   if (USBD_Init(&hUsbDeviceFS, &AUDIO_Desc, 0) != USBD_OK)
   {
     Error_Handler();
   }
+#if (USBD_AUDIO_UAC2 == 1U)
+  if (USBD_RegisterClass(&hUsbDeviceFS, &USBD_AUDIO2) != USBD_OK)
+#else
   if (USBD_RegisterClass(&hUsbDeviceFS, &USBD_AUDIO) != USBD_OK)
+#endif /* USBD_AUDIO_UAC2 */
   {
     Error_Handler();
   }
@@ -601,6 +678,92 @@ static void MX_GPIO_Init(void)
 }
 
 /* USER CODE BEGIN 4 */
+void HAL_I2S_TxHalfCpltCallback(I2S_HandleTypeDef *hi2s) {
+  if (hi2s->Instance == SPI2) {
+    USBD_AUDIO_Sync(&hUsbDeviceFS, AUDIO_OFFSET_HALF);
+  }
+}
+
+void HAL_I2S_TxCpltCallback(I2S_HandleTypeDef *hi2s) {
+  if (hi2s->Instance == SPI2) {
+    USBD_AUDIO_Sync(&hUsbDeviceFS, AUDIO_OFFSET_FULL);
+  }
+}
+
+/**
+  * @brief Retune PLL2 for the family of a sampling frequency so the I2S
+  *        dividers are exact for 16, 24 and 32-bit frames:
+  *        196.608 MHz for 48 kHz multiples, 180.6336 MHz for 44.1 kHz ones.
+  *        PLL2P also clocks SPI1 through the shared SPI123 kernel clock mux,
+  *        the LCD only sees a slightly different SCK but must not be mid
+  *        transfer: HAL_BUSY is returned until LCD_Idle.
+  *        Thread mode only, the PLL lock wait runs on SysTick.
+  *        I2S2 must be stopped and reinitialized afterwards.
+  * @param freq sampling frequency in Hz
+  * @retval HAL status
+  */
+HAL_StatusTypeDef AUDIO_ClockConfig(uint32_t freq) {
+  static uint32_t family = 0U;
+  RCC_PeriphCLKInitTypeDef PeriphClkInitStruct = {0};
+  uint32_t base = (freq % 11025U) == 0U ? 44100U : 48000U;
+
+  if (base == family) {
+    return HAL_OK;
+  }
+  if (LCD_Idle() == 0U) {
+    return HAL_BUSY;
+  }
+
+  /* 8 MHz HSE / 2 = 4 MHz, VCO = 4 MHz * (N + FRACN / 8192), PLL2P = VCO / 2 */
+  PeriphClkInitStruct.PeriphClockSelection = RCC_PERIPHCLK_SPI2|RCC_PERIPHCLK_SPI1;
+  PeriphClkInitStruct.PLL2.PLL2M = 2;
+  PeriphClkInitStruct.PLL2.PLL2N = base == 44100U ? 90 : 98;
+  PeriphClkInitStruct.PLL2.PLL2FRACN = base == 44100U ? 2595 : 2490;
+  PeriphClkInitStruct.PLL2.PLL2P = 2;
+  PeriphClkInitStruct.PLL2.PLL2Q = 2;
+  PeriphClkInitStruct.PLL2.PLL2R = 2;
+  PeriphClkInitStruct.PLL2.PLL2RGE = RCC_PLL2VCIRANGE_2;
+  PeriphClkInitStruct.PLL2.PLL2VCOSEL = RCC_PLL2VCOWIDE;
+  PeriphClkInitStruct.Spi123ClockSelection = RCC_SPI123CLKSOURCE_PLL2;
+  if (HAL_RCCEx_PeriphCLKConfig(&PeriphClkInitStruct) != HAL_OK) {
+    return HAL_ERROR;
+  }
+
+  family = base;
+  return HAL_OK;
+}
+
+/**
+  * @brief Start the SOF timestamp timer: free-running at the APB1 timer
+  *        clock, CCR1 latches the counter on every USB SOF through the
+  *        internal trigger, whatever the interrupt latency.
+  * @retval None
+  */
+void AUDIO_SofTimerInit(void) {
+  __HAL_RCC_TIM2_CLK_ENABLE();
+
+  AUDIO_SOF_TIM->CR1 = 0U;
+  AUDIO_SOF_TIM->PSC = 0U;
+  AUDIO_SOF_TIM->ARR = 0xFFFFFFFFU;
+  AUDIO_SOF_TIM->SMCR = AUDIO_SOF_TIM_ITR;
+  /* IC1 mapped on TRC, no filter, no prescaler, rising edge */
+  AUDIO_SOF_TIM->CCMR1 = TIM_CCMR1_CC1S_0 | TIM_CCMR1_CC1S_1;
+  AUDIO_SOF_TIM->CCER = TIM_CCER_CC1E;
+  AUDIO_SOF_TIM->EGR = TIM_EGR_UG;
+  AUDIO_SOF_TIM->CR1 = TIM_CR1_CEN;
+}
+
+/**
+  * @brief Clock of the SOF timestamp timer
+  * @retval Hz
+  */
+uint32_t AUDIO_SofTimerGetClock(void) {
+  uint32_t pclk1 = HAL_RCC_GetPCLK1Freq();
+
+  /* APB1 timers run at twice PCLK1 whenever APB1 is divided (TIMPRE = 0) */
+  return (RCC->D2CFGR & RCC_D2CFGR_D2PPRE1_2) == 0U ? pclk1 : 2U * pclk1;
+}
+
 int __io_getchar(void) {
   return EOF;
 }
@@ -12,6 +12,7 @@
 
 void LCD_Init(void);
 void LCD_Sync(void);
+uint8_t LCD_Idle(void);
 void LCD_DrawRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint16_t color);
 
 #endif /* INC_LCD_H_ */
@@ -202,6 +202,17 @@ void LCD_Sync(void) {
   HAL_SPI_Transmit_DMA(&hspi1, buf, size);
 }
 
+/*
+ * SPI1 takes its kernel clock from PLL2 through the SPI123 mux it shares with
+ * the I2S, which AUDIO_ClockConfig retunes on a sampling frequency change.
+ * A transfer only starts from LCD_Sync, in thread mode or chained from its own
+ * completion, so once this returns 1 in thread mode the bus stays quiet until
+ * the next LCD_Sync.
+ */
+uint8_t LCD_Idle(void) {
+  return nBytesSyncing == 0 ? 1 : 0;
+}
+
 void LCD_DrawRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint16_t color) {
   for (uint8_t i = x; i < x + w; i++) {
     for (uint8_t j = y; j < y + h; j++)  {
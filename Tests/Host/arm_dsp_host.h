@@ -0,0 +1,67 @@
+/**
+ ******************************************************************************
+ * @file    arm_dsp_host.h
+ * @brief   Cortex-M7 SIMD intrinsics in C, so the ARM_MATH_DSP paths of the
+ *          Audio modules can be built and compared on a host. Included ahead
+ *          of every source of the _dsp test variants.
+ ******************************************************************************
+ */
+
+#ifndef __ARM_DSP_HOST_H
+#define __ARM_DSP_HOST_H
+
+#include <stdint.h>
+
+/* APSR.GE bits of the last parallel subtraction, one per halfword */
+static uint32_t arm_dsp_host_ge;
+
+static inline int32_t __QADD(int32_t x, int32_t y) {
+  int64_t sum = (int64_t)x + y;
+
+  return sum > INT32_MAX ? INT32_MAX : sum < INT32_MIN ? INT32_MIN : (int32_t)sum;
+}
+
+static inline int32_t __QSUB(int32_t x, int32_t y) {
+  int64_t diff = (int64_t)x - y;
+
+  return diff > INT32_MAX ? INT32_MAX : diff < INT32_MIN ? INT32_MIN : (int32_t)diff;
+}
+
+static inline uint32_t __SMUAD(uint32_t x, uint32_t y) {
+  return (uint32_t)((int32_t)(int16_t)x * (int16_t)y + (int32_t)(int16_t)(x >> 16) * (int16_t)(y >> 16));
+}
+
+static inline uint32_t __SMLAD(uint32_t x, uint32_t y, uint32_t sum) {
+  return (uint32_t)((int32_t)(int16_t)x * (int16_t)y + (int32_t)(int16_t)(x >> 16) * (int16_t)(y >> 16) +
+                    (int32_t)sum);
+}
+
+static inline uint32_t __SMLADX(uint32_t x, uint32_t y, uint32_t sum) {
+  return (uint32_t)((int32_t)(int16_t)x * (int16_t)(y >> 16) + (int32_t)(int16_t)(x >> 16) * (int16_t)y +
+                    (int32_t)sum);
+}
+
+static inline uint64_t __SMLALD(uint32_t x, uint32_t y, uint64_t sum) {
+  return (uint64_t)((int64_t)(int16_t)x * (int16_t)y + (int64_t)(int16_t)(x >> 16) * (int16_t)(y >> 16) +
+                    (int64_t)sum);
+}
+
+static inline uint32_t __SSUB16(uint32_t x, uint32_t y) {
+  int32_t lo = (int32_t)(int16_t)x - (int16_t)y;
+  int32_t hi = (int32_t)(int16_t)(x >> 16) - (int16_t)(y >> 16);
+
+  arm_dsp_host_ge = (lo >= 0 ? 0x3U : 0U) | (hi >= 0 ? 0xCU : 0U);
+  return ((uint32_t)lo & 0xFFFFU) | ((uint32_t)hi << 16);
+}
+
+static inline uint32_t __SEL(uint32_t x, uint32_t y) {
+  return ((arm_dsp_host_ge & 0x3U) != 0U ? x & 0xFFFFU : y & 0xFFFFU) |
+         ((arm_dsp_host_ge & 0xCU) != 0U ? x & 0xFFFF0000U : y & 0xFFFF0000U);
+}
+
+#define __SMULWB(ARG1, ARG2) ((int32_t)(((int64_t)(int32_t)(ARG1) * (int16_t)(ARG2)) >> 16))
+#define __SMULWT(ARG1, ARG2) ((int32_t)(((int64_t)(int32_t)(ARG1) * (int16_t)((uint32_t)(ARG2) >> 16)) >> 16))
+#define __PKHBT(ARG1, ARG2, ARG3) ((((uint32_t)(ARG1)) & 0x0000FFFFU) | (((uint32_t)(ARG2) << (ARG3)) & 0xFFFF0000U))
+#define __PKHTB(ARG1, ARG2, ARG3) ((((uint32_t)(ARG1)) & 0xFFFF0000U) | (((uint32_t)(ARG2) >> (ARG3)) & 0x0000FFFFU))
+
+#endif /* __ARM_DSP_HOST_H */
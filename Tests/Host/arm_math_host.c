@@ -0,0 +1,438 @@
+/**
+ ******************************************************************************
+ * @file    arm_math_host.c
+ * @brief   Plain C versions of the CMSIS-DSP functions the Audio modules
+ *          call, for the host tests. Results match the reference semantics
+ *          of CMSIS-DSP V1.7, not its exact rounding.
+ ******************************************************************************
+ */
+
+#include "arm_math.h"
+
+#include <math.h>
+
+void arm_biquad_cascade_df2T_init_f32(arm_biquad_cascade_df2T_instance_f32 *S, uint8_t numStages,
+                                      const float32_t *pCoeffs, float32_t *pState) {
+  S->numStages = numStages;
+  S->pCoeffs = pCoeffs;
+  S->pState = pState;
+}
+
+void arm_biquad_cascade_df2T_f32(const arm_biquad_cascade_df2T_instance_f32 *S, const float32_t *pSrc,
+                                 float32_t *pDst, uint32_t blockSize) {
+  const float32_t *in = pSrc;
+
+  for (uint32_t stage = 0U; stage < S->numStages; stage++) {
+    const float32_t *c = &S->pCoeffs[5U * stage];
+    float32_t *d = &S->pState[2U * stage];
+
+    for (uint32_t i = 0U; i < blockSize; i++) {
+      float32_t x = in[i];
+      float32_t y = c[0] * x + d[0];
+
+      d[0] = c[1] * x + c[3] * y + d[1];
+      d[1] = c[2] * x + c[4] * y;
+      pDst[i] = y;
+    }
+    in = pDst;
+  }
+  if (S->numStages == 0U && pDst != pSrc) {
+    for (uint32_t i = 0U; i < blockSize; i++) {
+      pDst[i] = pSrc[i];
+    }
+  }
+}
+
+void arm_biquad_cascade_stereo_df2T_init_f32(arm_biquad_cascade_stereo_df2T_instance_f32 *S, uint8_t numStages,
+                                             const float32_t *pCoeffs, float32_t *pState) {
+  S->numStages = numStages;
+  S->pCoeffs = pCoeffs;
+  S->pState = pState;
+}
+
+void arm_biquad_cascade_stereo_df2T_f32(const arm_biquad_cascade_stereo_df2T_instance_f32 *S, const float32_t *pSrc,
+                                        float32_t *pDst, uint32_t blockSize) {
+  const float32_t *in = pSrc;
+
+  for (uint32_t stage = 0U; stage < S->numStages; stage++) {
+    const float32_t *c = &S->pCoeffs[5U * stage];
+    float32_t *d = &S->pState[4U * stage];
+
+    for (uint32_t i = 0U; i < 2U * blockSize; i++) {
+      float32_t *dc = &d[2U * (i & 1U)];
+      float32_t x = in[i];
+      float32_t y = c[0] * x + dc[0];
+
+      dc[0] = c[1] * x + c[3] * y + dc[1];
+      dc[1] = c[2] * x + c[4] * y;
+      pDst[i] = y;
+    }
+    in = pDst;
+  }
+  if (S->numStages == 0U && pDst != pSrc) {
+    for (uint32_t i = 0U; i < 2U * blockSize; i++) {
+      pDst[i] = pSrc[i];
+    }
+  }
+}
+
+float32_t arm_sin_f32(float32_t x) {
+  return sinf(x);
+}
+
+float32_t arm_cos_f32(float32_t x) {
+  return cosf(x);
+}
+
+void arm_vexp_f32(const float32_t *pSrc, float32_t *pDst, uint32_t blockSize) {
+  for (uint32_t i = 0U; i < blockSize; i++) {
+    pDst[i] = expf(pSrc[i]);
+  }
+}
+
+void arm_scale_f32(const float32_t *pSrc, float32_t scale, float32_t *pDst, uint32_t blockSize) {
+  for (uint32_t i = 0U; i < blockSize; i++) {
+    pDst[i] = pSrc[i] * scale;
+  }
+}
+
+void arm_q15_to_float(const q15_t *pSrc, float32_t *pDst, uint32_t blockSize) {
+  for (uint32_t i = 0U; i < blockSize; i++) {
+    pDst[i] = (float32_t)pSrc[i] / 32768.0f;
+  }
+}
+
+void arm_q31_to_float(const q31_t *pSrc, float32_t *pDst, uint32_t blockSize) {
+  for (uint32_t i = 0U; i < blockSize; i++) {
+    pDst[i] = (float32_t)pSrc[i] / 2147483648.0f;
+  }
+}
+
+void arm_float_to_q31(const float32_t *pSrc, q31_t *pDst, uint32_t blockSize) {
+  for (uint32_t i = 0U; i < blockSize; i++) {
+    float32_t x = pSrc[i] * 2147483648.0f;
+
+    /* Saturating, rounded to nearest like the CMSIS kernel */
+    pDst[i] = x >= 2147483647.0f ? INT32_MAX : x <= -2147483648.0f ? INT32_MIN : (q31_t)(x + (x > 0.0f ? 0.5f : -0.5f));
+  }
+}
+
+void arm_mult_f32(const float32_t *pSrcA, const float32_t *pSrcB, float32_t *pDst, uint32_t blockSize) {
+  for (uint32_t i = 0U; i < blockSize; i++) {
+    pDst[i] = pSrcA[i] * pSrcB[i];
+  }
+}
+
+void arm_mult_q31(const q31_t *pSrcA, const q31_t *pSrcB, q31_t *pDst, uint32_t blockSize) {
+  for (uint32_t i = 0U; i < blockSize; i++) {
+    q63_t p = ((q63_t)pSrcA[i] * pSrcB[i]) >> 31;
+
+    pDst[i] = p > INT32_MAX ? INT32_MAX : (q31_t)p;
+  }
+}
+
+void arm_mult_q15(const q15_t *pSrcA, const q15_t *pSrcB, q15_t *pDst, uint32_t blockSize) {
+  for (uint32_t i = 0U; i < blockSize; i++) {
+    int32_t p = ((int32_t)pSrcA[i] * pSrcB[i]) >> 15;
+
+    pDst[i] = p > INT16_MAX ? INT16_MAX : (q15_t)p;
+  }
+}
+
+void arm_q15_to_q31(const q15_t *pSrc, q31_t *pDst, uint32_t blockSize) {
+  for (uint32_t i = 0U; i < blockSize; i++) {
+    pDst[i] = (q31_t)((uint32_t)pSrc[i] << 16);
+  }
+}
+
+void arm_q31_to_q15(const q31_t *pSrc, q15_t *pDst, uint32_t blockSize) {
+  for (uint32_t i = 0U; i < blockSize; i++) {
+    pDst[i] = (q15_t)(pSrc[i] >> 16);
+  }
+}
+
+void arm_shift_q31(const q31_t *pSrc, int8_t shiftBits, q31_t *pDst, uint32_t blockSize) {
+  for (uint32_t i = 0U; i < blockSize; i++) {
+    q63_t x = shiftBits >= 0 ? (q63_t)pSrc[i] * ((q63_t)1 << shiftBits) : (q63_t)(pSrc[i] >> -shiftBits);
+
+    pDst[i] = x > INT32_MAX ? INT32_MAX : x < INT32_MIN ? INT32_MIN : (q31_t)x;
+  }
+}
+
+void arm_shift_q15(const q15_t *pSrc, int8_t shiftBits, q15_t *pDst, uint32_t blockSize) {
+  for (uint32_t i = 0U; i < blockSize; i++) {
+    int32_t x = shiftBits >= 0 ? (int32_t)pSrc[i] * (1 << shiftBits) : (int32_t)(pSrc[i] >> -shiftBits);
+
+    pDst[i] = x > INT16_MAX ? INT16_MAX : x < INT16_MIN ? INT16_MIN : (q15_t)x;
+  }
+}
+
+void arm_max_q15(const q15_t *pSrc, uint32_t blockSize, q15_t *pResult, uint32_t *pIndex) {
+  *pResult = pSrc[0];
+  *pIndex = 0U;
+  for (uint32_t i = 1U; i < blockSize; i++) {
+    if (pSrc[i] > *pResult) {
+      *pResult = pSrc[i];
+      *pIndex = i;
+    }
+  }
+}
+
+void arm_min_q15(const q15_t *pSrc, uint32_t blockSize, q15_t *pResult, uint32_t *pIndex) {
+  *pResult = pSrc[0];
+  *pIndex = 0U;
+  for (uint32_t i = 1U; i < blockSize; i++) {
+    if (pSrc[i] < *pResult) {
+      *pResult = pSrc[i];
+      *pIndex = i;
+    }
+  }
+}
+
+void arm_cmplx_mag_squared_f32(const float32_t *pSrc, float32_t *pDst, uint32_t numSamples) {
+  for (uint32_t i = 0U; i < numSamples; i++) {
+    pDst[i] = pSrc[2U * i] * pSrc[2U * i] + pSrc[2U * i + 1U] * pSrc[2U * i + 1U];
+  }
+}
+
+/*
+ * Real FFTs: an N / 2 point complex radix-2 FFT of the even and odd samples
+ * taken as real and imaginary parts, then the split into the N / 2 + 1 bins
+ * of the real spectrum, the way the CMSIS kernels do it. The fixed-point
+ * versions halve every butterfly and the split, so the output is the
+ * spectrum over N like arm_rfft_q31 and arm_rfft_q15, two-sided. Twiddles
+ * exp(-2 pi j k / 4096) are shared by every size up to 4096, stepped by
+ * 4096 / N.
+ */
+#define HOST_FFT_MAX                                  4096U
+
+static float32_t host_cos_f32[HOST_FFT_MAX / 2U];
+static float32_t host_sin_f32[HOST_FFT_MAX / 2U];
+static q31_t host_cos_q31[HOST_FFT_MAX / 2U];
+static q31_t host_sin_q31[HOST_FFT_MAX / 2U];
+static q15_t host_cos_q15[HOST_FFT_MAX / 2U];
+static q15_t host_sin_q15[HOST_FFT_MAX / 2U];
+
+static void host_fft_twiddles(void) {
+  for (uint32_t k = 0U; k < HOST_FFT_MAX / 2U; k++) {
+    double c = cos(2.0 * M_PI * (double)k / HOST_FFT_MAX);
+    double s = sin(2.0 * M_PI * (double)k / HOST_FFT_MAX);
+
+    host_cos_f32[k] = (float32_t)c;
+    host_sin_f32[k] = (float32_t)s;
+    host_cos_q31[k] = c < 1.0 ? (q31_t)lrint(c * 2147483648.0) : INT32_MAX;
+    host_sin_q31[k] = s < 1.0 ? (q31_t)lrint(s * 2147483648.0) : INT32_MAX;
+    host_cos_q15[k] = c < 1.0 ? (q15_t)lrint(c * 32768.0) : INT16_MAX;
+    host_sin_q15[k] = s < 1.0 ? (q15_t)lrint(s * 32768.0) : INT16_MAX;
+  }
+}
+
+static uint32_t host_fft_reverse(uint32_t i, uint32_t m) {
+  uint32_t r = 0U;
+
+  for (uint32_t b = 1U; b < m; b <<= 1) {
+    r = (r << 1) | ((i & b) != 0U ? 1U : 0U);
+  }
+  return r;
+}
+
+#define HOST_FFT_SWAP(x, i, j, type)                                           \
+  do {                                                                         \
+    type t0 = (x)[2U * (i)];                                                   \
+    type t1 = (x)[2U * (i) + 1U];                                              \
+    (x)[2U * (i)] = (x)[2U * (j)];                                             \
+    (x)[2U * (i) + 1U] = (x)[2U * (j) + 1U];                                   \
+    (x)[2U * (j)] = t0;                                                        \
+    (x)[2U * (j) + 1U] = t1;                                                   \
+  } while (0)
+
+arm_status arm_rfft_fast_init_f32(arm_rfft_fast_instance_f32 *S, uint16_t fftLen) {
+  if (fftLen < 32U || fftLen > HOST_FFT_MAX || (fftLen & (fftLen - 1U)) != 0U) {
+    return ARM_MATH_ARGUMENT_ERROR;
+  }
+  host_fft_twiddles();
+  S->fftLenRFFT = fftLen;
+  S->pTwiddleRFFT = host_cos_f32;
+  return ARM_MATH_SUCCESS;
+}
+
+void arm_rfft_fast_f32(const arm_rfft_fast_instance_f32 *S, float32_t *p, float32_t *pOut, uint8_t ifftFlag) {
+  uint32_t m = S->fftLenRFFT / 2U;
+  uint32_t step = HOST_FFT_MAX / S->fftLenRFFT;
+
+  (void)ifftFlag;
+  for (uint32_t i = 0U; i < m; i++) {
+    uint32_t j = host_fft_reverse(i, m);
+
+    if (j > i) {
+      HOST_FFT_SWAP(p, i, j, float32_t);
+    }
+  }
+  for (uint32_t half = 1U; half < m; half <<= 1) {
+    uint32_t tw = HOST_FFT_MAX / (2U * half);
+
+    for (uint32_t i = 0U; i < m; i += 2U * half) {
+      for (uint32_t k = 0U; k < half; k++) {
+        float32_t c = host_cos_f32[k * tw];
+        float32_t s = host_sin_f32[k * tw];
+        float32_t *a = &p[2U * (i + k)];
+        float32_t *b = &p[2U * (i + k + half)];
+        float32_t re = c * b[0] + s * b[1];
+        float32_t im = c * b[1] - s * b[0];
+
+        b[0] = a[0] - re;
+        b[1] = a[1] - im;
+        a[0] += re;
+        a[1] += im;
+      }
+    }
+  }
+
+  /* Split, X[0] and the real X[N / 2] packed together */
+  pOut[0] = p[0] + p[1];
+  pOut[1] = p[0] - p[1];
+  for (uint32_t k = 1U; k < m; k++) {
+    float32_t sr = p[2U * k] + p[2U * (m - k)];
+    float32_t si = p[2U * k + 1U] - p[2U * (m - k) + 1U];
+    float32_t dr = p[2U * k] - p[2U * (m - k)];
+    float32_t di = p[2U * k + 1U] + p[2U * (m - k) + 1U];
+    float32_t c = host_cos_f32[k * step];
+    float32_t s = host_sin_f32[k * step];
+
+    pOut[2U * k] = 0.5f * (sr + c * di - s * dr);
+    pOut[2U * k + 1U] = 0.5f * (si - c * dr - s * di);
+  }
+}
+
+arm_status arm_rfft_init_q31(arm_rfft_instance_q31 *S, uint32_t fftLenReal, uint32_t ifftFlagR,
+                             uint32_t bitReverseFlag) {
+  if (fftLenReal < 32U || fftLenReal > HOST_FFT_MAX || (fftLenReal & (fftLenReal - 1U)) != 0U) {
+    return ARM_MATH_ARGUMENT_ERROR;
+  }
+  host_fft_twiddles();
+  S->fftLenReal = fftLenReal;
+  S->ifftFlagR = (uint8_t)ifftFlagR;
+  S->bitReverseFlagR = (uint8_t)bitReverseFlag;
+  S->twidCoefRModifier = HOST_FFT_MAX / fftLenReal;
+  S->pTwiddleAReal = host_cos_q31;
+  S->pTwiddleBReal = host_sin_q31;
+  S->pCfft = NULL;
+  return ARM_MATH_SUCCESS;
+}
+
+void arm_rfft_q31(const arm_rfft_instance_q31 *S, q31_t *pSrc, q31_t *pDst) {
+  uint32_t n = S->fftLenReal;
+  uint32_t m = n / 2U;
+
+  for (uint32_t i = 0U; i < m; i++) {
+    uint32_t j = host_fft_reverse(i, m);
+
+    if (j > i) {
+      HOST_FFT_SWAP(pSrc, i, j, q31_t);
+    }
+  }
+  for (uint32_t half = 1U; half < m; half <<= 1) {
+    uint32_t tw = HOST_FFT_MAX / (2U * half);
+
+    for (uint32_t i = 0U; i < m; i += 2U * half) {
+      for (uint32_t k = 0U; k < half; k++) {
+        q63_t c = host_cos_q31[k * tw];
+        q63_t s = host_sin_q31[k * tw];
+        q31_t *a = &pSrc[2U * (i + k)];
+        q31_t *b = &pSrc[2U * (i + k + half)];
+        q63_t re = (c * b[0] + s * b[1]) >> 31;
+        q63_t im = (c * b[1] - s * b[0]) >> 31;
+
+        b[0] = (q31_t)(((q63_t)a[0] - re) >> 1);
+        b[1] = (q31_t)(((q63_t)a[1] - im) >> 1);
+        a[0] = (q31_t)(((q63_t)a[0] + re) >> 1);
+        a[1] = (q31_t)(((q63_t)a[1] + im) >> 1);
+      }
+    }
+  }
+
+  pDst[0] = (q31_t)(((q63_t)pSrc[0] + pSrc[1]) >> 1);
+  pDst[1] = 0;
+  pDst[n] = (q31_t)(((q63_t)pSrc[0] - pSrc[1]) >> 1);
+  pDst[n + 1U] = 0;
+  for (uint32_t k = 1U; k < m; k++) {
+    /* Halved first, the products would not fit 64 bits */
+    q63_t sr = ((q63_t)pSrc[2U * k] + pSrc[2U * (m - k)]) >> 1;
+    q63_t si = ((q63_t)pSrc[2U * k + 1U] - pSrc[2U * (m - k) + 1U]) >> 1;
+    q63_t dr = ((q63_t)pSrc[2U * k] - pSrc[2U * (m - k)]) >> 1;
+    q63_t di = ((q63_t)pSrc[2U * k + 1U] + pSrc[2U * (m - k) + 1U]) >> 1;
+    q63_t c = host_cos_q31[k * S->twidCoefRModifier];
+    q63_t s = host_sin_q31[k * S->twidCoefRModifier];
+
+    pDst[2U * k] = (q31_t)((sr + ((c * di - s * dr) >> 31)) >> 1);
+    pDst[2U * k + 1U] = (q31_t)((si - ((c * dr + s * di) >> 31)) >> 1);
+    pDst[2U * (n - k)] = pDst[2U * k];
+    pDst[2U * (n - k) + 1U] = -pDst[2U * k + 1U];
+  }
+}
+
+arm_status arm_rfft_init_q15(arm_rfft_instance_q15 *S, uint32_t fftLenReal, uint32_t ifftFlagR,
+                             uint32_t bitReverseFlag) {
+  if (fftLenReal < 32U || fftLenReal > HOST_FFT_MAX || (fftLenReal & (fftLenReal - 1U)) != 0U) {
+    return ARM_MATH_ARGUMENT_ERROR;
+  }
+  host_fft_twiddles();
+  S->fftLenReal = fftLenReal;
+  S->ifftFlagR = (uint8_t)ifftFlagR;
+  S->bitReverseFlagR = (uint8_t)bitReverseFlag;
+  S->twidCoefRModifier = HOST_FFT_MAX / fftLenReal;
+  S->pTwiddleAReal = host_cos_q15;
+  S->pTwiddleBReal = host_sin_q15;
+  S->pCfft = NULL;
+  return ARM_MATH_SUCCESS;
+}
+
+void arm_rfft_q15(const arm_rfft_instance_q15 *S, q15_t *pSrc, q15_t *pDst) {
+  uint32_t n = S->fftLenReal;
+  uint32_t m = n / 2U;
+
+  for (uint32_t i = 0U; i < m; i++) {
+    uint32_t j = host_fft_reverse(i, m);
+
+    if (j > i) {
+      HOST_FFT_SWAP(pSrc, i, j, q15_t);
+    }
+  }
+  for (uint32_t half = 1U; half < m; half <<= 1) {
+    uint32_t tw = HOST_FFT_MAX / (2U * half);
+
+    for (uint32_t i = 0U; i < m; i += 2U * half) {
+      for (uint32_t k = 0U; k < half; k++) {
+        int32_t c = host_cos_q15[k * tw];
+        int32_t s = host_sin_q15[k * tw];
+        q15_t *a = &pSrc[2U * (i + k)];
+        q15_t *b = &pSrc[2U * (i + k + half)];
+        int32_t re = (c * b[0] + s * b[1]) >> 15;
+        int32_t im = (c * b[1] - s * b[0]) >> 15;
+
+        b[0] = (q15_t)((a[0] - re) >> 1);
+        b[1] = (q15_t)((a[1] - im) >> 1);
+        a[0] = (q15_t)((a[0] + re) >> 1);
+        a[1] = (q15_t)((a[1] + im) >> 1);
+      }
+    }
+  }
+
+  pDst[0] = (q15_t)((pSrc[0] + pSrc[1]) >> 1);
+  pDst[1] = 0;
+  pDst[n] = (q15_t)((pSrc[0] - pSrc[1]) >> 1);
+  pDst[n + 1U] = 0;
+  for (uint32_t k = 1U; k < m; k++) {
+    int32_t sr = pSrc[2U * k] + pSrc[2U * (m - k)];
+    int32_t si = pSrc[2U * k + 1U] - pSrc[2U * (m - k) + 1U];
+    int32_t dr = pSrc[2U * k] - pSrc[2U * (m - k)];
+    int32_t di = pSrc[2U * k + 1U] + pSrc[2U * (m - k) + 1U];
+    int64_t c = host_cos_q15[k * S->twidCoefRModifier];
+    int64_t s = host_sin_q15[k * S->twidCoefRModifier];
+
+    pDst[2U * k] = (q15_t)((sr + (int32_t)((c * di - s * dr) >> 15)) >> 2);
+    pDst[2U * k + 1U] = (q15_t)((si - (int32_t)((c * dr + s * di) >> 15)) >> 2);
+    pDst[2U * (n - k)] = pDst[2U * k];
+    pDst[2U * (n - k) + 1U] = (q15_t)-pDst[2U * k + 1U];
+  }
+}
@@ -0,0 +1,38 @@
+/**
+ ******************************************************************************
+ * @file    audio_host.h
+ * @brief   Target hooks of the Audio modules for the host tests, included
+ *          ahead of every source.
+ ******************************************************************************
+ */
+
+#ifndef __AUDIO_HOST_H
+#define __AUDIO_HOST_H
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * @brief  AUDIO_HostCycles
+ *         Stand-in for the DWT cycle counter: time stamp counter ticks on
+ *         x86, nanoseconds elsewhere
+ * @retval counter, wrapping like CYCCNT
+ */
+static inline uint32_t AUDIO_HostCycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return (uint32_t)__builtin_ia32_rdtsc();
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec);
+#endif
+}
+
+#define AUDIO_RING_BARRIER()                          __sync_synchronize()
+#define AUDIO_FIFO_BARRIER()                          __sync_synchronize()
+#define AUDIO_LEVEL_BARRIER()                         __sync_synchronize()
+#define AUDIO_GRAPH_CYCLES()                          AUDIO_HostCycles()
+#define AUDIO_SPECTRUM_CYCLES()                       AUDIO_HostCycles()
+
+#endif /* __AUDIO_HOST_H */
@@ -0,0 +1,294 @@
+/**
+ ******************************************************************************
+ * @file    usbd_host.c
+ * @brief   USB core, HAL and board stand-ins for the host tests of the
+ *          class drivers, see usbd_host.h.
+ ******************************************************************************
+ */
+
+#include "usbd_host.h"
+
+#include "usbd_audio.h"
+#include "usbd_ctlreq.h"
+#include "usbd_ioreq.h"
+
+#include <string.h>
+
+/* SOF timer clock, one capture per USB frame of exactly 1 ms */
+#define USBD_HOST_SOF_TIM_CLOCK                       200000000U
+
+USBD_HostTypeDef USBD_Host;
+DWT_Type USBD_HostDwt;
+USB_OTG_DeviceTypeDef USBD_HostDevice;
+TIM_TypeDef USBD_HostSofTim;
+DMA_Stream_TypeDef USBD_HostDmaStream;
+
+static SPI_TypeDef USBD_HostSpi;
+static DMA_HandleTypeDef USBD_HostDma = {.Instance = &USBD_HostDmaStream};
+
+I2S_HandleTypeDef hi2s2 = {
+    .Instance = &USBD_HostSpi,
+    .Init = {.DataFormat = I2S_DATAFORMAT_16B, .AudioFreq = USBD_AUDIO_FREQ},
+    .hdmatx = &USBD_HostDma,
+};
+
+/* USB core ------------------------------------------------------------------*/
+
+USBD_StatusTypeDef USBD_CtlSendData(USBD_HandleTypeDef *pdev, uint8_t *pbuf, uint32_t len) {
+  UNUSED(pdev);
+
+  USBD_Host.ctl_len = len;
+  USBD_Host.ctl_sends++;
+  (void)memcpy(USBD_Host.ctl_data, pbuf, MIN(len, USBD_HOST_CTL_SIZE));
+  return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_CtlPrepareRx(USBD_HandleTypeDef *pdev, uint8_t *pbuf, uint32_t len) {
+  UNUSED(pdev);
+
+  USBD_Host.rx_buf = pbuf;
+  USBD_Host.rx_len = len;
+  USBD_Host.rx_prepares++;
+  return USBD_OK;
+}
+
+void USBD_CtlError(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req) {
+  UNUSED(pdev);
+  UNUSED(req);
+
+  USBD_Host.ctl_errors++;
+}
+
+USBD_DescHeaderTypeDef *USBD_FindDesc(uint8_t *buf, uint8_t type, uint8_t subType) {
+  UNUSED(buf);
+  UNUSED(type);
+  UNUSED(subType);
+
+  return NULL;
+}
+
+USBD_StatusTypeDef USBD_LL_OpenEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t ep_type, uint16_t ep_mps) {
+  UNUSED(pdev);
+  UNUSED(ep_addr);
+  UNUSED(ep_type);
+  UNUSED(ep_mps);
+
+  return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_CloseEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr) {
+  UNUSED(pdev);
+  UNUSED(ep_addr);
+
+  return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_FlushEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr) {
+  UNUSED(pdev);
+  UNUSED(ep_addr);
+
+  return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_Transmit(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t *pbuf, uint32_t size) {
+  UNUSED(pdev);
+
+  USBD_Host.tx_data[ep_addr & 0xFU] = pbuf;
+  USBD_Host.tx_len[ep_addr & 0xFU] = size;
+  USBD_Host.tx_count[ep_addr & 0xFU]++;
+  return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_PrepareReceive(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t *pbuf, uint32_t size) {
+  UNUSED(pdev);
+  UNUSED(ep_addr);
+  UNUSED(size);
+
+  USBD_Host.out_buf = pbuf;
+  return USBD_OK;
+}
+
+uint32_t USBD_LL_GetRxDataSize(USBD_HandleTypeDef *pdev, uint8_t ep_addr) {
+  UNUSED(pdev);
+  UNUSED(ep_addr);
+
+  return USBD_Host.out_len;
+}
+
+void *USBD_static_malloc(uint32_t size) {
+  UNUSED(size);
+  static uint32_t mem[(sizeof(USBD_AUDIO_HandleTypeDef) / 4) + 1]; /* On 32-bit boundary */
+  return mem;
+}
+
+void USBD_static_free(void *p) {
+  UNUSED(p);
+}
+
+/* HAL and board -------------------------------------------------------------*/
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma) {
+  UNUSED(hdma);
+
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2S_Init(I2S_HandleTypeDef *hi2s) {
+  /* No prescaler, the kernel clock below gives the exact rate */
+  hi2s->Instance->I2SCFGR = hi2s->Init.DataFormat == I2S_DATAFORMAT_16B ? 0U : SPI_I2SCFGR_CHLEN;
+  return HAL_OK;
+}
+
+uint32_t HAL_RCCEx_GetPeriphCLKFreq(uint64_t PeriphClk) {
+  UNUSED(PeriphClk);
+
+  return hi2s2.Init.AudioFreq * 2U * ((hi2s2.Instance->I2SCFGR & SPI_I2SCFGR_CHLEN) != 0U ? 32U : 16U);
+}
+
+HAL_StatusTypeDef HAL_I2S_Transmit_DMA(I2S_HandleTypeDef *hi2s, const uint16_t *pData, uint16_t Size) {
+  UNUSED(hi2s);
+
+  USBD_Host.dma_buf = (uint16_t *)pData;
+  USBD_Host.dma_size = Size;
+  USBD_Host.dma_on = 1U;
+  USBD_HostDmaStream.NDTR = Size;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2S_DMAStop(I2S_HandleTypeDef *hi2s) {
+  UNUSED(hi2s);
+
+  USBD_Host.dma_on = 0U;
+  return HAL_OK;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState) {
+  UNUSED(GPIOx);
+
+  if (GPIO_Pin == SD_MODE_Pin) {
+    USBD_Host.sd_mode = PinState;
+  }
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn) {
+  UNUSED(IRQn);
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn) {
+  UNUSED(IRQn);
+}
+
+HAL_StatusTypeDef AUDIO_ClockConfig(uint32_t freq) {
+  UNUSED(freq);
+
+  return USBD_Host.clock_status;
+}
+
+uint32_t AUDIO_SofTimerGetClock(void) {
+  return USBD_HOST_SOF_TIM_CLOCK;
+}
+
+/* Test drivers --------------------------------------------------------------*/
+
+/**
+ * @brief  USBD_HostInit
+ *         Configure a device on a class driver, as after SET_CONFIGURATION
+ * @param  pdev: device instance, cleared
+ * @param  pclass: class driver
+ * @retval status of the class Init
+ */
+uint8_t USBD_HostInit(USBD_HandleTypeDef *pdev, USBD_ClassTypeDef *pclass) {
+  (void)memset(&USBD_Host, 0, sizeof(USBD_Host));
+  (void)memset(pdev, 0, sizeof(*pdev));
+  USBD_HostDevice.DSTS = 0U;
+  USBD_HostSofTim.CCR1 = 0U;
+  USBD_HostDmaStream.NDTR = 0U;
+  USBD_Host.clock_status = HAL_OK;
+
+  pdev->pClass[0] = pclass;
+  pdev->dev_state = USBD_STATE_CONFIGURED;
+  return pclass->Init(pdev, 1U);
+}
+
+/**
+ * @brief  USBD_HostSetup
+ *         Hand a SETUP packet to the class driver
+ * @retval status of the class Setup, a STALL is counted in USBD_Host.ctl_errors
+ */
+uint8_t USBD_HostSetup(USBD_HandleTypeDef *pdev, uint8_t bmRequest, uint8_t bRequest, uint16_t wValue,
+                       uint16_t wIndex, uint16_t wLength) {
+  USBD_SetupReqTypedef req = {bmRequest, bRequest, wValue, wIndex, wLength};
+
+  return pdev->pClass[0]->Setup(pdev, &req);
+}
+
+/**
+ * @brief  USBD_HostDataStage
+ *         Complete the OUT data stage the last Setup prepared
+ * @param  data: bytes sent by the host, at most the prepared length
+ * @retval status of the class EP0_RxReady
+ */
+uint8_t USBD_HostDataStage(USBD_HandleTypeDef *pdev, const uint8_t *data, uint32_t len) {
+  (void)memcpy(USBD_Host.rx_buf, data, MIN(len, USBD_Host.rx_len));
+  return pdev->pClass[0]->EP0_RxReady(pdev);
+}
+
+/**
+ * @brief  USBD_HostOut
+ *         Deliver one isochronous OUT packet into the buffer last prepared
+ * @retval status of the class DataOut
+ */
+uint8_t USBD_HostOut(USBD_HandleTypeDef *pdev, const uint8_t *packet, uint32_t len) {
+  (void)memcpy(USBD_Host.out_buf, packet, len);
+  USBD_Host.out_len = len;
+  return pdev->pClass[0]->DataOut(pdev, AUDIO_OUT_EP);
+}
+
+/**
+ * @brief  USBD_HostSof
+ *         Start the next USB frame: frame number and SOF timer capture
+ *         move on, then the class SOF handler runs
+ * @retval status of the class SOF
+ */
+uint8_t USBD_HostSof(USBD_HandleTypeDef *pdev) {
+  uint32_t fnsof = ((USBD_HostDevice.DSTS & USB_OTG_DSTS_FNSOF) >> 8) + 1U;
+
+  USBD_HostDevice.DSTS = (fnsof << 8) & USB_OTG_DSTS_FNSOF;
+  USBD_HostSofTim.CCR1 += USBD_HOST_SOF_TIM_CLOCK / 1000U;
+  return pdev->pClass[0]->SOF(pdev);
+}
+
+/**
+ * @brief  USBD_HostPlay
+ *         Shift frames out of the I2S DMA buffer, running the half and
+ *         complete transfer callbacks as the DMA crosses them
+ * @param  frames: stereo frames
+ * @param  left: left channel of each frame as played, as q31, or NULL
+ * @retval None
+ */
+void USBD_HostPlay(USBD_HandleTypeDef *pdev, uint32_t frames, int32_t *left) {
+  for (uint32_t i = 0U; i < frames; i++) {
+    if (USBD_Host.dma_on == 0U) {
+      if (left != NULL) {
+        left[i] = 0;
+      }
+      continue;
+    }
+
+    if (left != NULL) {
+      uint32_t item = USBD_Host.dma_size - USBD_HostDmaStream.NDTR;
+
+      /* 16-bit samples take one halfword each, wider ones a word */
+      left[i] = hi2s2.Init.DataFormat == I2S_DATAFORMAT_16B ? (int32_t)((uint32_t)(int16_t)USBD_Host.dma_buf[item] << 16)
+                                                           : ((int32_t *)USBD_Host.dma_buf)[item];
+    }
+
+    USBD_HostDmaStream.NDTR -= 2U;
+    if (USBD_HostDmaStream.NDTR == USBD_Host.dma_size / 2U) {
+      USBD_AUDIO_Sync(pdev, AUDIO_OFFSET_HALF);
+    } else if (USBD_HostDmaStream.NDTR == 0U) {
+      USBD_HostDmaStream.NDTR = USBD_Host.dma_size;
+      USBD_AUDIO_Sync(pdev, AUDIO_OFFSET_FULL);
+    }
+  }
+}
@@ -0,0 +1,76 @@
+/**
+ ******************************************************************************
+ * @file    usbd_host.h
+ * @brief   Board and USB core stand-ins for the host tests of the class
+ *          drivers, included ahead of every source after audio_host.h.
+ ******************************************************************************
+ * @verbatim
+ *
+ *          usbd_audio.c and usbd_audio2.c are built unchanged. The registers
+ *          they read (DWT cycle counter, OTG frame number, SOF timer
+ *          capture) are redirected to plain structures the test drives, and
+ *          usbd_host.c records what they hand to the USB core and the HAL:
+ *          control data, STALLs, isochronous transfers, the I2S DMA buffer
+ *          and the SD_MODE pin. The DMA position is NDTR of
+ *          USBD_HostDmaStream, moved by the test.
+ *
+ *  @endverbatim
+ ******************************************************************************
+ */
+
+#ifndef __USBD_HOST_H
+#define __USBD_HOST_H
+
+#include "main.h"
+#include "usbd_def.h"
+
+/* Control data, up to the largest report of the class drivers */
+#define USBD_HOST_CTL_SIZE                            256U
+
+typedef struct {
+  /* EP0: last data stage, in both directions */
+  uint8_t ctl_data[USBD_HOST_CTL_SIZE];
+  uint32_t ctl_len;
+  uint32_t ctl_sends;
+  uint8_t *rx_buf;
+  uint32_t rx_len;
+  uint32_t rx_prepares;
+  uint32_t ctl_errors;
+  /* Other endpoints, by number: last transfer queued */
+  uint8_t *tx_data[16];
+  uint32_t tx_len[16];
+  uint32_t tx_count[16];
+  uint8_t *out_buf;
+  uint32_t out_len;
+  /* I2S, DMA and the amplifier */
+  uint16_t *dma_buf;
+  uint16_t dma_size;
+  uint8_t dma_on;
+  GPIO_PinState sd_mode;
+  HAL_StatusTypeDef clock_status;
+} USBD_HostTypeDef;
+
+extern USBD_HostTypeDef USBD_Host;
+extern DWT_Type USBD_HostDwt;
+extern USB_OTG_DeviceTypeDef USBD_HostDevice;
+extern TIM_TypeDef USBD_HostSofTim;
+extern DMA_Stream_TypeDef USBD_HostDmaStream;
+extern I2S_HandleTypeDef hi2s2;
+
+#undef DWT
+#define DWT                                           (&USBD_HostDwt)
+/* The SOF handlers still compute the OTG base address, it is not used */
+#undef USBx_DEVICE
+#define USBx_DEVICE                                   ((void)USBx_BASE, &USBD_HostDevice)
+#undef AUDIO_SOF_TIM
+#define AUDIO_SOF_TIM                                 (&USBD_HostSofTim)
+
+uint8_t USBD_HostInit(USBD_HandleTypeDef *pdev, USBD_ClassTypeDef *pclass);
+uint8_t USBD_HostSetup(USBD_HandleTypeDef *pdev, uint8_t bmRequest, uint8_t bRequest, uint16_t wValue,
+                       uint16_t wIndex, uint16_t wLength);
+uint8_t USBD_HostDataStage(USBD_HandleTypeDef *pdev, const uint8_t *data, uint32_t len);
+uint8_t USBD_HostOut(USBD_HandleTypeDef *pdev, const uint8_t *packet, uint32_t len);
+uint8_t USBD_HostSof(USBD_HandleTypeDef *pdev);
+void USBD_HostPlay(USBD_HandleTypeDef *pdev, uint32_t frames, int32_t *left);
+
+#endif /* __USBD_HOST_H */
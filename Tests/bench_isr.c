@@ -0,0 +1,109 @@
+/**
+ ******************************************************************************
+ * @file    bench_isr.c
+ * @brief   Host benchmark of the OUT packet work left in the USB ISR.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  Before the slot ring, USBD_AUDIO_DataOut shifted every sample of the
+ *  packet for the volume and fed the analyzer, as reproduced below from
+ *  the original driver. Now it only publishes the packet
+ *  (USBD_AUDIO_Receive) and hands the next slot to the endpoint. Both run
+ *  here on 48-frame 16-bit stereo packets, alternating so the ring never
+ *  fills. Host times only; on target USBD_AUDIO_HandleTypeDef.dataout_cycles
+ *  holds the DWT worst case.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_ring.h"
+#include "test.h"
+
+#define BENCH_PACKETS                                 2000000U
+#define BENCH_PACKET_SIZE                             (48U * 2U * 2U)
+#define BENCH_SAMPLES                                 1024U
+
+#define VOL_MIN                                       ((int16_t)0xA000)
+#define VOL_MAX                                       ((int16_t)0x0000)
+#define VOL_RES                                       ((int16_t)0x0300)
+
+static AUDIO_RingTypeDef ring;
+static int16_t buffer[BENCH_PACKET_SIZE / 2U] __attribute__((aligned(4)));
+static volatile float samples[BENCH_SAMPLES];
+static volatile uint32_t samples_read;
+static volatile int16_t volume = -0x0C00;
+
+/* Shift-based volume of the original driver */
+static int16_t BENCH_ApplyVolumeControl(int16_t sample, int16_t vol) {
+  if (vol > VOL_MAX) {
+    vol = VOL_MAX;
+  }
+  if (vol < VOL_MIN) {
+    vol = VOL_MIN;
+  }
+  int16_t shifts = (VOL_MAX - vol + (VOL_RES / 2)) / VOL_RES;
+  int16_t shifts2 = shifts >> 1;
+  if (shifts & 1) {
+    sample >>= shifts2;
+    sample += (sample >> 1);
+  } else {
+    sample >>= shifts2;
+  }
+  return sample;
+}
+
+/* Per-packet work of the original USBD_AUDIO_DataOut */
+static void BENCH_DataOutBefore(uint16_t packet_size) {
+  int16_t *ptr = buffer;
+
+  for (uint16_t i = 0; i < packet_size / 2 / sizeof(int16_t); i++) {
+    ptr[i * 2] = BENCH_ApplyVolumeControl(ptr[i * 2], volume);
+    ptr[i * 2 + 1] = BENCH_ApplyVolumeControl(ptr[i * 2 + 1], volume);
+    if (samples_read < BENCH_SAMPLES) {
+      samples[samples_read++] = (float)ptr[i * 2];
+    }
+  }
+}
+
+/* Per-packet work of USBD_AUDIO_DataOut on the slot ring */
+static uint8_t *BENCH_DataOutAfter(uint16_t packet_size) {
+  AUDIO_RingCommit(&ring, packet_size);
+  return AUDIO_RingWriteSlot(&ring);
+}
+
+int main(void) {
+  uint32_t seed = 1U;
+  double before;
+  double after;
+  double t;
+
+  for (uint32_t i = 0U; i < BENCH_PACKET_SIZE / 2U; i++) {
+    buffer[i] = (int16_t)TEST_Rand(&seed);
+  }
+  AUDIO_RingReset(&ring);
+
+  t = TEST_Seconds();
+  for (uint32_t p = 0U; p < BENCH_PACKETS; p++) {
+    BENCH_DataOutBefore(BENCH_PACKET_SIZE);
+    if ((p & 7U) == 0U) {
+      samples_read = 0U;
+    }
+  }
+  before = (TEST_Seconds() - t) / BENCH_PACKETS;
+
+  t = TEST_Seconds();
+  for (uint32_t p = 0U; p < BENCH_PACKETS; p++) {
+    uint8_t *slot = BENCH_DataOutAfter(BENCH_PACKET_SIZE);
+
+    /* Consumer side, outside the measured ISR work on target */
+    AUDIO_RingConsume(&ring, BENCH_PACKET_SIZE);
+    CHECK(slot != NULL);
+  }
+  after = (TEST_Seconds() - t) / BENCH_PACKETS;
+  CHECK(AUDIO_RingFill(&ring) == 0U);
+
+  printf("bench_isr (host): per 48-frame packet, before %.1f ns, after %.1f ns incl. consume, %.0fx\n",
+         before * 1e9, after * 1e9, before / after);
+  return 0;
+}
@@ -0,0 +1,52 @@
+/**
+ ******************************************************************************
+ * @file    test.h
+ * @brief   Minimal checks for the host tests.
+ ******************************************************************************
+ */
+
+#ifndef __TEST_H
+#define __TEST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Fail the test from main() or a function returning int */
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);          \
+      return 1;                                                                \
+    }                                                                          \
+  } while (0)
+
+/**
+ * @brief  TEST_Rand
+ *         xorshift32, reproducible across runs
+ * @param  state: generator state, not 0
+ * @retval next value
+ */
+static inline uint32_t TEST_Rand(uint32_t *state) {
+  uint32_t x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+/**
+ * @brief  TEST_Seconds
+ *         Monotonic time for the host benchmarks
+ * @retval seconds
+ */
+static inline double TEST_Seconds(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+#endif /* __TEST_H */
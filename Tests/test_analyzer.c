@@ -0,0 +1,111 @@
+/**
+ ******************************************************************************
+ * @file    test_analyzer.c
+ * @brief   Analyzer refresh at each overlap: frame count and cost.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  Ten seconds of playback blocks at 48 kHz go through the analyzer FIFO,
+ *  and every frame it yields is refreshed the way the main loop does it:
+ *  read with the hop of the overlap, power spectrum with the default
+ *  engine and window, 1/12 octave bands, dB. A consumer that keeps up
+ *  must get one frame per hop once the first frame is full. Then, for
+ *  0, 50 and 75 % overlap, the host cycles of one refresh, best and mean,
+ *  and the load at the refresh rate of the overlap: cycles per second of
+ *  audio and the share of one host core. The LCD transfer is not in it.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_bands.h"
+#include "audio_fifo.h"
+#include "audio_spectrum.h"
+#include "test.h"
+
+#include <math.h>
+#include <string.h>
+
+#define TEST_FREQ                                     48000U
+#define TEST_BLOCK_FRAMES                             48U
+#define TEST_BLOCKS                                   (10U * TEST_FREQ / TEST_BLOCK_FRAMES)
+
+static AUDIO_FifoTypeDef fifo;
+static AUDIO_SpectrumTypeDef spec;
+static AUDIO_BandsTypeDef bands;
+static int16_t block[TEST_BLOCK_FRAMES * 2U];
+static q15_t frame[AUDIO_SPECTRUM_SIZE];
+
+/* Host counter ticks per second, over a 50 ms spin */
+static double TEST_CounterHz(void) {
+  double t0 = TEST_Seconds();
+  uint32_t c0 = AUDIO_HostCycles();
+  double t;
+
+  do {
+    t = TEST_Seconds();
+  } while (t - t0 < 0.05);
+  return (double)(uint32_t)(AUDIO_HostCycles() - c0) / (t - t0);
+}
+
+int main(void) {
+  static const uint32_t overlap[3] = {0U, 50U, 75U};
+  double hz = TEST_CounterHz();
+  uint32_t seed = 0xA7A1U;
+  volatile float32_t sink = 0.0f;
+
+  AUDIO_SpectrumInit(&spec, AUDIO_SPECTRUM_ENGINE_F32, AUDIO_SPECTRUM_WINDOW_HANN);
+  for (uint32_t o = 0U; o < 3U; o++) {
+    uint32_t hop = AUDIO_SPECTRUM_SIZE * (100U - overlap[o]) / 100U;
+    uint32_t refreshes = 0U;
+    uint32_t best = UINT32_MAX;
+    uint64_t sum = 0U;
+    double load;
+
+    (void)memset(&fifo, 0, sizeof(fifo));
+    for (uint32_t b = 0U; b < TEST_BLOCKS; b++) {
+      for (uint32_t i = 0U; i < TEST_BLOCK_FRAMES; i++) {
+        double t = (double)(b * TEST_BLOCK_FRAMES + i) / TEST_FREQ;
+        int32_t x = (int32_t)lrint(8192.0 * sin(2.0 * M_PI * 1000.0 * t)) + (int32_t)(TEST_Rand(&seed) % 512U) - 256;
+
+        block[2U * i] = (int16_t)x;
+        block[2U * i + 1U] = (int16_t)x;
+      }
+      AUDIO_FifoPush_q15(&fifo, block, TEST_BLOCK_FRAMES);
+
+      for (;;) {
+        float32_t out[AUDIO_BANDS_MAX];
+        float32_t min;
+        float32_t max;
+        uint32_t cycles = AUDIO_HostCycles();
+
+        if (AUDIO_FifoRead_q15(&fifo, frame, AUDIO_SPECTRUM_SIZE, hop) == 0U) {
+          break;
+        }
+        AUDIO_SpectrumProcess(&spec, frame);
+        AUDIO_BandsConfig(&bands, AUDIO_BANDS_OCTAVE_12, TEST_FREQ);
+        AUDIO_BandsProcess(&bands, spec.power, out);
+        AUDIO_SpectrumDb(out, out, bands.count, &min, &max);
+        cycles = AUDIO_HostCycles() - cycles;
+        sink = max;
+
+        /* The first refresh also builds the band index */
+        if (refreshes++ != 0U) {
+          sum += cycles;
+          best = cycles < best ? cycles : best;
+        }
+      }
+    }
+    CHECK(fifo.overruns == 0U);
+    CHECK(refreshes == (TEST_BLOCKS * TEST_BLOCK_FRAMES - AUDIO_SPECTRUM_SIZE) / hop + 1U);
+
+    load = (double)sum / (refreshes - 1U) * TEST_FREQ / hop;
+    printf("test_analyzer: %2u%% overlap, %.1f refreshes/s: host best %u, mean %.0f cycles per refresh, "
+           "%.2f Mcycles/s, %.2f%% of a %.2f GHz core\n",
+           (unsigned)overlap[o], (double)TEST_FREQ / hop, (unsigned)best, (double)sum / (refreshes - 1U), load / 1e6,
+           100.0 * load / hz, hz / 1e9);
+  }
+  (void)sink;
+
+  return 0;
+}
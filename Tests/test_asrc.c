@@ -0,0 +1,215 @@
+/**
+ ******************************************************************************
+ * @file    test_asrc.c
+ * @brief   Fractional resampler against the exact signal, and its cost per
+ *          playback block.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  The resampler runs block by block as USBD_AUDIO_FillBlock drives it:
+ *  AUDIO_AsrcInputFrames new frames after the history slot, then one
+ *  AUDIO_BLOCK_FRAMES output block.
+ *
+ *  At a step of exactly one a sine must come out bit-exact, delayed by
+ *  the two history frames ahead of the first output position. At either
+ *  step limit the input consumed over the run must be the output frames
+ *  times the step, to the Q32 position left over, and every output frame
+ *  must match the sine at its fractional input position to within the
+ *  Catmull-Rom error of a 1 kHz tone at 48 kHz: -95 dBFS, checked to -90.
+ *  A full-scale square wave, which the cubic overshoots by a quarter of
+ *  full scale next to each edge, must saturate rather than wrap: between
+ *  two full-scale inputs the output stays at full scale of the same sign.
+ *
+ *  Then the cost of one block at the upper step limit: the best and the
+ *  mean of the AUDIO_HostCycles counts, time stamp counter ticks on an
+ *  x86 host.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_asrc.h"
+#include "test.h"
+
+#include <math.h>
+#include <string.h>
+
+#define TEST_BLOCK_FRAMES                             48U
+#define TEST_BLOCKS                                   1000U
+#define TEST_OUT_FRAMES                               (TEST_BLOCKS * TEST_BLOCK_FRAMES)
+#define TEST_IN_FRAMES                                (TEST_OUT_FRAMES + TEST_OUT_FRAMES / 128U)
+#define TEST_FREQ                                     48000.0
+#define TEST_TONE                                     1000.0
+#define TEST_AMPLITUDE                                0.5
+/* Output frames against input frames at a step of one */
+#define TEST_DELAY                                    2U
+/* Output frames still reading the zeroed history */
+#define TEST_SETTLE                                   4U
+#define TEST_INTERP_ERROR                             3e-5
+#define BENCH_BLOCKS                                  20000U
+
+static int32_t input[TEST_IN_FRAMES * 2U];
+static int32_t output[TEST_OUT_FRAMES * 2U];
+static int32_t work[AUDIO_ASRC_WORK_FRAMES(TEST_BLOCK_FRAMES) * 2U];
+
+/**
+ * @brief  TEST_Sine
+ *         Test tone at a fractional input position, left and right in
+ *         quadrature
+ * @param  t: input frame
+ * @param  ch: 0 for left, 1 for right
+ * @retval sample, full scale 1
+ */
+static double TEST_Sine(double t, uint32_t ch) {
+  double phase = 2.0 * M_PI * TEST_TONE / TEST_FREQ * t;
+
+  return TEST_AMPLITUDE * (ch == 0U ? sin(phase) : cos(phase));
+}
+
+/**
+ * @brief  TEST_Resample
+ *         Run the whole input through the resampler from a reset
+ * @param  asrc: resampler instance
+ * @param  step: input frames per output frame, Q32
+ * @param  pos: position of the first output frame, Q32, from the first history frame
+ * @retval input frames consumed
+ */
+static uint32_t TEST_Resample(AUDIO_AsrcTypeDef *asrc, uint64_t step, uint64_t *pos) {
+  uint32_t consumed = 0U;
+
+  AUDIO_AsrcReset(asrc);
+  AUDIO_AsrcSetStep(asrc, step);
+  *pos = asrc->pos;
+
+  for (uint32_t b = 0U; b < TEST_BLOCKS; b++) {
+    uint32_t wanted = AUDIO_AsrcInputFrames(asrc, TEST_BLOCK_FRAMES);
+
+    (void)memcpy(&work[AUDIO_ASRC_HISTORY * 2U], &input[consumed * 2U], wanted * 2U * sizeof(int32_t));
+    AUDIO_AsrcProcess_q31(asrc, work, &output[b * TEST_BLOCK_FRAMES * 2U], TEST_BLOCK_FRAMES);
+    consumed += wanted;
+  }
+  return consumed;
+}
+
+static int TEST_Unity(void) {
+  AUDIO_AsrcTypeDef asrc;
+  uint64_t pos;
+
+  for (uint32_t i = 0U; i < TEST_IN_FRAMES; i++) {
+    input[i * 2U] = (int32_t)lrint(TEST_Sine(i, 0U) * 2147483648.0);
+    input[i * 2U + 1U] = (int32_t)lrint(TEST_Sine(i, 1U) * 2147483648.0);
+  }
+
+  CHECK(TEST_Resample(&asrc, AUDIO_ASRC_STEP_UNITY, &pos) == TEST_OUT_FRAMES);
+  for (uint32_t j = 0U; j < TEST_OUT_FRAMES * 2U; j++) {
+    CHECK(output[j] == (j < TEST_DELAY * 2U ? 0 : input[j - TEST_DELAY * 2U]));
+  }
+  return 0;
+}
+
+static int TEST_Limits(void) {
+  const uint64_t limit = AUDIO_ASRC_STEP_UNITY >> AUDIO_ASRC_LIMIT_SHIFT;
+  const uint64_t steps[] = {AUDIO_ASRC_STEP_UNITY + limit, AUDIO_ASRC_STEP_UNITY - limit};
+  AUDIO_AsrcTypeDef asrc;
+
+  /* Beyond the limits the step is clamped to them */
+  AUDIO_AsrcSetStep(&asrc, AUDIO_ASRC_STEP_UNITY + 4U * limit);
+  CHECK(asrc.step == steps[0]);
+  AUDIO_AsrcSetStep(&asrc, AUDIO_ASRC_STEP_UNITY - 4U * limit);
+  CHECK(asrc.step == steps[1]);
+
+  for (uint32_t s = 0U; s < 2U; s++) {
+    uint64_t pos;
+    uint32_t consumed = TEST_Resample(&asrc, steps[s], &pos);
+    double err = 0.0;
+
+    /* Every output frame moved the position by the step, whole frames were consumed */
+    CHECK(((uint64_t)consumed << 32) + asrc.pos == pos + (uint64_t)TEST_OUT_FRAMES * steps[s]);
+    CHECK(fabs((double)consumed - TEST_OUT_FRAMES * ((double)steps[s] / 4294967296.0)) < 3.0);
+
+    for (uint32_t j = TEST_SETTLE; j < TEST_OUT_FRAMES; j++) {
+      /* The first history frame is input frame -AUDIO_ASRC_HISTORY */
+      double t = (double)(pos + (uint64_t)j * steps[s]) / 4294967296.0 - AUDIO_ASRC_HISTORY;
+
+      for (uint32_t ch = 0U; ch < 2U; ch++) {
+        double e = fabs((double)output[j * 2U + ch] / 2147483648.0 - TEST_Sine(t, ch));
+
+        err = e > err ? e : err;
+      }
+    }
+    printf("test_asrc: step 1%+.5f, %u frames in for %u out, worst error %.1f dBFS\n",
+           (double)steps[s] / 4294967296.0 - 1.0, (unsigned)consumed, (unsigned)TEST_OUT_FRAMES, 20.0 * log10(err));
+    CHECK(err < TEST_INTERP_ERROR);
+  }
+  return 0;
+}
+
+static int TEST_Saturate(void) {
+  AUDIO_AsrcTypeDef asrc;
+  uint64_t pos;
+  uint32_t clipped = 0U;
+
+  /* Full-scale square wave, 4 frames per half period */
+  for (uint32_t i = 0U; i < TEST_IN_FRAMES * 2U; i++) {
+    input[i] = ((i / 2U) & 4U) == 0U ? INT32_MAX : INT32_MIN;
+  }
+
+  (void)TEST_Resample(&asrc, AUDIO_ASRC_STEP_UNITY + (AUDIO_ASRC_STEP_UNITY >> AUDIO_ASRC_LIMIT_SHIFT), &pos);
+  for (uint32_t j = TEST_SETTLE; j < TEST_OUT_FRAMES; j++) {
+    uint32_t i1 = (uint32_t)((pos + (uint64_t)j * asrc.step) >> 32) - AUDIO_ASRC_HISTORY;
+    int32_t x0 = input[(i1 - 1U) * 2U];
+    int32_t x1 = input[i1 * 2U];
+    int32_t x2 = input[(i1 + 1U) * 2U];
+
+    for (uint32_t ch = 0U; ch < 2U; ch++) {
+      int32_t y = output[j * 2U + ch];
+
+      if (x1 == x2) {
+        /* Overshoot next to an edge saturates, it must not wrap to the other sign */
+        CHECK(y == x1);
+        clipped += x0 != x1 ? 1U : 0U;
+      }
+    }
+  }
+  CHECK(clipped > 0U);
+  return 0;
+}
+
+static int TEST_Bench(void) {
+  AUDIO_AsrcTypeDef asrc;
+  uint64_t sum = 0U;
+  uint32_t best = UINT32_MAX;
+  uint32_t consumed = 0U;
+
+  AUDIO_AsrcReset(&asrc);
+  AUDIO_AsrcSetStep(&asrc, AUDIO_ASRC_STEP_UNITY + (AUDIO_ASRC_STEP_UNITY >> AUDIO_ASRC_LIMIT_SHIFT));
+  for (uint32_t n = 0U; n < BENCH_BLOCKS; n++) {
+    uint32_t wanted = AUDIO_AsrcInputFrames(&asrc, TEST_BLOCK_FRAMES);
+    uint32_t cycles;
+
+    if (consumed + wanted > TEST_IN_FRAMES) {
+      consumed = 0U;
+    }
+    (void)memcpy(&work[AUDIO_ASRC_HISTORY * 2U], &input[consumed * 2U], wanted * 2U * sizeof(int32_t));
+    cycles = AUDIO_HostCycles();
+    AUDIO_AsrcProcess_q31(&asrc, work, output, TEST_BLOCK_FRAMES);
+    cycles = AUDIO_HostCycles() - cycles;
+    consumed += wanted;
+
+    sum += cycles;
+    best = cycles < best ? cycles : best;
+  }
+  printf("test_asrc: %u-frame block at the upper step limit: host best %u, mean %.0f cycles\n",
+         (unsigned)TEST_BLOCK_FRAMES, (unsigned)best, (double)sum / BENCH_BLOCKS);
+  return 0;
+}
+
+int main(void) {
+  int failed = 0;
+
+  failed |= TEST_Unity();
+  failed |= TEST_Limits();
+  failed |= TEST_Saturate();
+  failed |= TEST_Bench();
+  return failed;
+}
@@ -0,0 +1,178 @@
+/**
+ ******************************************************************************
+ * @file    test_audio.c
+ * @brief   Sampling frequency of the 5.1 stream and mute, through usbd_audio.c.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  The 5.1 alternate setting lists 44.1 and 48 kHz only: at 96 kHz its
+ *  packets, 97 frames of 12 bytes, would not fit AUDIO_OUT_PACKET_MAX.
+ *  Requests go through the class Setup and EP0_RxReady callbacks with the
+ *  USB core stubbed, see Host/usbd_host.c.
+ *    - Selecting 5.1 while the clock runs at 96 kHz, as another alternate
+ *      setting left it, falls back to 48 kHz: the retune is left to
+ *      USBD_AUDIO_Poll, after which the stream plays.
+ *    - SET_CUR of 96 kHz to the endpoint while 5.1 is selected STALLs the
+ *      status stage, through USBD_CtlError, and changes nothing; 44.1 kHz
+ *      is accepted.
+ *    - Once back on a stereo setting, 96 kHz is accepted again.
+ *
+ *  Then a 1 kHz tone plays in virtual time, as in test_capture.c, and the
+ *  Feature Unit mute is set: the tone must ramp down over a block, not
+ *  step, every frame shifted out from the moment SD_MODE is released on
+ *  must be exactly zero, and the last non-zero one must come before it.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "test.h"
+#include "usbd_audio.h"
+#include "usbd_host.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#define TEST_TONE_AMPLITUDE                           16384.0
+#define TEST_MUTE_AT_MS                               100U
+#define TEST_MUTE_MS                                  200U
+
+static USBD_HandleTypeDef dev;
+static int16_t packet[AUDIO_OUT_PACKET_MAX / sizeof(int16_t)];
+
+/**
+ * @brief  TEST_SetFreq
+ *         SET_CUR SAMPLING_FREQ_CONTROL to the OUT endpoint, with its data stage
+ * @param  freq: Hz
+ * @retval status of the data stage
+ */
+static uint8_t TEST_SetFreq(uint32_t freq) {
+  uint8_t hz[3] = {(uint8_t)freq, (uint8_t)(freq >> 8), (uint8_t)(freq >> 16)};
+
+  if (USBD_HostSetup(&dev, 0x22U, AUDIO_REQ_SET_CUR, 0x0100U, AUDIO_OUT_EP, 3U) != USBD_OK) {
+    return USBD_FAIL;
+  }
+  return USBD_HostDataStage(&dev, hz, sizeof(hz));
+}
+
+/**
+ * @brief  TEST_SetInterface
+ *         SET_INTERFACE of the playback streaming interface
+ * @param  alt: alternate setting
+ * @retval class Setup status
+ */
+static uint8_t TEST_SetInterface(uint8_t alt) {
+  return USBD_HostSetup(&dev, 0x01U, USB_REQ_SET_INTERFACE, alt, 1U, 0U);
+}
+
+static int TEST_Surround(void) {
+  USBD_AUDIO_HandleTypeDef *haudio;
+
+  CHECK(USBD_HostInit(&dev, &USBD_AUDIO) == USBD_OK);
+  haudio = (USBD_AUDIO_HandleTypeDef *)dev.pClassDataCmsit[0];
+  USBD_AUDIO_Poll(&dev);
+
+  /* 96 kHz while no stream is selected */
+  CHECK(TEST_SetFreq(USBD_AUDIO_FREQ_96K) == USBD_OK);
+  USBD_AUDIO_Poll(&dev);
+  CHECK(haudio->freq == USBD_AUDIO_FREQ_96K && hi2s2.Init.AudioFreq == USBD_AUDIO_FREQ_96K);
+
+  /* 5.1 falls back to 48 kHz, and plays once the clocks are retuned */
+  CHECK(TEST_SetInterface(AUDIO_ALT_SETTING_SURROUND) == USBD_OK);
+  CHECK(haudio->freq == USBD_AUDIO_FREQ_48K && haudio->freq_pending == 1U && haudio->playing == 0U);
+  USBD_AUDIO_Poll(&dev);
+  CHECK(hi2s2.Init.AudioFreq == USBD_AUDIO_FREQ_48K && haudio->playing != 0U);
+  CHECK(haudio->channels == 6U);
+
+  /* 96 kHz STALLs and leaves the stream alone, 44.1 kHz goes through */
+  CHECK(TEST_SetFreq(USBD_AUDIO_FREQ_96K) == USBD_FAIL);
+  CHECK(USBD_Host.ctl_errors == 1U);
+  CHECK(haudio->freq == USBD_AUDIO_FREQ_48K && haudio->freq_pending == 0U && haudio->playing != 0U);
+  CHECK(TEST_SetFreq(USBD_AUDIO_FREQ_44K) == USBD_OK);
+  CHECK(haudio->freq == USBD_AUDIO_FREQ_44K && haudio->freq_pending == 1U);
+  USBD_AUDIO_Poll(&dev);
+  CHECK(haudio->playing != 0U);
+
+  /* Stereo again: 96 kHz is accepted */
+  CHECK(TEST_SetInterface(AUDIO_ALT_SETTING_16B) == USBD_OK);
+  CHECK(TEST_SetFreq(USBD_AUDIO_FREQ_96K) == USBD_OK);
+  USBD_AUDIO_Poll(&dev);
+  CHECK(haudio->freq == USBD_AUDIO_FREQ_96K && haudio->playing != 0U);
+
+  CHECK(USBD_Host.ctl_errors == 1U);
+  return 0;
+}
+
+static int TEST_Mute(void) {
+  static const uint8_t on[] = {0x01};
+  const uint32_t frames = USBD_AUDIO_FREQ_48K / 1000U;
+  USBD_AUDIO_HandleTypeDef *haudio;
+  uint32_t n = 0U;
+  uint32_t muted_at = 0U;
+  int32_t peak = 0;
+  uint32_t ramped = 0U;
+  uint32_t last_sound = 0U;
+  uint32_t released = 0U;
+
+  CHECK(USBD_HostInit(&dev, &USBD_AUDIO) == USBD_OK);
+  haudio = (USBD_AUDIO_HandleTypeDef *)dev.pClassDataCmsit[0];
+  USBD_AUDIO_Poll(&dev);
+  CHECK(TEST_SetInterface(AUDIO_ALT_SETTING_16B) == USBD_OK);
+  CHECK(haudio->playing != 0U && USBD_Host.sd_mode == GPIO_PIN_SET);
+
+  /* One period of 1 kHz per packet */
+  for (uint32_t i = 0U; i < frames; i++) {
+    packet[i * 2U] = (int16_t)lrint(TEST_TONE_AMPLITUDE * sin(2.0 * M_PI * i / frames));
+    packet[i * 2U + 1U] = packet[i * 2U];
+  }
+
+  for (uint32_t ms = 0U; ms < TEST_MUTE_MS; ms++) {
+    if (ms == TEST_MUTE_AT_MS) {
+      /* SET_CUR MUTE_CONTROL, master channel, Feature Unit */
+      CHECK(USBD_HostSetup(&dev, 0x21U, AUDIO_REQ_SET_CUR, 0x0100U, 0x0200U, 1U) == USBD_OK);
+      CHECK(USBD_HostDataStage(&dev, on, sizeof(on)) == USBD_OK);
+      CHECK(haudio->mute == 1U && USBD_Host.sd_mode == GPIO_PIN_SET);
+      muted_at = n;
+    }
+    CHECK(USBD_HostSof(&dev) == USBD_OK);
+    CHECK(USBD_HostOut(&dev, (const uint8_t *)packet, frames * 2U * sizeof(int16_t)) == USBD_OK);
+
+    /* Frame by frame, to catch the pin at the exact frame */
+    for (uint32_t i = 0U; i < frames; i++, n++) {
+      int32_t left;
+
+      USBD_HostPlay(&dev, 1U, &left);
+      if (released == 0U && USBD_Host.sd_mode == GPIO_PIN_RESET) {
+        released = n;
+      }
+      if (released != 0U) {
+        CHECK(left == 0);
+      } else if (left != 0) {
+        last_sound = n;
+      }
+      /* Peak over each period since the mute: the ramp down leaves one below the tone, not yet silent */
+      if (muted_at != 0U) {
+        peak = abs(left >> 16) > peak ? abs(left >> 16) : peak;
+        if ((n - muted_at) % frames == frames - 1U) {
+          ramped += peak > 0 && peak < (int32_t)(TEST_TONE_AMPLITUDE * 0.9) ? 1U : 0U;
+          peak = 0;
+        }
+      }
+    }
+  }
+
+  printf("test_audio: muted at frame %u, last sound at %u, %u periods ramped, SD_MODE released at %u\n",
+         (unsigned)muted_at, (unsigned)last_sound, (unsigned)ramped, (unsigned)released);
+  CHECK(released > last_sound && last_sound > muted_at);
+  CHECK(ramped > 0U);
+  return 0;
+}
+
+int main(void) {
+  int failed = 0;
+
+  failed |= TEST_Surround();
+  printf("test_audio: 5.1 at 96 kHz %s\n", failed != 0 ? "FAILED" : "refused, falls back to 48 kHz");
+  failed |= TEST_Mute();
+  return failed;
+}
@@ -0,0 +1,181 @@
+/**
+ ******************************************************************************
+ * @file    test_audio2.c
+ * @brief   Replay of Audio Class 2.0 control requests through usbd_audio2.c.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  The SETUP packets are the 8 bytes on the wire, as a host sends them
+ *  while it enumerates and drives the function: the clock source
+ *  frequency CUR and RANGE, the latter first asked for its 2-byte header
+ *  then in full, or with a larger buffer it must be clipped to, CLOCK_VALID,
+ *  then the Feature Unit mute and volume. Each one goes through the class
+ *  Setup callback with the USB core stubbed, see Host/usbd_host.c, and the
+ *  data stage it returns is compared byte for byte.
+ *
+ *  SET_CUR requests are followed by their data stage through EP0_RxReady:
+ *  a new frequency must reach USBD_AUDIO_SetFreq and leave the retune
+ *  pending for USBD_AUDIO_Poll, the current one must not, an unlisted one
+ *  is ignored. Requests to an unknown entity or control selector, to a
+ *  channel other than the master one, a RANGE written by the host or a
+ *  SET_CUR longer than the EP0 buffer must STALL, through USBD_CtlError,
+ *  without a data stage.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "test.h"
+#include "usbd_audio2.h"
+#include "usbd_host.h"
+
+#include <string.h>
+
+/* One recorded SETUP packet and the answer expected from the class */
+typedef struct {
+  uint8_t setup[8];
+  uint8_t stall;
+  uint8_t len;                                 /* IN data stage, bytes */
+  uint8_t data[40];
+} TEST_RequestTypeDef;
+
+static const TEST_RequestTypeDef requests[] = {
+    /* Clock Source, SAM_FREQ RANGE: header only, in full, larger buffer clipped */
+    {{0xA1, 0x02, 0x00, 0x01, 0x00, 0x04, 0x02, 0x00}, 0U, 2U, {0x03, 0x00}},
+    {{0xA1, 0x02, 0x00, 0x01, 0x00, 0x04, 0x26, 0x00},
+     0U,
+     38U,
+     {0x03, 0x00, 0x44, 0xAC, 0x00, 0x00, 0x44, 0xAC, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x80, 0xBB, 0x00, 0x00, 0x80, 0xBB, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x77, 0x01, 0x00, 0x00, 0x77, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00}},
+    {{0xA1, 0x02, 0x00, 0x01, 0x00, 0x04, 0xFF, 0x00},
+     0U,
+     38U,
+     {0x03, 0x00, 0x44, 0xAC, 0x00, 0x00, 0x44, 0xAC, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x80, 0xBB, 0x00, 0x00, 0x80, 0xBB, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x77, 0x01, 0x00, 0x00, 0x77, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00}},
+    /* Clock Source, SAM_FREQ CUR, CLOCK_VALID CUR */
+    {{0xA1, 0x01, 0x00, 0x01, 0x00, 0x04, 0x04, 0x00}, 0U, 4U, {0x80, 0xBB, 0x00, 0x00}},
+    {{0xA1, 0x01, 0x00, 0x02, 0x00, 0x04, 0x01, 0x00}, 0U, 1U, {0x01}},
+    /* Feature Unit, master channel: MUTE CUR, VOLUME CUR and RANGE */
+    {{0xA1, 0x01, 0x00, 0x01, 0x00, 0x02, 0x01, 0x00}, 0U, 1U, {0x00}},
+    {{0xA1, 0x01, 0x00, 0x02, 0x00, 0x02, 0x02, 0x00}, 0U, 2U, {0x00, 0x00}},
+    {{0xA1, 0x02, 0x00, 0x02, 0x00, 0x02, 0x08, 0x00}, 0U, 8U, {0x01, 0x00, 0x00, 0xA0, 0x00, 0x00, 0x80, 0x00}},
+    /* STALL: unknown entity, unknown clock and FU selectors, channel 1, RANGE of MUTE */
+    {{0xA1, 0x01, 0x00, 0x01, 0x00, 0x09, 0x04, 0x00}, 1U, 0U, {0}},
+    {{0xA1, 0x01, 0x00, 0x07, 0x00, 0x04, 0x04, 0x00}, 1U, 0U, {0}},
+    {{0xA1, 0x01, 0x00, 0x05, 0x00, 0x02, 0x01, 0x00}, 1U, 0U, {0}},
+    {{0xA1, 0x01, 0x01, 0x02, 0x00, 0x02, 0x02, 0x00}, 1U, 0U, {0}},
+    {{0xA1, 0x02, 0x00, 0x01, 0x00, 0x02, 0x08, 0x00}, 1U, 0U, {0}},
+    /* STALL: RANGE from the host, SET_CUR to an unknown entity, longer than EP0 */
+    {{0x21, 0x02, 0x00, 0x01, 0x00, 0x04, 0x26, 0x00}, 1U, 0U, {0}},
+    {{0x21, 0x01, 0x00, 0x01, 0x00, 0x09, 0x04, 0x00}, 1U, 0U, {0}},
+    {{0x21, 0x01, 0x00, 0x01, 0x00, 0x04, 0x41, 0x00}, 1U, 0U, {0}},
+};
+
+static USBD_HandleTypeDef dev;
+
+/**
+ * @brief  TEST_Send
+ *         Hand a recorded SETUP packet to the class
+ * @param  setup: the 8 bytes of the packet
+ * @retval class Setup status
+ */
+static uint8_t TEST_Send(const uint8_t *setup) {
+  return USBD_HostSetup(&dev, setup[0], setup[1], (uint16_t)(setup[2] | (setup[3] << 8)),
+                        (uint16_t)(setup[4] | (setup[5] << 8)), (uint16_t)(setup[6] | (setup[7] << 8)));
+}
+
+static int TEST_Requests(void) {
+  for (uint32_t i = 0U; i < sizeof(requests) / sizeof(requests[0]); i++) {
+    const TEST_RequestTypeDef *r = &requests[i];
+    uint32_t errors = USBD_Host.ctl_errors;
+    uint32_t sends = USBD_Host.ctl_sends;
+    uint32_t prepares = USBD_Host.rx_prepares;
+    uint8_t status = TEST_Send(r->setup);
+
+    if (r->stall != 0U) {
+      CHECK(status == USBD_FAIL);
+      CHECK(USBD_Host.ctl_errors == errors + 1U);
+      CHECK(USBD_Host.ctl_sends == sends && USBD_Host.rx_prepares == prepares);
+    } else {
+      CHECK(status == USBD_OK);
+      CHECK(USBD_Host.ctl_errors == errors);
+      CHECK(USBD_Host.ctl_sends == sends + 1U);
+      CHECK(USBD_Host.ctl_len == r->len);
+      CHECK(memcmp(USBD_Host.ctl_data, r->data, r->len) == 0);
+    }
+  }
+  return 0;
+}
+
+static int TEST_SetCur(void) {
+  USBD_AUDIO_HandleTypeDef *haudio = (USBD_AUDIO_HandleTypeDef *)dev.pClassDataCmsit[0];
+  static const uint8_t freq_44k[] = {0x21, 0x01, 0x00, 0x01, 0x00, 0x04, 0x04, 0x00};
+  static const uint8_t mute[] = {0x21, 0x01, 0x00, 0x01, 0x00, 0x02, 0x01, 0x00};
+  static const uint8_t volume[] = {0x21, 0x01, 0x00, 0x02, 0x00, 0x02, 0x02, 0x00};
+  static const uint8_t get_mute[] = {0xA1, 0x01, 0x00, 0x01, 0x00, 0x02, 0x01, 0x00};
+  static const uint8_t get_volume[] = {0xA1, 0x01, 0x00, 0x02, 0x00, 0x02, 0x02, 0x00};
+  static const uint8_t get_freq[] = {0xA1, 0x01, 0x00, 0x01, 0x00, 0x04, 0x04, 0x00};
+  static const uint8_t hz_44k[] = {0x44, 0xAC, 0x00, 0x00};
+  static const uint8_t hz_22k[] = {0x22, 0x56, 0x00, 0x00};
+  static const uint8_t on[] = {0x01};
+  static const uint8_t db_16[] = {0x00, 0xF0};
+  uint16_t target = haudio->target_frames;
+
+  /* Settle the retune of Init first */
+  USBD_AUDIO_Poll(&dev);
+  CHECK(haudio->freq == USBD_AUDIO_FREQ_48K && haudio->freq_pending == 0U);
+
+  /* A new rate reaches USBD_AUDIO_SetFreq, the clocks wait for USBD_AUDIO_Poll */
+  CHECK(TEST_Send(freq_44k) == USBD_OK);
+  CHECK(USBD_Host.rx_len == 4U);
+  CHECK(USBD_HostDataStage(&dev, hz_44k, sizeof(hz_44k)) == USBD_OK);
+  CHECK(haudio->freq == USBD_AUDIO_FREQ_44K && haudio->freq_pending == 1U);
+  CHECK(haudio->target_frames < target);
+  CHECK(TEST_Send(get_freq) == USBD_OK);
+  CHECK(memcmp(USBD_Host.ctl_data, hz_44k, 4U) == 0);
+  USBD_AUDIO_Poll(&dev);
+  CHECK(haudio->freq_pending == 0U && hi2s2.Init.AudioFreq == USBD_AUDIO_FREQ_44K);
+
+  /* The current rate again, or one that is not listed, changes nothing */
+  CHECK(TEST_Send(freq_44k) == USBD_OK);
+  CHECK(USBD_HostDataStage(&dev, hz_44k, sizeof(hz_44k)) == USBD_OK);
+  CHECK(haudio->freq_pending == 0U);
+  CHECK(TEST_Send(freq_44k) == USBD_OK);
+  CHECK(USBD_HostDataStage(&dev, hz_22k, sizeof(hz_22k)) == USBD_OK);
+  CHECK(haudio->freq == USBD_AUDIO_FREQ_44K && haudio->freq_pending == 0U);
+
+  /* Mute and volume, read back */
+  CHECK(TEST_Send(mute) == USBD_OK);
+  CHECK(USBD_HostDataStage(&dev, on, sizeof(on)) == USBD_OK);
+  CHECK(haudio->mute == 1U);
+  CHECK(TEST_Send(get_mute) == USBD_OK);
+  CHECK(USBD_Host.ctl_len == 1U && USBD_Host.ctl_data[0] == 1U);
+
+  CHECK(TEST_Send(volume) == USBD_OK);
+  CHECK(USBD_HostDataStage(&dev, db_16, sizeof(db_16)) == USBD_OK);
+  CHECK(haudio->volume == (int16_t)0xF000);
+  CHECK(AUDIO_GainEqual(haudio->gain, AUDIO_GainFromVolume((int16_t)0xF000)) != 0U);
+  CHECK(TEST_Send(get_volume) == USBD_OK);
+  CHECK(USBD_Host.ctl_len == 2U && memcmp(USBD_Host.ctl_data, db_16, 2U) == 0);
+
+  CHECK(USBD_Host.ctl_errors == 0U);
+  return 0;
+}
+
+int main(void) {
+  int failed = 0;
+
+  if (USBD_HostInit(&dev, &USBD_AUDIO2) != USBD_OK) {
+    printf("test_audio2: class init failed\n");
+    return 1;
+  }
+
+  failed |= TEST_Requests();
+  USBD_Host.ctl_errors = 0U;
+  failed |= TEST_SetCur();
+
+  printf("test_audio2: %u requests replayed\n", (unsigned)(sizeof(requests) / sizeof(requests[0])));
+  return failed;
+}
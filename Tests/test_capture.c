@@ -0,0 +1,166 @@
+/**
+ ******************************************************************************
+ * @file    test_capture.c
+ * @brief   Loopback capture pacing against the SOF, in virtual time.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  usbd_audio.c runs unchanged on the stand-ins of Host/usbd_host.c,
+ *  with playback and the loopback capture interface selected by the same
+ *  requests a host sends. Time moves one USB frame at a time: the SOF,
+ *  the IN transfer of the loopback packet queued by it completing, one
+ *  OUT packet from the host, then the I2S DMA shifting out the frames of
+ *  that millisecond, whose half and complete transfer callbacks produce
+ *  the blocks USBD_AUDIO_CaptureBlock copies into the capture ring. The
+ *  I2S clock is off the host's by a few hundred ppm, either way or not
+ *  at all, so that the packet sizes have to steer the queue.
+ *
+ *  At 44.1, 48 and 96 kHz, each in a different capture sample width, and
+ *  once primed:
+ *    - every loopback packet is its nominal size, freq / 1000 frames with
+ *      the 44.1 kHz remainder carried over, plus or minus one frame;
+ *    - the frames sent, skipped packets included, average to the I2S
+ *      rate to within the queue depth over the run;
+ *    - the committed capture ring, the packet on the bus included, stays
+ *      within AUDIO_CAPTURE_PRIME_PACKETS - 1 and + 2 slots: the steering
+ *      band of PRIME to PRIME + 1 queued packets, the one on the bus, and
+ *      one less while the I2S block that completes a packet is still
+ *      shifting out at the SOF.
+ *  Every 97th IN transfer the host skips the frame instead, as
+ *  IsoINIncomplete reports it: the stale packet must free its slot, so
+ *  the ring does not fill up, and the next SOF sends again.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "test.h"
+#include "usbd_audio.h"
+#include "usbd_host.h"
+
+#include <math.h>
+#include <string.h>
+
+#define TEST_MS                                       20000U
+/* Frames until the capture queue is primed and the playback settled */
+#define TEST_SETTLE_MS                                100U
+#define TEST_SKIP_EVERY                               97U
+
+typedef struct {
+  uint32_t freq;
+  uint8_t capture_alt;
+  double ppm;                                  /* I2S clock against the host frame clock */
+} TEST_CaseTypeDef;
+
+static USBD_HandleTypeDef dev;
+static uint8_t packet[AUDIO_OUT_PACKET_MAX];
+
+/**
+ * @brief  TEST_Start
+ *         Enumerate, select the rate, then start playback and capture
+ * @param  c: test case
+ * @retval audio class handle, NULL on failure
+ */
+static USBD_AUDIO_HandleTypeDef *TEST_Start(const TEST_CaseTypeDef *c) {
+  uint8_t hz[3] = {(uint8_t)c->freq, (uint8_t)(c->freq >> 8), (uint8_t)(c->freq >> 16)};
+
+  if (USBD_HostInit(&dev, &USBD_AUDIO) != USBD_OK) {
+    return NULL;
+  }
+  /* SET_CUR SAMPLING_FREQ_CONTROL to the OUT endpoint */
+  (void)USBD_HostSetup(&dev, 0x22U, AUDIO_REQ_SET_CUR, 0x0100U, AUDIO_OUT_EP, 3U);
+  (void)USBD_HostDataStage(&dev, hz, sizeof(hz));
+  USBD_AUDIO_Poll(&dev);
+  /* SET_INTERFACE: 16-bit playback, then the loopback */
+  (void)USBD_HostSetup(&dev, 0x01U, USB_REQ_SET_INTERFACE, AUDIO_ALT_SETTING_16B, 1U, 0U);
+  (void)USBD_HostSetup(&dev, 0x01U, USB_REQ_SET_INTERFACE, c->capture_alt, AUDIO_CAPTURE_IF, 0U);
+
+  return USBD_Host.ctl_errors == 0U ? (USBD_AUDIO_HandleTypeDef *)dev.pClassDataCmsit[0] : NULL;
+}
+
+static int TEST_Run(const TEST_CaseTypeDef *c) {
+  USBD_AUDIO_HandleTypeDef *haudio = TEST_Start(c);
+  double rate = (double)c->freq / 1000.0;
+  double i2s_rate = rate * (1.0 + c->ppm * 1e-6);
+  double i2s_acc = 0.0;
+  uint32_t host_acc = 0U;
+  uint64_t frames_sent = 0U;
+  uint32_t packets = 0U;
+  uint32_t skipped = 0U;
+  uint32_t len_min = UINT32_MAX;
+  uint32_t len_max = 0U;
+  uint32_t slots_min = UINT32_MAX;
+  uint32_t slots_max = 0U;
+
+  CHECK(haudio != NULL);
+  CHECK(haudio->playing != 0U && haudio->freq == c->freq);
+
+  for (uint32_t ms = 0U; ms < TEST_MS; ms++) {
+    uint32_t count = USBD_Host.tx_count[AUDIO_CAPTURE_EP & 0xFU];
+    uint32_t slots;
+    uint32_t frames;
+
+    CHECK(USBD_HostSof(&dev) == USBD_OK);
+    CHECK(USBD_Host.tx_count[AUDIO_CAPTURE_EP & 0xFU] == count + 1U);
+    slots = haudio->capture.wr_slot - haudio->capture.rd_slot;
+
+    if (ms >= TEST_SETTLE_MS) {
+      /* Silence while priming: only packets from the ring are paced */
+      CHECK(haudio->capture_sent != 0U);
+      frames = USBD_Host.tx_len[AUDIO_CAPTURE_EP & 0xFU] / haudio->capture_frame_size;
+      CHECK(fabs((double)frames - rate) < 2.0);
+      len_min = frames < len_min ? frames : len_min;
+      len_max = frames > len_max ? frames : len_max;
+      slots_min = slots < slots_min ? slots : slots_min;
+      slots_max = slots > slots_max ? slots : slots_max;
+      CHECK(slots + 1U >= AUDIO_CAPTURE_PRIME_PACKETS && slots <= AUDIO_CAPTURE_PRIME_PACKETS + 2U);
+
+      if ((ms + 1U) % TEST_SKIP_EVERY == 0U) {
+        CHECK(dev.pClass[0]->IsoINIncomplete(&dev, AUDIO_CAPTURE_EP & 0xFU) == USBD_OK);
+        CHECK(haudio->capture.wr_slot - haudio->capture.rd_slot == slots - 1U);
+        skipped++;
+      } else {
+        CHECK(dev.pClass[0]->DataIn(&dev, AUDIO_CAPTURE_EP & 0xFU) == USBD_OK);
+      }
+      frames_sent += frames;
+      packets++;
+      CHECK(haudio->capture_busy == 0U);
+    } else {
+      (void)dev.pClass[0]->DataIn(&dev, AUDIO_CAPTURE_EP & 0xFU);
+    }
+
+    /* The host sends at the nominal rate, remainder carried over */
+    host_acc += c->freq;
+    frames = host_acc / 1000U;
+    host_acc -= frames * 1000U;
+    CHECK(USBD_HostOut(&dev, packet, frames * haudio->frame_size) == USBD_OK);
+
+    i2s_acc += i2s_rate;
+    frames = (uint32_t)i2s_acc;
+    i2s_acc -= frames;
+    USBD_HostPlay(&dev, frames, NULL);
+  }
+
+  printf("test_capture: %5u Hz %+4.0f ppm, %2u-bit: packets %u..%u frames, mean %.4f (I2S %.4f), "
+         "ring %u..%u slots, %u skipped\n",
+         (unsigned)c->freq, c->ppm, (unsigned)haudio->capture_bit_depth, (unsigned)len_min, (unsigned)len_max,
+         (double)frames_sent / packets, i2s_rate, (unsigned)slots_min, (unsigned)slots_max, (unsigned)skipped);
+  CHECK(skipped > 0U);
+  /* Whatever the queue held at the start of the count, it still holds to a packet either way */
+  CHECK(fabs((double)frames_sent / packets - i2s_rate) < (AUDIO_CAPTURE_PRIME_PACKETS + 2U) * rate / packets);
+  return 0;
+}
+
+int main(void) {
+  static const TEST_CaseTypeDef cases[] = {
+      {USBD_AUDIO_FREQ_44K, AUDIO_ALT_SETTING_16B, -300.0},
+      {USBD_AUDIO_FREQ_48K, AUDIO_ALT_SETTING_24B, 0.0},
+      {USBD_AUDIO_FREQ_96K, AUDIO_ALT_SETTING_32B, 300.0},
+  };
+  int failed = 0;
+
+  for (uint32_t i = 0U; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    failed |= TEST_Run(&cases[i]);
+  }
+  return failed;
+}
@@ -0,0 +1,152 @@
+/**
+ ******************************************************************************
+ * @file    test_dither.c
+ * @brief   Noise floor of the 16-bit requantization, and its cost per block.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  Silence, DC and a sine from a quarter LSB to a few LSB are
+ *  requantized in each mode and the error against the float input is
+ *  measured. Plain rounding leaves silence at exact zeros but its error
+ *  follows the signal; TPDF dither must give the same flat floor, an
+ *  error variance of 1/4 LSB^2, whatever the signal, and a hiss on
+ *  silence, which is why muted output is rounded instead. Noise shaping
+ *  must bring the error averaged over 128 samples, the band below
+ *  375 Hz at 48 kHz, well under the TPDF floor. Then the host cycles of
+ *  one playback block in each mode.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_dither.h"
+#include "test.h"
+
+#include <math.h>
+
+#define TEST_BLOCK_FRAMES                             48U
+#define TEST_BLOCKS                                   4096U
+#define TEST_LOWPASS                                  128U
+#define BENCH_BLOCKS                                  20000U
+
+static float32_t src[TEST_BLOCK_FRAMES * 2U];
+static int16_t dst[TEST_BLOCK_FRAMES * 2U];
+
+typedef struct {
+  double mean;
+  double var;                            /* LSB^2 */
+  double low;                            /* of the TEST_LOWPASS sample sums, per sample, LSB^2 */
+  uint32_t nonzero;
+} TEST_ErrTypeDef;
+
+/* Requantize TEST_BLOCKS blocks of a sine of amp LSB on a DC of dc LSB */
+static void TEST_Measure(AUDIO_DitherTypeDef *dither, int8_t mode, double amp, double dc, TEST_ErrTypeDef *res) {
+  double sum = 0.0;
+  double sq = 0.0;
+  double low = 0.0;
+  double run = 0.0;
+  uint32_t n = 0U;
+
+  res->nonzero = 0U;
+  AUDIO_DitherReset(dither);
+  for (uint32_t blk = 0U; blk < TEST_BLOCKS; blk++) {
+    for (uint32_t i = 0U; i < TEST_BLOCK_FRAMES; i++) {
+      double t = (double)(blk * TEST_BLOCK_FRAMES + i);
+      double x = (dc + amp * sin(2.0 * M_PI * 997.0 / 48000.0 * t)) / 32768.0;
+
+      src[2U * i] = (float32_t)x;
+      src[2U * i + 1U] = (float32_t)x;
+    }
+    if (mode < 0) {
+      AUDIO_DitherRound_q15(src, dst, TEST_BLOCK_FRAMES);
+    } else {
+      AUDIO_DitherQuantize_q15(dither, src, dst, TEST_BLOCK_FRAMES);
+    }
+    for (uint32_t i = 0U; i < TEST_BLOCK_FRAMES; i++) {
+      double e = (double)dst[2U * i] - (double)src[2U * i] * 32768.0;
+
+      sum += e;
+      sq += e * e;
+      run += e;
+      res->nonzero += dst[2U * i] != 0 ? 1U : 0U;
+      if (++n % TEST_LOWPASS == 0U) {
+        low += run * run;
+        run = 0.0;
+      }
+    }
+  }
+  res->mean = sum / n;
+  res->var = sq / n - res->mean * res->mean;
+  res->low = low / n;
+}
+
+int main(void) {
+  static const double amps[] = {0.0, 0.25, 0.5, 3.0};
+  static const char *const names[] = {"round", "off", "tpdf", "shaped"};
+  AUDIO_DitherTypeDef dither;
+  TEST_ErrTypeDef res;
+  double tpdf_low = 0.0;
+  volatile int16_t sink = 0;
+
+  /* Silence: exact zeros without dither, a hiss with it */
+  AUDIO_DitherInit(&dither, AUDIO_DITHER_TPDF);
+  TEST_Measure(&dither, -1, 0.0, 0.0, &res);
+  CHECK(res.nonzero == 0U);
+  TEST_Measure(&dither, AUDIO_DITHER_TPDF, 0.0, 0.0, &res);
+  CHECK(res.nonzero > TEST_BLOCKS * TEST_BLOCK_FRAMES / 4U);
+
+  /* TPDF: 1/12 of rounding plus 1/6 of dither, flat whatever the signal */
+  for (uint32_t a = 0U; a < 4U; a++) {
+    for (uint32_t d = 0U; d < 2U; d++) {
+      TEST_Measure(&dither, AUDIO_DITHER_TPDF, amps[a], 0.25 * d, &res);
+      CHECK(fabs(res.mean) < 0.01);
+      CHECK(fabs(res.var - 0.25) < 0.01);
+      tpdf_low = res.low > tpdf_low ? res.low : tpdf_low;
+    }
+  }
+  printf("test_dither: tpdf floor %.2f LSB^2, %.1f dB below a full-scale sine\n", 0.25,
+         10.0 * log10(0.5 * 32768.0 * 32768.0 / 0.25));
+
+  /* Plain rounding: the error is the signal's own, nothing at all on a quarter LSB DC */
+  TEST_Measure(&dither, -1, 0.0, 0.25, &res);
+  CHECK(res.var < 1e-9 && fabs(res.mean + 0.25) < 1e-3);
+
+  /* Shaped: more noise in total, far less of it at low frequencies */
+  AUDIO_DitherInit(&dither, AUDIO_DITHER_SHAPED);
+  for (uint32_t a = 0U; a < 4U; a++) {
+    TEST_Measure(&dither, AUDIO_DITHER_SHAPED, amps[a], 0.0, &res);
+    CHECK(res.var > 0.25);
+    CHECK(fabs(res.mean) < 0.01);
+    CHECK(res.low < tpdf_low / 10.0);
+    if (a == 3U) {
+      printf("test_dither: shaped total %.2f LSB^2, below 375 Hz %.1f dB under tpdf\n", res.var,
+             10.0 * log10(tpdf_low / res.low));
+    }
+  }
+
+  /* Host cycles of one playback block */
+  for (int8_t mode = -1; mode <= (int8_t)AUDIO_DITHER_SHAPED; mode++) {
+    uint64_t sum = 0U;
+    uint32_t best = UINT32_MAX;
+
+    AUDIO_DitherInit(&dither, mode < 0 ? AUDIO_DITHER_OFF : (AUDIO_DitherModeTypeDef)mode);
+    for (uint32_t n = 0U; n < BENCH_BLOCKS; n++) {
+      uint32_t cycles = AUDIO_HostCycles();
+
+      if (mode < 0) {
+        AUDIO_DitherRound_q15(src, dst, TEST_BLOCK_FRAMES);
+      } else {
+        AUDIO_DitherQuantize_q15(&dither, src, dst, TEST_BLOCK_FRAMES);
+      }
+      cycles = AUDIO_HostCycles() - cycles;
+      sink = dst[n % (2U * TEST_BLOCK_FRAMES)];
+      sum += cycles;
+      best = cycles < best ? cycles : best;
+    }
+    printf("test_dither: %-6s %u-frame block: host best %u, mean %.0f cycles\n", names[mode + 1],
+           (unsigned)TEST_BLOCK_FRAMES, (unsigned)best, (double)sum / BENCH_BLOCKS);
+  }
+  (void)sink;
+
+  return 0;
+}
@@ -0,0 +1,129 @@
+/**
+ ******************************************************************************
+ * @file    test_fifo.c
+ * @brief   Analyzer FIFO: overlapped frames and overruns.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  The producer pushes playback blocks of a counting sequence, the
+ *  consumer reads overlapped analyzer frames at a varying pace, often
+ *  far too slowly. Every frame must be a contiguous run of the sequence:
+ *  a dropped push may cost frames but never splice two runs into one.
+ *  Each dropped push must be counted once, with its samples. Then the
+ *  same run with a producer thread against a consumer thread.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_fifo.h"
+#include "test.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#define TEST_BLOCK_FRAMES                             48U
+#define TEST_SIZE                                     1024U
+#define TEST_HOP                                      256U
+#define TEST_BLOCKS                                   200000U
+
+static AUDIO_FifoTypeDef fifo;
+static int16_t frame[TEST_SIZE];
+static volatile uint32_t produced;
+
+/* Next playback block of the sequence, both channels */
+static void TEST_Push(uint32_t *next) {
+  int16_t block[TEST_BLOCK_FRAMES * 2U];
+
+  for (uint32_t i = 0U; i < TEST_BLOCK_FRAMES; i++) {
+    block[2U * i] = (int16_t)(*next + i);
+    block[2U * i + 1U] = 0;
+  }
+  *next += TEST_BLOCK_FRAMES;
+  AUDIO_FifoPush_q15(&fifo, block, TEST_BLOCK_FRAMES);
+}
+
+/* The frame is a contiguous run of the sequence */
+static int TEST_Contiguous(void) {
+  for (uint32_t i = 1U; i < TEST_SIZE; i++) {
+    CHECK((uint16_t)(frame[i] - frame[i - 1U]) == 1U);
+  }
+  return 0;
+}
+
+static void *TEST_Producer(void *arg) {
+  uint32_t next = 0U;
+
+  (void)arg;
+  for (uint32_t b = 0U; b < TEST_BLOCKS; b++) {
+    TEST_Push(&next);
+    produced = b + 1U;
+    if ((b & 63U) == 0U) {
+      /* Paced like the I2S callbacks, about 64 blocks per 0.1 ms */
+      struct timespec ts = {0, 100000L};
+
+      (void)nanosleep(&ts, NULL);
+    }
+  }
+  return NULL;
+}
+
+int main(void) {
+  uint32_t seed = 0xF1F0U;
+  uint32_t next = 0U;
+  uint32_t frames = 0U;
+  uint32_t dropped = 0U;
+  pthread_t thread;
+
+  /* Single thread: the consumer stalls for up to 4 FIFOs at a time */
+  for (uint32_t b = 0U; b < TEST_BLOCKS; b++) {
+    uint32_t before = fifo.overruns;
+
+    TEST_Push(&next);
+    dropped += fifo.overruns - before;
+    if (TEST_Rand(&seed) % 512U == 0U) {
+      uint32_t stall = TEST_Rand(&seed) % (4U * AUDIO_FIFO_SIZE / TEST_BLOCK_FRAMES);
+
+      for (uint32_t s = 0U; s < stall; s++, b++) {
+        before = fifo.overruns;
+        TEST_Push(&next);
+        dropped += fifo.overruns - before;
+      }
+    }
+    while (TEST_Rand(&seed) % 4U != 0U && AUDIO_FifoRead_q15(&fifo, frame, TEST_SIZE, TEST_HOP) != 0U) {
+      CHECK(TEST_Contiguous() == 0);
+      frames++;
+    }
+  }
+  CHECK(dropped > 0U && fifo.overruns == dropped);
+  CHECK(fifo.drops == dropped * TEST_BLOCK_FRAMES);
+  CHECK(frames > TEST_BLOCKS * TEST_BLOCK_FRAMES / TEST_HOP / 4U);
+  printf("test_fifo: %u frames contiguous, %u overruns (%u samples dropped)\n", (unsigned)frames,
+         (unsigned)fifo.overruns, (unsigned)fifo.drops);
+
+  /* Two threads, the consumer reading as fast as it can or not at all */
+  (void)memset(&fifo, 0, sizeof(fifo));
+  frames = 0U;
+  CHECK(pthread_create(&thread, NULL, TEST_Producer, NULL) == 0);
+  while (produced < TEST_BLOCKS) {
+    if (AUDIO_FifoRead_q15(&fifo, frame, TEST_SIZE, TEST_HOP) == 0U) {
+      sched_yield();
+      continue;
+    }
+    CHECK(TEST_Contiguous() == 0);
+    frames++;
+    if (frames % 16U == 0U && (TEST_Rand(&seed) & 1U) != 0U) {
+      /* Analyzer busy for a few FIFOs' worth of producer time */
+      struct timespec ts = {0, 2000000L};
+
+      (void)nanosleep(&ts, NULL);
+    }
+  }
+  CHECK(pthread_join(thread, NULL) == 0);
+  CHECK(frames != 0U);
+  CHECK(fifo.drops == fifo.overruns * TEST_BLOCK_FRAMES);
+  printf("test_fifo: threaded, %u frames contiguous, %u overruns\n", (unsigned)frames, (unsigned)fifo.overruns);
+
+  return 0;
+}
@@ -0,0 +1,276 @@
+/**
+ ******************************************************************************
+ * @file    test_gain.c
+ * @brief   Accuracy and bit-exactness of the volume gain kernel.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  Every 1/256 dB volume step from 0 dB to -96 dB must land within
+ *  0.01 dB of the exact gain. The kernel output must match the scalar
+ *  reference below bit for bit, for every volume step on random and
+ *  full-scale frames and for odd frame counts; the _dsp build runs the
+ *  same checks on the dual-16 MAC path. Mute must give exact zeros.
+ *  Also times the kernel against the shift-based volume it replaced, on
+ *  the host.
+ *
+ *  The ramps, between any two of 0 dB, -6 dB, -40 dB, -96 dB and mute,
+ *  over a block and over an odd span: on a full-scale input they must be
+ *  monotonic and their last frame must land exactly on the target, as
+ *  the constant kernel that follows scales it, exact zeros for mute. The
+ *  16-bit ramp into float must match the Q30 definition bit for bit, on
+ *  the dual-16 path of the _dsp build too, and the two passes it replaced,
+ *  arm_q15_to_float then AUDIO_GainRamp_f32, to a fraction of an LSB
+ *  away from 0 dB, which the float ramp takes one LSB short of unity.
+ *  Both are timed over a 48-frame block, AUDIO_HostCycles ticks.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "arm_math.h"
+#include "audio_gain.h"
+#include "test.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_FRAMES                                   193U
+#define BENCH_FRAMES                                  48U
+#define BENCH_ROUNDS                                  200000U
+#define TEST_RAMP_SPAN                                48U
+#define TEST_RAMP_ODD                                 37U
+/* Against the float ramp: its rounding, a 300th of a 16-bit LSB */
+#define TEST_RAMP_ERROR                               1e-7f
+
+static int16_t src[2U * TEST_FRAMES] __attribute__((aligned(4)));
+static int16_t dst[2U * TEST_FRAMES] __attribute__((aligned(4)));
+static int32_t src32[2U * TEST_FRAMES];
+static int32_t dst32[2U * TEST_FRAMES];
+static float ramp[2U * TEST_FRAMES];
+static float ref[2U * TEST_FRAMES];
+
+/* Kernel definition: round(x * mant / 2^(15 + shift)) */
+static int16_t TEST_GainRef(int16_t x, AUDIO_GainTypeDef gain) {
+  int32_t sh = 15 + (int32_t)gain.shift;
+
+  if (gain.mant == 0x7FFF && gain.shift == 0U) {
+    return x;
+  }
+  return (int16_t)(((int32_t)x * gain.mant + (1L << (sh - 1))) >> sh);
+}
+
+/* Shift-based volume of the original driver, 3 dB steps */
+static int16_t TEST_ShiftVolume(int16_t sample, int16_t volume) {
+  int16_t shifts = (int16_t)((0 - volume + (0x0300 / 2)) / 0x0300);
+  int16_t shifts2 = shifts >> 1;
+
+  sample >>= shifts2;
+  if (shifts & 1) {
+    sample += (sample >> 1);
+  }
+  return sample;
+}
+
+/* Ramp definition: the gain as Q30, stepped by the truncated slope, the last frame set to the target */
+static int32_t TEST_RampGain(AUDIO_GainTypeDef from, AUDIO_GainTypeDef to, uint32_t span, uint32_t i) {
+  int32_t g0 = AUDIO_GainEqual(from, AUDIO_GAIN_UNITY) ? 1L << 30
+                                                      : (int32_t)(((uint32_t)(uint16_t)from.mant << 15) >> from.shift);
+  int32_t g1 = AUDIO_GainEqual(to, AUDIO_GAIN_UNITY) ? 1L << 30
+                                                    : (int32_t)(((uint32_t)(uint16_t)to.mant << 15) >> to.shift);
+
+  return i == span ? g1 : g0 + (int32_t)i * ((g1 - g0) / (int32_t)span);
+}
+
+static int TEST_Ramp(void) {
+  const AUDIO_GainTypeDef gains[] = {AUDIO_GAIN_UNITY, AUDIO_GainFromVolume((int16_t)0xFA00),
+                                     AUDIO_GainFromVolume((int16_t)0xD800), AUDIO_GainFromVolume((int16_t)0xA000),
+                                     AUDIO_GAIN_MUTE};
+  const uint32_t spans[] = {TEST_RAMP_SPAN, TEST_RAMP_ODD};
+  const uint32_t n = sizeof(gains) / sizeof(gains[0]);
+  uint32_t seed = 0x5EEDU;
+  uint32_t pairs = 0U;
+  float worst = 0.0f;
+
+  for (uint32_t a = 0U; a < n; a++) {
+    for (uint32_t b = 0U; b < n; b++) {
+      for (uint32_t s = 0U; s < 2U; s++) {
+        AUDIO_GainTypeDef from = gains[a];
+        AUDIO_GainTypeDef to = gains[b];
+        uint32_t span = spans[s];
+        int32_t dir = AUDIO_GainToFloat(to) > AUDIO_GainToFloat(from) ? 1 : -1;
+        int16_t last16[2];
+        float last[2];
+
+        if (a == b) {
+          continue;
+        }
+        pairs++;
+
+        /* Full scale, positive on the left, negative on the right */
+        for (uint32_t i = 0U; i < span; i++) {
+          src[i * 2U] = 32767;
+          src[i * 2U + 1U] = -32768;
+          src32[i * 2U] = INT32_MAX;
+          src32[i * 2U + 1U] = INT32_MIN;
+        }
+
+        AUDIO_GainRamp_q15(src, ramp, span, from, to, span);
+        AUDIO_GainRamp_q15(src, last, 1U, to, to, 1U);
+        for (uint32_t i = 1U; i < span; i++) {
+          CHECK((ramp[i * 2U] - ramp[i * 2U - 2U]) * (float)dir >= 0.0f);
+          CHECK((ramp[i * 2U + 1U] - ramp[i * 2U - 1U]) * (float)dir <= 0.0f);
+        }
+        CHECK(ramp[(span - 1U) * 2U] == last[0] && ramp[(span - 1U) * 2U + 1U] == last[1]);
+        /* The float stage requantizes the last frame as the constant kernel would */
+        last16[0] = (int16_t)lrintf(last[0] * 32768.0f);
+        last16[1] = (int16_t)lrintf(last[1] * 32768.0f);
+        CHECK(abs(last16[0] - TEST_GainRef(32767, to)) <= 1 && abs(last16[1] - TEST_GainRef(-32768, to)) <= 1);
+
+        AUDIO_GainRamp_q31(src32, dst32, span, from, to, span);
+        for (uint32_t i = 1U; i < span; i++) {
+          CHECK(((int64_t)dst32[i * 2U] - dst32[i * 2U - 2U]) * dir >= 0);
+          CHECK(((int64_t)dst32[i * 2U + 1U] - dst32[i * 2U - 1U]) * dir <= 0);
+        }
+        AUDIO_GainApply_q31(&src32[(span - 1U) * 2U], src32, 2U, to);
+        CHECK(dst32[(span - 1U) * 2U] == src32[0] && dst32[(span - 1U) * 2U + 1U] == src32[1]);
+
+        if (AUDIO_GainEqual(to, AUDIO_GAIN_MUTE)) {
+          CHECK(last[0] == 0.0f && last[1] == 0.0f);
+          CHECK(dst32[(span - 1U) * 2U] == 0 && dst32[(span - 1U) * 2U + 1U] == 0);
+        }
+
+        /* Random frames: the Q30 definition exactly, the float ramp closely */
+        for (uint32_t i = 0U; i < 2U * span; i++) {
+          src[i] = (int16_t)TEST_Rand(&seed);
+        }
+        AUDIO_GainRamp_q15(src, ramp, span, from, to, span);
+        arm_q15_to_float(src, ref, 2U * span);
+        AUDIO_GainRamp_f32(ref, ref, span, from, to, span);
+        for (uint32_t i = 0U; i < 2U * span; i++) {
+          int32_t g = TEST_RampGain(from, to, span, i / 2U + 1U);
+          float y = (float)(int32_t)(((int64_t)g * src[i]) >> 16) * (1.0f / 536870912.0f);
+          float e = fabsf(ramp[i] - ref[i]);
+
+          CHECK(ramp[i] == y);
+          /* AUDIO_GainToFloat takes 0 dB for 0x7FFF / 32768, the Q30 ramp for exactly 1 */
+          if (!AUDIO_GainEqual(from, AUDIO_GAIN_UNITY) && !AUDIO_GainEqual(to, AUDIO_GAIN_UNITY)) {
+            worst = e > worst ? e : worst;
+          }
+        }
+      }
+    }
+  }
+  CHECK(worst < TEST_RAMP_ERROR);
+  printf("test_gain: %u ramps monotonic, exact on the target, %.1e off the float ramp\n", (unsigned)pairs,
+         (double)worst);
+  return 0;
+}
+
+static int TEST_RampBench(void) {
+  const AUDIO_GainTypeDef from = AUDIO_GainFromVolume((int16_t)0xF400);
+  const AUDIO_GainTypeDef to = AUDIO_GainFromVolume((int16_t)0xE800);
+  uint64_t sum[4] = {0U, 0U, 0U, 0U};
+  uint32_t best[4] = {UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX};
+  volatile float sink = 0.0f;
+
+  for (uint32_t n = 0U; n < BENCH_ROUNDS; n++) {
+    uint32_t c[5];
+
+    c[0] = AUDIO_HostCycles();
+    arm_q15_to_float(src, ramp, 2U * BENCH_FRAMES);
+    AUDIO_GainRamp_f32(ramp, ramp, BENCH_FRAMES, from, to, BENCH_FRAMES);
+    c[1] = AUDIO_HostCycles();
+    AUDIO_GainRamp_q15(src, ramp, BENCH_FRAMES, from, to, BENCH_FRAMES);
+    c[2] = AUDIO_HostCycles();
+    arm_q15_to_float(src, ramp, 2U * BENCH_FRAMES);
+    arm_scale_f32(ramp, AUDIO_GainToFloat(to), ramp, 2U * BENCH_FRAMES);
+    c[3] = AUDIO_HostCycles();
+    AUDIO_GainRamp_q15(src, ramp, BENCH_FRAMES, to, to, BENCH_FRAMES);
+    c[4] = AUDIO_HostCycles();
+    sink = ramp[n % (2U * BENCH_FRAMES)];
+
+    for (uint32_t k = 0U; k < 4U; k++) {
+      uint32_t d = c[k + 1U] - c[k];
+
+      sum[k] += d;
+      best[k] = d < best[k] ? d : best[k];
+    }
+  }
+  (void)sink;
+
+  printf("test_gain: 48-frame ramp into float, host best/mean cycles: q15_to_float + ramp_f32 %u/%.0f, "
+         "ramp_q15 %u/%.0f; constant gain, q15_to_float + scale_f32 %u/%.0f, ramp_q15 %u/%.0f\n",
+         (unsigned)best[0], (double)sum[0] / BENCH_ROUNDS, (unsigned)best[1], (double)sum[1] / BENCH_ROUNDS,
+         (unsigned)best[2], (double)sum[2] / BENCH_ROUNDS, (unsigned)best[3], (double)sum[3] / BENCH_ROUNDS);
+  return 0;
+}
+
+int main(void) {
+  uint32_t seed = 0xC0FFEEU;
+  float worst = 0.0f;
+  double t;
+  double t_old;
+  double t_new;
+  volatile int16_t sink = 0;
+
+  /* dB accuracy of the table interpolation and the mantissa */
+  for (int32_t v = 0; v >= (int16_t)AUDIO_GAIN_DB_MIN; v--) {
+    float err = fabsf(20.0f * log10f(AUDIO_GainToFloat(AUDIO_GainFromVolume((int16_t)v))) - (float)v / 256.0f);
+
+    worst = err > worst ? err : worst;
+  }
+  CHECK(worst < 0.01f);
+  CHECK(AUDIO_GainEqual(AUDIO_GainFromVolume(0), AUDIO_GAIN_UNITY));
+  CHECK(AUDIO_GainEqual(AUDIO_GainFromVolume(0x7FFF), AUDIO_GAIN_UNITY));
+  CHECK(AUDIO_GainEqual(AUDIO_GainFromVolume((int16_t)0x8000), AUDIO_GainFromVolume((int16_t)AUDIO_GAIN_DB_MIN)));
+
+  /* Bit-exact against the reference, all volumes, odd and even lengths, in place too */
+  for (int32_t v = 0; v >= (int16_t)AUDIO_GAIN_DB_MIN; v -= 7) {
+    AUDIO_GainTypeDef gain = AUDIO_GainFromVolume((int16_t)v);
+    uint32_t frames = 1U + TEST_Rand(&seed) % TEST_FRAMES;
+
+    for (uint32_t i = 0U; i < 2U * TEST_FRAMES; i++) {
+      src[i] = (i & 4U) != 0U ? (int16_t)((i & 1U) != 0U ? 32767 : -32768) : (int16_t)TEST_Rand(&seed);
+    }
+    AUDIO_GainApply_q15(src, dst, frames, gain);
+    for (uint32_t i = 0U; i < 2U * frames; i++) {
+      CHECK(dst[i] == TEST_GainRef(src[i], gain));
+    }
+    memcpy(dst, src, sizeof(dst));
+    AUDIO_GainApply_q15(dst, dst, frames, gain);
+    for (uint32_t i = 0U; i < 2U * frames; i++) {
+      CHECK(dst[i] == TEST_GainRef(src[i], gain));
+    }
+  }
+
+  /* Mute: digital silence, whatever the samples */
+  memset(dst, 0x55, sizeof(dst));
+  AUDIO_GainApply_q15(src, dst, TEST_FRAMES, AUDIO_GAIN_MUTE);
+  for (uint32_t i = 0U; i < 2U * TEST_FRAMES; i++) {
+    CHECK(dst[i] == 0);
+  }
+
+  CHECK(TEST_Ramp() == 0);
+
+  /* Host timing of a 48-frame packet at -12 dB */
+  t = TEST_Seconds();
+  for (uint32_t n = 0U; n < BENCH_ROUNDS; n++) {
+    for (uint32_t i = 0U; i < 2U * BENCH_FRAMES; i++) {
+      dst[i] = TEST_ShiftVolume(src[i], (int16_t)(-0x0C00 - (int16_t)(n & 1U)));
+    }
+    sink = dst[n % (2U * BENCH_FRAMES)];
+  }
+  t_old = (TEST_Seconds() - t) / BENCH_ROUNDS;
+  t = TEST_Seconds();
+  for (uint32_t n = 0U; n < BENCH_ROUNDS; n++) {
+    AUDIO_GainApply_q15(src, dst, BENCH_FRAMES, AUDIO_GainFromVolume((int16_t)(-0x0C00 - (int16_t)(n & 1U))));
+    sink = dst[n % (2U * BENCH_FRAMES)];
+  }
+  t_new = (TEST_Seconds() - t) / BENCH_ROUNDS;
+  (void)sink;
+
+  printf("test_gain: worst %.4f dB off, bit-exact; host per 48 frames: shift volume %.1f ns, gain kernel %.1f ns\n",
+         (double)worst, t_old * 1e9, t_new * 1e9);
+  return TEST_RampBench();
+}
@@ -0,0 +1,343 @@
+/**
+ ******************************************************************************
+ * @file    test_graph.c
+ * @brief   Playback graph over a WAV file: regression and cost per stage.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  The graph is assembled as USBD_AUDIO_DspInit does it, tone controls,
+ *  PEQ, limiter, then the analyzer tap and the requantization edges, and
+ *  driven block by block like the 16-bit playback path: through the
+ *  graph while a stage is active, straight to the output and the tap
+ *  otherwise.
+ *
+ *    test_graph [in.wav [out.wav]]
+ *
+ *  reads a 16-bit stereo WAV file, by default a sweep with full-scale
+ *  noise bursts written next to the binary, and writes what the graph
+ *  made of it. With every stage idle the output must be the input bit
+ *  for bit, fed to the analyzer from the integer edge. With the tone,
+ *  the PEQ and the limiter all boosting, it must stay under the limiter
+ *  ceiling and the analyzer must get what goes out, short of the dither.
+ *  Then the host cycles of each stage per block, mean and worst.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_fifo.h"
+#include "audio_graph.h"
+#include "audio_dither.h"
+#include "audio_limit.h"
+#include "audio_peq.h"
+#include "audio_tone.h"
+#include "test.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_BLOCK_FRAMES                             48U
+#define TEST_FREQ                                     48000U
+#define TEST_SECONDS                                  4U
+
+/* Same identifiers as the firmware graph */
+#define TEST_STAGE_TONE                               0x01U
+#define TEST_STAGE_PEQ                                0x02U
+#define TEST_STAGE_LIMIT                              0x03U
+#define TEST_STAGE_TAP                                0x04U
+#define TEST_STAGE_REQUANT                            0x05U
+
+typedef struct {
+  AUDIO_ToneTypeDef tone;
+  AUDIO_PeqTypeDef peq;
+  AUDIO_LimitTypeDef limit;
+  AUDIO_DitherTypeDef dither;
+  AUDIO_FifoTypeDef tap;
+  AUDIO_GraphTypeDef graph;
+  float32_t work[TEST_BLOCK_FRAMES * 2U];
+  int16_t *out;
+  uint8_t tapped;
+} TEST_PathTypeDef;
+
+static TEST_PathTypeDef path;
+
+static void TEST_ToneStage(void *ctx, float32_t *frames, uint32_t n) {
+  AUDIO_ToneProcess_f32((AUDIO_ToneTypeDef *)ctx, frames, n);
+}
+
+static uint8_t TEST_ToneActive(const void *ctx) {
+  return AUDIO_ToneActive((const AUDIO_ToneTypeDef *)ctx);
+}
+
+static void TEST_PeqStage(void *ctx, float32_t *frames, uint32_t n) {
+  AUDIO_PeqProcess_f32((AUDIO_PeqTypeDef *)ctx, frames, n);
+}
+
+static uint8_t TEST_PeqActive(const void *ctx) {
+  return AUDIO_PeqActive((const AUDIO_PeqTypeDef *)ctx);
+}
+
+static void TEST_LimitStage(void *ctx, float32_t *frames, uint32_t n) {
+  AUDIO_LimitProcess_f32((AUDIO_LimitTypeDef *)ctx, frames, n);
+}
+
+static uint8_t TEST_LimitActive(const void *ctx) {
+  return ((const AUDIO_LimitTypeDef *)ctx)->on;
+}
+
+static void TEST_TapStage(void *ctx, float32_t *frames, uint32_t n) {
+  TEST_PathTypeDef *p = (TEST_PathTypeDef *)ctx;
+
+  AUDIO_FifoPush_f32(&p->tap, frames, n);
+  p->tapped = 1U;
+}
+
+static void TEST_RequantStage(void *ctx, float32_t *frames, uint32_t n) {
+  TEST_PathTypeDef *p = (TEST_PathTypeDef *)ctx;
+
+  AUDIO_DitherQuantize_q15(&p->dither, frames, p->out, n);
+}
+
+static void TEST_PathInit(TEST_PathTypeDef *p) {
+  (void)memset(p, 0, sizeof(*p));
+  AUDIO_ToneInit(&p->tone, TEST_FREQ);
+  AUDIO_PeqInit(&p->peq);
+  AUDIO_LimitInit(&p->limit, TEST_FREQ);
+  AUDIO_DitherInit(&p->dither, AUDIO_DITHER_TPDF);
+
+  AUDIO_GraphInit(&p->graph);
+  (void)AUDIO_GraphAdd(&p->graph, TEST_STAGE_TONE, TEST_ToneStage, TEST_ToneActive, &p->tone);
+  (void)AUDIO_GraphAdd(&p->graph, TEST_STAGE_PEQ, TEST_PeqStage, TEST_PeqActive, &p->peq);
+  (void)AUDIO_GraphAdd(&p->graph, TEST_STAGE_LIMIT, TEST_LimitStage, TEST_LimitActive, &p->limit);
+  (void)AUDIO_GraphAddEdge(&p->graph, TEST_STAGE_TAP, TEST_TapStage, p);
+  (void)AUDIO_GraphAddEdge(&p->graph, TEST_STAGE_REQUANT, TEST_RequantStage, p);
+}
+
+/* One block the way USBD_AUDIO_ProcessBlock runs it at unity volume */
+static uint8_t TEST_PathBlock(TEST_PathTypeDef *p, int16_t *block) {
+  uint8_t dsp = AUDIO_GraphActive(&p->graph);
+
+  p->tapped = 0U;
+  if (dsp != 0U) {
+    arm_q15_to_float(block, p->work, TEST_BLOCK_FRAMES * 2U);
+    p->out = block;
+    AUDIO_GraphProcess_f32(&p->graph, p->work, TEST_BLOCK_FRAMES);
+  }
+  if (p->tapped == 0U) {
+    AUDIO_FifoPush_q15(&p->tap, block, TEST_BLOCK_FRAMES);
+  }
+  return dsp;
+}
+
+/* RBJ peaking EQ, CMSIS order with the feedback terms negated */
+static void TEST_Peaking(double f0, double q, double db, float32_t *coef) {
+  double a = pow(10.0, db / 40.0);
+  double w = 2.0 * M_PI * f0 / TEST_FREQ;
+  double alpha = sin(w) / (2.0 * q);
+  double a0 = 1.0 + alpha / a;
+
+  coef[0] = (float32_t)((1.0 + alpha * a) / a0);
+  coef[1] = (float32_t)(-2.0 * cos(w) / a0);
+  coef[2] = (float32_t)((1.0 - alpha * a) / a0);
+  coef[3] = (float32_t)(2.0 * cos(w) / a0);
+  coef[4] = (float32_t)(-(1.0 - alpha / a) / a0);
+}
+
+static void TEST_Put16(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void TEST_Put32(uint8_t *p, uint32_t v) {
+  TEST_Put16(p, v);
+  TEST_Put16(&p[2], v >> 16);
+}
+
+static uint32_t TEST_Get32(const uint8_t *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* 16-bit stereo PCM WAV file */
+static int TEST_WavWrite(const char *name, const int16_t *pcm, uint32_t frames, uint32_t freq) {
+  uint8_t hdr[44];
+  FILE *f = fopen(name, "wb");
+
+  if (f == NULL) {
+    return 0;
+  }
+  (void)memcpy(hdr, "RIFF", 4);
+  TEST_Put32(&hdr[4], 36U + frames * 4U);
+  (void)memcpy(&hdr[8], "WAVEfmt ", 8);
+  TEST_Put32(&hdr[16], 16U);
+  TEST_Put16(&hdr[20], 1U);
+  TEST_Put16(&hdr[22], 2U);
+  TEST_Put32(&hdr[24], freq);
+  TEST_Put32(&hdr[28], freq * 4U);
+  TEST_Put16(&hdr[32], 4U);
+  TEST_Put16(&hdr[34], 16U);
+  (void)memcpy(&hdr[36], "data", 4);
+  TEST_Put32(&hdr[40], frames * 4U);
+  (void)fwrite(hdr, 1, sizeof(hdr), f);
+  for (uint32_t i = 0U; i < frames * 2U; i++) {
+    uint8_t s[2];
+
+    TEST_Put16(s, (uint16_t)pcm[i]);
+    (void)fwrite(s, 1, 2, f);
+  }
+  return fclose(f) == 0;
+}
+
+/* Read a 16-bit stereo PCM WAV file, padded with silence to whole blocks */
+static int16_t *TEST_WavRead(const char *name, uint32_t *frames, uint32_t *freq) {
+  uint8_t hdr[12];
+  uint8_t chunk[8];
+  uint8_t fmt[16];
+  int16_t *pcm = NULL;
+  uint8_t have_fmt = 0U;
+  FILE *f = fopen(name, "rb");
+
+  if (f == NULL) {
+    return NULL;
+  }
+  if (fread(hdr, 1, 12, f) != 12 || memcmp(hdr, "RIFF", 4) != 0 || memcmp(&hdr[8], "WAVE", 4) != 0) {
+    (void)fclose(f);
+    return NULL;
+  }
+  while (pcm == NULL && fread(chunk, 1, 8, f) == 8) {
+    uint32_t size = TEST_Get32(&chunk[4]);
+
+    if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16U && fread(fmt, 1, 16, f) == 16) {
+      have_fmt = (uint8_t)(fmt[0] == 1U && fmt[2] == 2U && fmt[14] == 16U);
+      *freq = TEST_Get32(&fmt[4]);
+      (void)fseek(f, (long)(size - 16U + (size & 1U)), SEEK_CUR);
+    } else if (memcmp(chunk, "data", 4) == 0 && have_fmt != 0U) {
+      uint32_t n = size / 4U;
+      uint32_t padded = (n + TEST_BLOCK_FRAMES - 1U) / TEST_BLOCK_FRAMES * TEST_BLOCK_FRAMES;
+      uint8_t s[2];
+
+      pcm = calloc(padded * 2U, sizeof(int16_t));
+      for (uint32_t i = 0U; pcm != NULL && i < n * 2U && fread(s, 1, 2, f) == 2; i++) {
+        pcm[i] = (int16_t)(s[0] | s[1] << 8);
+      }
+      *frames = padded;
+    } else {
+      (void)fseek(f, (long)(size + (size & 1U)), SEEK_CUR);
+    }
+  }
+  (void)fclose(f);
+  return pcm;
+}
+
+/* Log sweep at -6 dBFS with a full-scale noise burst every second */
+static void TEST_Synth(int16_t *pcm, uint32_t frames) {
+  uint32_t seed = 0x1234567U;
+  double phase = 0.0;
+
+  for (uint32_t i = 0U; i < frames; i++) {
+    double t = (double)i / TEST_FREQ;
+    double f = 20.0 * pow(1000.0, t / TEST_SECONDS);
+    double x = 0.5 * sin(phase);
+
+    phase += 2.0 * M_PI * f / TEST_FREQ;
+    if (i % TEST_FREQ < TEST_FREQ / 10U) {
+      x = (double)(int32_t)TEST_Rand(&seed) / 2147483648.0;
+    }
+    pcm[2U * i] = (int16_t)lrint(32767.0 * x);
+    pcm[2U * i + 1U] = (int16_t)lrint(-32767.0 * x);
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *in_name = argc > 1 ? argv[1] : "test_graph_in.wav";
+  const char *out_name = argc > 2 ? argv[2] : "test_graph_out.wav";
+  static const char *const names[] = {"", "tone", "peq", "limit", "tap", "requant"};
+  uint64_t sum[AUDIO_GRAPH_STAGES_MAX] = {0U};
+  uint32_t worst[AUDIO_GRAPH_STAGES_MAX] = {0U};
+  float32_t coef[5];
+  int16_t tap[TEST_BLOCK_FRAMES];
+  int16_t *pcm;
+  int16_t *out;
+  uint32_t frames = 0U;
+  uint32_t freq = 0U;
+  uint32_t blocks;
+  int32_t peak = 0;
+  int32_t tap_err = 0;
+  int32_t ceiling;
+
+  if (argc <= 1) {
+    pcm = calloc(TEST_FREQ * TEST_SECONDS * 2U, sizeof(int16_t));
+    CHECK(pcm != NULL);
+    TEST_Synth(pcm, TEST_FREQ * TEST_SECONDS);
+    CHECK(TEST_WavWrite(in_name, pcm, TEST_FREQ * TEST_SECONDS, TEST_FREQ) != 0);
+    free(pcm);
+  }
+  pcm = TEST_WavRead(in_name, &frames, &freq);
+  CHECK(pcm != NULL && frames != 0U && freq == TEST_FREQ);
+  out = malloc(frames * 2U * sizeof(int16_t));
+  CHECK(out != NULL);
+  blocks = frames / TEST_BLOCK_FRAMES;
+
+  /* Every stage idle: integer fast path, bit-exact, tapped from the integer edge */
+  TEST_PathInit(&path);
+  (void)memcpy(out, pcm, frames * 2U * sizeof(int16_t));
+  for (uint32_t b = 0U; b < blocks; b++) {
+    CHECK(TEST_PathBlock(&path, &out[b * TEST_BLOCK_FRAMES * 2U]) == 0U);
+    CHECK(AUDIO_FifoRead_q15(&path.tap, tap, TEST_BLOCK_FRAMES, TEST_BLOCK_FRAMES) == 1U);
+    for (uint32_t i = 0U; i < TEST_BLOCK_FRAMES; i++) {
+      CHECK(tap[i] == pcm[(b * TEST_BLOCK_FRAMES + i) * 2U]);
+    }
+  }
+  CHECK(memcmp(out, pcm, frames * 2U * sizeof(int16_t)) == 0);
+
+  /* +6 dB of bass, two +9 dB PEQ bands, the limiter at -1 dBFS */
+  TEST_PathInit(&path);
+  AUDIO_ToneSetLevel(&path.tone, AUDIO_TONE_BASS, 24);
+  for (uint8_t ch = 0U; ch < AUDIO_PEQ_CHANNELS; ch++) {
+    TEST_Peaking(100.0, 1.0, 9.0, coef);
+    CHECK(AUDIO_PeqSetBand(&path.peq, ch, 0U, coef) == 1U);
+    TEST_Peaking(3000.0, 2.0, 9.0, coef);
+    CHECK(AUDIO_PeqSetBand(&path.peq, ch, 1U, coef) == 1U);
+  }
+  CHECK(AUDIO_PeqCommit(&path.peq, 2U, 2U) == 1U);
+  path.limit.on = 1U;
+  ceiling = (int32_t)(32768.0f * path.limit.ceiling) + 2;
+
+  (void)memcpy(out, pcm, frames * 2U * sizeof(int16_t));
+  for (uint32_t b = 0U; b < blocks; b++) {
+    int16_t *block = &out[b * TEST_BLOCK_FRAMES * 2U];
+
+    for (uint32_t s = 0U; s < path.graph.count; s++) {
+      path.graph.stage[s].cycles = 0U;
+    }
+    CHECK(TEST_PathBlock(&path, block) == 1U);
+    CHECK(path.tapped == 1U);
+    for (uint32_t s = 0U; s < path.graph.count; s++) {
+      sum[s] += path.graph.stage[s].cycles;
+      worst[s] = path.graph.stage[s].cycles > worst[s] ? path.graph.stage[s].cycles : worst[s];
+    }
+
+    CHECK(AUDIO_FifoRead_q15(&path.tap, tap, TEST_BLOCK_FRAMES, TEST_BLOCK_FRAMES) == 1U);
+    for (uint32_t i = 0U; i < TEST_BLOCK_FRAMES; i++) {
+      int32_t e = abs((int32_t)tap[i] - block[2U * i]);
+
+      tap_err = e > tap_err ? e : tap_err;
+      peak = abs(block[2U * i]) > peak ? abs(block[2U * i]) : peak;
+      peak = abs(block[2U * i + 1U]) > peak ? abs(block[2U * i + 1U]) : peak;
+    }
+  }
+  CHECK(TEST_WavWrite(out_name, out, frames, freq) != 0);
+  printf("test_graph: %s, %u blocks, peak %.2f dBFS under a %.2f dBFS ceiling, tap within %d LSB\n", in_name,
+         (unsigned)blocks, 20.0 * log10(peak / 32768.0), 20.0 * log10(path.limit.ceiling), (int)tap_err);
+  CHECK(peak <= ceiling);
+  CHECK(tap_err <= 2);
+
+  for (uint32_t s = 0U; s < path.graph.count; s++) {
+    printf("test_graph: %-8s host mean %5.0f, worst %6u cycles per %u-frame block\n", names[path.graph.stage[s].id],
+           (double)sum[s] / blocks, (unsigned)worst[s], (unsigned)TEST_BLOCK_FRAMES);
+  }
+
+  free(pcm);
+  free(out);
+  return 0;
+}
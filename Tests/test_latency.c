@@ -0,0 +1,148 @@
+/**
+ ******************************************************************************
+ * @file    test_latency.c
+ * @brief   End-to-end playback latency at each target, in virtual time.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  usbd_audio.c runs unchanged on the stand-ins of Host/usbd_host.c, as
+ *  in test_capture.c: one SOF, one OUT packet at the nominal rate, then
+ *  the I2S DMA shifting out the frames of that millisecond. The target is
+ *  selected by AUDIO_VENDOR_REQ_LATENCY before the stream starts, the
+ *  stream is silence with the default playback graph, then once more at
+ *  4 ms with the limiter switched on through AUDIO_VENDOR_REQ_LIMITER.
+ *
+ *  Once the feedback has settled, one packet carries an impulse on its
+ *  first left sample. The latency is counted in frames shifted out of
+ *  the I2S DMA buffer from the moment that packet was received to the
+ *  moment the impulse is: the queue, the DMA buffer and whatever delay
+ *  the playback graph adds, the limiter lookahead. It must be the target
+ *  plus the lookahead to within one I2S block, the granularity of the
+ *  prefill and of the callbacks, and match the queue depth the device
+ *  reports through AUDIO_VENDOR_REQ_LATENCY to within one packet. The
+ *  2 ms target is raised to the floor of USBD_AUDIO_LatencyFrames, two
+ *  blocks and a packet, so it measures 3 ms.
+ *
+ *  What the host adds, its own buffering and the bus, is not modelled:
+ *  this is the device side only.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "test.h"
+#include "usbd_audio.h"
+#include "usbd_host.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_FREQ                                     USBD_AUDIO_FREQ_48K
+#define TEST_SETTLE_MS                                1000U
+/* Long enough for the deepest target and the lookahead */
+#define TEST_LISTEN_MS                                40U
+#define TEST_IMPULSE                                  0x4000
+/* Half the impulse: the dither and the limiter may not move it that far */
+#define TEST_THRESHOLD                                (TEST_IMPULSE << 15)
+
+static USBD_HandleTypeDef dev;
+static int16_t packet[AUDIO_OUT_PACKET_MAX / sizeof(int16_t)];
+static int32_t left[TEST_FREQ / 1000U + 1U];
+
+/**
+ * @brief  TEST_Millisecond
+ *         One USB frame: SOF, an OUT packet of the nominal size, then the
+ *         I2S frames of that millisecond
+ * @param  impulse: first left sample of the packet set to TEST_IMPULSE
+ * @param  played: frames shifted out in this millisecond
+ * @retval frame of this millisecond the impulse came out at, -1 if none
+ */
+static int32_t TEST_Millisecond(uint8_t impulse, uint32_t *played) {
+  uint32_t frames = TEST_FREQ / 1000U;
+
+  (void)USBD_HostSof(&dev);
+  (void)memset(packet, 0, frames * 2U * sizeof(int16_t));
+  packet[0] = impulse != 0U ? TEST_IMPULSE : 0;
+  (void)USBD_HostOut(&dev, (const uint8_t *)packet, frames * 2U * sizeof(int16_t));
+
+  USBD_HostPlay(&dev, frames, left);
+  *played = frames;
+  for (uint32_t i = 0U; i < frames; i++) {
+    if (left[i] > TEST_THRESHOLD) {
+      return (int32_t)i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief  TEST_Run
+ *         Measure the latency at one target
+ * @param  ms: latency target
+ * @param  limit: switch the limiter on, default settings, before the stream starts
+ * @retval 0 on success
+ */
+static int TEST_Run(uint8_t ms, uint8_t limit) {
+  USBD_AUDIO_HandleTypeDef *haudio;
+  USBD_AUDIO_LatencyTypeDef report;
+  USBD_AUDIO_LimiterTypeDef limiter;
+  uint32_t lookahead;
+  uint32_t latency = 0U;
+  uint32_t queued;
+  uint32_t played;
+  int32_t at = -1;
+
+  CHECK(USBD_HostInit(&dev, &USBD_AUDIO) == USBD_OK);
+  haudio = (USBD_AUDIO_HandleTypeDef *)dev.pClassDataCmsit[0];
+  USBD_AUDIO_Poll(&dev);
+  CHECK(USBD_HostSetup(&dev, 0x41U, AUDIO_VENDOR_REQ_LATENCY, ms, 1U, 0U) == USBD_OK);
+  if (limit != 0U) {
+    limiter = (USBD_AUDIO_LimiterTypeDef){1U, AUDIO_LIMIT_CEILING_DEFAULT, AUDIO_LIMIT_ATTACK_US_DEFAULT,
+                                          AUDIO_LIMIT_RELEASE_MS_DEFAULT, 0U, 0U};
+    CHECK(USBD_HostSetup(&dev, 0x41U, AUDIO_VENDOR_REQ_LIMITER, 0U, 1U, sizeof(limiter)) == USBD_OK);
+    CHECK(USBD_HostDataStage(&dev, (const uint8_t *)&limiter, sizeof(limiter)) == USBD_OK);
+  }
+  CHECK(USBD_HostSetup(&dev, 0x01U, USB_REQ_SET_INTERFACE, AUDIO_ALT_SETTING_16B, 1U, 0U) == USBD_OK);
+  CHECK(haudio->playing != 0U && haudio->freq == TEST_FREQ && haudio->latency_ms == ms);
+
+  for (uint32_t t = 0U; t < TEST_SETTLE_MS; t++) {
+    CHECK(TEST_Millisecond(0U, &played) < 0);
+  }
+
+  CHECK(USBD_HostSetup(&dev, 0xC1U, AUDIO_VENDOR_REQ_LATENCY, 0U, 1U, sizeof(report)) == USBD_OK);
+  (void)memcpy(&report, USBD_Host.ctl_data, sizeof(report));
+  CHECK(USBD_HostSetup(&dev, 0xC1U, AUDIO_VENDOR_REQ_LIMITER, 0U, 1U, sizeof(limiter)) == USBD_OK);
+  (void)memcpy(&limiter, USBD_Host.ctl_data, sizeof(limiter));
+  lookahead = (uint32_t)lrint(limiter.latency_us * (TEST_FREQ / 1e6));
+
+  /* Counted from the end of the packet: the DMA moves on once it is in */
+  at = TEST_Millisecond(1U, &played);
+  for (uint32_t t = 0U; at < 0 && t < TEST_LISTEN_MS; t++) {
+    latency += played;
+    at = TEST_Millisecond(0U, &played);
+  }
+  CHECK(at >= 0);
+  latency += (uint32_t)at;
+  queued = (uint32_t)lrint(report.queued_us * (TEST_FREQ / 1e6));
+
+  printf("test_latency: target %2u ms (%4u frames), limiter %-3s: impulse out after %4u frames, %6.3f ms; "
+         "reported queue %6.3f ms, lookahead %5.3f ms\n",
+         (unsigned)ms, (unsigned)report.target_frames, limit != 0U ? "on" : "off", (unsigned)latency,
+         latency * (1000.0 / TEST_FREQ), report.queued_us / 1000.0, limiter.latency_us / 1000.0);
+  CHECK((limit != 0U) == (lookahead != 0U));
+  CHECK(abs((int32_t)latency - (int32_t)(report.target_frames + lookahead)) <= (int32_t)AUDIO_BLOCK_FRAMES);
+  CHECK(abs((int32_t)latency - (int32_t)(queued + lookahead)) <= (int32_t)(TEST_FREQ / 1000U));
+  return 0;
+}
+
+int main(void) {
+  static const uint8_t targets[] = {2U, 4U, 8U, 16U};
+  int failed = 0;
+
+  for (uint32_t i = 0U; i < sizeof(targets) / sizeof(targets[0]); i++) {
+    failed |= TEST_Run(targets[i], 0U);
+  }
+  failed |= TEST_Run(4U, 1U);
+  return failed;
+}
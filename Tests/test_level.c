@@ -0,0 +1,236 @@
+/**
+ ******************************************************************************
+ * @file    test_level.c
+ * @brief   Level meter against a brute-force windowed reference, and the
+ *          analyzer tap fed from the same loop.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  Blocks of random level, some of them a frame short so that the odd
+ *  frame is paired with silence, go through AUDIO_LevelBlock_q15 and, as
+ *  the same samples in the top halfword with random low bits below,
+ *  through AUDIO_LevelBlock_q31. After every block the snapshot must
+ *  match what the last AUDIO_LEVEL_WINDOW blocks give when summed again
+ *  from scratch:
+ *    - the peak, exactly, including each time the block that held it
+ *      leaves the window and the next largest has to be found;
+ *    - the RMS, to one step of the float square root;
+ *    - the clip count: blocks reaching +32767 or -32767 on a channel,
+ *      never those stopping one step short of it.
+ *  The tap must hold the first channel of every block it was given,
+ *  top 16 bits for q31, and nothing when it was not given or was full;
+ *  a full tap does not stop the metering.
+ *
+ *  Then the cost of one 48 frame q31 block fed to the tap: the fused
+ *  loop against metering and pushing in two loops, in AUDIO_HostCycles
+ *  counts, time stamp counter ticks on an x86 host.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_level.h"
+#include "test.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_BLOCK_FRAMES                             48U
+#define TEST_BLOCKS                                   2000U
+/* Every 5th block is a frame short */
+#define TEST_SHORT_EVERY                              5U
+#define TEST_CLIP_EVERY                               37U
+#define TEST_FULL_EVERY                               11U
+#define BENCH_BLOCKS                                  20000U
+
+typedef struct {
+  int32_t peak[AUDIO_LEVEL_CHANNELS];
+  uint64_t sum[AUDIO_LEVEL_CHANNELS];
+  uint8_t clip[AUDIO_LEVEL_CHANNELS];
+  uint32_t frames;
+} TEST_BlockTypeDef;
+
+static AUDIO_LevelTypeDef level;
+static AUDIO_FifoTypeDef tap;
+static TEST_BlockTypeDef history[TEST_BLOCKS];
+static int16_t block16[TEST_BLOCK_FRAMES * 2U];
+static int32_t block32[TEST_BLOCK_FRAMES * 2U];
+
+/**
+ * @brief  TEST_Block
+ *         Next block of the run and its reference measures
+ * @param  b: block index
+ * @param  state: generator state
+ * @retval frames of the block
+ */
+static uint32_t TEST_Block(uint32_t b, uint32_t *state) {
+  uint32_t n = (b % TEST_SHORT_EVERY) == TEST_SHORT_EVERY - 1U ? TEST_BLOCK_FRAMES - 1U : TEST_BLOCK_FRAMES;
+  /* Mostly quiet, now and then loud: the window peak rises and falls */
+  int32_t amp = (TEST_Rand(state) & 7U) == 0U ? 30000 : (int32_t)(TEST_Rand(state) % 8000U);
+  TEST_BlockTypeDef *ref = &history[b];
+
+  (void)memset(ref, 0, sizeof(*ref));
+  ref->frames = n;
+  for (uint32_t i = 0U; i < n * 2U; i++) {
+    int32_t x = (int32_t)(TEST_Rand(state) % (2U * (uint32_t)amp + 1U)) - amp;
+
+    block16[i] = (int16_t)x;
+  }
+
+  /* Full scale on one channel, either polarity; one step short of it every other time */
+  if (b % TEST_CLIP_EVERY == 0U) {
+    static const int16_t full[] = {32767, -32767, -32768, 32766, -32766};
+    uint32_t k = (b / TEST_CLIP_EVERY) % (sizeof(full) / sizeof(full[0]));
+
+    block16[(TEST_Rand(state) % n) * 2U + (b & 1U)] = full[k];
+  }
+
+  for (uint32_t i = 0U; i < n; i++) {
+    for (uint32_t ch = 0U; ch < AUDIO_LEVEL_CHANNELS; ch++) {
+      int32_t x = block16[i * 2U + ch];
+
+      block32[i * 2U + ch] = (int32_t)((uint32_t)x << 16 | (TEST_Rand(state) & 0xFFFFU));
+      ref->sum[ch] += (uint64_t)(x * x);
+      ref->peak[ch] = abs(x) > ref->peak[ch] ? abs(x) : ref->peak[ch];
+      ref->clip[ch] |= (uint8_t)(x >= 32767 || x <= -32767);
+    }
+  }
+  return n;
+}
+
+/**
+ * @brief  TEST_Check
+ *         Snapshot after block b against the reference window
+ * @param  b: last block metered
+ * @param  clips: reference clip counts, updated with block b
+ * @retval 0 on success
+ */
+static int TEST_Check(uint32_t b, uint32_t *clips) {
+  AUDIO_LevelSnapshotTypeDef snap;
+  uint32_t first = b + 1U > AUDIO_LEVEL_WINDOW ? b + 1U - AUDIO_LEVEL_WINDOW : 0U;
+
+  AUDIO_LevelRead(&level, &snap);
+  CHECK(snap.blocks == b + 1U);
+
+  for (uint32_t ch = 0U; ch < AUDIO_LEVEL_CHANNELS; ch++) {
+    int32_t peak = 0;
+    uint64_t sum = 0U;
+    uint32_t frames = 0U;
+    double rms;
+
+    for (uint32_t k = first; k <= b; k++) {
+      peak = history[k].peak[ch] > peak ? history[k].peak[ch] : peak;
+      sum += history[k].sum[ch];
+      frames += history[k].frames;
+    }
+    rms = floor(sqrt((double)sum / frames));
+    clips[ch] += history[b].clip[ch];
+
+    CHECK(snap.peak[ch] == (uint16_t)peak);
+    CHECK(fabs((double)snap.rms[ch] - rms) <= 1.0);
+    CHECK(snap.clips[ch] == clips[ch]);
+  }
+  return 0;
+}
+
+/**
+ * @brief  TEST_Run
+ *         Meter the whole run at one sample width
+ * @param  wide: 0 for q15, 1 for q31
+ * @retval 0 on success
+ */
+static int TEST_Run(uint8_t wide) {
+  uint32_t state = 0x1234567U;
+  uint32_t clips[AUDIO_LEVEL_CHANNELS] = {0U, 0U};
+  uint32_t evictions = 0U;
+  uint32_t tapped = 0U;
+  uint16_t last = 0U;
+
+  AUDIO_LevelInit(&level);
+  (void)memset(&tap, 0, sizeof(tap));
+
+  for (uint32_t b = 0U; b < TEST_BLOCKS; b++) {
+    uint32_t n = TEST_Block(b, &state);
+    /* Every other block fed to the tap, now and then a full one */
+    uint8_t feed = (b & 1U) == 0U;
+    uint8_t full = feed != 0U && b % TEST_FULL_EVERY == 0U;
+    uint32_t wr = tap.wr;
+    uint32_t overruns = tap.overruns;
+
+    tap.rd = full != 0U ? wr - AUDIO_FIFO_SIZE + n - 1U : wr;
+    if (wide != 0U) {
+      AUDIO_LevelBlock_q31(&level, block32, n, feed != 0U ? &tap : NULL);
+    } else {
+      AUDIO_LevelBlock_q15(&level, block16, n, feed != 0U ? &tap : NULL);
+    }
+    if (TEST_Check(b, clips) != 0) {
+      printf("test_level: %s block %u\n", wide != 0U ? "q31" : "q15", (unsigned)b);
+      return 1;
+    }
+
+    if (feed != 0U && full == 0U) {
+      CHECK(tap.wr == wr + n && tap.overruns == overruns);
+      for (uint32_t i = 0U; i < n; i++) {
+        CHECK(tap.buf[(wr + i) & AUDIO_FIFO_MASK] == block16[i * 2U]);
+      }
+      tapped++;
+    } else {
+      CHECK(tap.wr == wr && tap.overruns == overruns + full);
+    }
+
+    evictions += level.snap.peak[0] < last ? 1U : 0U;
+    last = level.snap.peak[0];
+  }
+
+  printf("test_level: %s, %u blocks: window peak fell %u times, clips %u/%u, %u blocks tapped\n",
+         wide != 0U ? "q31" : "q15", (unsigned)TEST_BLOCKS, (unsigned)evictions, (unsigned)clips[0],
+         (unsigned)clips[1], (unsigned)tapped);
+  CHECK(evictions > 0U && clips[0] > 0U && clips[1] > 0U);
+  return 0;
+}
+
+static int TEST_Bench(void) {
+  uint32_t state = 0x1234567U;
+  uint32_t best_fused = UINT32_MAX;
+  uint32_t best_split = UINT32_MAX;
+  uint64_t sum_fused = 0U;
+  uint64_t sum_split = 0U;
+
+  (void)TEST_Block(0U, &state);
+  AUDIO_LevelInit(&level);
+  (void)memset(&tap, 0, sizeof(tap));
+
+  for (uint32_t k = 0U; k < BENCH_BLOCKS; k++) {
+    uint32_t cycles;
+
+    tap.rd = tap.wr;
+    cycles = AUDIO_HostCycles();
+    AUDIO_LevelBlock_q31(&level, block32, TEST_BLOCK_FRAMES, &tap);
+    cycles = AUDIO_HostCycles() - cycles;
+    sum_fused += cycles;
+    best_fused = cycles < best_fused ? cycles : best_fused;
+
+    tap.rd = tap.wr;
+    cycles = AUDIO_HostCycles();
+    AUDIO_LevelBlock_q31(&level, block32, TEST_BLOCK_FRAMES, NULL);
+    AUDIO_FifoPush_q31(&tap, block32, TEST_BLOCK_FRAMES);
+    cycles = AUDIO_HostCycles() - cycles;
+    sum_split += cycles;
+    best_split = cycles < best_split ? cycles : best_split;
+  }
+  printf("test_level: %u-frame q31 block, meter and tap: host best %u, mean %.0f cycles fused; "
+         "best %u, mean %.0f in two loops\n",
+         (unsigned)TEST_BLOCK_FRAMES, (unsigned)best_fused, (double)sum_fused / BENCH_BLOCKS,
+         (unsigned)best_split, (double)sum_split / BENCH_BLOCKS);
+  return 0;
+}
+
+int main(void) {
+  int failed = 0;
+
+  failed |= TEST_Run(0U);
+  failed |= TEST_Run(1U);
+  failed |= TEST_Bench();
+  return failed;
+}
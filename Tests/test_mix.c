@@ -0,0 +1,92 @@
+/**
+ ******************************************************************************
+ * @file    test_mix.c
+ * @brief   Downmix matrix against a reference, and its cost per USB frame.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  Random crosspoints, including silent and 0 dB ones, on random and
+ *  full-scale quad and 5.1 frames: the kernel must match the rounded,
+ *  saturated dot product bit for bit (the _dsp build on its SMLALD path).
+ *  Then the host time of one millisecond of each format at its highest
+ *  rate, and the bus share of its packets against the 1023 bytes a
+ *  full-speed isochronous endpoint may move per frame.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_mix.h"
+#include "test.h"
+
+#define TEST_FRAMES                                   97U
+#define BENCH_ROUNDS                                  200000U
+#define TEST_FS_ISO_MAX                               1023U
+
+static int16_t src[TEST_FRAMES * AUDIO_MIX_CHANNELS_MAX] __attribute__((aligned(4)));
+static int16_t dst[TEST_FRAMES * 2U] __attribute__((aligned(4)));
+
+/* round(sum(x * c) / 2^15), saturated */
+static int16_t TEST_MixRef(const int16_t *frame, const AUDIO_MixTypeDef *mix, uint32_t out) {
+  int64_t acc = 0x4000;
+
+  for (uint32_t ch = 0U; ch < mix->channels; ch++) {
+    int16_t c = (int16_t)(mix->coef[out][ch / 2U] >> (16U * (ch & 1U)));
+
+    acc += (int64_t)frame[ch] * c;
+  }
+  acc >>= 15;
+  return (int16_t)(acc > INT16_MAX ? INT16_MAX : acc < INT16_MIN ? INT16_MIN : acc);
+}
+
+int main(void) {
+  static const struct {
+    uint8_t channels;
+    uint32_t freq;
+  } formats[] = {{4U, 96000U}, {6U, 48000U}};
+  uint32_t seed = 0xABCDU;
+  volatile int16_t sink = 0;
+
+  for (uint32_t f = 0U; f < 2U; f++) {
+    AUDIO_MixTypeDef mix;
+    uint8_t channels = formats[f].channels;
+    uint32_t frames_ms = formats[f].freq / 1000U + 1U;
+    double t;
+
+    for (uint32_t round = 0U; round < 200U; round++) {
+      AUDIO_MixInit(&mix, channels);
+      for (uint32_t in = 0U; in < channels; in++) {
+        for (uint32_t out = 0U; out < 2U; out++) {
+          uint32_t r = TEST_Rand(&seed) % 4U;
+          int16_t volume = r == 0U ? AUDIO_MIX_DB_SILENCE : r == 1U ? 0 : (int16_t)-(int32_t)(TEST_Rand(&seed) % 0x6000U);
+
+          AUDIO_MixSetGain(&mix, in, out, volume);
+        }
+      }
+      for (uint32_t i = 0U; i < TEST_FRAMES * channels; i++) {
+        src[i] = (round & 1U) != 0U ? (int16_t)((TEST_Rand(&seed) & 1U) != 0U ? 32767 : -32768) : (int16_t)TEST_Rand(&seed);
+      }
+      AUDIO_MixDown_q15(src, dst, TEST_FRAMES, &mix);
+      for (uint32_t i = 0U; i < TEST_FRAMES; i++) {
+        CHECK(dst[2U * i] == TEST_MixRef(&src[i * channels], &mix, 0U));
+        CHECK(dst[2U * i + 1U] == TEST_MixRef(&src[i * channels], &mix, 1U));
+      }
+    }
+
+    t = TEST_Seconds();
+    for (uint32_t n = 0U; n < BENCH_ROUNDS; n++) {
+      AUDIO_MixDown_q15(src, dst, frames_ms, &mix);
+      sink = dst[n % (2U * frames_ms)];
+    }
+    t = (TEST_Seconds() - t) / BENCH_ROUNDS;
+
+    printf("test_mix: %u ch at %u Hz bit-exact; host %.0f ns per ms (%.3f %% of the frame), "
+           "packet %u B, %.0f %% of a full-speed iso frame\n",
+           (unsigned)channels, (unsigned)formats[f].freq, t * 1e9, t * 1e5, (unsigned)(frames_ms * channels * 2U),
+           100.0 * frames_ms * channels * 2U / TEST_FS_ISO_MAX);
+    CHECK(frames_ms * channels * 2U <= TEST_FS_ISO_MAX);
+  }
+  (void)sink;
+
+  return 0;
+}
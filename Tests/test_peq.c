@@ -0,0 +1,197 @@
+/**
+ ******************************************************************************
+ * @file    test_peq.c
+ * @brief   Parametric EQ against a double precision cascade, bank swaps and
+ *          its cost per playback block.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  Ten peaking bands per channel, different on each side, run on noise
+ *  through the uploaded banks: every block must follow a double
+ *  precision cascade to -60 dB of full scale, the float rounding of the
+ *  low, narrow bands alone is about -75 dB. Uploads in between blocks
+ *  must not change the block being run, a commit takes effect at the
+ *  next block with the state of the bands that keep running. Then
+ *  the cost of one AUDIO_BLOCK_FRAMES block through the graph, as the
+ *  playback path runs it, for 1 to AUDIO_PEQ_BANDS_MAX bands per
+ *  channel: the best and the mean of the counts AUDIO_GRAPH_CYCLES
+ *  takes per block, time stamp counter ticks on an x86 host.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_graph.h"
+#include "audio_peq.h"
+#include "test.h"
+
+#include <math.h>
+#include <string.h>
+
+#define TEST_BLOCK_FRAMES                             48U
+#define TEST_BLOCKS                                   400U
+#define TEST_FREQ                                     48000.0
+#define BENCH_BLOCKS                                  20000U
+
+typedef struct {
+  double coef[AUDIO_PEQ_CHANNELS][5U * AUDIO_PEQ_BANDS_MAX];
+  double state[AUDIO_PEQ_CHANNELS][2U * AUDIO_PEQ_BANDS_MAX];
+  uint8_t bands[AUDIO_PEQ_CHANNELS];
+} TEST_PeqRefTypeDef;
+
+static AUDIO_PeqTypeDef peq;
+static AUDIO_GraphTypeDef graph;
+static float32_t block[TEST_BLOCK_FRAMES * 2U];
+
+/* RBJ cookbook peaking EQ, CMSIS order with the feedback terms negated */
+static void TEST_Peaking(double f0, double q, double db, float32_t *coef, double *ref) {
+  double a = pow(10.0, db / 40.0);
+  double w = 2.0 * M_PI * f0 / TEST_FREQ;
+  double alpha = sin(w) / (2.0 * q);
+  double a0 = 1.0 + alpha / a;
+  double c[5];
+
+  c[0] = (1.0 + alpha * a) / a0;
+  c[1] = -2.0 * cos(w) / a0;
+  c[2] = (1.0 - alpha * a) / a0;
+  c[3] = 2.0 * cos(w) / a0;
+  c[4] = -(1.0 - alpha / a) / a0;
+  for (uint32_t i = 0U; i < 5U; i++) {
+    coef[i] = (float32_t)c[i];
+    ref[i] = (double)coef[i];
+  }
+}
+
+/* Same transposed direct form II, in double */
+static void TEST_PeqRef(TEST_PeqRefTypeDef *ref, uint32_t ch, const float32_t *in, double *out, uint32_t n) {
+  for (uint32_t i = 0U; i < n; i++) {
+    double x = (double)in[2U * i + ch];
+
+    for (uint32_t b = 0U; b < ref->bands[ch]; b++) {
+      const double *c = &ref->coef[ch][5U * b];
+      double *d = &ref->state[ch][2U * b];
+      double y = c[0] * x + d[0];
+
+      d[0] = c[1] * x + c[3] * y + d[1];
+      d[1] = c[2] * x + c[4] * y;
+      x = y;
+    }
+    out[i] = x;
+  }
+}
+
+static uint8_t TEST_Active(const void *ctx) {
+  return AUDIO_PeqActive((const AUDIO_PeqTypeDef *)ctx);
+}
+
+static void TEST_Process(void *ctx, float32_t *frames, uint32_t n) {
+  AUDIO_PeqProcess_f32((AUDIO_PeqTypeDef *)ctx, frames, n);
+}
+
+/* Upload a random set of bands, mirrored into the pending reference */
+static void TEST_Upload(TEST_PeqRefTypeDef *next, uint32_t *seed, uint8_t left, uint8_t right) {
+  for (uint32_t ch = 0U; ch < AUDIO_PEQ_CHANNELS; ch++) {
+    for (uint32_t b = 0U; b < AUDIO_PEQ_BANDS_MAX; b++) {
+      float32_t coef[5];
+      double f0 = 30.0 * pow(2.0, 0.95 * ((double)b + (double)(TEST_Rand(seed) % 100U) / 100.0));
+      double q = 0.5 + (double)(TEST_Rand(seed) % 500U) / 100.0;
+      double db = -12.0 + (double)(TEST_Rand(seed) % 2400U) / 100.0;
+
+      TEST_Peaking(f0, q, db, coef, &next->coef[ch][5U * b]);
+      (void)AUDIO_PeqSetBand(&peq, (uint8_t)ch, (uint8_t)b, coef);
+    }
+  }
+  next->bands[0] = left;
+  next->bands[1] = right;
+  (void)AUDIO_PeqCommit(&peq, left, right);
+}
+
+int main(void) {
+  static TEST_PeqRefTypeDef ref;
+  static TEST_PeqRefTypeDef next;
+  static double out[AUDIO_PEQ_CHANNELS][TEST_BLOCK_FRAMES];
+  uint32_t seed = 0x5EEDU;
+  double err = 0.0;
+  float32_t coef[5] = {2.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+
+  AUDIO_PeqInit(&peq);
+  AUDIO_GraphInit(&graph);
+  (void)AUDIO_GraphAdd(&graph, 0x02U, TEST_Process, TEST_Active, &peq);
+  (void)memset(&ref, 0, sizeof(ref));
+
+  /* Unstable, out of range or too many bands are refused */
+  CHECK(AUDIO_PeqSetBand(&peq, 0U, 0U, coef) == 0U);
+  CHECK(AUDIO_PeqSetBand(&peq, 2U, 0U, coef) == 0U);
+  CHECK(AUDIO_PeqCommit(&peq, AUDIO_PEQ_BANDS_MAX + 1U, 0U) == 0U);
+  CHECK(AUDIO_GraphActive(&graph) == 0U);
+
+  for (uint32_t blk = 0U; blk < TEST_BLOCKS; blk++) {
+    /* A new set every 50 blocks, the band counts moving both ways */
+    if (blk % 50U == 0U) {
+      uint8_t left = (uint8_t)(blk / 50U % 2U == 0U ? AUDIO_PEQ_BANDS_MAX : 3U + blk / 50U % 4U);
+      uint8_t right = (uint8_t)(AUDIO_PEQ_BANDS_MAX - blk / 50U % 5U);
+
+      TEST_Upload(&next, &seed, left, right);
+      CHECK(AUDIO_GraphActive(&graph) != 0U);
+    }
+    if (peq.pending != 0U) {
+      for (uint32_t ch = 0U; ch < AUDIO_PEQ_CHANNELS; ch++) {
+        if (next.bands[ch] > ref.bands[ch]) {
+          (void)memset(&ref.state[ch][2U * ref.bands[ch]], 0,
+                       2U * (next.bands[ch] - ref.bands[ch]) * sizeof(double));
+        }
+        ref.bands[ch] = next.bands[ch];
+      }
+      (void)memcpy(ref.coef, next.coef, sizeof(ref.coef));
+    }
+
+    for (uint32_t i = 0U; i < TEST_BLOCK_FRAMES * 2U; i++) {
+      block[i] = 0.25f * ((float32_t)(int32_t)TEST_Rand(&seed) / 2147483648.0f);
+    }
+    for (uint32_t ch = 0U; ch < AUDIO_PEQ_CHANNELS; ch++) {
+      TEST_PeqRef(&ref, ch, block, out[ch], TEST_BLOCK_FRAMES);
+    }
+    AUDIO_GraphProcess_f32(&graph, block, TEST_BLOCK_FRAMES);
+    CHECK(peq.pending == 0U);
+
+    for (uint32_t i = 0U; i < TEST_BLOCK_FRAMES; i++) {
+      for (uint32_t ch = 0U; ch < AUDIO_PEQ_CHANNELS; ch++) {
+        double e = fabs((double)block[2U * i + ch] - out[ch][i]);
+
+        err = e > err ? e : err;
+      }
+    }
+
+    /* Staged but not committed: the next block still runs the bank in use */
+    if (blk % 50U == 25U) {
+      float32_t flat[5] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+
+      CHECK(AUDIO_PeqSetBand(&peq, 0U, 0U, flat) == 1U);
+      AUDIO_PeqGetBand(&peq, 0U, 0U, coef);
+      CHECK(coef[0] == (float32_t)ref.coef[0][0]);
+    }
+  }
+  printf("test_peq: %u blocks, %u uploads, worst error %.1f dBFS\n", (unsigned)TEST_BLOCKS,
+         (unsigned)(TEST_BLOCKS / 50U), 20.0 * log10(err));
+  CHECK(err < 1e-3);
+
+  /* Cost of one playback block per band count */
+  for (uint8_t bands = 1U; bands <= AUDIO_PEQ_BANDS_MAX; bands++) {
+    uint64_t sum = 0U;
+    uint32_t best = UINT32_MAX;
+
+    TEST_Upload(&next, &seed, bands, bands);
+    for (uint32_t n = 0U; n < BENCH_BLOCKS; n++) {
+      graph.stage[0].cycles = 0U;
+      AUDIO_GraphProcess_f32(&graph, block, TEST_BLOCK_FRAMES);
+      sum += graph.stage[0].cycles;
+      best = graph.stage[0].cycles < best ? graph.stage[0].cycles : best;
+    }
+    if (bands == 1U || bands == AUDIO_PEQ_BANDS_MAX / 2U || bands == AUDIO_PEQ_BANDS_MAX) {
+      printf("test_peq: %2u bands x 2 ch, %u-frame block: host best %u, mean %.0f cycles\n", (unsigned)bands,
+             (unsigned)TEST_BLOCK_FRAMES, (unsigned)best, (double)sum / BENCH_BLOCKS);
+    }
+  }
+
+  return 0;
+}
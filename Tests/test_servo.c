@@ -0,0 +1,181 @@
+/**
+ ******************************************************************************
+ * @file    test_servo.c
+ * @brief   Virtual-time simulation of the feedback rate servo.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  One hour of stream per case, stepped per USB frame of the host clock:
+ *
+ *  - the host sends the feedback rate, 10.14 samples per frame, with
+ *    its own fractional accumulator, and picks up a new value 1 to 4
+ *    frames after the device sent it
+ *  - the I2S plays at the nominal rate off by the case's ppm, in 48-frame
+ *    DMA halves refilled from the prefill and then the ring, as in
+ *    USBD_AUDIO_Sync; a refill that finds less than a block is an underrun,
+ *    a packet that finds AUDIO_RING_SLOT_NUM - 1 slots queued an overrun
+ *  - every 5 frames the device reads the queue, ring plus DMA items left,
+ *    late by up to the case's SOF interrupt jitter, and runs the servo
+ *
+ *  After the first two minutes the fill must stay within a few frames of
+ *  the target, with no underrun or overrun over the whole hour.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_ring.h"
+#include "audio_servo.h"
+#include "test.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#define SIM_BLOCK                                     48U
+#define SIM_LATENCY_MS                                4U
+#define SIM_FRAMES                                    (3600U * 1000U)
+#define SIM_SETTLE                                    (120U * 1000U)
+#define SIM_FB_INTERVAL                               5U
+#define SIM_FB_DELAY_MAX                              4U
+
+typedef struct {
+  uint32_t freq;
+  double ppm;                                  /* device clock against the host clock */
+  double jitter_us;                            /* SOF interrupt latency, uniform 0..jitter */
+} SIM_CaseTypeDef;
+
+typedef struct {
+  uint32_t underruns;
+  uint32_t overruns;
+  double mean;                                 /* fill error after settling, frames */
+  double worst;
+  double settle_s;                             /* last time the error exceeded 4 frames */
+  double drift_ppm;                            /* the servo's rate estimate against nominal */
+} SIM_ResultTypeDef;
+
+static uint32_t seed = 0x5EED5U;
+
+/* Uniform in [0, 1) */
+static double SIM_Uniform(void) {
+  return (double)(TEST_Rand(&seed) >> 8) / 16777216.0;
+}
+
+static void SIM_Run(const SIM_CaseTypeDef *c, SIM_ResultTypeDef *res) {
+  AUDIO_ServoTypeDef servo;
+  uint16_t packets[AUDIO_RING_SLOT_NUM];
+  uint32_t head = 0U;
+  uint32_t count = 0U;
+  uint32_t ring_frames = 0U;
+  uint32_t pkt_off = 0U;
+  double rate = (double)c->freq / 1000.0 * (1.0 + c->ppm * 1e-6);
+  uint32_t least = 2U * SIM_BLOCK + c->freq / 1000U + 1U;
+  uint32_t target = SIM_LATENCY_MS * c->freq / 1000U > least ? SIM_LATENCY_MS * c->freq / 1000U : least;
+  uint32_t prefill = target / SIM_BLOCK * SIM_BLOCK - 2U * SIM_BLOCK;
+  uint64_t loaded = 2U * SIM_BLOCK;            /* frames handed to the DMA so far */
+  uint32_t fb_sent = 0U;
+  uint32_t fb_host = 0U;
+  uint32_t fb_due = UINT32_MAX;
+  uint64_t host_acc = 0U;
+  double sum = 0.0;
+  uint32_t n = 0U;
+
+  AUDIO_ServoInit(&servo, c->freq);
+  fb_host = (uint32_t)(((uint64_t)c->freq << 14) / 1000U);
+  res->underruns = 0U;
+  res->overruns = 0U;
+  res->worst = 0.0;
+  res->settle_s = 0.0;
+
+  for (uint32_t k = 0U; k < SIM_FRAMES; k++) {
+    double t = (double)k;
+
+    /* SOF: queue as read by the feedback update, late by the interrupt latency */
+    if (k % SIM_FB_INTERVAL == 0U && k != 0U) {
+      double played = (t + SIM_Uniform() * c->jitter_us * 1e-3) * rate;
+      int32_t queued = (int32_t)(ring_frames - pkt_off) + (int32_t)prefill + (int32_t)(loaded - (uint64_t)played);
+      int32_t error = queued - (int32_t)target;
+
+      fb_sent = AUDIO_ServoUpdate(&servo, error, SIM_FB_INTERVAL, 14U);
+      fb_due = k + 1U + TEST_Rand(&seed) % SIM_FB_DELAY_MAX;
+      if (k >= SIM_SETTLE) {
+        sum += error;
+        n++;
+        res->worst = fabs((double)error) > res->worst ? fabs((double)error) : res->worst;
+      }
+      if (abs(error) > 4) {
+        res->settle_s = t * 1e-3;
+      }
+    }
+    if (k == fb_due) {
+      fb_host = fb_sent;
+    }
+
+    /* Host packet, received early in the frame */
+    host_acc += fb_host;
+    if (count == AUDIO_RING_SLOT_NUM - 1U) {
+      res->overruns++;
+    } else {
+      uint16_t len = (uint16_t)(host_acc >> 14);
+
+      packets[(head + count) % AUDIO_RING_SLOT_NUM] = len;
+      count++;
+      ring_frames += len;
+    }
+    host_acc &= (1U << 14) - 1U;
+
+    /* DMA halves finished within the frame, refilled from prefill then ring */
+    while ((double)(loaded - SIM_BLOCK) < (t + 1.0) * rate) {
+      uint32_t need = SIM_BLOCK;
+      uint32_t take = prefill < need ? prefill : need;
+
+      prefill -= take;
+      need -= take;
+      if (ring_frames - pkt_off < need) {
+        res->underruns++;
+        need = ring_frames - pkt_off;
+      }
+      while (need != 0U) {
+        uint32_t run = packets[head] - pkt_off < need ? packets[head] - pkt_off : need;
+
+        pkt_off += run;
+        need -= run;
+        if (pkt_off == packets[head]) {
+          ring_frames -= packets[head];
+          pkt_off = 0U;
+          head = (head + 1U) % AUDIO_RING_SLOT_NUM;
+          count--;
+        }
+      }
+      loaded += SIM_BLOCK;
+    }
+  }
+
+  res->mean = n != 0U ? sum / n : 0.0;
+  res->drift_ppm = ((double)servo.integ / 4294967296.0) / ((double)c->freq / 1000.0) * -1e6;
+}
+
+int main(void) {
+  static const SIM_CaseTypeDef cases[] = {
+      {48000U, 0.0, 0.0},     {48000U, 100.0, 50.0},   {48000U, -100.0, 50.0},
+      {48000U, 1000.0, 100.0}, {48000U, -1000.0, 100.0}, {44100U, 250.0, 50.0},
+      {44100U, -250.0, 50.0},  {96000U, 500.0, 50.0},    {96000U, -500.0, 50.0},
+  };
+
+  for (uint32_t i = 0U; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    SIM_ResultTypeDef res;
+
+    SIM_Run(&cases[i], &res);
+    printf("test_servo: %5u Hz %+6.0f ppm %3.0f us jitter: settled %5.1f s, error mean %+.2f worst %.0f frames, "
+           "estimate %+.1f ppm, %u underruns %u overruns\n",
+           (unsigned)cases[i].freq, cases[i].ppm, cases[i].jitter_us, res.settle_s, res.mean, res.worst, res.drift_ppm,
+           (unsigned)res.underruns, (unsigned)res.overruns);
+    CHECK(res.underruns == 0U);
+    CHECK(res.overruns == 0U);
+    CHECK(res.settle_s < SIM_SETTLE * 1e-3);
+    CHECK(fabs(res.mean) < 1.0);
+    CHECK(res.worst <= 4.0);
+    CHECK(fabs(res.drift_ppm - cases[i].ppm) < 0.05 * fabs(cases[i].ppm) + 5.0);
+  }
+
+  return 0;
+}
@@ -0,0 +1,120 @@
+/**
+ ******************************************************************************
+ * @file    test_sofmeter.c
+ * @brief   Replay of SOF timer captures through the frame period meter.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  The meter only sees (capture, frame number) pairs, so a capture trace
+ *  replays exactly as on the board. Without arguments the trace is
+ *  synthesized: a 240 MHz timer latching SOFs from a host clock off by the
+ *  case's ppm, with timestamp jitter, read every 5 frames as the feedback
+ *  update does, across the 32-bit timer and 14-bit frame number wraps.
+ *  Every 997th read races a new SOF and gets its capture with the old
+ *  frame number, which the meter must reject without losing the rate.
+ *  Once settled the rate must be within one 10.14 LSB of the true
+ *  samples per frame.
+ *
+ *  With a file argument, each line holding a capture and a frame number
+ *  as read on the board (TIM2->CCR1 and DSTS.FNSOF), the trace is
+ *  replayed at 48 kHz and the measured rates printed instead.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_sofmeter.h"
+#include "test.h"
+
+#include <math.h>
+
+#define TEST_TIM_CLK                                  240000000U
+#define TEST_SECONDS                                  60U
+#define TEST_INTERVAL                                 5U
+#define TEST_SETTLE_WINDOWS                           16U
+#define TEST_LSB_10_14                                (1.0 / 16384.0)
+
+typedef struct {
+  uint32_t freq;
+  uint32_t i2s_clk;                            /* PLL2P of the frequency's family */
+  uint32_t i2s_div;                            /* kernel clock cycles per sample frame */
+  double ppm;                                  /* host frame period against the crystal */
+  double jitter_ns;                            /* SOF timestamp jitter, uniform +-jitter */
+} TEST_CaseTypeDef;
+
+static uint32_t seed = 0xF00DU;
+
+static int TEST_Replay(const char *path) {
+  AUDIO_SofMeterTypeDef meter;
+  unsigned long capture;
+  unsigned int fnsof;
+  FILE *f = fopen(path, "r");
+
+  CHECK(f != NULL);
+  AUDIO_SofMeterInit(&meter, 196608000U, 4096U, TEST_TIM_CLK);
+  while (fscanf(f, "%lu %u", &capture, &fnsof) == 2) {
+    if (AUDIO_SofMeterUpdate(&meter, (uint32_t)capture, (uint16_t)fnsof) != 0U) {
+      printf("%u %.7f\n", (unsigned)meter.windows, (double)meter.rate / 4294967296.0);
+    }
+  }
+  fclose(f);
+  printf("rejects %u\n", (unsigned)meter.rejects);
+  return 0;
+}
+
+static int TEST_Run(const TEST_CaseTypeDef *c) {
+  AUDIO_SofMeterTypeDef meter;
+  double period = (double)TEST_TIM_CLK / 1000.0 * (1.0 + c->ppm * 1e-6);
+  double truth = (double)c->freq / 1000.0 * (1.0 + c->ppm * 1e-6);
+  double worst = 0.0;
+  uint32_t races = 0U;
+
+  AUDIO_SofMeterInit(&meter, c->i2s_clk, c->i2s_div, TEST_TIM_CLK);
+
+  /* Start off zero so both wraps happen within the run */
+  for (uint32_t k = 1U; k <= TEST_SECONDS * 1000U / TEST_INTERVAL; k++) {
+    uint64_t frame = 16000U + (uint64_t)k * TEST_INTERVAL;
+    double jitter = (2.0 * (double)(TEST_Rand(&seed) >> 8) / 16777216.0 - 1.0) * c->jitter_ns;
+    uint32_t capture = (uint32_t)(uint64_t)llround((double)frame * period + jitter * TEST_TIM_CLK * 1e-9);
+    uint16_t fnsof = (uint16_t)(frame & 0x3FFFU);
+
+    if (k % 997U == 0U) {
+      /* Capture of the next SOF read with the frame number of this one */
+      capture += (uint32_t)period;
+      races++;
+    }
+    if (AUDIO_SofMeterUpdate(&meter, capture, fnsof) != 0U && meter.windows > TEST_SETTLE_WINDOWS) {
+      double err = fabs((double)meter.rate / 4294967296.0 - truth);
+
+      worst = err > worst ? err : worst;
+    }
+  }
+
+  printf("test_sofmeter: %5u Hz %+5.0f ppm %3.0f ns jitter: %u windows, worst %.2e samples/frame (%.3f LSB 10.14), "
+         "%u/%u races rejected\n",
+         (unsigned)c->freq, c->ppm, c->jitter_ns, (unsigned)meter.windows, worst, worst / TEST_LSB_10_14,
+         (unsigned)meter.rejects, (unsigned)races);
+  CHECK(meter.windows > TEST_SETTLE_WINDOWS);
+  /* The raced read and the one after it */
+  CHECK(meter.rejects == 2U * races);
+  CHECK(worst < TEST_LSB_10_14);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  static const TEST_CaseTypeDef cases[] = {
+      {48000U, 196608000U, 4096U, 0.0, 0.0},      {48000U, 196608000U, 4096U, 300.0, 20.0},
+      {48000U, 196608000U, 4096U, -300.0, 100.0}, {44100U, 180633600U, 4096U, 150.0, 20.0},
+      {96000U, 196608000U, 2048U, -150.0, 20.0},
+  };
+
+  if (argc > 1) {
+    return TEST_Replay(argv[1]);
+  }
+  for (uint32_t i = 0U; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    if (TEST_Run(&cases[i]) != 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
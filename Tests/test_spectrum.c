@@ -0,0 +1,208 @@
+/**
+ ******************************************************************************
+ * @file    test_spectrum.c
+ * @brief   Analyzer spectrum of each engine against a double precision DFT,
+ *          and its cost per frame.
+ ******************************************************************************
+ * @verbatim
+ *
+ *  Built with ANALYZER_BENCH, so all three engines are in. A -1 dBFS
+ *  tone centered on a bin must read -1 dB in that bin whatever the engine
+ *  and window, and silence nothing at all. The float engine must follow
+ *  a double precision DFT of the same windowed frame to -100 dB of full
+ *  scale in every bin. AUDIO_SpectrumBench must find each engine's range
+ *  above its bound: the float one is limited by the 16-bit frame, the
+ *  q15 one by its own rounding.
+ *
+ *  AUDIO_SpectrumDb must stay within TEST_DB_ERROR of 10 * log10
+ *  over random powers from its floor to well above full scale, and on the
+ *  square of every q15 magnitude, as the level bars use it; it must find
+ *  the same minimum and maximum. Its cost per bin is set against a
+ *  log10f loop over the same spectrum.
+ *
+ *  Then the cost of one frame of noise in each engine, the best and the
+ *  mean of the counts AUDIO_SPECTRUM_CYCLES takes per frame: time stamp
+ *  counter ticks of the plain C FFTs of Host/arm_math_host.c on an x86
+ *  host, the relative cost of the engines rather than Cortex-M7 cycles.
+ *
+ * @endverbatim
+ ******************************************************************************
+ */
+
+#include "audio_spectrum.h"
+#include "test.h"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#define TEST_BIN                                      103U
+#define BENCH_FRAMES                                  2000U
+
+/* Bound of AUDIO_SpectrumDb against 10 * log10, dB */
+#define TEST_DB_ERROR                                 0.0003
+
+static AUDIO_SpectrumTypeDef spec;
+static q15_t frame[AUDIO_SPECTRUM_SIZE];
+
+/* Power of a real DFT in double, normalized like AUDIO_SpectrumProcess */
+static void TEST_Dft(const q15_t *x, const float32_t *window, float32_t gain, double *power) {
+  static double w[AUDIO_SPECTRUM_SIZE];
+
+  for (uint32_t i = 0U; i < AUDIO_SPECTRUM_SIZE; i++) {
+    w[i] = (double)x[i] / 32768.0 * (double)window[i];
+  }
+  for (uint32_t k = 0U; k < AUDIO_SPECTRUM_BINS; k++) {
+    double re = 0.0;
+    double im = 0.0;
+
+    for (uint32_t i = 0U; i < AUDIO_SPECTRUM_SIZE; i++) {
+      double a = 2.0 * M_PI * (double)((k * i) % AUDIO_SPECTRUM_SIZE) / AUDIO_SPECTRUM_SIZE;
+
+      re += w[i] * cos(a);
+      im -= w[i] * sin(a);
+    }
+    power[k] = (re * re + im * im) * 4.0 * (double)gain / ((double)AUDIO_SPECTRUM_SIZE * AUDIO_SPECTRUM_SIZE);
+  }
+}
+
+int main(void) {
+  static const char *const names[AUDIO_SPECTRUM_ENGINES] = {"f32", "q31", "q15"};
+  static const float32_t range[AUDIO_SPECTRUM_ENGINES] = {115.0f, 115.0f, 70.0f};
+  static double ref[AUDIO_SPECTRUM_BINS];
+  uint32_t seed = 0x5BEC7U;
+  double err = 0.0;
+
+  AUDIO_SpectrumInit(&spec, AUDIO_SPECTRUM_ENGINE_F32, AUDIO_SPECTRUM_WINDOW_HANN);
+
+  /* -1 dBFS on a bin reads -1 dB in it, silence reads nothing */
+  for (uint32_t i = 0U; i < AUDIO_SPECTRUM_SIZE; i++) {
+    frame[i] = (q15_t)lrint(0.891250938 * 32767.0 *
+                            sin(2.0 * M_PI * (double)((i * TEST_BIN) % AUDIO_SPECTRUM_SIZE) / AUDIO_SPECTRUM_SIZE));
+  }
+  for (uint32_t e = 0U; e < AUDIO_SPECTRUM_ENGINES; e++) {
+    CHECK(AUDIO_SpectrumSetEngine(&spec, (AUDIO_SpectrumEngineTypeDef)e) == 1U);
+    for (uint32_t w = 0U; w < AUDIO_SPECTRUM_WINDOWS; w++) {
+      AUDIO_SpectrumSetWindow(&spec, (AUDIO_SpectrumWindowTypeDef)w);
+      AUDIO_SpectrumProcess(&spec, frame);
+      CHECK(fabs(10.0 * log10(spec.power[TEST_BIN]) + 1.0) < 0.05);
+    }
+  }
+  (void)memset(frame, 0, sizeof(frame));
+  for (uint32_t e = 0U; e < AUDIO_SPECTRUM_ENGINES; e++) {
+    (void)AUDIO_SpectrumSetEngine(&spec, (AUDIO_SpectrumEngineTypeDef)e);
+    AUDIO_SpectrumProcess(&spec, frame);
+    for (uint32_t k = 0U; k < AUDIO_SPECTRUM_BINS; k++) {
+      CHECK(spec.power[k] == 0.0f);
+    }
+  }
+
+  /* Float engine against the DFT, on noise and a tone between two bins */
+  (void)AUDIO_SpectrumSetEngine(&spec, AUDIO_SPECTRUM_ENGINE_F32);
+  AUDIO_SpectrumSetWindow(&spec, AUDIO_SPECTRUM_WINDOW_BLACKMAN);
+  for (uint32_t i = 0U; i < AUDIO_SPECTRUM_SIZE; i++) {
+    frame[i] = (q15_t)((int32_t)(TEST_Rand(&seed) % 8192U) - 4096 +
+                       (int32_t)lrint(16384.0 * sin(2.0 * M_PI * 50.5 * (double)i / AUDIO_SPECTRUM_SIZE)));
+  }
+  AUDIO_SpectrumProcess(&spec, frame);
+  TEST_Dft(frame, spec.window_f32, spec.gain, ref);
+  for (uint32_t k = 0U; k < AUDIO_SPECTRUM_BINS; k++) {
+    double e = fabs(sqrt((double)spec.power[k]) - sqrt(ref[k]));
+
+    err = e > err ? e : err;
+  }
+  printf("test_spectrum: f32 against the DFT, worst error %.1f dBFS\n", 20.0 * log10(err));
+  CHECK(err < 1e-5);
+
+  /* dB against libm, on random powers and on every q15 magnitude squared */
+  err = 0.0;
+  for (uint32_t n = 0U; n < 64U; n++) {
+    static float32_t power[AUDIO_SPECTRUM_BINS];
+    static float32_t db[AUDIO_SPECTRUM_BINS];
+    float32_t lo = FLT_MAX;
+    float32_t hi = -FLT_MAX;
+    float32_t min;
+    float32_t max;
+
+    for (uint32_t k = 0U; k < AUDIO_SPECTRUM_BINS; k++) {
+      power[k] = (float32_t)pow(10.0, -16.0 + 18.0 * (double)TEST_Rand(&seed) / 4294967296.0);
+    }
+    AUDIO_SpectrumDb(power, db, AUDIO_SPECTRUM_BINS, &min, &max);
+    for (uint32_t k = 0U; k < AUDIO_SPECTRUM_BINS; k++) {
+      double e = fabs((double)db[k] - 10.0 * log10((double)power[k]));
+
+      err = e > err ? e : err;
+      lo = db[k] < lo ? db[k] : lo;
+      hi = db[k] > hi ? db[k] : hi;
+    }
+    CHECK(min == lo && max == hi);
+  }
+  for (uint32_t level = 1U; level <= 32768U; level++) {
+    float32_t power = (float32_t)level * (float32_t)level / (32768.0f * 32768.0f);
+    float32_t db;
+    float32_t min;
+    float32_t max;
+    double e;
+
+    AUDIO_SpectrumDb(&power, &db, 1U, &min, &max);
+    e = fabs((double)db - 20.0 * log10((double)level / 32768.0));
+    err = e > err ? e : err;
+  }
+  printf("test_spectrum: dB against log10, worst error %.5f dB\n", err);
+  CHECK(err < TEST_DB_ERROR);
+
+  /* Cost of one spectrum to dB, the kernel against a log10f loop */
+  {
+    static float32_t db[AUDIO_SPECTRUM_BINS];
+    volatile float32_t sink = 0.0f;
+    uint32_t best[2] = {UINT32_MAX, UINT32_MAX};
+    float32_t min;
+    float32_t max;
+
+    for (uint32_t n = 0U; n < BENCH_FRAMES; n++) {
+      uint32_t cycles = AUDIO_HostCycles();
+
+      AUDIO_SpectrumDb(spec.power, db, AUDIO_SPECTRUM_BINS, &min, &max);
+      cycles = AUDIO_HostCycles() - cycles;
+      best[0] = cycles < best[0] ? cycles : best[0];
+      sink = db[n % AUDIO_SPECTRUM_BINS];
+
+      cycles = AUDIO_HostCycles();
+      for (uint32_t k = 0U; k < AUDIO_SPECTRUM_BINS; k++) {
+        db[k] = 10.0f * log10f(spec.power[k] > 1e-16f ? spec.power[k] : 1e-16f);
+      }
+      cycles = AUDIO_HostCycles() - cycles;
+      best[1] = cycles < best[1] ? cycles : best[1];
+      sink = db[n % AUDIO_SPECTRUM_BINS];
+    }
+    (void)sink;
+    printf("test_spectrum: %u bins to dB: host best %u cycles, log10f loop %u\n", (unsigned)AUDIO_SPECTRUM_BINS,
+           (unsigned)best[0], (unsigned)best[1]);
+  }
+
+  /* Range and cost of each engine */
+  AUDIO_SpectrumSetWindow(&spec, AUDIO_SPECTRUM_WINDOW_HANN);
+  for (uint32_t e = 0U; e < AUDIO_SPECTRUM_ENGINES; e++) {
+    AUDIO_SpectrumBenchTypeDef bench;
+    uint64_t sum = 0U;
+    uint32_t best = UINT32_MAX;
+
+    (void)AUDIO_SpectrumSetEngine(&spec, (AUDIO_SpectrumEngineTypeDef)e);
+    AUDIO_SpectrumBench(&spec, frame, &bench);
+    CHECK(bench.range_db > range[e]);
+
+    for (uint32_t n = 0U; n < BENCH_FRAMES; n++) {
+      for (uint32_t i = 0U; i < AUDIO_SPECTRUM_SIZE; i++) {
+        frame[i] = (q15_t)((int32_t)(TEST_Rand(&seed) % 16384U) - 8192);
+      }
+      AUDIO_SpectrumProcess(&spec, frame);
+      sum += spec.cycles;
+      best = spec.cycles < best ? spec.cycles : best;
+    }
+    printf("test_spectrum: %s %u-sample frame: host best %u, mean %.0f cycles, %u bytes, range %.1f dB\n", names[e],
+           (unsigned)AUDIO_SPECTRUM_SIZE, (unsigned)best, (double)sum / BENCH_FRAMES, (unsigned)bench.ram,
+           (double)bench.range_db);
+  }
+
+  return 0;
+}
@@ -24,11 +24,38 @@ extern "C" {
 #endif
 
 #include "usbd_ioreq.h"
+#include "audio_ring.h"
+#include "audio_gain.h"
+#include "audio_servo.h"
+#include "audio_sofmeter.h"
+#include "audio_asrc.h"
+#include "audio_mix.h"
+#include "audio_tone.h"
+#include "audio_peq.h"
+#include "audio_limit.h"
+#include "audio_dither.h"
+#include "audio_graph.h"
+#include "audio_level.h"
+#include "audio_fifo.h"
 
 #ifndef USBD_AUDIO_FREQ
 #define USBD_AUDIO_FREQ                               48000U
 #endif /* USBD_AUDIO_FREQ */
 
+/* Sampling frequencies listed in the format descriptors, USBD_AUDIO_FREQ is the one used after reset */
+#define USBD_AUDIO_FREQ_44K                           44100U
+#define USBD_AUDIO_FREQ_48K                           48000U
+#define USBD_AUDIO_FREQ_96K                           96000U
+#define USBD_AUDIO_FREQ_MAX                           USBD_AUDIO_FREQ_96K
+
+#ifndef USBD_AUDIO_LATENCY_MS
+#define USBD_AUDIO_LATENCY_MS                         4U
+#endif /* USBD_AUDIO_LATENCY_MS */
+
+/* Playback latency targets the host may select, in ms */
+#define AUDIO_LATENCY_MS_MIN                          2U
+#define AUDIO_LATENCY_MS_MAX                          16U
+
 #ifndef USBD_MAX_NUM_INTERFACES
 #define USBD_MAX_NUM_INTERFACES                       1U
 #endif /* USBD_AUDIO_FREQ */
@@ -41,11 +68,18 @@ extern "C" {
 #define AUDIO_IN_EP                                   0x81U
 #endif /* AUDIO_IN_EP */
 
+/* Loopback capture: isochronous IN endpoint of the second streaming interface */
+#ifndef AUDIO_CAPTURE_EP
+#define AUDIO_CAPTURE_EP                              0x82U
+#endif /* AUDIO_CAPTURE_EP */
+
+#define AUDIO_CAPTURE_IF                              0x02U
+
 #define USBD_AUDIO_VOL_MIN                            0xA000U    /* -96dB */
 #define USBD_AUDIO_VOL_MAX                            0x0000U    /*   0dB */
-#define USBD_AUDIO_VOL_RES                            0x0300U    /*   3dB */
+#define USBD_AUDIO_VOL_RES                            0x0080U    /* 0.5dB */
 
-#define USB_AUDIO_CONFIG_DESC_SIZ                     0x76U
+#define USB_AUDIO_CONFIG_DESC_SIZ                     0x22FU
 #define AUDIO_INTERFACE_DESC_SIZE                     0x09U
 #define USB_AUDIO_DESC_SIZ                            0x09U
 #define AUDIO_STANDARD_ENDPOINT_DESC_SIZE             0x09U
@@ -67,20 +101,44 @@ extern "C" {
 #define AUDIO_CONTROL_HEADER                          0x01U
 #define AUDIO_CONTROL_INPUT_TERMINAL                  0x02U
 #define AUDIO_CONTROL_OUTPUT_TERMINAL                 0x03U
+#define AUDIO_CONTROL_MIXER_UNIT                      0x04U
 #define AUDIO_CONTROL_FEATURE_UNIT                    0x06U
 
+/* Multichannel Input Terminals and the Mixer Unit that folds them down to stereo */
+#define AUDIO_QUAD_IT_ID                              0x05U
+#define AUDIO_SURROUND_IT_ID                          0x06U
+#define AUDIO_MIXER_UNIT_ID                           0x07U
+
+/* Mixer input channels: stereo pin 1-2, quad pin 3-6, 5.1 pin 7-12 */
+#define AUDIO_MIX_IN_CHANNELS                         12U
+
 #define AUDIO_INPUT_TERMINAL_DESC_SIZE                0x0CU
 #define AUDIO_OUTPUT_TERMINAL_DESC_SIZE               0x09U
 #define AUDIO_STREAMING_INTERFACE_DESC_SIZE           0x07U
 
 #define AUDIO_CONTROL_MUTE                            0x0001U
 #define AUDIO_CONTROL_VOLUME                          0x0002U
+#define AUDIO_CONTROL_BASS                            0x0004U
+#define AUDIO_CONTROL_MID                             0x0008U
+#define AUDIO_CONTROL_TREBLE                          0x0010U
+#define AUDIO_CONTROL_AGC                             0x0040U
+
+/* Feature Unit control selectors */
+#define AUDIO_FU_MUTE_CONTROL                         0x01U
+#define AUDIO_FU_VOLUME_CONTROL                       0x02U
+#define AUDIO_FU_BASS_CONTROL                         0x03U
+#define AUDIO_FU_MID_CONTROL                          0x04U
+#define AUDIO_FU_TREBLE_CONTROL                       0x05U
+#define AUDIO_FU_AGC_CONTROL                          0x07U
 
 #define AUDIO_FORMAT_TYPE_I                           0x01U
 #define AUDIO_FORMAT_TYPE_III                         0x03U
 
 #define AUDIO_ENDPOINT_GENERAL                        0x01U
 
+/* Endpoint control selectors */
+#define AUDIO_EP_CONTROL_SAMPLING_FREQ                0x01U
+
 #define AUDIO_REQ_SET_CUR                             0x01U
 #define AUDIO_REQ_SET_MIN                             0x02U
 #define AUDIO_REQ_SET_MAX                             0x03U
@@ -90,30 +148,119 @@ extern "C" {
 #define AUDIO_REQ_GET_MAX                             0x83U
 #define AUDIO_REQ_GET_RES                             0x84U
 
+/* Vendor requests, recipient interface 0 */
+#define AUDIO_VENDOR_REQ_LATENCY                      0x01U  /* OUT: wValue = target in ms, IN: USBD_AUDIO_LatencyTypeDef */
+#define AUDIO_VENDOR_REQ_XRUN                         0x02U  /* IN: USBD_AUDIO_XrunTypeDef */
+#define AUDIO_VENDOR_REQ_PEQ_BAND                     0x03U  /* OUT, IN: USBD_AUDIO_PeqBandTypeDef, wValue = ch << 8 | band */
+#define AUDIO_VENDOR_REQ_PEQ_COMMIT                   0x04U  /* OUT: wValue = right bands << 8 | left bands */
+#define AUDIO_VENDOR_REQ_LIMITER                      0x05U  /* OUT, IN: USBD_AUDIO_LimiterTypeDef */
+#define AUDIO_VENDOR_REQ_DITHER                       0x06U  /* OUT: wValue = AUDIO_DitherModeTypeDef, IN: 1 byte */
+#define AUDIO_VENDOR_REQ_STAGE                        0x07U  /* OUT: wValue = id << 8 | bypass, IN: USBD_AUDIO_StageTypeDef[] */
+#define AUDIO_VENDOR_REQ_LEVEL                        0x08U  /* IN: USBD_AUDIO_LevelTypeDef */
+
+/* Float stages of the playback graph, in their default order */
+#define AUDIO_STAGE_TONE                              0x01U  /* Bass/Mid/Treble and AGC */
+#define AUDIO_STAGE_PEQ                               0x02U  /* parametric EQ */
+#define AUDIO_STAGE_LIMIT                             0x03U  /* lookahead limiter */
+#define AUDIO_STAGE_TAP                               0x04U  /* edge: analyzer FIFO */
+#define AUDIO_STAGE_REQUANT                           0x05U  /* edge: back to the I2S word, last, never bypassed */
+
 #define AUDIO_OUT_STREAMING_CTRL                      0x02U
 
 #define AUDIO_OUT_TC                                  0x01U
 #define AUDIO_IN_TC                                   0x02U
 
-#define AUDIO_OUT_PACKET                              (uint16_t)(((USBD_AUDIO_FREQ / 1000U + 1) * 2U * 2U))
-
-/* Number of sub-packets in the audio transfer buffer. You can modify this value but always make sure
-  that it is an even number and higher than 3 */
-#define AUDIO_OUT_PACKET_NUM                          8U
-/* Total size of the audio transfer buffer */
-#define AUDIO_TOTAL_BUF_SIZE                          ((uint16_t)(AUDIO_OUT_PACKET * AUDIO_OUT_PACKET_NUM))
+/* Packet sizes at the highest sampling frequency, the endpoint never receives more */
+#define AUDIO_OUT_PACKET                              (uint16_t)(((USBD_AUDIO_FREQ_MAX / 1000U + 1) * 2U * 2U))
+#define AUDIO_OUT_PACKET_24                           (uint16_t)(((USBD_AUDIO_FREQ_MAX / 1000U + 1) * 2U * 3U))
+#define AUDIO_OUT_PACKET_32                           (uint16_t)(((USBD_AUDIO_FREQ_MAX / 1000U + 1) * 2U * 4U))
+/* Multichannel 16-bit packets: quad up to 96 kHz, 5.1 up to 48 kHz to stay within a full-speed isochronous packet */
+#define AUDIO_OUT_PACKET_QUAD                         (uint16_t)(((USBD_AUDIO_FREQ_MAX / 1000U + 1) * 4U * 2U))
+#define AUDIO_OUT_PACKET_SURROUND                     (uint16_t)(((USBD_AUDIO_FREQ_48K / 1000U + 1) * 6U * 2U))
+/* Largest packet over all alternate settings, used to size the endpoint and the ring slots */
+#define AUDIO_OUT_PACKET_MAX                          AUDIO_OUT_PACKET_32
+
+/* Streaming interface alternate settings: 0 is zero bandwidth, then 16, 24 and 32-bit PCM */
+#define AUDIO_ALT_SETTING_16B                         0x01U
+#define AUDIO_ALT_SETTING_24B                         0x02U
+#define AUDIO_ALT_SETTING_32B                         0x03U
+#define AUDIO_ALT_SETTING_MAX                         AUDIO_ALT_SETTING_32B
+/* Playback only: 16-bit quad and 5.1, downmixed to stereo by the Mixer Unit */
+#define AUDIO_ALT_SETTING_QUAD                        0x04U
+#define AUDIO_ALT_SETTING_SURROUND                    0x05U
+
+/* Frames per I2S DMA half-buffer, the block size the playback path works in */
+#define AUDIO_BLOCK_FRAMES                            48U
+
+/* Capture packets queued before the IN endpoint starts draining them, and the level it steers to */
+#define AUDIO_CAPTURE_PRIME_PACKETS                   2U
+
+typedef enum {
+  AUDIO_OFFSET_NONE = 0,
+  AUDIO_OFFSET_HALF,
+  AUDIO_OFFSET_FULL,
+} AUDIO_OffsetTypeDef;
 
 typedef struct {
   uint32_t alt_setting;
-  uint8_t buffer[AUDIO_TOTAL_BUF_SIZE + AUDIO_OUT_PACKET];
+  AUDIO_RingTypeDef ring;
+  int32_t pcm[2U * AUDIO_BLOCK_FRAMES * 2U]; /* viewed as int16_t in 16-bit mode */
+  uint8_t bit_depth;                        /* 16, 24 or 32 */
+  uint8_t frame_size;                       /* bytes per frame on the bus */
+  uint8_t channels;                         /* channels per frame on the bus, 2, 4 or 6 */
+  uint32_t fill_last[2];                    /* last frame out of the ring, before the DSP stage, in the I2S width */
+  AUDIO_MixTypeDef mix;                     /* downmix of the current multichannel format */
+  int16_t mix_volume[AUDIO_MIX_IN_CHANNELS][2]; /* Mixer Unit controls, 8.8 dB per input and output channel */
   uint8_t playing;
-  uint16_t rd_ptr;
-  uint16_t wr_ptr;
+  uint32_t freq;                            /* current sampling frequency, Hz */
+  volatile uint8_t freq_pending;            /* I2S clocks not yet retuned to freq, see USBD_AUDIO_Poll */
+  uint8_t latency_ms;                       /* playback latency target, AUDIO_LATENCY_MS_MIN..AUDIO_LATENCY_MS_MAX */
+  uint16_t target_frames;                   /* latency_ms at freq: the feedback setpoint */
+  uint16_t prefill;                         /* silence frames to play before the ring */
+  uint16_t queued;                          /* device-side queue at the last feedback update, frames */
+  uint16_t queued_min;
+  uint16_t queued_max;
+  uint8_t faded;                            /* output ramped down to silence, the next data fades in */
+  uint32_t underruns;                       /* blocks short of received frames */
+  uint32_t overruns;                        /* packets dropped on a full ring, before the last ring reset */
+  uint32_t dropouts;                        /* gaps concealed, one per fade to silence */
+  uint32_t dataout_cycles; /* worst case USBD_AUDIO_DataOut, DWT cycles */
+  uint32_t sync_cycles;    /* worst case USBD_AUDIO_Sync, DWT cycles */
   uint16_t fb_fnsof;
   uint32_t fb_value;
-  uint32_t fb_value_norm;
+  AUDIO_ServoTypeDef servo;
+  AUDIO_SofMeterTypeDef meter;
+#if (USBD_AUDIO_ASRC == 1U)
+  AUDIO_AsrcTypeDef asrc;
+  int32_t asrc_work[AUDIO_ASRC_WORK_FRAMES(AUDIO_BLOCK_FRAMES) * 2U];
+  int32_t asrc_out[AUDIO_BLOCK_FRAMES * 2U]; /* resampler output in 16-bit mode */
+#endif /* USBD_AUDIO_ASRC */
+  uint8_t capture_alt;                      /* alternate setting of the capture interface, 0 when idle */
+  uint8_t capture_bit_depth;
+  uint8_t capture_frame_size;
+  uint8_t capture_primed;
+  uint8_t capture_busy;                     /* a packet is armed on the IN endpoint */
+  uint16_t capture_len;                     /* frames of the packet being filled */
+  uint16_t capture_off;                     /* frames already written to it */
+  uint16_t capture_sent;                    /* bytes of the packet on the IN endpoint, 0 for silence */
+  uint32_t capture_acc;                     /* packet size accumulator, freq modulo 1000 */
+  AUDIO_RingTypeDef capture;
   uint8_t mute;
   int16_t volume;
+  AUDIO_GainTypeDef gain;
+  AUDIO_GainTypeDef gain_cur;               /* gain the last block ended on, mute included */
+  AUDIO_GainTypeDef gain_next;              /* gain the block being produced ramps to */
+  uint8_t mute_hold;                        /* blocks until a mute ramp has played out and SD_MODE is released */
+  AUDIO_ToneTypeDef tone;                   /* Bass/Mid/Treble and AGC, after the volume */
+  AUDIO_PeqTypeDef peq;                     /* speaker correction, after the tone controls */
+  AUDIO_LimitTypeDef limit;                 /* last, keeps every boost under the ceiling */
+  AUDIO_DitherTypeDef dither;               /* float to 16-bit I2S word */
+  AUDIO_GraphTypeDef graph;                 /* the stages above, then the analyzer tap and requantization */
+  float32_t dsp_work[AUDIO_BLOCK_FRAMES * 2U];
+  void *dsp_out;                            /* I2S block the requantization stage writes */
+  uint8_t tapped;                           /* the graph fed the analyzer FIFO this block */
+  uint32_t dsp_cycles;                      /* worst case USBD_AUDIO_DspBlock, DWT cycles */
+  AUDIO_LevelTypeDef level;                 /* peak/RMS/clip of the I2S output */
   USBD_SetupReqTypedef setup_req;
   uint8_t setup_data[USB_MAX_EP0_SIZE];
 } USBD_AUDIO_HandleTypeDef;
@@ -122,6 +269,57 @@ typedef struct {
  * Audio Class specification release 1.0
  */
 
+/* AUDIO_VENDOR_REQ_LATENCY data stage, device to host */
+typedef struct {
+  uint16_t target_ms;
+  uint16_t target_frames;
+  uint32_t queued_us;     /* received but not yet shifted out, at the last feedback update */
+  uint32_t queued_min_us; /* since the stream or the target last changed */
+  uint32_t queued_max_us;
+} __PACKED USBD_AUDIO_LatencyTypeDef;
+
+/* AUDIO_VENDOR_REQ_XRUN data stage, device to host, counted since the interface was configured */
+typedef struct {
+  uint32_t underruns;
+  uint32_t overruns;
+  uint32_t dropouts;
+} __PACKED USBD_AUDIO_XrunTypeDef;
+
+/* AUDIO_VENDOR_REQ_PEQ_BAND data stage: one biquad, CMSIS order, little-endian IEEE 754 */
+typedef struct {
+  float32_t b0;
+  float32_t b1;
+  float32_t b2;
+  float32_t a1; /* negated: y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] + a1 y[n-1] + a2 y[n-2] */
+  float32_t a2;
+} __PACKED USBD_AUDIO_PeqBandTypeDef;
+
+/* AUDIO_VENDOR_REQ_LIMITER data stage, the report fields are ignored host to device */
+typedef struct {
+  uint8_t enable;
+  int16_t ceiling;       /* 8.8 dBFS, AUDIO_LIMIT_CEILING_MIN..AUDIO_LIMIT_CEILING_MAX */
+  uint16_t attack_us;    /* lookahead, up to AUDIO_LIMIT_ATTACK_US_MAX */
+  uint16_t release_ms;   /* AUDIO_LIMIT_RELEASE_MS_MIN..AUDIO_LIMIT_RELEASE_MS_MAX */
+  uint32_t latency_us;   /* report: delay the lookahead adds to the output, 0 when disabled */
+  uint32_t dsp_cycles;   /* report: worst case of the whole DSP block stage, DWT cycles */
+} __PACKED USBD_AUDIO_LimiterTypeDef;
+
+/* AUDIO_VENDOR_REQ_STAGE data stage, device to host: one per stage, in processing order */
+typedef struct {
+  uint8_t id;            /* AUDIO_STAGE_... */
+  uint8_t bypass;
+  uint8_t active;        /* would run on the next block */
+  uint32_t cycles;       /* worst case of one block, DWT cycles */
+} __PACKED USBD_AUDIO_StageTypeDef;
+
+/* AUDIO_VENDOR_REQ_LEVEL data stage, device to host: I2S output over the last AUDIO_LEVEL_WINDOW blocks */
+typedef struct {
+  uint16_t peak[2];      /* q15, 0x8000 is full scale */
+  uint16_t rms[2];       /* q15 */
+  uint32_t clips[2];     /* blocks that reached full scale, counted since the interface was configured */
+  uint32_t blocks;       /* blocks metered */
+} __PACKED USBD_AUDIO_LevelTypeDef;
+
 /* Table 4-2: Class-Specific AC Interface Header Descriptor */
 typedef struct {
   uint8_t bLength;
@@ -221,6 +419,24 @@ typedef struct {
 extern USBD_ClassTypeDef USBD_AUDIO;
 #define USBD_AUDIO_CLASS &USBD_AUDIO
 
+void USBD_AUDIO_Sync(USBD_HandleTypeDef *pdev, AUDIO_OffsetTypeDef offset);
+void USBD_AUDIO_Poll(USBD_HandleTypeDef *pdev);
+
+/* Streaming path, shared with the Audio Class 2.0 driver */
+USBD_StatusTypeDef USBD_AUDIO_SetFormat(USBD_AUDIO_HandleTypeDef *haudio, uint8_t alt);
+USBD_StatusTypeDef USBD_AUDIO_SetFreq(USBD_AUDIO_HandleTypeDef *haudio, uint32_t freq);
+USBD_StatusTypeDef USBD_AUDIO_StopPlay(USBD_HandleTypeDef *pdev);
+void USBD_AUDIO_DspInit(USBD_AUDIO_HandleTypeDef *haudio);
+void USBD_AUDIO_SetMute(USBD_AUDIO_HandleTypeDef *haudio, uint8_t mute);
+USBD_StatusTypeDef USBD_AUDIO_ReadLevel(USBD_HandleTypeDef *pdev, AUDIO_LevelSnapshotTypeDef *snap);
+uint8_t USBD_AUDIO_ReadTap(q15_t *samples, uint32_t size, uint32_t hop);
+void USBD_AUDIO_StartPlay(USBD_AUDIO_HandleTypeDef *haudio);
+USBD_StatusTypeDef USBD_AUDIO_VendorReq(USBD_HandleTypeDef *pdev, USBD_AUDIO_HandleTypeDef *haudio,
+                                        USBD_SetupReqTypedef *req);
+void USBD_AUDIO_VendorRxReady(USBD_AUDIO_HandleTypeDef *haudio, USBD_SetupReqTypedef *req);
+void USBD_AUDIO_Receive(USBD_AUDIO_HandleTypeDef *haudio, uint16_t len);
+uint32_t USBD_AUDIO_GetFeedback(USBD_AUDIO_HandleTypeDef *haudio, uint16_t fnsof, uint32_t frames, uint32_t frac_bits);
+
 #ifdef USE_USBD_COMPOSITE
 uint32_t USBD_AUDIO_GetEpPcktSze(USBD_HandleTypeDef *pdev, uint8_t If, uint8_t Ep);
 #endif /* USE_USBD_COMPOSITE */
@@ -0,0 +1,71 @@
+/**
+ ******************************************************************************
+ * @file    usbd_audio2.h
+ * @brief   header file for the usbd_audio2.c file.
+ ******************************************************************************
+ */
+
+#ifndef __USBD_AUDIO2_H
+#define __USBD_AUDIO2_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "usbd_audio.h"
+
+#define USB_AUDIO2_CONFIG_DESC_SIZ                    0x102U
+
+#define AUDIO2_IAD_DESC_SIZE                          0x08U
+#define AUDIO2_AC_HEADER_DESC_SIZE                    0x09U
+#define AUDIO2_CLOCK_SOURCE_DESC_SIZE                 0x08U
+#define AUDIO2_INPUT_TERMINAL_DESC_SIZE               0x11U
+#define AUDIO2_FEATURE_UNIT_DESC_SIZE                 0x12U
+#define AUDIO2_OUTPUT_TERMINAL_DESC_SIZE              0x0CU
+#define AUDIO2_AS_GENERAL_DESC_SIZE                   0x10U
+#define AUDIO2_FORMAT_TYPE_DESC_SIZE                  0x06U
+#define AUDIO2_STANDARD_ENDPOINT_DESC_SIZE            0x07U
+#define AUDIO2_STREAMING_ENDPOINT_DESC_SIZE           0x08U
+
+/* Class-specific AC descriptors, as counted in the AC header wTotalLength */
+#define AUDIO2_AC_DESC_SIZE                           (AUDIO2_AC_HEADER_DESC_SIZE + AUDIO2_CLOCK_SOURCE_DESC_SIZE +   \
+                                                       AUDIO2_INPUT_TERMINAL_DESC_SIZE + AUDIO2_FEATURE_UNIT_DESC_SIZE + \
+                                                       AUDIO2_OUTPUT_TERMINAL_DESC_SIZE)
+
+#define USB_DESC_TYPE_IAD                             0x0BU
+#define AUDIO2_PROTOCOL_IP_VERSION_02_00              0x20U
+#define AUDIO2_FUNCTION_SUBCLASS_UNDEFINED            0x00U
+#define AUDIO2_CATEGORY_DESKTOP_SPEAKER               0x01U
+
+/* Audio Control Interface Descriptor Subtypes */
+#define AUDIO2_CONTROL_CLOCK_SOURCE                   0x0AU
+
+/* Entity IDs */
+#define AUDIO2_IT_ID                                  0x01U
+#define AUDIO2_FU_ID                                  0x02U
+#define AUDIO2_OT_ID                                  0x03U
+#define AUDIO2_CLOCK_ID                               0x04U
+
+/* Requests */
+#define AUDIO2_REQ_CUR                                0x01U
+#define AUDIO2_REQ_RANGE                              0x02U
+
+/* Clock Source control selectors */
+#define AUDIO2_CS_SAM_FREQ_CONTROL                    0x01U
+#define AUDIO2_CS_CLOCK_VALID_CONTROL                 0x02U
+
+/* Feature Unit control selectors */
+#define AUDIO2_FU_MUTE_CONTROL                        0x01U
+#define AUDIO2_FU_VOLUME_CONTROL                      0x02U
+
+/* 16.16 feedback, 4 bytes */
+#define AUDIO2_FEEDBACK_PACKET                        0x04U
+
+extern USBD_ClassTypeDef USBD_AUDIO2;
+#define USBD_AUDIO2_CLASS &USBD_AUDIO2
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBD_AUDIO2_H */
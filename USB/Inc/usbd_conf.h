@@ -29,7 +29,8 @@ extern "C" {
 
 #include "stm32h7xx.h" /* replace 'stm32xxx' with your HAL driver header filename, ex: stm32f4xx.h */
 
-#define USBD_MAX_NUM_INTERFACES                     1U
+/* AudioControl, playback AudioStreaming, loopback capture AudioStreaming */
+#define USBD_MAX_NUM_INTERFACES                     3U
 #define USBD_MAX_NUM_CONFIGURATION                  1U
 #define USBD_MAX_STR_DESC_SIZ                       0x100U
 #define USBD_SELF_POWERED                           1U
@@ -37,6 +38,12 @@ extern "C" {
 
 /* AUDIO Class Config */
 #define USBD_AUDIO_FREQ                             48000U
+/* Playback latency target after reset, in ms, the host may change it with AUDIO_VENDOR_REQ_LATENCY */
+#define USBD_AUDIO_LATENCY_MS                       4U
+/* 1: register the Audio Class 2.0 driver (usbd_audio2.c) instead of the 1.0 one */
+#define USBD_AUDIO_UAC2                             0U
+/* 1: resample on the device for hosts that ignore the feedback endpoint */
+#define USBD_AUDIO_ASRC                             0U
 
 /* Memory management macros make sure to use static memory allocation */
 /** Alias for memory allocation. */
@@ -27,23 +27,34 @@
  *             - Device descriptor management
  *             - Configuration descriptor management
  *             - Standard AC Interface Descriptor management
- *             - 1 Audio Streaming Interface (with single channel, PCM, Stereo mode)
- *             - 1 Audio Streaming Endpoint
- *             - 1 Audio Terminal Input (1 channel)
+ *             - 2 Audio Streaming Interfaces: playback (stereo, quad or 5.1 PCM) and loopback capture
+ *             - 3 Audio Streaming Endpoints: playback OUT, its feedback IN, capture IN
+ *             - 3 Input Terminals (stereo, quad, 5.1) into a Mixer Unit that folds them to stereo
  *             - Audio Class-Specific AC Interfaces
  *             - Audio Class-Specific AS Interfaces
- *             - AudioControl Requests: only SET_CUR and GET_CUR requests are supported (for Mute)
- *             - Audio Feature Unit (limited to Mute control)
+ *             - AudioControl Requests: SET_CUR, GET_CUR, GET_MIN, GET_MAX and GET_RES
+ *             - Audio Feature Unit: Mute, Volume, Bass, Mid, Treble and AGC controls
+ *             - Audio Mixer Unit: one crosspoint control per input and output channel
  *             - Audio Synchronization type: Asynchronous
- *             - Single fixed audio sampling rate (configurable in usbd_conf.h file)
+ *             - Endpoint Requests: SET_CUR and GET_CUR for the Sampling Frequency control
  *          The current audio class version supports the following audio features:
  *             - Pulse Coded Modulation (PCM) format
- *             - sampling rate: 48KHz.
- *             - Bit resolution: 16
- *             - Number of channels: 2
- *             - No volume control
- *             - Mute/Unmute capability
+ *             - sampling rate: 44.1KHz, 48KHz or 96KHz, selected by the host at runtime.
+ *             - Bit resolution: 16, 24 or 32 (one alternate setting each)
+ *             - Number of channels: 2, or 4 and 6 downmixed to the stereo output
+ *             - Volume control, 0dB..-96dB in 0.5dB steps, changes ramped over one I2S block
+ *             - Mute/Unmute capability, ramped to silence before the amplifier is shut down
  *             - Asynchronous Endpoints
+ *             - Loopback capture: a second streaming interface sends the post-volume output back
+ *             - Optional on-device resampling (USBD_AUDIO_ASRC) for hosts that ignore the feedback
+ *             - Playback latency target of 2..16 ms, set and reported through AUDIO_VENDOR_REQ_LATENCY
+ *             - Starved stream concealed by fades to silence and back, counted by AUDIO_VENDOR_REQ_XRUN
+ *             - 16-bit quad and 5.1 streams, folded to stereo by a Mixer Unit with settable crosspoints
+ *             - Bass, Mid and Treble controls (+-12dB in 0.25dB steps) and an AGC on the Feature Unit
+ *             - Parametric EQ, up to 10 biquads per channel uploaded through AUDIO_VENDOR_REQ_PEQ_BAND
+ *             - Lookahead limiter after the tone controls and EQ, set through AUDIO_VENDOR_REQ_LIMITER
+ *             - 16-bit output requantized once, with TPDF dither and optional noise shaping
+ *             - Output peak, RMS and clip metering, reported through AUDIO_VENDOR_REQ_LEVEL
  *
  * @note     In HS mode and when the DMA is used, all variables and data structures
  *           dealing with the DMA during the transaction process should be 32-bit aligned.
@@ -58,6 +69,13 @@
 #include "main.h"
 #include "arm_math.h"
 #include "usbd_ctlreq.h"
+#include "audio_format.h"
+#include "audio_fade.h"
+
+#include <string.h>
+
+_Static_assert(AUDIO_RING_SLOT_NUM - 1U >= AUDIO_LATENCY_MS_MAX + 2U,
+               "AUDIO_RING_SLOT_NUM too small for AUDIO_LATENCY_MS_MAX");
 
 #define AUDIO_SAMPLE_FREQ(frq) \
   (uint8_t)(frq), (uint8_t)((frq >> 8)), (uint8_t)((frq >> 16))
@@ -65,6 +83,65 @@
 #define AUDIO_PACKET_SZE(frq) \
   (uint8_t)(((frq / 1000U + 1) * 2U * 2U) & 0xFFU), (uint8_t)((((frq / 1000U + 1) * 2U * 2U) >> 8) & 0xFFU)
 
+#define AUDIO_PACKET_SZE_24(frq) \
+  (uint8_t)(((frq / 1000U + 1) * 2U * 3U) & 0xFFU), (uint8_t)((((frq / 1000U + 1) * 2U * 3U) >> 8) & 0xFFU)
+
+#define AUDIO_PACKET_SZE_32(frq) \
+  (uint8_t)(((frq / 1000U + 1) * 2U * 4U) & 0xFFU), (uint8_t)((((frq / 1000U + 1) * 2U * 4U) >> 8) & 0xFFU)
+
+/* Standard AS interface, class-specific AS interface, format and isochronous IN endpoint of one loopback sample width */
+#define AUDIO_CAPTURE_ALT_DESC(alt, bytes, packet)                                                                \
+  AUDIO_INTERFACE_DESC_SIZE,              /* bLength */                                                           \
+  USB_DESC_TYPE_INTERFACE,                /* bDescriptorType */                                                   \
+  AUDIO_CAPTURE_IF,                       /* bInterfaceNumber */                                                  \
+  (alt),                                  /* bAlternateSetting */                                                 \
+  0x01,                                   /* bNumEndpoints 1 in */                                                \
+  USB_DEVICE_CLASS_AUDIO,                 /* bInterfaceClass */                                                   \
+  AUDIO_SUBCLASS_AUDIOSTREAMING,          /* bInterfaceSubClass */                                                \
+  AUDIO_PROTOCOL_UNDEFINED,               /* bInterfaceProtocol */                                                \
+  0x00,                                   /* iInterface */                                                        \
+                                                                                                                  \
+  AUDIO_STREAMING_INTERFACE_DESC_SIZE,    /* bLength */                                                           \
+  AUDIO_INTERFACE_DESCRIPTOR_TYPE,        /* bDescriptorType */                                                   \
+  AUDIO_STREAMING_GENERAL,                /* bDescriptorSubtype */                                                \
+  0x04,                                   /* bTerminalLink: loopback Output Terminal */                           \
+  0x01,                                   /* bDelay */                                                            \
+  0x01, 0x00,                             /* wFormatTag AUDIO_FORMAT_PCM  0x0001 */                               \
+                                                                                                                  \
+  0x11,                                   /* bLength */                                                           \
+  AUDIO_INTERFACE_DESCRIPTOR_TYPE,        /* bDescriptorType */                                                   \
+  AUDIO_STREAMING_FORMAT_TYPE,            /* bDescriptorSubtype */                                                \
+  AUDIO_FORMAT_TYPE_I,                    /* bFormatType */                                                       \
+  0x02,                                   /* bNrChannels */                                                       \
+  (bytes),                                /* bSubFrameSize */                                                     \
+  (bytes) * 8U,                           /* bBitResolution */                                                    \
+  0x03,                                   /* bSamFreqType: 3 discrete frequencies */                              \
+  AUDIO_SAMPLE_FREQ(USBD_AUDIO_FREQ_44K), /* tSamFreq */                                                          \
+  AUDIO_SAMPLE_FREQ(USBD_AUDIO_FREQ_48K),                                                                         \
+  AUDIO_SAMPLE_FREQ(USBD_AUDIO_FREQ_96K),                                                                         \
+                                                                                                                  \
+  AUDIO_STANDARD_ENDPOINT_DESC_SIZE,      /* bLength */                                                           \
+  USB_DESC_TYPE_ENDPOINT,                 /* bDescriptorType */                                                   \
+  AUDIO_CAPTURE_EP,                       /* bEndpointAddress 2 in endpoint */                                    \
+  0x05,                                   /* bmAttributes isochronous, asynchronous */                            \
+  LOBYTE(packet), HIBYTE(packet),         /* wMaxPacketSize */                                                    \
+  0x01,                                   /* bInterval */                                                         \
+  0x00,                                   /* bRefresh */                                                          \
+  0x00,                                   /* bSynchAddress: the device clock paces the packets */                 \
+                                                                                                                  \
+  AUDIO_STREAMING_ENDPOINT_DESC_SIZE,     /* bLength */                                                           \
+  AUDIO_ENDPOINT_DESCRIPTOR_TYPE,         /* bDescriptorType */                                                   \
+  AUDIO_ENDPOINT_GENERAL,                 /* bDescriptor */                                                       \
+  0x01,                                   /* bmAttributes: Sampling Frequency control */                          \
+  0x00,                                   /* bLockDelayUnits */                                                   \
+  0x00, 0x00                              /* wLockDelay */
+
+_Static_assert(AUDIO_OUT_PACKET_MAX <= AUDIO_RING_SLOT_SIZE, "AUDIO_RING_SLOT_SIZE too small for AUDIO_OUT_PACKET_MAX");
+_Static_assert(AUDIO_OUT_PACKET_QUAD <= AUDIO_OUT_PACKET_MAX && AUDIO_OUT_PACKET_SURROUND <= AUDIO_OUT_PACKET_MAX,
+               "AUDIO_OUT_PACKET_MAX smaller than a multichannel packet");
+_Static_assert(AUDIO_GRAPH_STAGES_MAX * sizeof(USBD_AUDIO_StageTypeDef) <= USB_MAX_EP0_SIZE,
+               "AUDIO_VENDOR_REQ_STAGE report larger than the control buffer");
+
 #ifdef USE_USBD_COMPOSITE
 #define AUDIO_PACKET_SZE_WORD(frq) \
   (uint32_t)((((frq) * 2U * 2U) / 1000U))
@@ -118,7 +195,7 @@ __ALIGN_BEGIN static uint8_t USBD_AUDIO_CfgDesc[USB_AUDIO_CONFIG_DESC_SIZ] __ALI
     USB_DESC_TYPE_CONFIGURATION,       /* bDescriptorType */
     LOBYTE(USB_AUDIO_CONFIG_DESC_SIZ), /* wTotalLength */
     HIBYTE(USB_AUDIO_CONFIG_DESC_SIZ),
-    0x02, /* bNumInterfaces */
+    0x03, /* bNumInterfaces */
     0x01, /* bConfigurationValue */
     0x00, /* iConfiguration */
 #if (USBD_SELF_POWERED == 1U)
@@ -142,16 +219,17 @@ __ALIGN_BEGIN static uint8_t USBD_AUDIO_CfgDesc[USB_AUDIO_CONFIG_DESC_SIZ] __ALI
     /* 09 byte*/
 
     /* USB Speaker Class-specific AC Interface Descriptor */
-    AUDIO_INTERFACE_DESC_SIZE,       /* bLength */
+    AUDIO_INTERFACE_DESC_SIZE + 1U,  /* bLength */
     AUDIO_INTERFACE_DESCRIPTOR_TYPE, /* bDescriptorType */
     AUDIO_CONTROL_HEADER,            /* bDescriptorSubtype */
     0x00, /* 1.00 */                 /* bcdADC */
     0x01,
-    0x27, /* wTotalLength */
+    0x59, /* wTotalLength */
     0x00,
-    0x01, /* bInCollection */
-    0x01, /* baInterfaceNr */
-    /* 09 byte*/
+    0x02,             /* bInCollection */
+    0x01,             /* baInterfaceNr(1): playback */
+    AUDIO_CAPTURE_IF, /* baInterfaceNr(2): loopback capture */
+    /* 10 byte*/
 
     /* USB Speaker Input Terminal Descriptor */
     AUDIO_INPUT_TERMINAL_DESC_SIZE,  /* bLength */
@@ -167,14 +245,60 @@ __ALIGN_BEGIN static uint8_t USBD_AUDIO_CfgDesc[USB_AUDIO_CONFIG_DESC_SIZ] __ALI
     0x00,       /* iTerminal */
     /* 12 byte*/
 
+    /* Quad Input Terminal Descriptor: streamed by alternate setting 4 */
+    AUDIO_INPUT_TERMINAL_DESC_SIZE,  /* bLength */
+    AUDIO_INTERFACE_DESCRIPTOR_TYPE, /* bDescriptorType */
+    AUDIO_CONTROL_INPUT_TERMINAL,    /* bDescriptorSubtype */
+    AUDIO_QUAD_IT_ID,                /* bTerminalID */
+    0x01,                            /* wTerminalType AUDIO_TERMINAL_USB_STREAMING   0x0101 */
+    0x01,
+    0x00,       /* bAssocTerminal */
+    0x04,       /* bNrChannels */
+    0x33, 0x00, /* wChannelConfig: L, R, Ls, Rs */
+    0x00,       /* iChannelNames */
+    0x00,       /* iTerminal */
+    /* 12 byte*/
+
+    /* 5.1 Input Terminal Descriptor: streamed by alternate setting 5 */
+    AUDIO_INPUT_TERMINAL_DESC_SIZE,  /* bLength */
+    AUDIO_INTERFACE_DESCRIPTOR_TYPE, /* bDescriptorType */
+    AUDIO_CONTROL_INPUT_TERMINAL,    /* bDescriptorSubtype */
+    AUDIO_SURROUND_IT_ID,            /* bTerminalID */
+    0x01,                            /* wTerminalType AUDIO_TERMINAL_USB_STREAMING   0x0101 */
+    0x01,
+    0x00,       /* bAssocTerminal */
+    0x06,       /* bNrChannels */
+    0x3F, 0x00, /* wChannelConfig: L, R, C, LFE, Ls, Rs */
+    0x00,       /* iChannelNames */
+    0x00,       /* iTerminal */
+    /* 12 byte*/
+
+    /* Mixer Unit Descriptor: the three terminals down to stereo, only the active one carries signal */
+    0x10,                            /* bLength */
+    AUDIO_INTERFACE_DESCRIPTOR_TYPE, /* bDescriptorType */
+    AUDIO_CONTROL_MIXER_UNIT,        /* bDescriptorSubtype */
+    AUDIO_MIXER_UNIT_ID,             /* bUnitID */
+    0x03,                            /* bNrInPins */
+    0x01,                            /* baSourceID(1): stereo */
+    AUDIO_QUAD_IT_ID,                /* baSourceID(2) */
+    AUDIO_SURROUND_IT_ID,            /* baSourceID(3) */
+    0x02,                            /* bNrChannels */
+    0x03, 0x00,                      /* wChannelConfig */
+    0x00,                            /* iChannelNames */
+    0x0F, 0xFF, 0xFF,                /* bmControls: every quad and 5.1 crosspoint, the stereo one is fixed */
+    0x00,                            /* iMixer */
+    /* 16 byte */
+
     /* USB Speaker Audio Feature Unit Descriptor */
     0x09,                                      /* bLength */
     AUDIO_INTERFACE_DESCRIPTOR_TYPE,           /* bDescriptorType */
     AUDIO_CONTROL_FEATURE_UNIT,                /* bDescriptorSubtype */
     AUDIO_OUT_STREAMING_CTRL,                  /* bUnitID */
-    0x01,                                      /* bSourceID */
+    AUDIO_MIXER_UNIT_ID,                       /* bSourceID */
     0x01,                                      /* bControlSize */
-    AUDIO_CONTROL_VOLUME | AUDIO_CONTROL_MUTE, /* bmaControls(0) */
+    AUDIO_CONTROL_VOLUME | AUDIO_CONTROL_MUTE |
+    AUDIO_CONTROL_BASS | AUDIO_CONTROL_MID |
+    AUDIO_CONTROL_TREBLE | AUDIO_CONTROL_AGC,  /* bmaControls(0) */
     0,                                         /* bmaControls(1) */
     0x00,                                      /* iTerminal */
     /* 09 byte */
@@ -191,6 +315,18 @@ __ALIGN_BEGIN static uint8_t USBD_AUDIO_CfgDesc[USB_AUDIO_CONFIG_DESC_SIZ] __ALI
     0x00, /* iTerminal */
     /* 09 byte */
 
+    /* Loopback Output Terminal Descriptor: the Feature Unit output back to the host */
+    0x09,                            /* bLength */
+    AUDIO_INTERFACE_DESCRIPTOR_TYPE, /* bDescriptorType */
+    AUDIO_CONTROL_OUTPUT_TERMINAL,   /* bDescriptorSubtype */
+    0x04,                            /* bTerminalID */
+    0x01,                            /* wTerminalType AUDIO_TERMINAL_USB_STREAMING   0x0101 */
+    0x01,
+    0x00, /* bAssocTerminal */
+    0x02, /* bSourceID */
+    0x00, /* iTerminal */
+    /* 09 byte */
+
     /* USB Speaker Standard AS Interface Descriptor - Audio Streaming Zero Bandwidth */
     /* Interface 1, Alternate Setting 0                                              */
     AUDIO_INTERFACE_DESC_SIZE,     /* bLength */
@@ -228,23 +364,306 @@ __ALIGN_BEGIN static uint8_t USBD_AUDIO_CfgDesc[USB_AUDIO_CONFIG_DESC_SIZ] __ALI
     /* 07 byte*/
 
     /* USB Speaker Audio Type III Format Interface Descriptor */
-    0x0B,                               /* bLength */
+    0x11,                               /* bLength */
+    AUDIO_INTERFACE_DESCRIPTOR_TYPE,    /* bDescriptorType */
+    AUDIO_STREAMING_FORMAT_TYPE,        /* bDescriptorSubtype */
+    AUDIO_FORMAT_TYPE_I,                /* bFormatType */
+    0x02,                               /* bNrChannels */
+    0x02,                               /* bSubFrameSize :  2 Bytes per frame (16bits) */
+    16,                                 /* bBitResolution (16-bits per sample) */
+    0x03,                                   /* bSamFreqType: 3 discrete frequencies */
+    AUDIO_SAMPLE_FREQ(USBD_AUDIO_FREQ_44K), /* Audio sampling frequencies coded on 3 bytes */
+    AUDIO_SAMPLE_FREQ(USBD_AUDIO_FREQ_48K),
+    AUDIO_SAMPLE_FREQ(USBD_AUDIO_FREQ_96K),
+    /* 17 byte*/
+
+    /* Standard AS Isochronous Audio Data Endpoint Descriptor */
+    AUDIO_STANDARD_ENDPOINT_DESC_SIZE, /* bLength */
+    USB_DESC_TYPE_ENDPOINT,            /* bDescriptorType */
+    AUDIO_OUT_EP,                      /* bEndpointAddress 1 out endpoint */
+    0x05,                              /* bmAttributes */
+    AUDIO_PACKET_SZE(USBD_AUDIO_FREQ_MAX), /* wMaxPacketSize in Bytes (Freq(Samples)*2(Stereo)*2(HalfWord)) */
+    0x01,                              /* bInterval */
+    0x00,                              /* bRefresh */
+    AUDIO_IN_EP,                       /* bSynchAddress */
+    /* 09 byte*/
+
+    /* Class-Specific AS Isochronous Audio Data Endpoint Descriptor */
+    AUDIO_STREAMING_ENDPOINT_DESC_SIZE, /* bLength */
+    AUDIO_ENDPOINT_DESCRIPTOR_TYPE,     /* bDescriptorType */
+    AUDIO_ENDPOINT_GENERAL,             /* bDescriptor */
+    0x01,                               /* bmAttributes: Sampling Frequency control */
+    0x00,                               /* bLockDelayUnits */
+    0x00,                               /* wLockDelay */
+    0x00,
+    /* 07 byte*/
+
+    /* Standard AS Isochronous Synch Endpoint Descriptor */
+    AUDIO_STANDARD_ENDPOINT_DESC_SIZE, /* bLength */
+    USB_DESC_TYPE_ENDPOINT,            /* bDescriptorType */
+    AUDIO_IN_EP,                       /* bEndpointAddress 1 feekback endpoint */
+    0x01,                              /* bmAttributes */
+    0x03,                              /* wMaxPacketSize in Bytes 3bytes */
+    0x00,
+    0x01,                              /* bInterval */
+    0x02,                              /* bRefresh 4ms = 2^2 */
+    0x00,                              /* bSynchAddress */
+    /* 09 byte*/
+
+    /* USB Speaker Standard AS Interface Descriptor - Audio Streaming Operational */
+    /* Interface 1, Alternate Setting 2                                           */
+    AUDIO_INTERFACE_DESC_SIZE,     /* bLength */
+    USB_DESC_TYPE_INTERFACE,       /* bDescriptorType */
+    0x01,                          /* bInterfaceNumber */
+    0x02,                          /* bAlternateSetting */
+    0x02,                          /* bNumEndpoints 1 out and 1 feekback */
+    USB_DEVICE_CLASS_AUDIO,        /* bInterfaceClass */
+    AUDIO_SUBCLASS_AUDIOSTREAMING, /* bInterfaceSubClass */
+    AUDIO_PROTOCOL_UNDEFINED,      /* bInterfaceProtocol */
+    0x00,                          /* iInterface */
+    /* 09 byte*/
+
+    /* USB Speaker Audio Streaming Interface Descriptor */
+    AUDIO_STREAMING_INTERFACE_DESC_SIZE, /* bLength */
+    AUDIO_INTERFACE_DESCRIPTOR_TYPE,     /* bDescriptorType */
+    AUDIO_STREAMING_GENERAL,             /* bDescriptorSubtype */
+    0x01,                                /* bTerminalLink */
+    0x01,                                /* bDelay */
+    0x01,                                /* wFormatTag AUDIO_FORMAT_PCM  0x0001 */
+    0x00,
+    /* 07 byte*/
+
+    /* USB Speaker Audio Type III Format Interface Descriptor */
+    0x11,                               /* bLength */
+    AUDIO_INTERFACE_DESCRIPTOR_TYPE,    /* bDescriptorType */
+    AUDIO_STREAMING_FORMAT_TYPE,        /* bDescriptorSubtype */
+    AUDIO_FORMAT_TYPE_I,                /* bFormatType */
+    0x02,                               /* bNrChannels */
+    0x03,                               /* bSubFrameSize :  3 Bytes per frame (24bits) */
+    24,                                 /* bBitResolution (24-bits per sample) */
+    0x03,                                   /* bSamFreqType: 3 discrete frequencies */
+    AUDIO_SAMPLE_FREQ(USBD_AUDIO_FREQ_44K), /* Audio sampling frequencies coded on 3 bytes */
+    AUDIO_SAMPLE_FREQ(USBD_AUDIO_FREQ_48K),
+    AUDIO_SAMPLE_FREQ(USBD_AUDIO_FREQ_96K),
+    /* 17 byte*/
+
+    /* Standard AS Isochronous Audio Data Endpoint Descriptor */
+    AUDIO_STANDARD_ENDPOINT_DESC_SIZE, /* bLength */
+    USB_DESC_TYPE_ENDPOINT,            /* bDescriptorType */
+    AUDIO_OUT_EP,                      /* bEndpointAddress 1 out endpoint */
+    0x05,                              /* bmAttributes */
+    AUDIO_PACKET_SZE_24(USBD_AUDIO_FREQ_MAX), /* wMaxPacketSize in Bytes (Freq(Samples)*2(Stereo)*3(3 Bytes)) */
+    0x01,                              /* bInterval */
+    0x00,                              /* bRefresh */
+    AUDIO_IN_EP,                       /* bSynchAddress */
+    /* 09 byte*/
+
+    /* Class-Specific AS Isochronous Audio Data Endpoint Descriptor */
+    AUDIO_STREAMING_ENDPOINT_DESC_SIZE, /* bLength */
+    AUDIO_ENDPOINT_DESCRIPTOR_TYPE,     /* bDescriptorType */
+    AUDIO_ENDPOINT_GENERAL,             /* bDescriptor */
+    0x01,                               /* bmAttributes: Sampling Frequency control */
+    0x00,                               /* bLockDelayUnits */
+    0x00,                               /* wLockDelay */
+    0x00,
+    /* 07 byte*/
+
+    /* Standard AS Isochronous Synch Endpoint Descriptor */
+    AUDIO_STANDARD_ENDPOINT_DESC_SIZE, /* bLength */
+    USB_DESC_TYPE_ENDPOINT,            /* bDescriptorType */
+    AUDIO_IN_EP,                       /* bEndpointAddress 1 feekback endpoint */
+    0x01,                              /* bmAttributes */
+    0x03,                              /* wMaxPacketSize in Bytes 3bytes */
+    0x00,
+    0x01,                              /* bInterval */
+    0x02,                              /* bRefresh 4ms = 2^2 */
+    0x00,                              /* bSynchAddress */
+    /* 09 byte*/
+
+    /* USB Speaker Standard AS Interface Descriptor - Audio Streaming Operational */
+    /* Interface 1, Alternate Setting 3                                           */
+    AUDIO_INTERFACE_DESC_SIZE,     /* bLength */
+    USB_DESC_TYPE_INTERFACE,       /* bDescriptorType */
+    0x01,                          /* bInterfaceNumber */
+    0x03,                          /* bAlternateSetting */
+    0x02,                          /* bNumEndpoints 1 out and 1 feekback */
+    USB_DEVICE_CLASS_AUDIO,        /* bInterfaceClass */
+    AUDIO_SUBCLASS_AUDIOSTREAMING, /* bInterfaceSubClass */
+    AUDIO_PROTOCOL_UNDEFINED,      /* bInterfaceProtocol */
+    0x00,                          /* iInterface */
+    /* 09 byte*/
+
+    /* USB Speaker Audio Streaming Interface Descriptor */
+    AUDIO_STREAMING_INTERFACE_DESC_SIZE, /* bLength */
+    AUDIO_INTERFACE_DESCRIPTOR_TYPE,     /* bDescriptorType */
+    AUDIO_STREAMING_GENERAL,             /* bDescriptorSubtype */
+    0x01,                                /* bTerminalLink */
+    0x01,                                /* bDelay */
+    0x01,                                /* wFormatTag AUDIO_FORMAT_PCM  0x0001 */
+    0x00,
+    /* 07 byte*/
+
+    /* USB Speaker Audio Type III Format Interface Descriptor */
+    0x11,                               /* bLength */
     AUDIO_INTERFACE_DESCRIPTOR_TYPE,    /* bDescriptorType */
     AUDIO_STREAMING_FORMAT_TYPE,        /* bDescriptorSubtype */
     AUDIO_FORMAT_TYPE_I,                /* bFormatType */
     0x02,                               /* bNrChannels */
+    0x04,                               /* bSubFrameSize :  4 Bytes per frame (32bits) */
+    32,                                 /* bBitResolution (32-bits per sample) */
+    0x03,                                   /* bSamFreqType: 3 discrete frequencies */
+    AUDIO_SAMPLE_FREQ(USBD_AUDIO_FREQ_44K), /* Audio sampling frequencies coded on 3 bytes */
+    AUDIO_SAMPLE_FREQ(USBD_AUDIO_FREQ_48K),
+    AUDIO_SAMPLE_FREQ(USBD_AUDIO_FREQ_96K),
+    /* 17 byte*/
+
+    /* Standard AS Isochronous Audio Data Endpoint Descriptor */
+    AUDIO_STANDARD_ENDPOINT_DESC_SIZE, /* bLength */
+    USB_DESC_TYPE_ENDPOINT,            /* bDescriptorType */
+    AUDIO_OUT_EP,                      /* bEndpointAddress 1 out endpoint */
+    0x05,                              /* bmAttributes */
+    AUDIO_PACKET_SZE_32(USBD_AUDIO_FREQ_MAX), /* wMaxPacketSize in Bytes (Freq(Samples)*2(Stereo)*4(Word)) */
+    0x01,                              /* bInterval */
+    0x00,                              /* bRefresh */
+    AUDIO_IN_EP,                       /* bSynchAddress */
+    /* 09 byte*/
+
+    /* Class-Specific AS Isochronous Audio Data Endpoint Descriptor */
+    AUDIO_STREAMING_ENDPOINT_DESC_SIZE, /* bLength */
+    AUDIO_ENDPOINT_DESCRIPTOR_TYPE,     /* bDescriptorType */
+    AUDIO_ENDPOINT_GENERAL,             /* bDescriptor */
+    0x01,                               /* bmAttributes: Sampling Frequency control */
+    0x00,                               /* bLockDelayUnits */
+    0x00,                               /* wLockDelay */
+    0x00,
+    /* 07 byte*/
+
+    /* Standard AS Isochronous Synch Endpoint Descriptor */
+    AUDIO_STANDARD_ENDPOINT_DESC_SIZE, /* bLength */
+    USB_DESC_TYPE_ENDPOINT,            /* bDescriptorType */
+    AUDIO_IN_EP,                       /* bEndpointAddress 1 feekback endpoint */
+    0x01,                              /* bmAttributes */
+    0x03,                              /* wMaxPacketSize in Bytes 3bytes */
+    0x00,
+    0x01,                              /* bInterval */
+    0x02,                              /* bRefresh 4ms = 2^2 */
+    0x00,                              /* bSynchAddress */
+    /* 09 byte*/
+
+    /* USB Speaker Standard AS Interface Descriptor - Audio Streaming Operational */
+    /* Interface 1, Alternate Setting 4: 16-bit quad                             */
+    AUDIO_INTERFACE_DESC_SIZE,     /* bLength */
+    USB_DESC_TYPE_INTERFACE,       /* bDescriptorType */
+    0x01,                          /* bInterfaceNumber */
+    0x04,                          /* bAlternateSetting */
+    0x02,                          /* bNumEndpoints 1 out and 1 feekback */
+    USB_DEVICE_CLASS_AUDIO,        /* bInterfaceClass */
+    AUDIO_SUBCLASS_AUDIOSTREAMING, /* bInterfaceSubClass */
+    AUDIO_PROTOCOL_UNDEFINED,      /* bInterfaceProtocol */
+    0x00,                          /* iInterface */
+    /* 09 byte*/
+
+    /* USB Speaker Audio Streaming Interface Descriptor */
+    AUDIO_STREAMING_INTERFACE_DESC_SIZE, /* bLength */
+    AUDIO_INTERFACE_DESCRIPTOR_TYPE,     /* bDescriptorType */
+    AUDIO_STREAMING_GENERAL,             /* bDescriptorSubtype */
+    AUDIO_QUAD_IT_ID,                    /* bTerminalLink */
+    0x01,                                /* bDelay */
+    0x01,                                /* wFormatTag AUDIO_FORMAT_PCM  0x0001 */
+    0x00,
+    /* 07 byte*/
+
+    /* USB Speaker Audio Type I Format Interface Descriptor */
+    0x11,                               /* bLength */
+    AUDIO_INTERFACE_DESCRIPTOR_TYPE,    /* bDescriptorType */
+    AUDIO_STREAMING_FORMAT_TYPE,        /* bDescriptorSubtype */
+    AUDIO_FORMAT_TYPE_I,                /* bFormatType */
+    0x04,                               /* bNrChannels */
+    0x02,                               /* bSubFrameSize :  2 Bytes per frame (16bits) */
+    16,                                 /* bBitResolution (16-bits per sample) */
+    0x03,                                   /* bSamFreqType: 3 discrete frequencies */
+    AUDIO_SAMPLE_FREQ(USBD_AUDIO_FREQ_44K), /* Audio sampling frequencies coded on 3 bytes */
+    AUDIO_SAMPLE_FREQ(USBD_AUDIO_FREQ_48K),
+    AUDIO_SAMPLE_FREQ(USBD_AUDIO_FREQ_96K),
+    /* 17 byte*/
+
+    /* Standard AS Isochronous Audio Data Endpoint Descriptor */
+    AUDIO_STANDARD_ENDPOINT_DESC_SIZE, /* bLength */
+    USB_DESC_TYPE_ENDPOINT,            /* bDescriptorType */
+    AUDIO_OUT_EP,                      /* bEndpointAddress 1 out endpoint */
+    0x05,                              /* bmAttributes */
+    LOBYTE(AUDIO_OUT_PACKET_QUAD),     /* wMaxPacketSize in Bytes (Freq(Samples)*4(Channels)*2(HalfWord)) */
+    HIBYTE(AUDIO_OUT_PACKET_QUAD),
+    0x01,                              /* bInterval */
+    0x00,                              /* bRefresh */
+    AUDIO_IN_EP,                       /* bSynchAddress */
+    /* 09 byte*/
+
+    /* Class-Specific AS Isochronous Audio Data Endpoint Descriptor */
+    AUDIO_STREAMING_ENDPOINT_DESC_SIZE, /* bLength */
+    AUDIO_ENDPOINT_DESCRIPTOR_TYPE,     /* bDescriptorType */
+    AUDIO_ENDPOINT_GENERAL,             /* bDescriptor */
+    0x01,                               /* bmAttributes: Sampling Frequency control */
+    0x00,                               /* bLockDelayUnits */
+    0x00,                               /* wLockDelay */
+    0x00,
+    /* 07 byte*/
+
+    /* Standard AS Isochronous Synch Endpoint Descriptor */
+    AUDIO_STANDARD_ENDPOINT_DESC_SIZE, /* bLength */
+    USB_DESC_TYPE_ENDPOINT,            /* bDescriptorType */
+    AUDIO_IN_EP,                       /* bEndpointAddress 1 feekback endpoint */
+    0x01,                              /* bmAttributes */
+    0x03,                              /* wMaxPacketSize in Bytes 3bytes */
+    0x00,
+    0x01,                              /* bInterval */
+    0x02,                              /* bRefresh 4ms = 2^2 */
+    0x00,                              /* bSynchAddress */
+    /* 09 byte*/
+
+    /* USB Speaker Standard AS Interface Descriptor - Audio Streaming Operational */
+    /* Interface 1, Alternate Setting 5: 16-bit 5.1                              */
+    AUDIO_INTERFACE_DESC_SIZE,     /* bLength */
+    USB_DESC_TYPE_INTERFACE,       /* bDescriptorType */
+    0x01,                          /* bInterfaceNumber */
+    0x05,                          /* bAlternateSetting */
+    0x02,                          /* bNumEndpoints 1 out and 1 feekback */
+    USB_DEVICE_CLASS_AUDIO,        /* bInterfaceClass */
+    AUDIO_SUBCLASS_AUDIOSTREAMING, /* bInterfaceSubClass */
+    AUDIO_PROTOCOL_UNDEFINED,      /* bInterfaceProtocol */
+    0x00,                          /* iInterface */
+    /* 09 byte*/
+
+    /* USB Speaker Audio Streaming Interface Descriptor */
+    AUDIO_STREAMING_INTERFACE_DESC_SIZE, /* bLength */
+    AUDIO_INTERFACE_DESCRIPTOR_TYPE,     /* bDescriptorType */
+    AUDIO_STREAMING_GENERAL,             /* bDescriptorSubtype */
+    AUDIO_SURROUND_IT_ID,                /* bTerminalLink */
+    0x01,                                /* bDelay */
+    0x01,                                /* wFormatTag AUDIO_FORMAT_PCM  0x0001 */
+    0x00,
+    /* 07 byte*/
+
+    /* USB Speaker Audio Type I Format Interface Descriptor */
+    0x0E,                               /* bLength */
+    AUDIO_INTERFACE_DESCRIPTOR_TYPE,    /* bDescriptorType */
+    AUDIO_STREAMING_FORMAT_TYPE,        /* bDescriptorSubtype */
+    AUDIO_FORMAT_TYPE_I,                /* bFormatType */
+    0x06,                               /* bNrChannels */
     0x02,                               /* bSubFrameSize :  2 Bytes per frame (16bits) */
     16,                                 /* bBitResolution (16-bits per sample) */
-    0x01,                               /* bSamFreqType only one frequency supported */
-    AUDIO_SAMPLE_FREQ(USBD_AUDIO_FREQ), /* Audio sampling frequency coded on 3 bytes */
-    /* 11 byte*/
+    0x02,                                   /* bSamFreqType: 2 discrete frequencies, 96 kHz exceeds a full-speed packet */
+    AUDIO_SAMPLE_FREQ(USBD_AUDIO_FREQ_44K), /* Audio sampling frequencies coded on 3 bytes */
+    AUDIO_SAMPLE_FREQ(USBD_AUDIO_FREQ_48K),
+    /* 14 byte*/
 
     /* Standard AS Isochronous Audio Data Endpoint Descriptor */
     AUDIO_STANDARD_ENDPOINT_DESC_SIZE, /* bLength */
     USB_DESC_TYPE_ENDPOINT,            /* bDescriptorType */
     AUDIO_OUT_EP,                      /* bEndpointAddress 1 out endpoint */
     0x05,                              /* bmAttributes */
-    AUDIO_PACKET_SZE(USBD_AUDIO_FREQ), /* wMaxPacketSize in Bytes (Freq(Samples)*2(Stereo)*2(HalfWord)) */
+    LOBYTE(AUDIO_OUT_PACKET_SURROUND), /* wMaxPacketSize in Bytes (Freq(Samples)*6(Channels)*2(HalfWord)) */
+    HIBYTE(AUDIO_OUT_PACKET_SURROUND),
     0x01,                              /* bInterval */
     0x00,                              /* bRefresh */
     AUDIO_IN_EP,                       /* bSynchAddress */
@@ -254,7 +673,7 @@ __ALIGN_BEGIN static uint8_t USBD_AUDIO_CfgDesc[USB_AUDIO_CONFIG_DESC_SIZ] __ALI
     AUDIO_STREAMING_ENDPOINT_DESC_SIZE, /* bLength */
     AUDIO_ENDPOINT_DESCRIPTOR_TYPE,     /* bDescriptorType */
     AUDIO_ENDPOINT_GENERAL,             /* bDescriptor */
-    0x00,                               /* bmAttributes */
+    0x01,                               /* bmAttributes: Sampling Frequency control */
     0x00,                               /* bLockDelayUnits */
     0x00,                               /* wLockDelay */
     0x00,
@@ -266,10 +685,29 @@ __ALIGN_BEGIN static uint8_t USBD_AUDIO_CfgDesc[USB_AUDIO_CONFIG_DESC_SIZ] __ALI
     AUDIO_IN_EP,                       /* bEndpointAddress 1 feekback endpoint */
     0x01,                              /* bmAttributes */
     0x03,                              /* wMaxPacketSize in Bytes 3bytes */
+    0x00,
     0x01,                              /* bInterval */
     0x02,                              /* bRefresh 4ms = 2^2 */
     0x00,                              /* bSynchAddress */
-                                       /* 09 byte*/
+    /* 09 byte*/
+
+    /* Loopback Standard AS Interface Descriptor - Audio Streaming Zero Bandwidth */
+    /* Interface 2, Alternate Setting 0                                          */
+    AUDIO_INTERFACE_DESC_SIZE,     /* bLength */
+    USB_DESC_TYPE_INTERFACE,       /* bDescriptorType */
+    AUDIO_CAPTURE_IF,              /* bInterfaceNumber */
+    0x00,                          /* bAlternateSetting */
+    0x00,                          /* bNumEndpoints */
+    USB_DEVICE_CLASS_AUDIO,        /* bInterfaceClass */
+    AUDIO_SUBCLASS_AUDIOSTREAMING, /* bInterfaceSubClass */
+    AUDIO_PROTOCOL_UNDEFINED,      /* bInterfaceProtocol */
+    0x00,                          /* iInterface */
+    /* 09 byte*/
+
+    /* Interface 2, Alternate Settings 1 to 3: 16, 24 and 32-bit PCM */
+    AUDIO_CAPTURE_ALT_DESC(AUDIO_ALT_SETTING_16B, 2U, AUDIO_OUT_PACKET),
+    AUDIO_CAPTURE_ALT_DESC(AUDIO_ALT_SETTING_24B, 3U, AUDIO_OUT_PACKET_24),
+    AUDIO_CAPTURE_ALT_DESC(AUDIO_ALT_SETTING_32B, 4U, AUDIO_OUT_PACKET_32),
 };
 
 /* USB Standard Device Descriptor */
@@ -287,48 +725,934 @@ __ALIGN_BEGIN static uint8_t USBD_AUDIO_DeviceQualifierDesc[USB_LEN_DEV_QUALIFIE
 };
 #endif /* USE_USBD_COMPOSITE  */
 
-static uint8_t AUDIOOutEpAdd = AUDIO_OUT_EP;
-static uint8_t AUDIOInEpAdd = AUDIO_IN_EP;
+static uint8_t AUDIOOutEpAdd = AUDIO_OUT_EP;
+static uint8_t AUDIOInEpAdd = AUDIO_IN_EP;
+static uint8_t AUDIOCaptureEpAdd = AUDIO_CAPTURE_EP;
+
+/* Mixer Unit crosspoints after reset, 8.8 dB to the left and right outputs:
+   stereo passes through, quad folds each side at -6dB, 5.1 keeps L/R at
+   -8dB with C and the surround side at -11dB so the sum stays below 0dB,
+   LFE is left out */
+static const int16_t USBD_AUDIO_MixDefault[AUDIO_MIX_IN_CHANNELS][2] = {
+    {0x0000, AUDIO_MIX_DB_SILENCE},               /* stereo L */
+    {AUDIO_MIX_DB_SILENCE, 0x0000},               /* stereo R */
+    {-6 * 256, AUDIO_MIX_DB_SILENCE},             /* quad L */
+    {AUDIO_MIX_DB_SILENCE, -6 * 256},             /* quad R */
+    {-6 * 256, AUDIO_MIX_DB_SILENCE},             /* quad Ls */
+    {AUDIO_MIX_DB_SILENCE, -6 * 256},             /* quad Rs */
+    {-8 * 256, AUDIO_MIX_DB_SILENCE},             /* 5.1 L */
+    {AUDIO_MIX_DB_SILENCE, -8 * 256},             /* 5.1 R */
+    {-11 * 256, -11 * 256},                       /* 5.1 C */
+    {AUDIO_MIX_DB_SILENCE, AUDIO_MIX_DB_SILENCE}, /* 5.1 LFE */
+    {-11 * 256, AUDIO_MIX_DB_SILENCE},            /* 5.1 Ls */
+    {AUDIO_MIX_DB_SILENCE, -11 * 256},            /* 5.1 Rs */
+};
+
+extern I2S_HandleTypeDef hi2s2;
+
+/* Left channel of the I2S output, pulled by the analyzer in the main loop */
+static AUDIO_FifoTypeDef USBD_AUDIO_Tap;
+
+/**
+ * @brief  USBD_AUDIO_ReadTap
+ *         Next analyzer frame of the left output channel, from thread
+ *         mode, without waiting. Blocks the analyzer was too slow for are
+ *         dropped and counted in the FIFO overruns, and the frame restarts
+ *         after them rather than splicing the audio on either side.
+ * @param  samples: frame, q15
+ * @param  size: frame length, at most AUDIO_FIFO_SIZE
+ * @param  hop: samples between the starts of two frames, 1..size
+ * @retval 1 when a frame was read, 0 when fewer than size samples are queued
+ */
+uint8_t USBD_AUDIO_ReadTap(q15_t *samples, uint32_t size, uint32_t hop) {
+  return AUDIO_FifoRead_q15(&USBD_AUDIO_Tap, samples, size, hop);
+}
+
+/**
+ * @brief  USBD_AUDIO_GetBlock
+ *         Half of the I2S buffer, in the sample width of the current format
+ * @param  haudio: audio class handle
+ * @param  half: 0 for the first half, 1 for the second one
+ * @retval pointer to AUDIO_BLOCK_FRAMES stereo frames
+ */
+static void *USBD_AUDIO_GetBlock(USBD_AUDIO_HandleTypeDef *haudio, uint32_t half) {
+  if (haudio->bit_depth == 16U) {
+    return &((int16_t *)haudio->pcm)[half * AUDIO_BLOCK_FRAMES * 2U];
+  }
+  return &haudio->pcm[half * AUDIO_BLOCK_FRAMES * 2U];
+}
+
+/**
+ * @brief  USBD_AUDIO_Muted
+ *         Whether the block being produced is muted from its first frame:
+ *         the ramp to mute, if any, ended with the last block
+ * @param  haudio: audio class handle
+ * @retval 0 while the output may still carry sound
+ */
+static inline uint8_t USBD_AUDIO_Muted(const USBD_AUDIO_HandleTypeDef *haudio) {
+  return (uint8_t)(AUDIO_GainEqual(haudio->gain_cur, AUDIO_GAIN_MUTE) != 0U &&
+                   AUDIO_GainEqual(haudio->gain_next, AUDIO_GAIN_MUTE) != 0U);
+}
+
+#if (USBD_AUDIO_ASRC == 1U)
+/**
+ * @brief  USBD_AUDIO_ReadFrames_q31
+ *         Unpack frames from the receive ring to stereo q31, whatever the format
+ * @param  haudio: audio class handle
+ * @param  dst: output frames
+ * @param  frames: frames wanted
+ * @retval frames read, fewer than wanted when the ring ran dry
+ */
+static uint32_t USBD_AUDIO_ReadFrames_q31(USBD_AUDIO_HandleTypeDef *haudio, int32_t *dst, uint32_t frames) {
+  uint32_t done = 0U;
+  uint8_t *data;
+
+  while (done < frames) {
+    uint32_t run = AUDIO_RingPeek(&haudio->ring, &data) / haudio->frame_size;
+    if (run == 0U) {
+      break;
+    }
+    if (run > frames - done) {
+      run = frames - done;
+    }
+
+    switch (haudio->bit_depth) {
+      case 24U:
+        AUDIO_Unpack24_q31(data, &dst[done * 2U], run * 2U);
+        break;
+
+      case 32U:
+        (void)memcpy(&dst[done * 2U], data, run * 2U * sizeof(int32_t));
+        break;
+
+      default:
+        if (haudio->channels != 2U) {
+          /* asrc_out is free until the resampler runs */
+          AUDIO_MixDown_q15((const int16_t *)data, (int16_t *)haudio->asrc_out, run, &haudio->mix);
+          arm_q15_to_q31((const q15_t *)haudio->asrc_out, &dst[done * 2U], run * 2U);
+        } else {
+          arm_q15_to_q31((const q15_t *)data, &dst[done * 2U], run * 2U);
+        }
+        break;
+    }
+
+    AUDIO_RingConsume(&haudio->ring, (uint16_t)(run * haudio->frame_size));
+    done += run;
+  }
+
+  return done;
+}
+
+/**
+ * @brief  USBD_AUDIO_FillBlock
+ *         Produce one I2S block through the resampler: the input frames
+ *         the current step asks for are unpacked to q31 behind the
+ *         resampler history, resampled, then scaled, or ramped to a new
+ *         gain. In 16-bit mode the q31 result is left in asrc_out,
+ *         unscaled, for the float stage to apply the volume and requantize.
+ *         With a prefill pending the ring is left alone and the stream
+ *         fades out into the inserted silence.
+ * @param  haudio: audio class handle
+ * @param  block: AUDIO_BLOCK_FRAMES stereo frames of the I2S buffer
+ * @retval None
+ */
+static void USBD_AUDIO_FillBlock(USBD_AUDIO_HandleTypeDef *haudio, void *block) {
+  int32_t *in = &haudio->asrc_work[AUDIO_ASRC_HISTORY * 2U];
+  int32_t *out = haudio->bit_depth == 16U ? haudio->asrc_out : (int32_t *)block;
+  uint32_t wanted = AUDIO_AsrcInputFrames(&haudio->asrc, AUDIO_BLOCK_FRAMES);
+  uint8_t gap = haudio->prefill >= AUDIO_BLOCK_FRAMES ? 1U : 0U;
+  uint32_t done = gap != 0U ? 0U : USBD_AUDIO_ReadFrames_q31(haudio, in, wanted);
+
+  if (haudio->faded != 0U && done != 0U) {
+    /* Data is back after a gap: ramp it up from silence */
+    AUDIO_FadeIn_q31(in, MIN(done, AUDIO_FADE_FRAMES));
+    haudio->faded = 0U;
+  }
+
+  if (done < wanted) {
+    /* Host fell behind, or silence was inserted ahead of the ring: resample
+       a fade to silence rather than stale data */
+    if (haudio->faded == 0U) {
+      AUDIO_FadeHold_q31(done != 0U ? &in[(done - 1U) * 2U] : &haudio->asrc.hist[(AUDIO_ASRC_HISTORY - 1U) * 2U],
+                         &in[done * 2U], wanted - done);
+      haudio->faded = 1U;
+      haudio->dropouts += gap != 0U ? 0U : 1U;
+    } else {
+      (void)memset(&in[done * 2U], 0, (wanted - done) * 2U * sizeof(int32_t));
+    }
+    haudio->underruns += gap != 0U ? 0U : 1U;
+  }
+
+  AUDIO_AsrcProcess_q31(&haudio->asrc, haudio->asrc_work, out, AUDIO_BLOCK_FRAMES);
+  if (haudio->bit_depth == 16U) {
+    if (USBD_AUDIO_Muted(haudio) != 0U && AUDIO_GraphActive(&haudio->graph) == 0U) {
+      /* Nothing for the float stage to do, see USBD_AUDIO_DspActive */
+      (void)memset(block, 0, AUDIO_BLOCK_FRAMES * 2U * sizeof(int16_t));
+    }
+    return;
+  }
+  if (AUDIO_GainEqual(haudio->gain_cur, haudio->gain_next) != 0U) {
+    AUDIO_GainApply_q31(out, out, AUDIO_BLOCK_FRAMES * 2U, haudio->gain_next);
+  } else {
+    AUDIO_GainRamp_q31(out, out, AUDIO_BLOCK_FRAMES, haudio->gain_cur, haudio->gain_next, AUDIO_BLOCK_FRAMES);
+  }
+}
+#else
+/**
+ * @brief  USBD_AUDIO_PrevFrame
+ *         The frame taken from the ring just before a given frame of a
+ *         block: inside the block, or the last one of the previous block.
+ *         Not read back from the I2S buffer, which holds the DSP output.
+ * @param  haudio: audio class handle
+ * @param  block: AUDIO_BLOCK_FRAMES stereo frames, as filled from the ring
+ * @param  index: frame of the block
+ * @retval pointer to a stereo frame, in the sample width of the current format
+ */
+static void *USBD_AUDIO_PrevFrame(USBD_AUDIO_HandleTypeDef *haudio, void *block, uint32_t index) {
+  uint32_t size = haudio->bit_depth == 16U ? 2U * sizeof(int16_t) : 2U * sizeof(int32_t);
+
+  if (index == 0U) {
+    return haudio->fill_last;
+  }
+  return (uint8_t *)block + (index - 1U) * size;
+}
+
+/**
+ * @brief  USBD_AUDIO_FillBlock
+ *         Produce one I2S block from the receive ring in a single pass:
+ *         samples are unpacked, downmixed and the gain is applied while
+ *         they move from the packet slots into the DMA buffer. A block
+ *         that ramps to a new gain is moved at unity and ramped after.
+ *         With a prefill pending the ring is left alone and the stream
+ *         fades out into the inserted silence.
+ * @param  haudio: audio class handle
+ * @param  block: AUDIO_BLOCK_FRAMES stereo frames of the I2S buffer
+ * @param  wide: the float stage follows; 16-bit samples are left at
+ *         unity gain for it, rather than truncated here
+ * @retval None
+ */
+static void USBD_AUDIO_FillBlock(USBD_AUDIO_HandleTypeDef *haudio, void *block, uint8_t wide) {
+  AUDIO_GainTypeDef gain = wide != 0U && haudio->bit_depth == 16U ? AUDIO_GAIN_UNITY : haudio->gain_next;
+  uint8_t ramp = 0U;
+  uint8_t gap = haudio->prefill >= AUDIO_BLOCK_FRAMES ? 1U : 0U;
+  int16_t *block16 = (int16_t *)block;
+  int32_t *block32 = (int32_t *)block;
+  uint32_t done = 0U;
+  uint8_t *data;
+
+  /* 16-bit output only leaves unity through the float stage, see USBD_AUDIO_DspActive */
+  if (haudio->bit_depth != 16U && AUDIO_GainEqual(haudio->gain_cur, gain) == 0U) {
+    gain = AUDIO_GAIN_UNITY;
+    ramp = 1U;
+  }
+
+  while (done < AUDIO_BLOCK_FRAMES && gap == 0U) {
+    uint32_t frames = AUDIO_RingPeek(&haudio->ring, &data) / haudio->frame_size;
+    if (frames == 0U) {
+      break;
+    }
+    if (frames > AUDIO_BLOCK_FRAMES - done) {
+      frames = AUDIO_BLOCK_FRAMES - done;
+    }
+
+    switch (haudio->bit_depth) {
+      case 24U:
+        AUDIO_Unpack24_q31(data, &block32[done * 2U], frames * 2U);
+        AUDIO_GainApply_q31(&block32[done * 2U], &block32[done * 2U], frames * 2U, gain);
+        break;
+
+      case 32U:
+        AUDIO_GainApply_q31((const int32_t *)data, &block32[done * 2U], frames * 2U, gain);
+        break;
+
+      default:
+        if (haudio->channels != 2U) {
+          AUDIO_MixDown_q15((const int16_t *)data, &block16[done * 2U], frames, &haudio->mix);
+          AUDIO_GainApply_q15(&block16[done * 2U], &block16[done * 2U], frames, gain);
+        } else {
+          AUDIO_GainApply_q15((const int16_t *)data, &block16[done * 2U], frames, gain);
+        }
+        break;
+    }
+
+    AUDIO_RingConsume(&haudio->ring, (uint16_t)(frames * haudio->frame_size));
+    done += frames;
+  }
+
+  if (ramp != 0U) {
+    AUDIO_GainRamp_q31(block32, block32, done, haudio->gain_cur, haudio->gain_next, AUDIO_BLOCK_FRAMES);
+  }
+
+  if (haudio->faded != 0U && done != 0U) {
+    /* Data is back after a gap: ramp it up from silence */
+    if (haudio->bit_depth == 16U) {
+      AUDIO_FadeIn_q15(block16, MIN(done, AUDIO_FADE_FRAMES));
+    } else {
+      AUDIO_FadeIn_q31(block32, MIN(done, AUDIO_FADE_FRAMES));
+    }
+    haudio->faded = 0U;
+  }
+
+  if (done < AUDIO_BLOCK_FRAMES) {
+    /* Host fell behind, or silence was inserted ahead of the ring: fade to
+       silence rather than play stale data or step to zero */
+    if (haudio->faded == 0U) {
+      void *last = USBD_AUDIO_PrevFrame(haudio, block, done);
+
+      if (haudio->bit_depth == 16U) {
+        AUDIO_FadeHold_q15((const int16_t *)last, &block16[done * 2U], AUDIO_BLOCK_FRAMES - done);
+      } else {
+        AUDIO_FadeHold_q31((const int32_t *)last, &block32[done * 2U], AUDIO_BLOCK_FRAMES - done);
+      }
+      haudio->faded = 1U;
+      haudio->dropouts += gap != 0U ? 0U : 1U;
+    } else if (haudio->bit_depth == 16U) {
+      (void)memset(&block16[done * 2U], 0, (AUDIO_BLOCK_FRAMES - done) * 2U * sizeof(int16_t));
+    } else {
+      (void)memset(&block32[done * 2U], 0, (AUDIO_BLOCK_FRAMES - done) * 2U * sizeof(int32_t));
+    }
+    haudio->underruns += gap != 0U ? 0U : 1U;
+  }
+
+  (void)memcpy(haudio->fill_last, USBD_AUDIO_PrevFrame(haudio, block, AUDIO_BLOCK_FRAMES),
+               haudio->bit_depth == 16U ? 2U * sizeof(int16_t) : 2U * sizeof(int32_t));
+}
+#endif /* USBD_AUDIO_ASRC */
+
+/**
+ * @brief  USBD_AUDIO_CapturePacketFrames
+ *         Size of the next loopback packet. The nominal size carries the
+ *         remainder of freq / 1000 over, then one frame is added or taken
+ *         to steer the queue back to AUDIO_CAPTURE_PRIME_PACKETS: the I2S
+ *         clock produces the frames, the SOF drains one packet per frame.
+ * @param  haudio: audio class handle
+ * @retval frames
+ */
+static uint16_t USBD_AUDIO_CapturePacketFrames(USBD_AUDIO_HandleTypeDef *haudio) {
+  uint32_t nominal = haudio->freq / 1000U;
+  uint32_t queued = AUDIO_RingFill(&haudio->capture) / haudio->capture_frame_size;
+  uint32_t frames = nominal;
+
+  haudio->capture_acc += haudio->freq % 1000U;
+  if (haudio->capture_acc >= 1000U) {
+    haudio->capture_acc -= 1000U;
+    frames++;
+  }
+
+  if (queued > (AUDIO_CAPTURE_PRIME_PACKETS + 1U) * nominal) {
+    frames++;
+  } else if (queued < AUDIO_CAPTURE_PRIME_PACKETS * nominal) {
+    frames--;
+  }
+
+  return (uint16_t)frames;
+}
+
+/**
+ * @brief  USBD_AUDIO_CaptureBlock
+ *         Write a finished I2S block into the loopback packet slots, in the
+ *         capture sample width. This is the only copy: the IN endpoint
+ *         sends the slots in place.
+ * @param  haudio: audio class handle
+ * @param  block: AUDIO_BLOCK_FRAMES stereo frames of the I2S buffer
+ * @retval None
+ */
+static void USBD_AUDIO_CaptureBlock(USBD_AUDIO_HandleTypeDef *haudio, const void *block) {
+  const int16_t *block16 = (const int16_t *)block;
+  const int32_t *block32 = (const int32_t *)block;
+  uint32_t done = 0U;
+
+  while (done < AUDIO_BLOCK_FRAMES) {
+    uint8_t *dst;
+    uint32_t frames;
+
+    if (haudio->capture_off == 0U) {
+      haudio->capture_len = USBD_AUDIO_CapturePacketFrames(haudio);
+    }
+    dst = &AUDIO_RingWriteSlot(&haudio->capture)[haudio->capture_off * haudio->capture_frame_size];
+    frames = MIN(AUDIO_BLOCK_FRAMES - done, (uint32_t)(haudio->capture_len - haudio->capture_off));
+
+    switch (haudio->capture_bit_depth) {
+      case 24U:
+        if (haudio->bit_depth == 16U) {
+          AUDIO_Pack24_q15(&block16[done * 2U], dst, frames * 2U);
+        } else {
+          AUDIO_Pack24_q31(&block32[done * 2U], dst, frames * 2U);
+        }
+        break;
+
+      case 32U:
+        if (haudio->bit_depth == 16U) {
+          arm_q15_to_q31(&block16[done * 2U], (q31_t *)dst, frames * 2U);
+        } else {
+          (void)memcpy(dst, &block32[done * 2U], frames * 2U * sizeof(int32_t));
+        }
+        break;
+
+      default:
+        if (haudio->bit_depth == 16U) {
+          (void)memcpy(dst, &block16[done * 2U], frames * 2U * sizeof(int16_t));
+        } else {
+          arm_q31_to_q15(&block32[done * 2U], (q15_t *)dst, frames * 2U);
+        }
+        break;
+    }
+
+    haudio->capture_off += (uint16_t)frames;
+    done += frames;
+    if (haudio->capture_off == haudio->capture_len) {
+      /* A full ring drops the packet, the host stopped reading */
+      (void)AUDIO_RingCommit(&haudio->capture, (uint16_t)(haudio->capture_len * haudio->capture_frame_size));
+      haudio->capture_off = 0U;
+    }
+  }
+}
+
+/**
+ * @brief  USBD_AUDIO_ToneStage
+ *         Graph callbacks of the tone controls and AGC
+ * @param  ctx: AUDIO_ToneTypeDef
+ * @param  frames: interleaved stereo samples
+ * @param  n: number of frames
+ * @retval None
+ */
+static void USBD_AUDIO_ToneStage(void *ctx, float32_t *frames, uint32_t n) {
+  AUDIO_ToneProcess_f32((AUDIO_ToneTypeDef *)ctx, frames, n);
+}
+
+static uint8_t USBD_AUDIO_ToneStageActive(const void *ctx) {
+  return AUDIO_ToneActive((const AUDIO_ToneTypeDef *)ctx);
+}
+
+/**
+ * @brief  USBD_AUDIO_PeqStage
+ *         Graph callbacks of the parametric EQ
+ * @param  ctx: AUDIO_PeqTypeDef
+ * @param  frames: interleaved stereo samples
+ * @param  n: number of frames
+ * @retval None
+ */
+static void USBD_AUDIO_PeqStage(void *ctx, float32_t *frames, uint32_t n) {
+  AUDIO_PeqProcess_f32((AUDIO_PeqTypeDef *)ctx, frames, n);
+}
+
+static uint8_t USBD_AUDIO_PeqStageActive(const void *ctx) {
+  return AUDIO_PeqActive((const AUDIO_PeqTypeDef *)ctx);
+}
+
+/**
+ * @brief  USBD_AUDIO_LimitStage
+ *         Graph callbacks of the limiter
+ * @param  ctx: AUDIO_LimitTypeDef
+ * @param  frames: interleaved stereo samples
+ * @param  n: number of frames
+ * @retval None
+ */
+static void USBD_AUDIO_LimitStage(void *ctx, float32_t *frames, uint32_t n) {
+  AUDIO_LimitProcess_f32((AUDIO_LimitTypeDef *)ctx, frames, n);
+}
+
+static uint8_t USBD_AUDIO_LimitStageActive(const void *ctx) {
+  return ((const AUDIO_LimitTypeDef *)ctx)->on;
+}
+
+/**
+ * @brief  USBD_AUDIO_TapStage
+ *         Graph edge feeding the analyzer FIFO with the left channel of
+ *         the block as it is at this point of the graph
+ * @param  ctx: audio class handle
+ * @param  frames: interleaved stereo samples
+ * @param  n: number of frames
+ * @retval None
+ */
+static void USBD_AUDIO_TapStage(void *ctx, float32_t *frames, uint32_t n) {
+  AUDIO_FifoPush_f32(&USBD_AUDIO_Tap, frames, n);
+  ((USBD_AUDIO_HandleTypeDef *)ctx)->tapped = 1U;
+}
+
+/**
+ * @brief  USBD_AUDIO_RequantStage
+ *         Graph edge writing the block back to the I2S word: 16-bit output
+ *         dithered, or only rounded once the ramp to mute is over, wider
+ *         output saturated
+ * @param  ctx: audio class handle
+ * @param  frames: interleaved stereo samples
+ * @param  n: number of frames
+ * @retval None
+ */
+static void USBD_AUDIO_RequantStage(void *ctx, float32_t *frames, uint32_t n) {
+  USBD_AUDIO_HandleTypeDef *haudio = (USBD_AUDIO_HandleTypeDef *)ctx;
+
+  if (haudio->bit_depth != 16U) {
+    arm_float_to_q31(frames, (q31_t *)haudio->dsp_out, n * 2U);
+  } else if (USBD_AUDIO_Muted(haudio) != 0U) {
+    AUDIO_DitherRound_q15(frames, (int16_t *)haudio->dsp_out, n);
+    AUDIO_DitherReset(&haudio->dither);
+  } else {
+    AUDIO_DitherQuantize_q15(&haudio->dither, frames, (int16_t *)haudio->dsp_out, n);
+  }
+}
+
+/**
+ * @brief  USBD_AUDIO_DspInit
+ *         Set up the DSP stages and assemble them into the playback graph,
+ *         in processing order, the requantization last. Shared by both
+ *         class drivers.
+ * @param  haudio: audio class handle
+ * @retval None
+ */
+void USBD_AUDIO_DspInit(USBD_AUDIO_HandleTypeDef *haudio) {
+  AUDIO_ToneInit(&haudio->tone, USBD_AUDIO_FREQ);
+  AUDIO_PeqInit(&haudio->peq);
+  AUDIO_LimitInit(&haudio->limit, USBD_AUDIO_FREQ);
+  AUDIO_DitherInit(&haudio->dither, AUDIO_DITHER_DEFAULT);
+  haudio->dsp_cycles = 0U;
+
+  AUDIO_GraphInit(&haudio->graph);
+  (void)AUDIO_GraphAdd(&haudio->graph, AUDIO_STAGE_TONE, USBD_AUDIO_ToneStage, USBD_AUDIO_ToneStageActive,
+                       &haudio->tone);
+  (void)AUDIO_GraphAdd(&haudio->graph, AUDIO_STAGE_PEQ, USBD_AUDIO_PeqStage, USBD_AUDIO_PeqStageActive,
+                       &haudio->peq);
+  (void)AUDIO_GraphAdd(&haudio->graph, AUDIO_STAGE_LIMIT, USBD_AUDIO_LimitStage, USBD_AUDIO_LimitStageActive,
+                       &haudio->limit);
+  (void)AUDIO_GraphAddEdge(&haudio->graph, AUDIO_STAGE_TAP, USBD_AUDIO_TapStage, haudio);
+  (void)AUDIO_GraphAddEdge(&haudio->graph, AUDIO_STAGE_REQUANT, USBD_AUDIO_RequantStage, haudio);
+}
+
+/**
+ * @brief  USBD_AUDIO_DspActive
+ *         Whether the next block goes through USBD_AUDIO_DspBlock: for any
+ *         stage of the graph that would run, and in 16-bit mode as soon as
+ *         the samples stop being bit-exact, so that the volume and the
+ *         resampler work at full precision and the result is requantized
+ *         once, with dither. Once a ramp to mute is over, silence needs
+ *         neither: USBD_AUDIO_FillBlock writes the zeros itself.
+ * @param  haudio: audio class handle
+ * @retval 0 when the block is final once filled
+ */
+static uint8_t USBD_AUDIO_DspActive(const USBD_AUDIO_HandleTypeDef *haudio) {
+  if (AUDIO_GraphActive(&haudio->graph) != 0U) {
+    return 1U;
+  }
+  if (haudio->bit_depth != 16U || USBD_AUDIO_Muted(haudio) != 0U) {
+    return 0U;
+  }
+#if (USBD_AUDIO_ASRC == 1U)
+  return 1U;
+#else
+  return (uint8_t)(AUDIO_GainEqual(haudio->gain_cur, AUDIO_GAIN_UNITY) == 0U ||
+                   AUDIO_GainEqual(haudio->gain_next, AUDIO_GAIN_UNITY) == 0U);
+#endif /* USBD_AUDIO_ASRC */
+}
+
+/**
+ * @brief  USBD_AUDIO_DspBlock
+ *         Run the playback graph over an I2S block: convert to float, run
+ *         the stages, whose requantization edge writes the block back. In
+ *         16-bit mode the volume, or its ramp, is applied on the way in.
+ * @param  haudio: audio class handle
+ * @param  block: AUDIO_BLOCK_FRAMES stereo frames of the I2S buffer
+ * @retval None
+ */
+static void USBD_AUDIO_DspBlock(USBD_AUDIO_HandleTypeDef *haudio, void *block) {
+  uint32_t cycles = DWT->CYCCNT;
+
+  if (haudio->bit_depth == 16U) {
+#if (USBD_AUDIO_ASRC == 1U)
+    arm_q31_to_float(haudio->asrc_out, haudio->dsp_work, AUDIO_BLOCK_FRAMES * 2U);
+    if (AUDIO_GainEqual(haudio->gain_cur, haudio->gain_next) != 0U) {
+      arm_scale_f32(haudio->dsp_work, AUDIO_GainToFloat(haudio->gain_next), haudio->dsp_work,
+                    AUDIO_BLOCK_FRAMES * 2U);
+    } else {
+      AUDIO_GainRamp_f32(haudio->dsp_work, haudio->dsp_work, AUDIO_BLOCK_FRAMES, haudio->gain_cur,
+                         haudio->gain_next, AUDIO_BLOCK_FRAMES);
+    }
+#else
+    if (AUDIO_GainEqual(haudio->gain_cur, haudio->gain_next) != 0U) {
+      arm_q15_to_float((q15_t *)block, haudio->dsp_work, AUDIO_BLOCK_FRAMES * 2U);
+      arm_scale_f32(haudio->dsp_work, AUDIO_GainToFloat(haudio->gain_next), haudio->dsp_work,
+                    AUDIO_BLOCK_FRAMES * 2U);
+    } else {
+      /* Converted and ramped in one pass, on the dual-16 multiplies */
+      AUDIO_GainRamp_q15((const int16_t *)block, haudio->dsp_work, AUDIO_BLOCK_FRAMES, haudio->gain_cur,
+                         haudio->gain_next, AUDIO_BLOCK_FRAMES);
+    }
+#endif /* USBD_AUDIO_ASRC */
+  } else {
+    arm_q31_to_float((q31_t *)block, haudio->dsp_work, AUDIO_BLOCK_FRAMES * 2U);
+  }
+
+  haudio->dsp_out = block;
+  AUDIO_GraphProcess_f32(&haudio->graph, haudio->dsp_work, AUDIO_BLOCK_FRAMES);
+
+  cycles = DWT->CYCCNT - cycles;
+  if (cycles > haudio->dsp_cycles) {
+    haudio->dsp_cycles = cycles;
+  }
+}
+
+/**
+ * @brief  USBD_AUDIO_GainSettle
+ *         Close the gain ramp of a finished block. After a ramp to mute
+ *         the amplifier is released once the silence reaches the pins:
+ *         the DMA plays the other half of the buffer first, the limiter
+ *         lookahead delays it further.
+ * @param  haudio: audio class handle
+ * @retval None
+ */
+static void USBD_AUDIO_GainSettle(USBD_AUDIO_HandleTypeDef *haudio) {
+  if (AUDIO_GainEqual(haudio->gain_next, AUDIO_GAIN_MUTE) != 0U &&
+      AUDIO_GainEqual(haudio->gain_cur, AUDIO_GAIN_MUTE) == 0U) {
+    haudio->mute_hold = (uint8_t)(2U + (AUDIO_LimitLatency(&haudio->limit) + AUDIO_BLOCK_FRAMES - 1U) /
+                                           AUDIO_BLOCK_FRAMES);
+  } else if (haudio->mute_hold != 0U) {
+    haudio->mute_hold--;
+    if (haudio->mute_hold == 0U) {
+      HAL_GPIO_WritePin(SD_MODE_GPIO_Port, SD_MODE_Pin, GPIO_PIN_RESET);
+    }
+  }
+  haudio->gain_cur = haudio->gain_next;
+}
+
+/**
+ * @brief  USBD_AUDIO_ProcessBlock
+ *         Produce one I2S block from the receive ring, or from the silence
+ *         prefill ahead of it, then feed the loopback capture, the level
+ *         meter and the analyzer FIFO from the result
+ * @param  haudio: audio class handle
+ * @param  block: AUDIO_BLOCK_FRAMES stereo frames of the I2S buffer
+ * @retval None
+ */
+static void USBD_AUDIO_ProcessBlock(USBD_AUDIO_HandleTypeDef *haudio, void *block) {
+  int16_t *block16 = (int16_t *)block;
+  int32_t *block32 = (int32_t *)block;
+  AUDIO_FifoTypeDef *tap;
+
+  /* Volume and mute changes since the last block ramp in over this one */
+  haudio->gain_next = haudio->mute != 0U ? AUDIO_GAIN_MUTE : haudio->gain;
+  haudio->tapped = 0U;
+
+  if (haudio->prefill >= AUDIO_BLOCK_FRAMES && haudio->faded != 0U) {
+    (void)memset(block, 0, AUDIO_BLOCK_FRAMES * 2U * (haudio->bit_depth == 16U ? 2U : 4U));
+    /* The prefill stands for the queue the host has yet to build: it only drains once packets arrive */
+    if (haudio->ring.wr_count != 0U) {
+      haudio->prefill -= AUDIO_BLOCK_FRAMES;
+    }
+  } else {
+    uint8_t dsp = USBD_AUDIO_DspActive(haudio);
+    /* Silence inserted under a playing stream, see USBD_AUDIO_SetLatency:
+       this block fades out into it, the stream fades back in after it */
+    uint8_t gap = haudio->prefill >= AUDIO_BLOCK_FRAMES ? 1U : 0U;
+
+#if (USBD_AUDIO_ASRC == 1U)
+    /* Resampled 16-bit output always goes through the float stage */
+    USBD_AUDIO_FillBlock(haudio, block);
+#else
+    USBD_AUDIO_FillBlock(haudio, block, dsp);
+#endif /* USBD_AUDIO_ASRC */
+    if (dsp != 0U) {
+      USBD_AUDIO_DspBlock(haudio, block);
+    }
+    if (gap != 0U) {
+      haudio->prefill -= AUDIO_BLOCK_FRAMES;
+    }
+  }
+  USBD_AUDIO_GainSettle(haudio);
+
+  if (haudio->capture_alt != 0U) {
+    USBD_AUDIO_CaptureBlock(haudio, block);
+  }
+
+  /* Metered in one pass with the integer edge of the analyzer tap, for the blocks the graph did not feed it */
+  tap = haudio->tapped == 0U ? &USBD_AUDIO_Tap : NULL;
+  if (haudio->bit_depth == 16U) {
+    AUDIO_LevelBlock_q15(&haudio->level, block16, AUDIO_BLOCK_FRAMES, tap);
+  } else {
+    AUDIO_LevelBlock_q31(&haudio->level, block32, AUDIO_BLOCK_FRAMES, tap);
+  }
+}
+
+/**
+ * @brief  USBD_AUDIO_MeterInit
+ *         Give the SOF meter the exact I2S sample rate, as set up by the
+ *         last HAL_I2S_Init, in units of the SOF timer clock
+ * @param  haudio: audio class handle
+ * @retval None
+ */
+static void USBD_AUDIO_MeterInit(USBD_AUDIO_HandleTypeDef *haudio) {
+  uint32_t cfgr = hi2s2.Instance->I2SCFGR;
+  uint32_t chlen = (cfgr & SPI_I2SCFGR_CHLEN) != 0U ? 32U : 16U;
+  uint32_t div = (cfgr & SPI_I2SCFGR_I2SDIV) >> SPI_I2SCFGR_I2SDIV_Pos;
+
+  /* The linear prescaler is bypassed when I2SDIV is 0 */
+  div = div == 0U ? 1U : 2U * div + ((cfgr & SPI_I2SCFGR_ODD) != 0U ? 1U : 0U);
+
+  AUDIO_SofMeterInit(&haudio->meter, (uint32_t)HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_SPI123),
+                     2U * chlen * div, AUDIO_SofTimerGetClock());
+}
+
+/**
+ * @brief  USBD_AUDIO_LatencyFrames
+ *         Feedback setpoint for a latency target, never below two I2S
+ *         blocks plus one packet: the shallowest queue that cannot run dry
+ * @param  freq: sampling frequency, Hz
+ * @param  ms: latency target
+ * @retval frames
+ */
+static uint16_t USBD_AUDIO_LatencyFrames(uint32_t freq, uint32_t ms) {
+  uint32_t frames = ms * freq / 1000U;
+  uint32_t least = 2U * AUDIO_BLOCK_FRAMES + freq / 1000U + 1U;
+
+  return (uint16_t)(frames > least ? frames : least);
+}
+
+/**
+ * @brief  USBD_AUDIO_MixFirst
+ *         First Mixer Unit input channel of a multichannel format
+ * @param  channels: 4 or 6
+ * @retval input channel, from 0
+ */
+static uint32_t USBD_AUDIO_MixFirst(uint32_t channels) {
+  return channels == 4U ? 2U : 6U;
+}
+
+/**
+ * @brief  USBD_AUDIO_SetMixer
+ *         Set one Mixer Unit crosspoint, and the downmix matrix as well
+ *         when it belongs to the current format
+ * @param  haudio: audio class handle
+ * @param  in: input channel, from 0
+ * @param  out: output channel, from 0
+ * @param  volume: 8.8 dB, AUDIO_MIX_DB_SILENCE for none
+ * @retval None
+ */
+static void USBD_AUDIO_SetMixer(USBD_AUDIO_HandleTypeDef *haudio, uint32_t in, uint32_t out, int16_t volume) {
+  uint32_t first = USBD_AUDIO_MixFirst(haudio->channels);
+
+  haudio->mix_volume[in][out] = volume;
+  if (haudio->channels != 2U && in >= first && in < first + haudio->channels) {
+    AUDIO_MixSetGain(&haudio->mix, in - first, out, volume);
+  }
+}
+
+/**
+ * @brief  USBD_AUDIO_SetFormat
+ *         Switch the I2S data width and the DMA item size to match the
+ *         streaming alternate setting, and load the downmix of the
+ *         multichannel ones. Playback must be stopped.
+ * @param  haudio: audio class handle
+ * @param  alt: AUDIO_ALT_SETTING_16B to AUDIO_ALT_SETTING_SURROUND
+ * @retval status
+ */
+USBD_StatusTypeDef USBD_AUDIO_SetFormat(USBD_AUDIO_HandleTypeDef *haudio, uint8_t alt) {
+  uint32_t data_format;
+  uint32_t align;
+  uint32_t first;
+
+  haudio->channels = 2U;
+
+  switch (alt) {
+    case AUDIO_ALT_SETTING_QUAD:
+    case AUDIO_ALT_SETTING_SURROUND:
+      haudio->channels = alt == AUDIO_ALT_SETTING_QUAD ? 4U : 6U;
+      haudio->bit_depth = 16U;
+      haudio->frame_size = (uint8_t)(haudio->channels * 2U);
+      data_format = I2S_DATAFORMAT_16B;
+
+      /* Load the crosspoints of this format's Input Terminal */
+      AUDIO_MixInit(&haudio->mix, haudio->channels);
+      first = USBD_AUDIO_MixFirst(haudio->channels);
+      for (uint32_t in = first; in < first + haudio->channels; in++) {
+        USBD_AUDIO_SetMixer(haudio, in, 0U, haudio->mix_volume[in][0]);
+        USBD_AUDIO_SetMixer(haudio, in, 1U, haudio->mix_volume[in][1]);
+      }
+      break;
+
+    case AUDIO_ALT_SETTING_24B:
+      haudio->bit_depth = 24U;
+      haudio->frame_size = 6U;
+      data_format = I2S_DATAFORMAT_24B;
+      break;
+
+    case AUDIO_ALT_SETTING_32B:
+      haudio->bit_depth = 32U;
+      haudio->frame_size = 8U;
+      data_format = I2S_DATAFORMAT_32B;
+      break;
+
+    default:
+      haudio->bit_depth = 16U;
+      haudio->frame_size = 4U;
+      data_format = I2S_DATAFORMAT_16B;
+      break;
+  }
+
+  if (hi2s2.Init.DataFormat == data_format) {
+    return USBD_OK;
+  }
+
+  /* 24-bit samples are sent left-justified in a 32-bit word */
+  align = data_format == I2S_DATAFORMAT_16B ? DMA_PDATAALIGN_HALFWORD : DMA_PDATAALIGN_WORD;
+  hi2s2.hdmatx->Init.PeriphDataAlignment = align;
+  hi2s2.hdmatx->Init.MemDataAlignment = align == DMA_PDATAALIGN_WORD ? DMA_MDATAALIGN_WORD : DMA_MDATAALIGN_HALFWORD;
+  if (HAL_DMA_Init(hi2s2.hdmatx) != HAL_OK) {
+    return USBD_FAIL;
+  }
+
+  hi2s2.Init.DataFormat = data_format;
+  if (HAL_I2S_Init(&hi2s2) != HAL_OK) {
+    return USBD_FAIL;
+  }
+  USBD_AUDIO_MeterInit(haudio);
+
+  return USBD_OK;
+}
+
+/**
+ * @brief  USBD_AUDIO_SetFreq
+ *         Switch to a new sampling frequency: recompute the latency
+ *         setpoint and the DSP coefficients at once, and leave the I2S
+ *         kernel clock and dividers to USBD_AUDIO_Poll. Playback must be
+ *         stopped, it stays so until the clocks are retuned.
+ * @param  haudio: audio class handle
+ * @param  freq: one of the frequencies listed in the format descriptors, in Hz
+ * @retval status
+ */
+USBD_StatusTypeDef USBD_AUDIO_SetFreq(USBD_AUDIO_HandleTypeDef *haudio, uint32_t freq) {
+  if (freq != USBD_AUDIO_FREQ_44K && freq != USBD_AUDIO_FREQ_48K && freq != USBD_AUDIO_FREQ_96K) {
+    return USBD_FAIL;
+  }
+
+  haudio->freq = freq;
+  haudio->target_frames = USBD_AUDIO_LatencyFrames(freq, haudio->latency_ms);
+  AUDIO_ServoInit(&haudio->servo, freq);
+  AUDIO_ToneSetFreq(&haudio->tone, freq);
+  (void)AUDIO_LimitConfig(&haudio->limit, freq, haudio->limit.ceiling_db, haudio->limit.attack_us,
+                          haudio->limit.release_ms);
+  haudio->freq_pending = 1U;
 
-extern I2S_HandleTypeDef hi2s2;
+  return USBD_OK;
+}
+
+/**
+ * @brief  USBD_AUDIO_Poll
+ *         Thread mode part of a sampling frequency change, call it from
+ *         the main loop. Retuning PLL2 waits on HAL timeouts, which stall
+ *         inside the USB interrupt as SysTick has the lowest priority, and
+ *         PLL2 also clocks the LCD SPI: AUDIO_ClockConfig returns HAL_BUSY
+ *         while an LCD transfer is on and the change is retried on the
+ *         next call. Playback restarts once the I2S runs at the new rate.
+ * @param  pdev: device instance
+ * @retval None
+ */
+void USBD_AUDIO_Poll(USBD_HandleTypeDef *pdev) {
+  USBD_AUDIO_HandleTypeDef *haudio;
+  HAL_StatusTypeDef status;
+
+  haudio = (USBD_AUDIO_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
+  if (haudio == NULL || haudio->freq_pending == 0U) {
+    return;
+  }
+
+  /* Class requests, SET_INTERFACE included, wait while the I2S is reinitialized */
+  HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+  HAL_NVIC_DisableIRQ(OTG_FS_EP1_OUT_IRQn);
+  HAL_NVIC_DisableIRQ(OTG_FS_EP1_IN_IRQn);
+
+  status = AUDIO_ClockConfig(haudio->freq);
+  if (status == HAL_OK) {
+    hi2s2.Init.AudioFreq = haudio->freq;
+    status = HAL_I2S_Init(&hi2s2);
+    USBD_AUDIO_MeterInit(haudio);
+  }
+  if (status != HAL_BUSY) {
+    haudio->freq_pending = 0U;
+    if (status == HAL_OK && haudio->alt_setting != 0U) {
+      USBD_AUDIO_StartPlay(haudio);
+    }
+  }
+
+  HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+  HAL_NVIC_EnableIRQ(OTG_FS_EP1_OUT_IRQn);
+  HAL_NVIC_EnableIRQ(OTG_FS_EP1_IN_IRQn);
+}
 
-volatile float32_t *pSamples = NULL;
-volatile uint32_t nSamplesRead = 0;
-volatile uint32_t nSamples = 0;
+/**
+ * @brief  USBD_AUDIO_CaptureReset
+ *         Drop the queued loopback packets, the IN endpoint sends silence
+ *         until AUDIO_CAPTURE_PRIME_PACKETS are queued again
+ * @param  haudio: audio class handle
+ * @retval None
+ */
+static void USBD_AUDIO_CaptureReset(USBD_AUDIO_HandleTypeDef *haudio) {
+  AUDIO_RingReset(&haudio->capture);
+  haudio->capture_primed = 0U;
+  haudio->capture_off = 0U;
+  haudio->capture_acc = 0U;
+  haudio->capture_sent = 0U;
+}
 
-void AUDIO_WaitForSamples(float32_t *samples, uint32_t size) {
-  pSamples = samples;
-  nSamples = size;
-  nSamplesRead = 0;
-  while (nSamplesRead < nSamples) {
-    __NOP();
+/**
+ * @brief  USBD_AUDIO_SetCaptureFormat
+ *         Select the loopback sample width, independent of the playback one
+ * @param  haudio: audio class handle
+ * @param  alt: 0 to stop, AUDIO_ALT_SETTING_16B, AUDIO_ALT_SETTING_24B or AUDIO_ALT_SETTING_32B
+ * @retval None
+ */
+static void USBD_AUDIO_SetCaptureFormat(USBD_AUDIO_HandleTypeDef *haudio, uint8_t alt) {
+  switch (alt) {
+    case AUDIO_ALT_SETTING_24B:
+      haudio->capture_bit_depth = 24U;
+      break;
+
+    case AUDIO_ALT_SETTING_32B:
+      haudio->capture_bit_depth = 32U;
+      break;
+
+    default:
+      haudio->capture_bit_depth = 16U;
+      break;
   }
+  haudio->capture_frame_size = (uint8_t)(haudio->capture_bit_depth / 4U);
+  haudio->capture_alt = alt;
+
+  USBD_AUDIO_CaptureReset(haudio);
 }
 
 /**
- * @brief  USBD_AUDIO_ApplyVolumeControl
- *         apply volume control to sample
- * @param  sample: the sample value
- * @param  volume: target volume
- * @retval transformed sample
+ * @brief  USBD_AUDIO_CaptureSend
+ *         Queue the next loopback packet on the IN endpoint, straight from
+ *         its ring slot. Silence of the nominal size goes out while the
+ *         queue is priming, so the host sees a continuous stream.
+ * @param  pdev: device instance
+ * @param  haudio: audio class handle
+ * @retval None
  */
-static int16_t USBD_AUDIO_ApplyVolumeControl(int16_t sample, int16_t volume) {
-  if (volume > USBD_AUDIO_VOL_MAX) {
-    volume = USBD_AUDIO_VOL_MAX;
+static void USBD_AUDIO_CaptureSend(USBD_HandleTypeDef *pdev, USBD_AUDIO_HandleTypeDef *haudio) {
+  static uint8_t silence[AUDIO_OUT_PACKET_MAX];
+  uint8_t *data = silence;
+  uint16_t len = 0U;
+
+  if (haudio->capture_primed == 0U &&
+      haudio->capture.wr_slot - haudio->capture.rd_slot >= AUDIO_CAPTURE_PRIME_PACKETS) {
+    haudio->capture_primed = 1U;
   }
-  if (volume < USBD_AUDIO_VOL_MIN) {
-    volume = USBD_AUDIO_VOL_MIN;
+  if (haudio->capture_primed != 0U) {
+    len = AUDIO_RingPeek(&haudio->capture, &data);
+    if (len == 0U) {
+      /* Drained: prime again rather than send one packet at a time */
+      haudio->capture_primed = 0U;
+      data = silence;
+    }
   }
-  /* Get number of shifts, round half-up */
-  int16_t shifts = (USBD_AUDIO_VOL_MAX - volume + (USBD_AUDIO_VOL_RES / 2)) / USBD_AUDIO_VOL_RES;
-  int16_t shifts2 = shifts >> 1;
-  if (shifts & 1) {
-    sample >>= shifts2;
-    sample += (sample >> 1);
-  } else {
-    sample >>= shifts2;
+
+  /* Released once the transfer is done, in USBD_AUDIO_DataIn */
+  haudio->capture_sent = len;
+  if (len == 0U) {
+    len = (uint16_t)((haudio->freq / 1000U) * haudio->capture_frame_size);
   }
-  return sample;
+  haudio->capture_busy = 1U;
+  USBD_LL_Transmit(pdev, AUDIOCaptureEpAdd, data, len);
 }
 
 /**
@@ -337,7 +1661,7 @@ static int16_t USBD_AUDIO_ApplyVolumeControl(int16_t sample, int16_t volume) {
  * @param  pdev: device instance
  * @retval status
  */
-static USBD_StatusTypeDef USBD_AUDIO_StopPlay(USBD_HandleTypeDef *pdev) {
+USBD_StatusTypeDef USBD_AUDIO_StopPlay(USBD_HandleTypeDef *pdev) {
   USBD_AUDIO_HandleTypeDef *haudio;
 
   haudio = (USBD_AUDIO_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
@@ -350,12 +1674,447 @@ static USBD_StatusTypeDef USBD_AUDIO_StopPlay(USBD_HandleTypeDef *pdev) {
   HAL_GPIO_WritePin(SD_MODE_GPIO_Port, SD_MODE_Pin, GPIO_PIN_RESET);
 
   haudio->playing = 0U;
-  haudio->wr_ptr = 0U;
-  haudio->rd_ptr = 0U;
+  haudio->mute_hold = 0U;
+  AUDIO_LevelReset(&haudio->level);
+  haudio->overruns += haudio->ring.overruns;
+  AUDIO_RingReset(&haudio->ring);
+  AUDIO_ServoReset(&haudio->servo);
+  USBD_AUDIO_CaptureReset(haudio);
+#if (USBD_AUDIO_ASRC == 1U)
+  AUDIO_AsrcReset(&haudio->asrc);
+#endif /* USBD_AUDIO_ASRC */
+  AUDIO_ToneReset(&haudio->tone);
+  AUDIO_PeqReset(&haudio->peq);
+  AUDIO_LimitReset(&haudio->limit);
+  AUDIO_DitherReset(&haudio->dither);
+  (void)memset(haudio->pcm, 0, sizeof(haudio->pcm));
+
+  return USBD_OK;
+}
+
+/**
+ * @brief  USBD_AUDIO_GetQueuedFrames
+ *         Frames received but not yet shifted out: the ring fill plus what
+ *         is left in the I2S DMA buffer, plus the pending silence prefill
+ * @param  haudio: audio class handle
+ * @retval frames
+ */
+static uint32_t USBD_AUDIO_GetQueuedFrames(USBD_AUDIO_HandleTypeDef *haudio) {
+  uint32_t queued = AUDIO_RingFill(&haudio->ring) / haudio->frame_size + haudio->prefill;
+
+  if (haudio->playing != 0U) {
+    /* One DMA item per sample, whatever the sample width */
+    uint32_t remaining = ((DMA_Stream_TypeDef *)hi2s2.hdmatx->Instance)->NDTR / 2U;
+    /* While the second half plays, the first one has already been refilled */
+    queued += remaining <= AUDIO_BLOCK_FRAMES ? remaining + AUDIO_BLOCK_FRAMES : remaining;
+  }
+
+  return queued;
+}
+
+/**
+ * @brief  USBD_AUDIO_SetLatency
+ *         Select the playback latency target. While playing, the queue
+ *         jumps to the new depth at once rather than through the servo:
+ *         silence is inserted in whole blocks to deepen it, the oldest
+ *         queued frames are dropped to shorten it. Either way the jump is
+ *         concealed like an underrun, the stream fades out into one block
+ *         of silence and fades back in after it.
+ * @param  haudio: audio class handle
+ * @param  ms: AUDIO_LATENCY_MS_MIN..AUDIO_LATENCY_MS_MAX
+ * @retval None
+ */
+static void USBD_AUDIO_SetLatency(USBD_AUDIO_HandleTypeDef *haudio, uint8_t ms) {
+  uint32_t target = USBD_AUDIO_LatencyFrames(haudio->freq, ms);
+  uint32_t queued;
+  uint32_t excess;
+  uint8_t *data;
+
+  haudio->latency_ms = ms;
+  haudio->target_frames = (uint16_t)target;
+  haudio->queued_min = UINT16_MAX;
+  haudio->queued_max = 0U;
+
+  if (haudio->playing == 0U) {
+    return;
+  }
+
+  queued = USBD_AUDIO_GetQueuedFrames(haudio);
+  if (target > queued) {
+    /* Silence ahead of the ring, the next block fades out into it and
+       the received frames fade back in after it */
+    haudio->prefill += (uint16_t)((target - queued) / AUDIO_BLOCK_FRAMES * AUDIO_BLOCK_FRAMES);
+    return;
+  }
+
+  /* Pending silence goes first, in whole blocks, then received frames */
+  excess = queued - target;
+  while (excess >= AUDIO_BLOCK_FRAMES && haudio->prefill >= AUDIO_BLOCK_FRAMES) {
+    haudio->prefill -= AUDIO_BLOCK_FRAMES;
+    excess -= AUDIO_BLOCK_FRAMES;
+  }
+  if (excess > 0U && haudio->faded == 0U) {
+    /* The skip hides behind a block of silence that replaces one more block of frames */
+    haudio->prefill += AUDIO_BLOCK_FRAMES;
+    excess += AUDIO_BLOCK_FRAMES;
+  }
+  while (excess > 0U) {
+    uint32_t run = AUDIO_RingPeek(&haudio->ring, &data) / haudio->frame_size;
+    if (run == 0U) {
+      break;
+    }
+    if (run > excess) {
+      run = excess;
+    }
+    AUDIO_RingConsume(&haudio->ring, (uint16_t)(run * haudio->frame_size));
+    excess -= run;
+  }
+}
+
+/**
+ * @brief  USBD_AUDIO_FramesToUs
+ *         Queue depth in microseconds at the current sampling frequency
+ * @param  haudio: audio class handle
+ * @param  frames: frames
+ * @retval microseconds
+ */
+static uint32_t USBD_AUDIO_FramesToUs(USBD_AUDIO_HandleTypeDef *haudio, uint32_t frames) {
+  return (uint32_t)((uint64_t)frames * 1000000U / haudio->freq);
+}
+
+/**
+ * @brief  USBD_AUDIO_VendorReq
+ *         AUDIO_VENDOR_REQ_LATENCY: without data stage, select the target
+ *         given in wValue (ms); device to host, report the target and the
+ *         device-side queue depth, as USBD_AUDIO_LatencyTypeDef.
+ *         AUDIO_VENDOR_REQ_XRUN: report the stream health counters.
+ *         AUDIO_VENDOR_REQ_PEQ_BAND: host to device, stage one EQ band,
+ *         see USBD_AUDIO_VendorRxReady; device to host, read it back from
+ *         the set in use.
+ *         AUDIO_VENDOR_REQ_PEQ_COMMIT: without data stage, run the staged
+ *         set from the next block on.
+ *         AUDIO_VENDOR_REQ_LIMITER: host to device, set the limiter, see
+ *         USBD_AUDIO_VendorRxReady; device to host, report its settings,
+ *         the latency it adds and the cost of the DSP stage.
+ *         AUDIO_VENDOR_REQ_DITHER: without data stage, select how 16-bit
+ *         output is requantized; device to host, report it.
+ *         AUDIO_VENDOR_REQ_STAGE: without data stage, bypass a stage of
+ *         the playback graph or put it back, any but the requantization;
+ *         device to host, list them.
+ *         AUDIO_VENDOR_REQ_LEVEL: report the output level meter.
+ * @param  pdev: device instance
+ * @param  haudio: audio class handle
+ * @param  req: vendor request, recipient interface
+ * @retval status
+ */
+USBD_StatusTypeDef USBD_AUDIO_VendorReq(USBD_HandleTypeDef *pdev, USBD_AUDIO_HandleTypeDef *haudio,
+                                        USBD_SetupReqTypedef *req) {
+  USBD_AUDIO_LatencyTypeDef *report;
+  USBD_AUDIO_XrunTypeDef *xrun;
+  USBD_AUDIO_LimiterTypeDef *limiter;
+  USBD_AUDIO_StageTypeDef *stages;
+  USBD_AUDIO_LevelTypeDef *level;
+  AUDIO_LevelSnapshotTypeDef snap;
+  AUDIO_StageTypeDef *stage;
+  float32_t coef[5];
+
+  if (req->bRequest == AUDIO_VENDOR_REQ_PEQ_BAND) {
+    if (HIBYTE(req->wValue) >= AUDIO_PEQ_CHANNELS || LOBYTE(req->wValue) >= AUDIO_PEQ_BANDS_MAX) {
+      return USBD_FAIL;
+    }
+    if ((req->bmRequest & 0x80U) == 0U) {
+      if (req->wLength != sizeof(USBD_AUDIO_PeqBandTypeDef)) {
+        return USBD_FAIL;
+      }
+      haudio->setup_req = *req;
+      return USBD_CtlPrepareRx(pdev, haudio->setup_data, sizeof(USBD_AUDIO_PeqBandTypeDef));
+    }
+    AUDIO_PeqGetBand(&haudio->peq, HIBYTE(req->wValue), LOBYTE(req->wValue), coef);
+    (void)memcpy(haudio->setup_data, coef, sizeof(coef));
+    return USBD_CtlSendData(pdev, haudio->setup_data, MIN(req->wLength, sizeof(USBD_AUDIO_PeqBandTypeDef)));
+  }
+
+  if (req->bRequest == AUDIO_VENDOR_REQ_PEQ_COMMIT && (req->bmRequest & 0x80U) == 0U) {
+    if (req->wLength != 0U || AUDIO_PeqCommit(&haudio->peq, LOBYTE(req->wValue), HIBYTE(req->wValue)) == 0U) {
+      return USBD_FAIL;
+    }
+    return USBD_OK;
+  }
+
+  if (req->bRequest == AUDIO_VENDOR_REQ_LIMITER) {
+    if ((req->bmRequest & 0x80U) == 0U) {
+      if (req->wLength != sizeof(USBD_AUDIO_LimiterTypeDef)) {
+        return USBD_FAIL;
+      }
+      haudio->setup_req = *req;
+      return USBD_CtlPrepareRx(pdev, haudio->setup_data, sizeof(USBD_AUDIO_LimiterTypeDef));
+    }
+    limiter = (USBD_AUDIO_LimiterTypeDef *)haudio->setup_data;
+    limiter->enable = haudio->limit.on;
+    limiter->ceiling = haudio->limit.ceiling_db;
+    limiter->attack_us = haudio->limit.attack_us;
+    limiter->release_ms = haudio->limit.release_ms;
+    limiter->latency_us = haudio->limit.on != 0U ? USBD_AUDIO_FramesToUs(haudio, AUDIO_LimitLatency(&haudio->limit))
+                                                 : 0U;
+    limiter->dsp_cycles = haudio->dsp_cycles;
+    return USBD_CtlSendData(pdev, haudio->setup_data, MIN(req->wLength, sizeof(USBD_AUDIO_LimiterTypeDef)));
+  }
+
+  if (req->bRequest == AUDIO_VENDOR_REQ_DITHER) {
+    if ((req->bmRequest & 0x80U) == 0U) {
+      if (req->wLength != 0U || req->wValue > AUDIO_DITHER_SHAPED) {
+        return USBD_FAIL;
+      }
+      haudio->dither.mode = (uint8_t)req->wValue;
+      AUDIO_DitherReset(&haudio->dither);
+      return USBD_OK;
+    }
+    haudio->setup_data[0] = haudio->dither.mode;
+    return USBD_CtlSendData(pdev, haudio->setup_data, MIN(req->wLength, 1U));
+  }
+
+  if (req->bRequest == AUDIO_VENDOR_REQ_STAGE) {
+    if ((req->bmRequest & 0x80U) == 0U) {
+      stage = AUDIO_GraphFind(&haudio->graph, HIBYTE(req->wValue));
+      if (req->wLength != 0U || stage == NULL || stage->id == AUDIO_STAGE_REQUANT) {
+        return USBD_FAIL;
+      }
+      stage->bypass = (uint8_t)(LOBYTE(req->wValue) != 0U);
+      return USBD_OK;
+    }
+    stages = (USBD_AUDIO_StageTypeDef *)haudio->setup_data;
+    for (uint32_t i = 0U; i < haudio->graph.count; i++) {
+      stage = &haudio->graph.stage[i];
+      stages[i].id = stage->id;
+      stages[i].bypass = stage->bypass;
+      stages[i].active = AUDIO_StageRuns(stage);
+      stages[i].cycles = stage->cycles;
+    }
+    return USBD_CtlSendData(pdev, haudio->setup_data,
+                            MIN(req->wLength, haudio->graph.count * sizeof(USBD_AUDIO_StageTypeDef)));
+  }
+
+  if (req->bRequest == AUDIO_VENDOR_REQ_LEVEL && (req->bmRequest & 0x80U) != 0U) {
+    AUDIO_LevelRead(&haudio->level, &snap);
+    level = (USBD_AUDIO_LevelTypeDef *)haudio->setup_data;
+    for (uint32_t ch = 0U; ch < AUDIO_LEVEL_CHANNELS; ch++) {
+      level->peak[ch] = snap.peak[ch];
+      level->rms[ch] = snap.rms[ch];
+      level->clips[ch] = snap.clips[ch];
+    }
+    level->blocks = snap.blocks;
+    return USBD_CtlSendData(pdev, haudio->setup_data, MIN(req->wLength, sizeof(USBD_AUDIO_LevelTypeDef)));
+  }
+
+  if (req->bRequest == AUDIO_VENDOR_REQ_XRUN && (req->bmRequest & 0x80U) != 0U) {
+    xrun = (USBD_AUDIO_XrunTypeDef *)haudio->setup_data;
+    xrun->underruns = haudio->underruns;
+    xrun->overruns = haudio->overruns + haudio->ring.overruns;
+    xrun->dropouts = haudio->dropouts;
+    return USBD_CtlSendData(pdev, haudio->setup_data, MIN(req->wLength, sizeof(USBD_AUDIO_XrunTypeDef)));
+  }
+
+  if (req->bRequest != AUDIO_VENDOR_REQ_LATENCY) {
+    return USBD_FAIL;
+  }
+
+  if ((req->bmRequest & 0x80U) == 0U) {
+    if (req->wLength != 0U || req->wValue < AUDIO_LATENCY_MS_MIN || req->wValue > AUDIO_LATENCY_MS_MAX) {
+      return USBD_FAIL;
+    }
+    USBD_AUDIO_SetLatency(haudio, (uint8_t)req->wValue);
+    return USBD_OK;
+  }
+
+  report = (USBD_AUDIO_LatencyTypeDef *)haudio->setup_data;
+  report->target_ms = haudio->latency_ms;
+  report->target_frames = haudio->target_frames;
+  report->queued_us = USBD_AUDIO_FramesToUs(haudio, haudio->queued);
+  /* No sample yet since the last reset: report the minimum as 0 */
+  report->queued_min_us = haudio->queued_max != 0U ? USBD_AUDIO_FramesToUs(haudio, haudio->queued_min) : 0U;
+  report->queued_max_us = USBD_AUDIO_FramesToUs(haudio, haudio->queued_max);
+
+  return USBD_CtlSendData(pdev, haudio->setup_data, MIN(req->wLength, sizeof(USBD_AUDIO_LatencyTypeDef)));
+}
+
+/**
+ * @brief  USBD_AUDIO_VendorRxReady
+ *         Data stages of AUDIO_VENDOR_REQ_PEQ_BAND and
+ *         AUDIO_VENDOR_REQ_LIMITER, checked in USBD_AUDIO_VendorReq.
+ *         An unstable band or out of range limiter settings are dropped:
+ *         the status stage cannot refuse them, reading back shows what
+ *         the audio path runs.
+ * @param  haudio: audio class handle
+ * @param  req: vendor request, recipient interface
+ * @retval None
+ */
+void USBD_AUDIO_VendorRxReady(USBD_AUDIO_HandleTypeDef *haudio, USBD_SetupReqTypedef *req) {
+  USBD_AUDIO_LimiterTypeDef limiter;
+  float32_t coef[5];
+
+  if (req->bRequest == AUDIO_VENDOR_REQ_PEQ_BAND) {
+    (void)memcpy(coef, haudio->setup_data, sizeof(coef));
+    (void)AUDIO_PeqSetBand(&haudio->peq, HIBYTE(req->wValue), LOBYTE(req->wValue), coef);
+  } else if (req->bRequest == AUDIO_VENDOR_REQ_LIMITER) {
+    (void)memcpy(&limiter, haudio->setup_data, sizeof(limiter));
+    /* Restarting empties the delay line, only do it on a change */
+    if ((limiter.enable != 0U) != (haudio->limit.on != 0U) || limiter.ceiling != haudio->limit.ceiling_db ||
+        limiter.attack_us != haudio->limit.attack_us || limiter.release_ms != haudio->limit.release_ms) {
+      if (AUDIO_LimitConfig(&haudio->limit, haudio->freq, limiter.ceiling, limiter.attack_us, limiter.release_ms) !=
+          0U) {
+        haudio->limit.on = (uint8_t)(limiter.enable != 0U);
+      }
+    }
+  }
+}
+
+/**
+ * @brief  USBD_AUDIO_GetFeedback
+ *         Rate the host should send at, in samples per frame: the servo
+ *         output for the current distance of the queue from the latency target,
+ *         around the rate measured from the SOF timestamps once known.
+ *         With USBD_AUDIO_ASRC the resampler step follows it as well.
+ * @param  haudio: audio class handle
+ * @param  fnsof: current frame number
+ * @param  frames: USB frames elapsed since the previous call
+ * @param  frac_bits: fractional bits of the result, 14 for 10.14, 16 for 16.16
+ * @retval feedback value
+ */
+uint32_t USBD_AUDIO_GetFeedback(USBD_AUDIO_HandleTypeDef *haudio, uint16_t fnsof, uint32_t frames, uint32_t frac_bits) {
+  uint32_t queued;
+  int32_t error;
+  uint32_t fb;
+
+  if (AUDIO_SofMeterUpdate(&haudio->meter, AUDIO_SOF_TIM->CCR1, fnsof) != 0U) {
+    if (haudio->meter.windows == 1U) {
+      /* The measurement replaces the drift estimate, restart the loop around it */
+      AUDIO_ServoInit(&haudio->servo, haudio->freq);
+    }
+    AUDIO_ServoSetNominal(&haudio->servo, haudio->meter.rate);
+  }
+
+  if (haudio->playing == 0U || haudio->ring.wr_count == 0U) {
+    /* Nothing is consumed yet: hold the drift estimate */
+    return AUDIO_ServoUpdate(&haudio->servo, 0, 0U, frac_bits);
+  }
+
+  queued = USBD_AUDIO_GetQueuedFrames(haudio);
+  haudio->queued = (uint16_t)queued;
+  if (haudio->queued < haudio->queued_min) {
+    haudio->queued_min = haudio->queued;
+  }
+  if (haudio->queued > haudio->queued_max) {
+    haudio->queued_max = haudio->queued;
+  }
+
+  error = (int32_t)queued - (int32_t)haudio->target_frames;
+  fb = AUDIO_ServoUpdate(&haudio->servo, error, frames, frac_bits);
+
+#if (USBD_AUDIO_ASRC == 1U)
+  /* A host that ignores the feedback keeps sending the nominal rate:
+     consume nominal / fb input frames per output frame instead */
+  AUDIO_AsrcSetStep(&haudio->asrc, ((((uint64_t)haudio->freq << 16) / 1000U) << 32) /
+                                   ((uint64_t)fb << (16U - frac_bits)));
+#endif /* USBD_AUDIO_ASRC */
+
+  return fb;
+}
+
+/**
+ * @brief  USBD_AUDIO_StartPlay
+ *         Start the I2S stream at once on silence: the queue starts at the
+ *         latency target, two blocks in the DMA buffer and the rest as
+ *         prefill the received packets take over from
+ * @param  haudio: audio class handle
+ * @retval None
+ */
+void USBD_AUDIO_StartPlay(USBD_AUDIO_HandleTypeDef *haudio) {
+  /* Not before USBD_AUDIO_Poll has retuned the I2S to the new rate */
+  if (haudio->playing != 0U || haudio->freq_pending != 0U) {
+    return;
+  }
+
+  haudio->prefill = (uint16_t)(haudio->target_frames / AUDIO_BLOCK_FRAMES * AUDIO_BLOCK_FRAMES -
+                               2U * AUDIO_BLOCK_FRAMES);
+  haudio->queued_min = UINT16_MAX;
+  haudio->queued_max = 0U;
+  /* Silence first, the stream fades in over it */
+  haudio->faded = 1U;
+  haudio->gain_cur = haudio->mute != 0U ? AUDIO_GAIN_MUTE : haudio->gain;
+  haudio->mute_hold = 0U;
+
+  /* Start DMA Transfer (one item per sample) */
+  (void)memset(haudio->pcm, 0, sizeof(haudio->pcm));
+  HAL_I2S_Transmit_DMA(&hi2s2, (uint16_t *)haudio->pcm, 2U * AUDIO_BLOCK_FRAMES * 2U);
+  HAL_GPIO_WritePin(SD_MODE_GPIO_Port, SD_MODE_Pin, haudio->mute != 0U ? GPIO_PIN_RESET : GPIO_PIN_SET);
+
+  haudio->playing = 1U;
+}
+
+/**
+ * @brief  USBD_AUDIO_SetMute
+ *         Apply the Feature Unit mute. Muting ramps the gain to silence
+ *         over the next block and only then releases SD_MODE, see
+ *         USBD_AUDIO_GainSettle; unmuting enables the amplifier first and
+ *         ramps up from silence. Toggling the pin under signal pops.
+ * @param  haudio: audio class handle
+ * @param  mute: 0 to unmute
+ * @retval None
+ */
+void USBD_AUDIO_SetMute(USBD_AUDIO_HandleTypeDef *haudio, uint8_t mute) {
+  haudio->mute = mute;
+
+  if (haudio->playing == 0U) {
+    /* StartPlay enables the amplifier */
+    return;
+  }
+  if (mute == 0U) {
+    haudio->mute_hold = 0U;
+    HAL_GPIO_WritePin(SD_MODE_GPIO_Port, SD_MODE_Pin, GPIO_PIN_SET);
+  }
+}
+
+/**
+ * @brief  USBD_AUDIO_ReadLevel
+ *         Output level for the display, from thread mode
+ * @param  pdev: device instance
+ * @param  snap: copy of the last published level snapshot
+ * @retval USBD_FAIL before the class is initialized
+ */
+USBD_StatusTypeDef USBD_AUDIO_ReadLevel(USBD_HandleTypeDef *pdev, AUDIO_LevelSnapshotTypeDef *snap) {
+  USBD_AUDIO_HandleTypeDef *haudio;
+
+  haudio = (USBD_AUDIO_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
+  if (haudio == NULL) {
+    return USBD_FAIL;
+  }
 
+  AUDIO_LevelRead(&haudio->level, snap);
   return USBD_OK;
 }
 
+/**
+ * @brief  USBD_AUDIO_Receive
+ *         Publish a received OUT packet
+ * @param  haudio: audio class handle
+ * @param  len: packet length in bytes
+ * @retval None
+ */
+void USBD_AUDIO_Receive(USBD_AUDIO_HandleTypeDef *haudio, uint16_t len) {
+  /* Packets at the new rate are dropped until the I2S runs at it */
+  if (haudio->freq_pending != 0U) {
+    return;
+  }
+
+  /* Publish the raw packet, processing happens in USBD_AUDIO_Sync. The
+     consumers only take whole frames, a trailing partial frame would sit
+     in its slot forever and stall playback, so it is dropped here */
+  AUDIO_RingCommit(&haudio->ring, (uint16_t)(len - len % haudio->frame_size));
+
+  /* Playback normally starts on SET_INTERFACE, this catches a stream the host left running */
+  USBD_AUDIO_StartPlay(haudio);
+}
+
 /**
  * @brief  USBD_AUDIO_Init
  *         Initialize the AUDIO interface
@@ -383,7 +2142,7 @@ static uint8_t USBD_AUDIO_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx) {
 #endif /* USE_USBD_COMPOSITE */
 
   /* Open EP OUT */
-  USBD_LL_OpenEP(pdev, AUDIOOutEpAdd, USBD_EP_TYPE_ISOC, AUDIO_OUT_PACKET);
+  USBD_LL_OpenEP(pdev, AUDIOOutEpAdd, USBD_EP_TYPE_ISOC, AUDIO_OUT_PACKET_MAX);
   pdev->ep_out[AUDIOOutEpAdd & 0xFU].is_used = 1U;
   pdev->ep_out[AUDIOOutEpAdd & 0xFU].bInterval = 1U;
 
@@ -395,19 +2154,44 @@ static uint8_t USBD_AUDIO_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx) {
   /* Flush feedback endpoint */
   USBD_LL_FlushEP(pdev, AUDIO_IN_EP);
 
+  /* Open EP IN of the loopback capture */
+  USBD_LL_OpenEP(pdev, AUDIOCaptureEpAdd, USBD_EP_TYPE_ISOC, AUDIO_OUT_PACKET_MAX);
+  pdev->ep_in[AUDIOCaptureEpAdd & 0xFU].is_used = 1U;
+  pdev->ep_in[AUDIOCaptureEpAdd & 0xFU].bInterval = 1U;
+
   haudio->alt_setting = 0U;
   haudio->playing = 0U;
-  haudio->wr_ptr = 0U;
-  haudio->rd_ptr = 0U;
+  haudio->faded = 1U;
+  haudio->underruns = 0U;
+  haudio->overruns = 0U;
+  haudio->dropouts = 0U;
+  (void)memcpy(haudio->mix_volume, USBD_AUDIO_MixDefault, sizeof(haudio->mix_volume));
+  (void)USBD_AUDIO_SetFormat(haudio, AUDIO_ALT_SETTING_16B);
+  haudio->dataout_cycles = 0U;
+  haudio->sync_cycles = 0U;
+  AUDIO_RingReset(&haudio->ring);
+#if (USBD_AUDIO_ASRC == 1U)
+  AUDIO_AsrcReset(&haudio->asrc);
+#endif /* USBD_AUDIO_ASRC */
   haudio->mute = 0;
   haudio->volume = USBD_AUDIO_VOL_MAX;
+  haudio->gain = AUDIO_GainFromVolume(haudio->volume);
+  haudio->gain_cur = haudio->gain;
+  haudio->gain_next = haudio->gain;
+  haudio->mute_hold = 0U;
+  USBD_AUDIO_DspInit(haudio);
+  AUDIO_LevelInit(&haudio->level);
 
   haudio->fb_fnsof = 0;
-  haudio->fb_value_norm = 48UL << 14;
-  haudio->fb_value = haudio->fb_value_norm;
+  haudio->fb_value = 0U;
+  haudio->latency_ms = USBD_AUDIO_LATENCY_MS;
+  haudio->queued = 0U;
+  (void)USBD_AUDIO_SetFreq(haudio, USBD_AUDIO_FREQ);
+  USBD_AUDIO_SetCaptureFormat(haudio, 0U);
+  haudio->capture_busy = 0U;
 
   /* Prepare Out endpoint to receive 1st packet */
-  USBD_LL_PrepareReceive(pdev, AUDIOOutEpAdd, haudio->buffer, AUDIO_OUT_PACKET);
+  USBD_LL_PrepareReceive(pdev, AUDIOOutEpAdd, AUDIO_RingWriteSlot(&haudio->ring), AUDIO_OUT_PACKET_MAX);
 
   return (uint8_t)USBD_OK;
 }
@@ -442,6 +2226,14 @@ static uint8_t USBD_AUDIO_DeInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx) {
   pdev->ep_in[AUDIOInEpAdd & 0xFU].is_used = 0U;
   pdev->ep_in[AUDIOInEpAdd & 0xFU].bInterval = 0U;
 
+  /* Close EP IN of the loopback capture */
+  USBD_LL_CloseEP(pdev, AUDIOCaptureEpAdd);
+  pdev->ep_in[AUDIOCaptureEpAdd & 0xFU].is_used = 0U;
+  pdev->ep_in[AUDIOCaptureEpAdd & 0xFU].bInterval = 0U;
+
+  /* Stop the I2S DMA and release SD_MODE while the handle is still there */
+  USBD_AUDIO_StopPlay(pdev);
+
   /* DeInit  physical Interface components */
   if (pdev->pClassDataCmsit[pdev->classId] != NULL) {
     USBD_free(pdev->pClassDataCmsit[pdev->classId]);
@@ -449,11 +2241,116 @@ static uint8_t USBD_AUDIO_DeInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx) {
     pdev->pClassData = NULL;
   }
 
-  USBD_AUDIO_StopPlay(pdev);
-
   return (uint8_t)USBD_OK;
 }
 
+/**
+ * @brief  USBD_AUDIO_MixerReq
+ *         Mixer Unit control requests, wValue holds the input channel in
+ *         its high byte and the output channel in its low byte, from 1.
+ *         The stereo crosspoints are fixed, SET_CUR is refused there.
+ * @param  pdev: device instance
+ * @param  haudio: audio class handle
+ * @param  req: class request to AUDIO_MIXER_UNIT_ID
+ * @retval status
+ */
+static USBD_StatusTypeDef USBD_AUDIO_MixerReq(USBD_HandleTypeDef *pdev, USBD_AUDIO_HandleTypeDef *haudio,
+                                              USBD_SetupReqTypedef *req) {
+  uint32_t in = HIBYTE(req->wValue);
+  uint32_t out = LOBYTE(req->wValue);
+  int16_t value;
+
+  if (in == 0U || in > AUDIO_MIX_IN_CHANNELS || out == 0U || out > 2U) {
+    return USBD_FAIL;
+  }
+
+  switch (req->bRequest) {
+    case AUDIO_REQ_SET_CUR:
+      if (in <= 2U || req->wLength != 2U) {
+        return USBD_FAIL;
+      }
+      haudio->setup_req = *req;
+      return USBD_CtlPrepareRx(pdev, haudio->setup_data, 2U);
+
+    case AUDIO_REQ_GET_CUR:
+      value = haudio->mix_volume[in - 1U][out - 1U];
+      break;
+
+    case AUDIO_REQ_GET_MIN:
+      value = (int16_t)USBD_AUDIO_VOL_MIN;
+      break;
+
+    case AUDIO_REQ_GET_MAX:
+      value = (int16_t)USBD_AUDIO_VOL_MAX;
+      break;
+
+    case AUDIO_REQ_GET_RES:
+      value = (int16_t)USBD_AUDIO_VOL_RES;
+      break;
+
+    default:
+      return USBD_FAIL;
+  }
+
+  haudio->setup_data[0] = LOBYTE(value);
+  haudio->setup_data[1] = HIBYTE(value);
+  return USBD_CtlSendData(pdev, haudio->setup_data, MIN(req->wLength, 2U));
+}
+
+/**
+ * @brief  USBD_AUDIO_ToneReq
+ *         Bass, Mid, Treble and AGC requests to the Feature Unit, master
+ *         channel only. The bands are one signed byte in 0.25 dB steps,
+ *         the AGC one boolean byte.
+ * @param  pdev: device instance
+ * @param  haudio: audio class handle
+ * @param  req: class request, control selector in the high byte of wValue
+ * @retval status
+ */
+static USBD_StatusTypeDef USBD_AUDIO_ToneReq(USBD_HandleTypeDef *pdev, USBD_AUDIO_HandleTypeDef *haudio,
+                                             USBD_SetupReqTypedef *req) {
+  uint8_t cs = HIBYTE(req->wValue);
+  int8_t value;
+
+  if (LOBYTE(req->wValue) != 0U || req->wLength == 0U) {
+    return USBD_FAIL;
+  }
+
+  /* AGC has no range */
+  if (cs == AUDIO_FU_AGC_CONTROL && req->bRequest != AUDIO_REQ_SET_CUR && req->bRequest != AUDIO_REQ_GET_CUR) {
+    return USBD_FAIL;
+  }
+
+  switch (req->bRequest) {
+    case AUDIO_REQ_SET_CUR:
+      haudio->setup_req = *req;
+      return USBD_CtlPrepareRx(pdev, haudio->setup_data, 1U);
+
+    case AUDIO_REQ_GET_CUR:
+      value = cs == AUDIO_FU_AGC_CONTROL ? (int8_t)haudio->tone.agc
+                                         : haudio->tone.level[cs - AUDIO_FU_BASS_CONTROL];
+      break;
+
+    case AUDIO_REQ_GET_MIN:
+      value = AUDIO_TONE_DB_MIN;
+      break;
+
+    case AUDIO_REQ_GET_MAX:
+      value = AUDIO_TONE_DB_MAX;
+      break;
+
+    case AUDIO_REQ_GET_RES:
+      value = AUDIO_TONE_DB_RES;
+      break;
+
+    default:
+      return USBD_FAIL;
+  }
+
+  haudio->setup_data[0] = (uint8_t)value;
+  return USBD_CtlSendData(pdev, haudio->setup_data, 1U);
+}
+
 /**
  * @brief  USBD_AUDIO_Setup
  *         Handle the AUDIO specific requests
@@ -474,8 +2371,19 @@ static uint8_t USBD_AUDIO_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *
 
   /* Type: Class, Recipient: Interface */
   if ((req->bmRequest & 0b01111111) == 0b00100001) {
+    /* Entity: Mixer Unit */
+    if (HIBYTE(req->wIndex) == AUDIO_MIXER_UNIT_ID) {
+      ret = USBD_AUDIO_MixerReq(pdev, haudio, req);
+    }
+
+    /* CS: BASS/MID/TREBLE_CONTROL, AGC_CONTROL */
+    else if ((HIBYTE(req->wValue) >= AUDIO_FU_BASS_CONTROL && HIBYTE(req->wValue) <= AUDIO_FU_TREBLE_CONTROL) ||
+             HIBYTE(req->wValue) == AUDIO_FU_AGC_CONTROL) {
+      ret = USBD_AUDIO_ToneReq(pdev, haudio, req);
+    }
+
     /* Request: SET_CUR, CS: MUTE_CONTROL */
-    if (req->bRequest == 0x01 && HIBYTE(req->wValue) == 0x01) {
+    else if (req->bRequest == 0x01 && HIBYTE(req->wValue) == 0x01) {
       haudio->setup_req = *req;
       ret = USBD_CtlPrepareRx(pdev, haudio->setup_data, req->wLength);
     }
@@ -515,6 +2423,28 @@ static uint8_t USBD_AUDIO_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *
     }
   }
 
+  /* Type: Vendor, Recipient: Interface */
+  else if ((req->bmRequest & 0b01111111) == 0b01000001) {
+    ret = USBD_AUDIO_VendorReq(pdev, haudio, req);
+  }
+
+  /* Type: Class, Recipient: Endpoint */
+  else if ((req->bmRequest & 0b01111111) == 0b00100010) {
+    /* Request: SET_CUR, CS: SAMPLING_FREQ_CONTROL */
+    if (req->bRequest == AUDIO_REQ_SET_CUR && HIBYTE(req->wValue) == AUDIO_EP_CONTROL_SAMPLING_FREQ) {
+      haudio->setup_req = *req;
+      ret = USBD_CtlPrepareRx(pdev, haudio->setup_data, MIN(req->wLength, 3U));
+    }
+
+    /* Request: GET_CUR, CS: SAMPLING_FREQ_CONTROL */
+    else if (req->bRequest == AUDIO_REQ_GET_CUR && HIBYTE(req->wValue) == AUDIO_EP_CONTROL_SAMPLING_FREQ) {
+      buf[0] = (uint8_t)haudio->freq;
+      buf[1] = (uint8_t)(haudio->freq >> 8);
+      buf[2] = (uint8_t)(haudio->freq >> 16);
+      ret = USBD_CtlSendData(pdev, buf, MIN(req->wLength, 3U));
+    }
+  }
+
   /* Type: Standard, Recipient: Any */
   else if ((req->bmRequest & 0b01100000) == 0b00000000) {
     /* Request: GET_STATUS */
@@ -546,21 +2476,48 @@ static uint8_t USBD_AUDIO_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *
     /* Request: GET_INTERFACE */
     else if (req->bRequest == 10) {
       if (pdev->dev_state == USBD_STATE_CONFIGURED) {
-        ret = USBD_CtlSendData(pdev, (uint8_t *)&haudio->alt_setting, 1U);
+        if (LOBYTE(req->wIndex) == AUDIO_CAPTURE_IF) {
+          ret = USBD_CtlSendData(pdev, &haudio->capture_alt, 1U);
+        } else {
+          ret = USBD_CtlSendData(pdev, (uint8_t *)&haudio->alt_setting, 1U);
+        }
       }
     }
 
     /* Request: SET_INTERFACE */
     else if (req->bRequest == 11) {
       if (pdev->dev_state == USBD_STATE_CONFIGURED) {
-        if (LOBYTE(req->wValue) <= USBD_MAX_NUM_INTERFACES) {
-          haudio->alt_setting = (uint8_t)req->wValue;
+        if (LOBYTE(req->wIndex) == AUDIO_CAPTURE_IF) {
+          if (LOBYTE(req->wValue) <= AUDIO_ALT_SETTING_MAX) {
+            if (LOBYTE(req->wValue) == 0U) {
+              USBD_LL_FlushEP(pdev, AUDIOCaptureEpAdd);
+              haudio->capture_busy = 0U;
+            }
+            USBD_AUDIO_SetCaptureFormat(haudio, LOBYTE(req->wValue));
+            ret = USBD_OK;
+          }
+        } else if (LOBYTE(req->wValue) <= AUDIO_ALT_SETTING_SURROUND) {
+          uint8_t alt = LOBYTE(req->wValue);
 
-          if (haudio->alt_setting == 0U) {
+          if (alt == 0U || alt != haudio->alt_setting) {
             USBD_AUDIO_StopPlay(pdev);
           }
+          haudio->alt_setting = alt;
+          if (alt == AUDIO_ALT_SETTING_SURROUND && haudio->freq == USBD_AUDIO_FREQ_96K) {
+            /* 5.1 is not listed at 96 kHz, its packets would not fit AUDIO_OUT_PACKET_MAX:
+               fall back to 48 kHz, the stream starts once USBD_AUDIO_Poll has retuned */
+            (void)USBD_AUDIO_SetFreq(haudio, USBD_AUDIO_FREQ_48K);
+          }
 
-          ret = USBD_OK;
+          if (alt != 0U) {
+            /* The sample width only changes between streams, never mid-stream */
+            ret = USBD_AUDIO_SetFormat(haudio, alt);
+            if (ret == USBD_OK) {
+              USBD_AUDIO_StartPlay(haudio);
+            }
+          } else {
+            ret = USBD_OK;
+          }
         }
       }
     }
@@ -591,18 +2548,60 @@ static uint8_t USBD_AUDIO_EP0_RxReady(USBD_HandleTypeDef *pdev) {
 
   /* Type: Class, Recipient: Interface */
   if ((req->bmRequest & 0b01111111) == 0b00100001) {
+    /* Entity: Mixer Unit, Request: SET_CUR, checked in USBD_AUDIO_MixerReq */
+    if (HIBYTE(req->wIndex) == AUDIO_MIXER_UNIT_ID) {
+      USBD_AUDIO_SetMixer(haudio, HIBYTE(req->wValue) - 1U, LOBYTE(req->wValue) - 1U,
+                          (int16_t)((uint16_t)haudio->setup_data[0] | ((uint16_t)haudio->setup_data[1] << 8)));
+    }
+
     /* Request: SET_CUR, CS: MUTE_CONTROL */
-    if (req->bRequest == 0x01 && HIBYTE(req->wValue) == 0x01) {
-      haudio->mute = haudio->setup_data[0];
-      
-      HAL_GPIO_WritePin(SD_MODE_GPIO_Port, SD_MODE_Pin, haudio->mute ? GPIO_PIN_RESET : GPIO_PIN_SET);
+    else if (req->bRequest == 0x01 && HIBYTE(req->wValue) == 0x01) {
+      USBD_AUDIO_SetMute(haudio, haudio->setup_data[0]);
     }
 
     /* Request: SET_CUR, CS: VOLUMN_CONTROL */
     else if (req->bRequest == 0x01 && HIBYTE(req->wValue) == 0x02) {
       haudio->volume = *(uint16_t *)&haudio->setup_data[0];
+      haudio->gain = AUDIO_GainFromVolume(haudio->volume);
+    }
+
+    /* Request: SET_CUR, CS: BASS/MID/TREBLE_CONTROL, checked in USBD_AUDIO_ToneReq */
+    else if (HIBYTE(req->wValue) >= AUDIO_FU_BASS_CONTROL && HIBYTE(req->wValue) <= AUDIO_FU_TREBLE_CONTROL) {
+      AUDIO_ToneSetLevel(&haudio->tone, (AUDIO_ToneBandTypeDef)(HIBYTE(req->wValue) - AUDIO_FU_BASS_CONTROL),
+                         (int8_t)haudio->setup_data[0]);
+    }
+
+    /* Request: SET_CUR, CS: AGC_CONTROL */
+    else if (HIBYTE(req->wValue) == AUDIO_FU_AGC_CONTROL) {
+      AUDIO_ToneSetAgc(&haudio->tone, haudio->setup_data[0]);
+    }
+  }
+
+  /* Type: Vendor, Recipient: Interface */
+  else if ((req->bmRequest & 0b01111111) == 0b01000001) {
+    USBD_AUDIO_VendorRxReady(haudio, req);
+  }
+
+  /* Type: Class, Recipient: Endpoint */
+  else if ((req->bmRequest & 0b01111111) == 0b00100010) {
+    /* Request: SET_CUR, CS: SAMPLING_FREQ_CONTROL */
+    if (req->bRequest == AUDIO_REQ_SET_CUR && HIBYTE(req->wValue) == AUDIO_EP_CONTROL_SAMPLING_FREQ) {
+      uint32_t freq = (uint32_t)haudio->setup_data[0] | ((uint32_t)haudio->setup_data[1] << 8) |
+                      ((uint32_t)haudio->setup_data[2] << 16);
+
+      if (freq == USBD_AUDIO_FREQ_96K && haudio->alt_setting == AUDIO_ALT_SETTING_SURROUND) {
+        /* Not listed for 5.1, STALL the status stage */
+        USBD_CtlError(pdev, req);
+        return (uint8_t)USBD_FAIL;
+      }
+      if (freq != haudio->freq) {
+        /* Drop what was queued at the old rate, USBD_AUDIO_Poll restarts from an empty ring */
+        USBD_AUDIO_StopPlay(pdev);
+        (void)USBD_AUDIO_SetFreq(haudio, freq);
+      }
     }
   }
+
   return (uint8_t)USBD_OK;
 }
 
@@ -627,8 +2626,21 @@ static uint8_t USBD_AUDIO_EP0_TxReady(USBD_HandleTypeDef *pdev) {
  * @retval status
  */
 static uint8_t USBD_AUDIO_DataIn(USBD_HandleTypeDef *pdev, uint8_t epnum) {
-  UNUSED(pdev);
-  UNUSED(epnum);
+  USBD_AUDIO_HandleTypeDef *haudio;
+
+  haudio = (USBD_AUDIO_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
+  if (haudio == NULL) {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  if (epnum == (AUDIOCaptureEpAdd & 0x0FU)) {
+    /* The loopback packet is on the bus, its slot can be reused */
+    if (haudio->capture_sent != 0U) {
+      AUDIO_RingConsume(&haudio->capture, haudio->capture_sent);
+      haudio->capture_sent = 0U;
+    }
+    haudio->capture_busy = 0U;
+  }
 
   return (uint8_t)USBD_OK;
 }
@@ -655,49 +2667,49 @@ static uint8_t USBD_AUDIO_DataOut(USBD_HandleTypeDef *pdev, uint8_t epnum) {
   }
 
   if (epnum == AUDIOOutEpAdd) {
+    uint32_t cycles = DWT->CYCCNT;
+
     /* Get received data packet length */
     packet_size = (uint16_t)USBD_LL_GetRxDataSize(pdev, epnum);
 
-    int16_t *ptr = (int16_t *)&haudio->buffer;
-    for (uint16_t i = 0; i < packet_size / 2 / sizeof(int16_t); i++) {
-      int16_t *samp_l = &ptr[i * 2];
-      int16_t *samp_r = &ptr[i * 2 + 1];
+    USBD_AUDIO_Receive(haudio, packet_size);
 
-      *samp_l = USBD_AUDIO_ApplyVolumeControl(*samp_l, haudio->volume);
-      *samp_r = USBD_AUDIO_ApplyVolumeControl(*samp_r, haudio->volume);
+    /* Prepare Out endpoint to receive next audio packet */
+    USBD_LL_PrepareReceive(pdev, AUDIOOutEpAdd, AUDIO_RingWriteSlot(&haudio->ring), AUDIO_OUT_PACKET_MAX);
 
-      if (nSamplesRead < nSamples) {
-        pSamples[nSamplesRead++] = (float32_t)*samp_l;
-      }
+    cycles = DWT->CYCCNT - cycles;
+    if (cycles > haudio->dataout_cycles) {
+      haudio->dataout_cycles = cycles;
     }
+  }
 
-    /* Increment the Buffer pointer or roll it back when all buffers are full */
-    haudio->wr_ptr += packet_size;
+  return (uint8_t)USBD_OK;
+}
 
-    if (haudio->wr_ptr >= AUDIO_TOTAL_BUF_SIZE) {
-      /* All buffers are full: roll back */
-      uint16_t overflow = haudio->wr_ptr - AUDIO_TOTAL_BUF_SIZE;
-      for (uint16_t i = 0; i < overflow; i++) {
-        haudio->buffer[i] = haudio->buffer[AUDIO_TOTAL_BUF_SIZE + i];
-      }
-      haudio->wr_ptr = overflow;
-    }
+/**
+ * @brief  USBD_AUDIO_Sync
+ *         Refill the half of the I2S buffer the DMA has just finished with.
+ *         Called from the I2S half/complete transfer callbacks.
+ * @param  pdev: device instance
+ * @param  offset: AUDIO_OFFSET_HALF when the first half is free,
+ *                 AUDIO_OFFSET_FULL when the second half is free
+ * @retval None
+ */
+void USBD_AUDIO_Sync(USBD_HandleTypeDef *pdev, AUDIO_OffsetTypeDef offset) {
+  USBD_AUDIO_HandleTypeDef *haudio;
+  uint32_t cycles = DWT->CYCCNT;
 
-    // Start playing when half of the audio buffer is filled
-    // so if you increase the buffer length too much, the audio latency will be obvious when watching video+audio
-    if (haudio->playing == 0U && haudio->wr_ptr >= AUDIO_TOTAL_BUF_SIZE / 2U) {
-      /* Start DMA Transfer */
-      HAL_I2S_Transmit_DMA(&hi2s2, (uint16_t *)haudio->buffer, AUDIO_TOTAL_BUF_SIZE / sizeof(uint16_t));
-      HAL_GPIO_WritePin(SD_MODE_GPIO_Port, SD_MODE_Pin, GPIO_PIN_SET);
+  haudio = (USBD_AUDIO_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
+  if (haudio == NULL || haudio->playing == 0U || offset == AUDIO_OFFSET_NONE) {
+    return;
+  }
 
-      haudio->playing = 1U;
-    }
+  USBD_AUDIO_ProcessBlock(haudio, USBD_AUDIO_GetBlock(haudio, offset == AUDIO_OFFSET_FULL ? 1U : 0U));
 
-    /* Prepare Out endpoint to receive next audio packet */
-    USBD_LL_PrepareReceive(pdev, AUDIOOutEpAdd, &haudio->buffer[haudio->wr_ptr], AUDIO_OUT_PACKET);
+  cycles = DWT->CYCCNT - cycles;
+  if (cycles > haudio->sync_cycles) {
+    haudio->sync_cycles = cycles;
   }
-
-  return (uint8_t)USBD_OK;
 }
 
 /**
@@ -714,25 +2726,23 @@ static uint8_t USBD_AUDIO_SOF(USBD_HandleTypeDef *pdev) {
     return (uint8_t)USBD_FAIL;
   }
 
-  haudio->rd_ptr = AUDIO_TOTAL_BUF_SIZE - ((DMA_Stream_TypeDef *)hi2s2.hdmatx->Instance)->NDTR * sizeof(uint16_t);
-
   static uint32_t USBx_BASE = (uint32_t)USB_OTG_FS;
   uint16_t fnsof = (uint16_t)((USBx_DEVICE->DSTS & USB_OTG_DSTS_FNSOF) >> 8);
   uint16_t fnsof_interval = fnsof < haudio->fb_fnsof
                                 ? fnsof + 0x3FFFUL - haudio->fb_fnsof
                                 : fnsof - haudio->fb_fnsof;
   if (fnsof_interval > 4) {
-    uint16_t writable_samples = haudio->rd_ptr < haudio->wr_ptr
-                                    ? (haudio->rd_ptr + AUDIO_TOTAL_BUF_SIZE - haudio->wr_ptr) / 4
-                                    : (haudio->rd_ptr - haudio->wr_ptr) / 4;
-    int32_t factor = (1L << 14) + (writable_samples - AUDIO_TOTAL_BUF_SIZE / 4 / 2);
-
-    haudio->fb_value = (uint32_t)(((uint64_t)haudio->fb_value_norm * factor) >> 14);
+    /* 10.14 format, samples per frame */
+    haudio->fb_value = USBD_AUDIO_GetFeedback(haudio, fnsof, fnsof_interval, 14U);
     haudio->fb_fnsof = fnsof;
 
     USBD_LL_Transmit(pdev, AUDIO_IN_EP, (uint8_t *)&haudio->fb_value, 3U);
   }
 
+  if (haudio->capture_alt != 0U && haudio->capture_busy == 0U) {
+    USBD_AUDIO_CaptureSend(pdev, haudio);
+  }
+
   return (uint8_t)USBD_OK;
 }
 
@@ -748,6 +2758,19 @@ static uint8_t USBD_AUDIO_IsoINIncomplete(USBD_HandleTypeDef *pdev, uint8_t epnu
 
   if (epnum == (AUDIO_IN_EP & 0x0FU)) {
     USBD_LL_FlushEP(pdev, AUDIO_IN_EP);
+  } else if (epnum == (AUDIOCaptureEpAdd & 0x0FU)) {
+    haudio = (USBD_AUDIO_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
+    if (haudio == NULL) {
+      return (uint8_t)USBD_FAIL;
+    }
+
+    /* The host skipped the frame: the packet is stale, drop it with its slot */
+    USBD_LL_FlushEP(pdev, AUDIOCaptureEpAdd);
+    if (haudio->capture_sent != 0U) {
+      AUDIO_RingConsume(&haudio->capture, haudio->capture_sent);
+      haudio->capture_sent = 0U;
+    }
+    haudio->capture_busy = 0U;
   }
 
   return (uint8_t)USBD_OK;
@@ -772,7 +2795,7 @@ static uint8_t USBD_AUDIO_IsoOUTIncomplete(USBD_HandleTypeDef *pdev, uint8_t epn
     USBD_LL_FlushEP(pdev, epnum);
 
     /* Prepare Out endpoint to receive next audio packet */
-    USBD_LL_PrepareReceive(pdev, epnum, &haudio->buffer[haudio->wr_ptr], AUDIO_OUT_PACKET);
+    USBD_LL_PrepareReceive(pdev, epnum, AUDIO_RingWriteSlot(&haudio->ring), AUDIO_OUT_PACKET_MAX);
   }
 
   return (uint8_t)USBD_OK;
@@ -821,7 +2844,7 @@ uint32_t USBD_AUDIO_GetEpPcktSze(USBD_HandleTypeDef *pdev, uint8_t If, uint8_t E
   UNUSED(If);
   UNUSED(Ep);
 
-  mps = AUDIO_PACKET_SZE_WORD(USBD_AUDIO_FREQ);
+  mps = AUDIO_PACKET_SZE_WORD(USBD_AUDIO_FREQ_MAX);
 
   /* Return the wMaxPacketSize value in Bytes (Freq(Samples)*2(Stereo)*2(HalfWord)) */
   return mps;
@@ -0,0 +1,770 @@
+/**
+ ******************************************************************************
+ * @file    usbd_audio2.c
+ * @brief   This file provides the Audio Class 2.0 core functions.
+ ******************************************************************************
+ * @verbatim
+ *
+ *          ===================================================================
+ *                                AUDIO 2.0 Class  Description
+ *          ===================================================================
+ *           This driver manages the Audio Class 2.0 following the "Universal Serial
+ *           Bus Device Class Definition for Audio Devices Release 2.0 May 31, 2006",
+ *           on the full speed core.
+ *           This driver implements the following aspects of the specification:
+ *             - Interface Association Descriptor
+ *             - Audio Control Interface with a Clock Source (internal, programmable),
+ *               an Input Terminal, a Feature Unit (Mute, Volume) and an Output Terminal
+ *             - 1 Audio Streaming Interface with one alternate setting per sample width
+ *             - 1 Asynchronous Audio Streaming Endpoint with an explicit feedback endpoint
+ *             - Clock Source Requests: CUR and RANGE for Sampling Frequency, CUR for Clock Validity
+ *             - Feature Unit Requests: CUR for Mute, CUR and RANGE for Volume
+ *          The current audio class version supports the following audio features:
+ *             - Pulse Coded Modulation (PCM) format
+ *             - sampling rate: 44.1KHz, 48KHz or 96KHz, selected by the host at runtime.
+ *             - Bit resolution: 16, 24 or 32 (one alternate setting each)
+ *             - Number of channels: 2
+ *             - Volume control, 0dB..-96dB in 0.5dB steps, changes ramped over one I2S block
+ *             - Mute/Unmute capability, ramped to silence before the amplifier is shut down
+ *             - 16.16 feedback on 4 bytes
+ *             - Playback latency target of 2..16 ms, set and reported through AUDIO_VENDOR_REQ_LATENCY
+ *             - Starved stream concealed by fades to silence and back, counted by AUDIO_VENDOR_REQ_XRUN
+ *             - Parametric EQ, up to 10 biquads per channel uploaded through AUDIO_VENDOR_REQ_PEQ_BAND
+ *             - Lookahead limiter after the tone controls and EQ, set through AUDIO_VENDOR_REQ_LIMITER
+ *             - 16-bit output requantized once, with TPDF dither and optional noise shaping
+ *             - Output peak, RMS and clip metering, reported through AUDIO_VENDOR_REQ_LEVEL
+ *
+ *          The streaming path (receive ring, I2S, gain) is the one of usbd_audio.c,
+ *          both drivers share USBD_AUDIO_HandleTypeDef and USBD_AUDIO_Sync.
+ *
+ *  @endverbatim
+ ******************************************************************************
+ */
+
+#include "usbd_audio2.h"
+
+#include "main.h"
+#include "usbd_ctlreq.h"
+
+#define AUDIO2_WORD(w) \
+  (uint8_t)(w), (uint8_t)((w) >> 8)
+
+#define AUDIO2_DWORD(dw) \
+  (uint8_t)(dw), (uint8_t)((dw) >> 8), (uint8_t)((dw) >> 16), (uint8_t)((dw) >> 24)
+
+/* One discrete frequency as a RANGE subrange: dMIN, dMAX, dRES */
+#define AUDIO2_FREQ_SUBRANGE(frq) \
+  AUDIO2_DWORD(frq), AUDIO2_DWORD(frq), AUDIO2_DWORD(0U)
+
+#define AUDIO2_PACKET_SZE(frq, bytes) \
+  AUDIO2_WORD(((frq) / 1000U + 1U) * 2U * (bytes))
+
+/* Standard AS interface, class-specific AS interface, format, data and feedback endpoints of one sample width */
+#define AUDIO2_STREAMING_ALT_DESC(alt, bytes, bits)                                                               \
+  AUDIO_INTERFACE_DESC_SIZE,             /* bLength */                                                            \
+  USB_DESC_TYPE_INTERFACE,               /* bDescriptorType */                                                    \
+  0x01,                                  /* bInterfaceNumber */                                                   \
+  (alt),                                 /* bAlternateSetting */                                                  \
+  0x02,                                  /* bNumEndpoints 1 out and 1 feedback */                                 \
+  USB_DEVICE_CLASS_AUDIO,                /* bInterfaceClass */                                                    \
+  AUDIO_SUBCLASS_AUDIOSTREAMING,         /* bInterfaceSubClass */                                                 \
+  AUDIO2_PROTOCOL_IP_VERSION_02_00,      /* bInterfaceProtocol */                                                 \
+  0x00,                                  /* iInterface */                                                         \
+                                                                                                                  \
+  AUDIO2_AS_GENERAL_DESC_SIZE,           /* bLength */                                                            \
+  AUDIO_INTERFACE_DESCRIPTOR_TYPE,       /* bDescriptorType */                                                    \
+  AUDIO_STREAMING_GENERAL,               /* bDescriptorSubtype */                                                 \
+  AUDIO2_IT_ID,                          /* bTerminalLink */                                                      \
+  0x00,                                  /* bmControls */                                                         \
+  AUDIO_FORMAT_TYPE_I,                   /* bFormatType */                                                        \
+  AUDIO2_DWORD(0x00000001U),             /* bmFormats PCM */                                                      \
+  0x02,                                  /* bNrChannels */                                                        \
+  AUDIO2_DWORD(0x00000003U),             /* bmChannelConfig front left, front right */                            \
+  0x00,                                  /* iChannelNames */                                                      \
+                                                                                                                  \
+  AUDIO2_FORMAT_TYPE_DESC_SIZE,          /* bLength */                                                            \
+  AUDIO_INTERFACE_DESCRIPTOR_TYPE,       /* bDescriptorType */                                                    \
+  AUDIO_STREAMING_FORMAT_TYPE,           /* bDescriptorSubtype */                                                 \
+  AUDIO_FORMAT_TYPE_I,                   /* bFormatType */                                                        \
+  (bytes),                               /* bSubslotSize */                                                       \
+  (bits),                                /* bBitResolution */                                                     \
+                                                                                                                  \
+  AUDIO2_STANDARD_ENDPOINT_DESC_SIZE,    /* bLength */                                                            \
+  USB_DESC_TYPE_ENDPOINT,                /* bDescriptorType */                                                    \
+  AUDIO_OUT_EP,                          /* bEndpointAddress 1 out endpoint */                                    \
+  0x05,                                  /* bmAttributes isochronous, asynchronous */                             \
+  AUDIO2_PACKET_SZE(USBD_AUDIO_FREQ_MAX, (bytes)), /* wMaxPacketSize */                                           \
+  0x01,                                  /* bInterval */                                                          \
+                                                                                                                  \
+  AUDIO2_STREAMING_ENDPOINT_DESC_SIZE,   /* bLength */                                                            \
+  AUDIO_ENDPOINT_DESCRIPTOR_TYPE,        /* bDescriptorType */                                                    \
+  AUDIO_ENDPOINT_GENERAL,                /* bDescriptorSubtype */                                                 \
+  0x00,                                  /* bmAttributes */                                                       \
+  0x00,                                  /* bmControls */                                                         \
+  0x00,                                  /* bLockDelayUnits */                                                    \
+  AUDIO2_WORD(0x0000U),                  /* wLockDelay */                                                         \
+                                                                                                                  \
+  AUDIO2_STANDARD_ENDPOINT_DESC_SIZE,    /* bLength */                                                            \
+  USB_DESC_TYPE_ENDPOINT,                /* bDescriptorType */                                                    \
+  AUDIO_IN_EP,                           /* bEndpointAddress 1 feedback endpoint */                               \
+  0x11,                                  /* bmAttributes isochronous, feedback */                                 \
+  AUDIO2_WORD(AUDIO2_FEEDBACK_PACKET),   /* wMaxPacketSize */                                                     \
+  0x01                                   /* bInterval */
+
+static uint8_t USBD_AUDIO2_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx);
+static uint8_t USBD_AUDIO2_DeInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx);
+static uint8_t USBD_AUDIO2_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req);
+static uint8_t USBD_AUDIO2_EP0_RxReady(USBD_HandleTypeDef *pdev);
+static uint8_t USBD_AUDIO2_EP0_TxReady(USBD_HandleTypeDef *pdev);
+static uint8_t USBD_AUDIO2_DataIn(USBD_HandleTypeDef *pdev, uint8_t epnum);
+static uint8_t USBD_AUDIO2_DataOut(USBD_HandleTypeDef *pdev, uint8_t epnum);
+static uint8_t USBD_AUDIO2_SOF(USBD_HandleTypeDef *pdev);
+static uint8_t USBD_AUDIO2_IsoINIncomplete(USBD_HandleTypeDef *pdev, uint8_t epnum);
+static uint8_t USBD_AUDIO2_IsoOUTIncomplete(USBD_HandleTypeDef *pdev, uint8_t epnum);
+static uint8_t *USBD_AUDIO2_GetCfgDesc(uint16_t *length);
+static uint8_t *USBD_AUDIO2_GetDeviceQualifierDesc(uint16_t *length);
+
+USBD_ClassTypeDef USBD_AUDIO2 = {
+    USBD_AUDIO2_Init,
+    USBD_AUDIO2_DeInit,
+    USBD_AUDIO2_Setup,
+    USBD_AUDIO2_EP0_TxReady,
+    USBD_AUDIO2_EP0_RxReady,
+    USBD_AUDIO2_DataIn,
+    USBD_AUDIO2_DataOut,
+    USBD_AUDIO2_SOF,
+    USBD_AUDIO2_IsoINIncomplete,
+    USBD_AUDIO2_IsoOUTIncomplete,
+    USBD_AUDIO2_GetCfgDesc,
+    USBD_AUDIO2_GetCfgDesc,
+    USBD_AUDIO2_GetCfgDesc,
+    USBD_AUDIO2_GetDeviceQualifierDesc,
+};
+
+/* USB AUDIO 2.0 device Configuration Descriptor */
+__ALIGN_BEGIN static uint8_t USBD_AUDIO2_CfgDesc[USB_AUDIO2_CONFIG_DESC_SIZ] __ALIGN_END = {
+    /* Configuration 1 */
+    0x09,                               /* bLength */
+    USB_DESC_TYPE_CONFIGURATION,        /* bDescriptorType */
+    LOBYTE(USB_AUDIO2_CONFIG_DESC_SIZ), /* wTotalLength */
+    HIBYTE(USB_AUDIO2_CONFIG_DESC_SIZ),
+    0x02, /* bNumInterfaces */
+    0x01, /* bConfigurationValue */
+    0x00, /* iConfiguration */
+#if (USBD_SELF_POWERED == 1U)
+    0xC0, /* bmAttributes: Bus Powered according to user configuration */
+#else
+    0x80, /* bmAttributes: Bus Powered according to user configuration */
+#endif              /* USBD_SELF_POWERED */
+    USBD_MAX_POWER, /* MaxPower (mA) */
+    /* 09 byte*/
+
+    /* Interface Association Descriptor */
+    AUDIO2_IAD_DESC_SIZE,               /* bLength */
+    USB_DESC_TYPE_IAD,                  /* bDescriptorType */
+    0x00,                               /* bFirstInterface */
+    0x02,                               /* bInterfaceCount */
+    USB_DEVICE_CLASS_AUDIO,             /* bFunctionClass */
+    AUDIO2_FUNCTION_SUBCLASS_UNDEFINED, /* bFunctionSubClass */
+    AUDIO2_PROTOCOL_IP_VERSION_02_00,   /* bFunctionProtocol */
+    0x00,                               /* iFunction */
+    /* 08 byte*/
+
+    /* USB Speaker Standard AC Interface Descriptor */
+    AUDIO_INTERFACE_DESC_SIZE,        /* bLength */
+    USB_DESC_TYPE_INTERFACE,          /* bDescriptorType */
+    0x00,                             /* bInterfaceNumber */
+    0x00,                             /* bAlternateSetting */
+    0x00,                             /* bNumEndpoints */
+    USB_DEVICE_CLASS_AUDIO,           /* bInterfaceClass */
+    AUDIO_SUBCLASS_AUDIOCONTROL,      /* bInterfaceSubClass */
+    AUDIO2_PROTOCOL_IP_VERSION_02_00, /* bInterfaceProtocol */
+    0x00,                             /* iInterface */
+    /* 09 byte*/
+
+    /* USB Speaker Class-specific AC Interface Header Descriptor */
+    AUDIO2_AC_HEADER_DESC_SIZE,      /* bLength */
+    AUDIO_INTERFACE_DESCRIPTOR_TYPE, /* bDescriptorType */
+    AUDIO_CONTROL_HEADER,            /* bDescriptorSubtype */
+    AUDIO2_WORD(0x0200U),            /* bcdADC 2.00 */
+    AUDIO2_CATEGORY_DESKTOP_SPEAKER, /* bCategory */
+    AUDIO2_WORD(AUDIO2_AC_DESC_SIZE), /* wTotalLength */
+    0x00,                            /* bmControls */
+    /* 09 byte*/
+
+    /* USB Speaker Clock Source Descriptor */
+    AUDIO2_CLOCK_SOURCE_DESC_SIZE,   /* bLength */
+    AUDIO_INTERFACE_DESCRIPTOR_TYPE, /* bDescriptorType */
+    AUDIO2_CONTROL_CLOCK_SOURCE,     /* bDescriptorSubtype */
+    AUDIO2_CLOCK_ID,                 /* bClockID */
+    0x03,                            /* bmAttributes internal programmable clock */
+    0x07,                            /* bmControls frequency read/write, validity read */
+    0x00,                            /* bAssocTerminal */
+    0x00,                            /* iClockSource */
+    /* 08 byte*/
+
+    /* USB Speaker Input Terminal Descriptor */
+    AUDIO2_INPUT_TERMINAL_DESC_SIZE, /* bLength */
+    AUDIO_INTERFACE_DESCRIPTOR_TYPE, /* bDescriptorType */
+    AUDIO_CONTROL_INPUT_TERMINAL,    /* bDescriptorSubtype */
+    AUDIO2_IT_ID,                    /* bTerminalID */
+    AUDIO2_WORD(0x0101U),            /* wTerminalType USB streaming */
+    0x00,                            /* bAssocTerminal */
+    AUDIO2_CLOCK_ID,                 /* bCSourceID */
+    0x02,                            /* bNrChannels */
+    AUDIO2_DWORD(0x00000003U),       /* bmChannelConfig front left, front right */
+    0x00,                            /* iChannelNames */
+    AUDIO2_WORD(0x0000U),            /* bmControls */
+    0x00,                            /* iTerminal */
+    /* 17 byte*/
+
+    /* USB Speaker Audio Feature Unit Descriptor */
+    AUDIO2_FEATURE_UNIT_DESC_SIZE,   /* bLength */
+    AUDIO_INTERFACE_DESCRIPTOR_TYPE, /* bDescriptorType */
+    AUDIO_CONTROL_FEATURE_UNIT,      /* bDescriptorSubtype */
+    AUDIO2_FU_ID,                    /* bUnitID */
+    AUDIO2_IT_ID,                    /* bSourceID */
+    AUDIO2_DWORD(0x0000000FU),       /* bmaControls(0) mute and volume read/write */
+    AUDIO2_DWORD(0x00000000U),       /* bmaControls(1) */
+    AUDIO2_DWORD(0x00000000U),       /* bmaControls(2) */
+    0x00,                            /* iFeature */
+    /* 18 byte*/
+
+    /* USB Speaker Output Terminal Descriptor */
+    AUDIO2_OUTPUT_TERMINAL_DESC_SIZE, /* bLength */
+    AUDIO_INTERFACE_DESCRIPTOR_TYPE,  /* bDescriptorType */
+    AUDIO_CONTROL_OUTPUT_TERMINAL,    /* bDescriptorSubtype */
+    AUDIO2_OT_ID,                     /* bTerminalID */
+    AUDIO2_WORD(0x0301U),             /* wTerminalType speaker */
+    0x00,                             /* bAssocTerminal */
+    AUDIO2_FU_ID,                     /* bSourceID */
+    AUDIO2_CLOCK_ID,                  /* bCSourceID */
+    AUDIO2_WORD(0x0000U),             /* bmControls */
+    0x00,                             /* iTerminal */
+    /* 12 byte*/
+
+    /* USB Speaker Standard AS Interface Descriptor - Audio Streaming Zero Bandwidth */
+    /* Interface 1, Alternate Setting 0                                              */
+    AUDIO_INTERFACE_DESC_SIZE,        /* bLength */
+    USB_DESC_TYPE_INTERFACE,          /* bDescriptorType */
+    0x01,                             /* bInterfaceNumber */
+    0x00,                             /* bAlternateSetting */
+    0x00,                             /* bNumEndpoints */
+    USB_DEVICE_CLASS_AUDIO,           /* bInterfaceClass */
+    AUDIO_SUBCLASS_AUDIOSTREAMING,    /* bInterfaceSubClass */
+    AUDIO2_PROTOCOL_IP_VERSION_02_00, /* bInterfaceProtocol */
+    0x00,                             /* iInterface */
+    /* 09 byte*/
+
+    /* Interface 1, Alternate Settings 1 to 3: 16, 24 and 32-bit PCM */
+    AUDIO2_STREAMING_ALT_DESC(AUDIO_ALT_SETTING_16B, 0x02, 16),
+    /* 53 byte*/
+    AUDIO2_STREAMING_ALT_DESC(AUDIO_ALT_SETTING_24B, 0x03, 24),
+    /* 53 byte*/
+    AUDIO2_STREAMING_ALT_DESC(AUDIO_ALT_SETTING_32B, 0x04, 32),
+    /* 53 byte*/
+};
+
+/* USB Standard Device Descriptor */
+__ALIGN_BEGIN static uint8_t USBD_AUDIO2_DeviceQualifierDesc[USB_LEN_DEV_QUALIFIER_DESC] __ALIGN_END = {
+    USB_LEN_DEV_QUALIFIER_DESC,
+    USB_DESC_TYPE_DEVICE_QUALIFIER,
+    0x00,
+    0x02,
+    0xEF,
+    0x02,
+    0x01,
+    0x40,
+    0x01,
+    0x00,
+};
+
+/* Sampling Frequency RANGE: one subrange per discrete rate */
+__ALIGN_BEGIN static uint8_t USBD_AUDIO2_FreqRange[2U + 3U * 12U] __ALIGN_END = {
+    AUDIO2_WORD(3U), /* wNumSubRanges */
+    AUDIO2_FREQ_SUBRANGE(USBD_AUDIO_FREQ_44K),
+    AUDIO2_FREQ_SUBRANGE(USBD_AUDIO_FREQ_48K),
+    AUDIO2_FREQ_SUBRANGE(USBD_AUDIO_FREQ_96K),
+};
+
+/* Volume RANGE */
+__ALIGN_BEGIN static uint8_t USBD_AUDIO2_VolRange[2U + 3U * 2U] __ALIGN_END = {
+    AUDIO2_WORD(1U), /* wNumSubRanges */
+    AUDIO2_WORD(USBD_AUDIO_VOL_MIN),
+    AUDIO2_WORD(USBD_AUDIO_VOL_MAX),
+    AUDIO2_WORD(USBD_AUDIO_VOL_RES),
+};
+
+static uint8_t AUDIO2OutEpAdd = AUDIO_OUT_EP;
+static uint8_t AUDIO2InEpAdd = AUDIO_IN_EP;
+
+/**
+ * @brief  USBD_AUDIO2_Init
+ *         Initialize the AUDIO interface
+ * @param  pdev: device instance
+ * @param  cfgidx: Configuration index
+ * @retval status
+ */
+static uint8_t USBD_AUDIO2_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx) {
+  UNUSED(cfgidx);
+  USBD_AUDIO_HandleTypeDef *haudio;
+
+  /* Allocate Audio structure */
+  haudio = (USBD_AUDIO_HandleTypeDef *)USBD_malloc(sizeof(USBD_AUDIO_HandleTypeDef));
+  if (haudio == NULL) {
+    return (uint8_t)USBD_EMEM;
+  }
+
+  pdev->pClassDataCmsit[pdev->classId] = haudio;
+  pdev->pClassData = haudio;
+
+  /* Open EP OUT */
+  USBD_LL_OpenEP(pdev, AUDIO2OutEpAdd, USBD_EP_TYPE_ISOC, AUDIO_OUT_PACKET_MAX);
+  pdev->ep_out[AUDIO2OutEpAdd & 0xFU].is_used = 1U;
+  pdev->ep_out[AUDIO2OutEpAdd & 0xFU].bInterval = 1U;
+
+  /* Open EP IN */
+  USBD_LL_OpenEP(pdev, AUDIO2InEpAdd, USBD_EP_TYPE_ISOC, AUDIO2_FEEDBACK_PACKET);
+  pdev->ep_in[AUDIO2InEpAdd & 0xFU].is_used = 1U;
+  pdev->ep_in[AUDIO2InEpAdd & 0xFU].bInterval = 1U;
+
+  /* Flush feedback endpoint */
+  USBD_LL_FlushEP(pdev, AUDIO2InEpAdd);
+
+  haudio->alt_setting = 0U;
+  haudio->capture_alt = 0U; /* no loopback interface in this configuration */
+  haudio->playing = 0U;
+  haudio->faded = 1U;
+  haudio->underruns = 0U;
+  haudio->overruns = 0U;
+  haudio->dropouts = 0U;
+  (void)USBD_AUDIO_SetFormat(haudio, AUDIO_ALT_SETTING_16B);
+  haudio->dataout_cycles = 0U;
+  haudio->sync_cycles = 0U;
+  AUDIO_RingReset(&haudio->ring);
+#if (USBD_AUDIO_ASRC == 1U)
+  AUDIO_AsrcReset(&haudio->asrc);
+#endif /* USBD_AUDIO_ASRC */
+  haudio->mute = 0;
+  haudio->volume = USBD_AUDIO_VOL_MAX;
+  haudio->gain = AUDIO_GainFromVolume(haudio->volume);
+  haudio->gain_cur = haudio->gain;
+  haudio->gain_next = haudio->gain;
+  haudio->mute_hold = 0U;
+  USBD_AUDIO_DspInit(haudio);
+  AUDIO_LevelInit(&haudio->level);
+
+  haudio->fb_fnsof = 0;
+  haudio->fb_value = 0U;
+  haudio->latency_ms = USBD_AUDIO_LATENCY_MS;
+  haudio->queued = 0U;
+  (void)USBD_AUDIO_SetFreq(haudio, USBD_AUDIO_FREQ);
+
+  /* Prepare Out endpoint to receive 1st packet */
+  USBD_LL_PrepareReceive(pdev, AUDIO2OutEpAdd, AUDIO_RingWriteSlot(&haudio->ring), AUDIO_OUT_PACKET_MAX);
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+ * @brief  USBD_AUDIO2_DeInit
+ *         DeInitialize the AUDIO layer
+ * @param  pdev: device instance
+ * @param  cfgidx: Configuration index
+ * @retval status
+ */
+static uint8_t USBD_AUDIO2_DeInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx) {
+  UNUSED(cfgidx);
+
+  /* Flush all endpoints */
+  USBD_LL_FlushEP(pdev, AUDIO2OutEpAdd);
+  USBD_LL_FlushEP(pdev, AUDIO2InEpAdd);
+
+  /* Close EP OUT */
+  USBD_LL_CloseEP(pdev, AUDIO2OutEpAdd);
+  pdev->ep_out[AUDIO2OutEpAdd & 0xFU].is_used = 0U;
+  pdev->ep_out[AUDIO2OutEpAdd & 0xFU].bInterval = 0U;
+
+  /* Close EP IN */
+  USBD_LL_CloseEP(pdev, AUDIO2InEpAdd);
+  pdev->ep_in[AUDIO2InEpAdd & 0xFU].is_used = 0U;
+  pdev->ep_in[AUDIO2InEpAdd & 0xFU].bInterval = 0U;
+
+  /* Stop the I2S DMA and release SD_MODE while the handle is still there */
+  USBD_AUDIO_StopPlay(pdev);
+
+  /* DeInit  physical Interface components */
+  if (pdev->pClassDataCmsit[pdev->classId] != NULL) {
+    USBD_free(pdev->pClassDataCmsit[pdev->classId]);
+    pdev->pClassDataCmsit[pdev->classId] = NULL;
+    pdev->pClassData = NULL;
+  }
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+ * @brief  USBD_AUDIO2_EntityReq
+ *         Handle a CUR or RANGE request addressed to the clock source or
+ *         the feature unit
+ * @param  pdev: instance
+ * @param  haudio: audio class handle
+ * @param  req: usb requests
+ * @retval status
+ */
+static USBD_StatusTypeDef USBD_AUDIO2_EntityReq(USBD_HandleTypeDef *pdev, USBD_AUDIO_HandleTypeDef *haudio,
+                                                USBD_SetupReqTypedef *req) {
+  uint8_t entity = HIBYTE(req->wIndex);
+  uint8_t cs = HIBYTE(req->wValue);
+  uint8_t *buf = haudio->setup_data;
+
+  /* Host to device: only CUR is writable */
+  if ((req->bmRequest & 0x80U) == 0U) {
+    if (req->bRequest != AUDIO2_REQ_CUR || req->wLength > sizeof(haudio->setup_data)) {
+      return USBD_FAIL;
+    }
+    if ((entity == AUDIO2_CLOCK_ID && cs == AUDIO2_CS_SAM_FREQ_CONTROL) ||
+        (entity == AUDIO2_FU_ID && (cs == AUDIO2_FU_MUTE_CONTROL || cs == AUDIO2_FU_VOLUME_CONTROL))) {
+      haudio->setup_req = *req;
+      return USBD_CtlPrepareRx(pdev, haudio->setup_data, req->wLength);
+    }
+    return USBD_FAIL;
+  }
+
+  /* Clock Source */
+  if (entity == AUDIO2_CLOCK_ID) {
+    /* Request: CUR, CS: SAM_FREQ_CONTROL */
+    if (req->bRequest == AUDIO2_REQ_CUR && cs == AUDIO2_CS_SAM_FREQ_CONTROL) {
+      buf[0] = (uint8_t)haudio->freq;
+      buf[1] = (uint8_t)(haudio->freq >> 8);
+      buf[2] = (uint8_t)(haudio->freq >> 16);
+      buf[3] = (uint8_t)(haudio->freq >> 24);
+      return USBD_CtlSendData(pdev, buf, MIN(req->wLength, 4U));
+    }
+
+    /* Request: RANGE, CS: SAM_FREQ_CONTROL */
+    if (req->bRequest == AUDIO2_REQ_RANGE && cs == AUDIO2_CS_SAM_FREQ_CONTROL) {
+      return USBD_CtlSendData(pdev, USBD_AUDIO2_FreqRange, MIN(req->wLength, sizeof(USBD_AUDIO2_FreqRange)));
+    }
+
+    /* Request: CUR, CS: CLOCK_VALID_CONTROL */
+    if (req->bRequest == AUDIO2_REQ_CUR && cs == AUDIO2_CS_CLOCK_VALID_CONTROL) {
+      buf[0] = 1U;
+      return USBD_CtlSendData(pdev, buf, MIN(req->wLength, 1U));
+    }
+  }
+
+  /* Feature Unit, master channel only */
+  else if (entity == AUDIO2_FU_ID && LOBYTE(req->wValue) == 0U) {
+    /* Request: CUR, CS: MUTE_CONTROL */
+    if (req->bRequest == AUDIO2_REQ_CUR && cs == AUDIO2_FU_MUTE_CONTROL) {
+      buf[0] = haudio->mute;
+      return USBD_CtlSendData(pdev, buf, MIN(req->wLength, 1U));
+    }
+
+    /* Request: CUR, CS: VOLUME_CONTROL */
+    if (req->bRequest == AUDIO2_REQ_CUR && cs == AUDIO2_FU_VOLUME_CONTROL) {
+      buf[0] = (uint8_t)haudio->volume;
+      buf[1] = (uint8_t)((uint16_t)haudio->volume >> 8);
+      return USBD_CtlSendData(pdev, buf, MIN(req->wLength, 2U));
+    }
+
+    /* Request: RANGE, CS: VOLUME_CONTROL */
+    if (req->bRequest == AUDIO2_REQ_RANGE && cs == AUDIO2_FU_VOLUME_CONTROL) {
+      return USBD_CtlSendData(pdev, USBD_AUDIO2_VolRange, MIN(req->wLength, sizeof(USBD_AUDIO2_VolRange)));
+    }
+  }
+
+  return USBD_FAIL;
+}
+
+/**
+ * @brief  USBD_AUDIO2_Setup
+ *         Handle the AUDIO specific requests
+ * @param  pdev: instance
+ * @param  req: usb requests
+ * @retval status
+ */
+static uint8_t USBD_AUDIO2_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req) {
+  USBD_AUDIO_HandleTypeDef *haudio;
+  USBD_StatusTypeDef ret = USBD_FAIL;
+  uint8_t buf[2];
+
+  haudio = (USBD_AUDIO_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
+  if (haudio == NULL) {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  /* Type: Class, Recipient: Interface */
+  if ((req->bmRequest & 0b01111111) == 0b00100001) {
+    ret = USBD_AUDIO2_EntityReq(pdev, haudio, req);
+  }
+
+  /* Type: Vendor, Recipient: Interface */
+  else if ((req->bmRequest & 0b01111111) == 0b01000001) {
+    ret = USBD_AUDIO_VendorReq(pdev, haudio, req);
+  }
+
+  /* Type: Standard, Recipient: Any */
+  else if ((req->bmRequest & 0b01100000) == 0b00000000) {
+    /* Request: GET_STATUS */
+    if (req->bRequest == 0) {
+      if (pdev->dev_state == USBD_STATE_CONFIGURED) {
+        *((uint16_t *)buf) = 0U;
+        ret = USBD_CtlSendData(pdev, buf, 2U);
+      }
+    }
+
+    /* Request: CLEAR_FEATURE */
+    else if (req->bRequest == 1) {
+      ret = USBD_OK;
+    }
+
+    /* Request: GET_DESCRIPTOR */
+    else if (req->bRequest == 6) {
+      ret = USBD_OK;
+    }
+
+    /* Request: GET_INTERFACE */
+    else if (req->bRequest == 10) {
+      if (pdev->dev_state == USBD_STATE_CONFIGURED) {
+        ret = USBD_CtlSendData(pdev, (uint8_t *)&haudio->alt_setting, 1U);
+      }
+    }
+
+    /* Request: SET_INTERFACE */
+    else if (req->bRequest == 11) {
+      if (pdev->dev_state == USBD_STATE_CONFIGURED) {
+        if (LOBYTE(req->wValue) <= AUDIO_ALT_SETTING_MAX) {
+          uint8_t alt = LOBYTE(req->wValue);
+
+          if (alt == 0U || alt != haudio->alt_setting) {
+            USBD_AUDIO_StopPlay(pdev);
+          }
+          haudio->alt_setting = alt;
+
+          if (alt != 0U) {
+            /* The sample width only changes between streams, never mid-stream */
+            ret = USBD_AUDIO_SetFormat(haudio, alt);
+            if (ret == USBD_OK) {
+              USBD_AUDIO_StartPlay(haudio);
+            }
+          } else {
+            ret = USBD_OK;
+          }
+        }
+      }
+    }
+  }
+
+  if (ret == USBD_FAIL) {
+    USBD_CtlError(pdev, req);
+  }
+  return (uint8_t)ret;
+}
+
+/**
+ * @brief  USBD_AUDIO2_EP0_RxReady
+ *         handle EP0 Rx Ready event
+ * @param  pdev: device instance
+ * @retval status
+ */
+static uint8_t USBD_AUDIO2_EP0_RxReady(USBD_HandleTypeDef *pdev) {
+  USBD_AUDIO_HandleTypeDef *haudio;
+  USBD_SetupReqTypedef *req;
+  uint8_t *data;
+
+  haudio = (USBD_AUDIO_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
+  if (haudio == NULL) {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  req = &haudio->setup_req;
+  data = haudio->setup_data;
+
+  /* Type: Class, Recipient: Interface, Request: CUR */
+  if ((req->bmRequest & 0b01111111) == 0b00100001 && req->bRequest == AUDIO2_REQ_CUR) {
+    /* Entity: Clock Source, CS: SAM_FREQ_CONTROL */
+    if (HIBYTE(req->wIndex) == AUDIO2_CLOCK_ID && HIBYTE(req->wValue) == AUDIO2_CS_SAM_FREQ_CONTROL &&
+        req->wLength >= 4U) {
+      uint32_t freq = (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) |
+                      ((uint32_t)data[3] << 24);
+
+      if (freq != haudio->freq) {
+        /* Drop what was queued at the old rate, USBD_AUDIO_Poll restarts from an empty ring */
+        USBD_AUDIO_StopPlay(pdev);
+        (void)USBD_AUDIO_SetFreq(haudio, freq);
+      }
+    }
+
+    /* Entity: Feature Unit, CS: MUTE_CONTROL */
+    else if (HIBYTE(req->wIndex) == AUDIO2_FU_ID && HIBYTE(req->wValue) == AUDIO2_FU_MUTE_CONTROL) {
+      USBD_AUDIO_SetMute(haudio, data[0]);
+    }
+
+    /* Entity: Feature Unit, CS: VOLUME_CONTROL */
+    else if (HIBYTE(req->wIndex) == AUDIO2_FU_ID && HIBYTE(req->wValue) == AUDIO2_FU_VOLUME_CONTROL) {
+      haudio->volume = (int16_t)((uint16_t)data[0] | ((uint16_t)data[1] << 8));
+      haudio->gain = AUDIO_GainFromVolume(haudio->volume);
+    }
+  }
+
+  /* Type: Vendor, Recipient: Interface */
+  else if ((req->bmRequest & 0b01111111) == 0b01000001) {
+    USBD_AUDIO_VendorRxReady(haudio, req);
+  }
+  return (uint8_t)USBD_OK;
+}
+
+/**
+ * @brief  USBD_AUDIO2_EP0_TxReady
+ *         handle EP0 TRx Ready event
+ * @param  pdev: device instance
+ * @retval status
+ */
+static uint8_t USBD_AUDIO2_EP0_TxReady(USBD_HandleTypeDef *pdev) {
+  UNUSED(pdev);
+
+  /* Only OUT control data are processed */
+  return (uint8_t)USBD_OK;
+}
+
+/**
+ * @brief  USBD_AUDIO2_DataIn
+ *         handle data IN Stage
+ * @param  pdev: device instance
+ * @param  epnum: endpoint index
+ * @retval status
+ */
+static uint8_t USBD_AUDIO2_DataIn(USBD_HandleTypeDef *pdev, uint8_t epnum) {
+  UNUSED(pdev);
+  UNUSED(epnum);
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+ * @brief  USBD_AUDIO2_DataOut
+ *         handle data OUT Stage
+ * @param  pdev: device instance
+ * @param  epnum: endpoint index
+ * @retval status
+ */
+static uint8_t USBD_AUDIO2_DataOut(USBD_HandleTypeDef *pdev, uint8_t epnum) {
+  USBD_AUDIO_HandleTypeDef *haudio;
+
+  haudio = (USBD_AUDIO_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
+  if (haudio == NULL) {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  if (epnum == AUDIO2OutEpAdd) {
+    uint32_t cycles = DWT->CYCCNT;
+
+    USBD_AUDIO_Receive(haudio, (uint16_t)USBD_LL_GetRxDataSize(pdev, epnum));
+
+    /* Prepare Out endpoint to receive next audio packet */
+    USBD_LL_PrepareReceive(pdev, AUDIO2OutEpAdd, AUDIO_RingWriteSlot(&haudio->ring), AUDIO_OUT_PACKET_MAX);
+
+    cycles = DWT->CYCCNT - cycles;
+    if (cycles > haudio->dataout_cycles) {
+      haudio->dataout_cycles = cycles;
+    }
+  }
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+ * @brief  USBD_AUDIO2_SOF
+ *         handle SOF event
+ * @param  pdev: device instance
+ * @retval status
+ */
+static uint8_t USBD_AUDIO2_SOF(USBD_HandleTypeDef *pdev) {
+  USBD_AUDIO_HandleTypeDef *haudio;
+
+  haudio = (USBD_AUDIO_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
+  if (haudio == NULL) {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  static uint32_t USBx_BASE = (uint32_t)USB_OTG_FS;
+  uint16_t fnsof = (uint16_t)((USBx_DEVICE->DSTS & USB_OTG_DSTS_FNSOF) >> 8);
+  uint16_t fnsof_interval = fnsof < haudio->fb_fnsof
+                                ? fnsof + 0x3FFFUL - haudio->fb_fnsof
+                                : fnsof - haudio->fb_fnsof;
+  if (fnsof_interval > 4) {
+    /* 16.16 format, samples per frame */
+    haudio->fb_value = USBD_AUDIO_GetFeedback(haudio, fnsof, fnsof_interval, 16U);
+    haudio->fb_fnsof = fnsof;
+
+    USBD_LL_Transmit(pdev, AUDIO2InEpAdd, (uint8_t *)&haudio->fb_value, AUDIO2_FEEDBACK_PACKET);
+  }
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+ * @brief  USBD_AUDIO2_IsoINIncomplete
+ *         handle data ISO IN Incomplete event
+ * @param  pdev: device instance
+ * @param  epnum: endpoint index
+ * @retval status
+ */
+static uint8_t USBD_AUDIO2_IsoINIncomplete(USBD_HandleTypeDef *pdev, uint8_t epnum) {
+  if (epnum == (AUDIO2InEpAdd & 0x0FU)) {
+    USBD_LL_FlushEP(pdev, AUDIO2InEpAdd);
+  }
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+ * @brief  USBD_AUDIO2_IsoOUTIncomplete
+ *         handle data ISO OUT Incomplete event
+ * @param  pdev: device instance
+ * @param  epnum: endpoint index
+ * @retval status
+ */
+static uint8_t USBD_AUDIO2_IsoOUTIncomplete(USBD_HandleTypeDef *pdev, uint8_t epnum) {
+  USBD_AUDIO_HandleTypeDef *haudio;
+
+  if (epnum == (AUDIO2OutEpAdd & 0x0FU)) {
+    haudio = (USBD_AUDIO_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
+    if (haudio == NULL) {
+      return (uint8_t)USBD_FAIL;
+    }
+
+    USBD_LL_FlushEP(pdev, epnum);
+
+    /* Prepare Out endpoint to receive next audio packet */
+    USBD_LL_PrepareReceive(pdev, epnum, AUDIO_RingWriteSlot(&haudio->ring), AUDIO_OUT_PACKET_MAX);
+  }
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+ * @brief  USBD_AUDIO2_GetCfgDesc
+ *         return configuration descriptor
+ * @param  length : pointer data length
+ * @retval pointer to descriptor buffer
+ */
+static uint8_t *USBD_AUDIO2_GetCfgDesc(uint16_t *length) {
+  *length = (uint16_t)sizeof(USBD_AUDIO2_CfgDesc);
+
+  return USBD_AUDIO2_CfgDesc;
+}
+
+/**
+ * @brief  USBD_AUDIO2_GetDeviceQualifierDesc
+ *         return Device Qualifier descriptor
+ * @param  length : pointer data length
+ * @retval pointer to descriptor buffer
+ */
+static uint8_t *USBD_AUDIO2_GetDeviceQualifierDesc(uint16_t *length) {
+  *length = (uint16_t)sizeof(USBD_AUDIO2_DeviceQualifierDesc);
+
+  return USBD_AUDIO2_DeviceQualifierDesc;
+}
@@ -24,7 +24,11 @@
 #include "usbd_core.h"
 
 #define USBD_VID                        0x0483
+#if (USBD_AUDIO_UAC2 == 1U)
+#define USBD_PID                        0x5741                     /* Own PID so hosts do not reuse the cached UAC1 driver binding */
+#else
 #define USBD_PID                        0x5740                     /* Replace '0xaaaa' with your device product ID */
+#endif /* USBD_AUDIO_UAC2 */
 #define USBD_LANGID_STRING              0x409                      /* Replace '0xbbb' with your device language ID */
 #define USBD_MANUFACTURER_STRING        "STMicroelectronics"       /* Add your manufacturer string */
 #define USBD_PRODUCT_HS_STRING          "STM32 Audio Class"        /* Add your product High Speed string */
@@ -81,9 +85,15 @@ __ALIGN_BEGIN uint8_t USBD_DeviceDesc[USB_LEN_DEV_DESC] __ALIGN_END = {
     0x00, /* bcdUSB */
 #endif /* (USBD_LPM_ENABLED == 1) || (USBD_CLASS_BOS_ENABLED == 1) */
     0x02,
+#if (USBD_AUDIO_UAC2 == 1U)
+    0xEF,             /* bDeviceClass: Miscellaneous, the function uses an IAD */
+    0x02,             /* bDeviceSubClass */
+    0x01,             /* bDeviceProtocol */
+#else
     0x00,             /* bDeviceClass */
     0x00,             /* bDeviceSubClass */
     0x00,             /* bDeviceProtocol */
+#endif /* USBD_AUDIO_UAC2 */
     USB_MAX_EP0_SIZE, /* bMaxPacketSize */
     LOBYTE(USBD_VID), /* idVendor */
     HIBYTE(USBD_VID), /* idVendor */